@@ -0,0 +1,186 @@
+/* Micro-benchmark for the broadway buffer encoder
+ *
+ * Builds a synthetic 4K window with the kind of content a typical
+ * application has (flat backgrounds, text-like noise, gradients and some
+ * translucency), then times each kernel on its own, copying the pixels
+ * into buffers and encoding them, with each of the kernel sets the cpu
+ * supports. The kernel and encoder output must be the same for all of
+ * them.
+ */
+
+#include "config.h"
+
+#include "broadway-buffer.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define WIDTH 3840
+#define HEIGHT 2160
+
+static int iterations = 10;
+
+static const char *level_names[] = { "none", "sse2", "avx2" };
+
+static const struct {
+  BroadwayKernel kernel;
+  const char *name;
+} kernel_names[] = {
+  { BROADWAY_KERNEL_UNPREMULTIPLY, "unpremultiply" },
+  { BROADWAY_KERNEL_HASH_LINE, "row hash" },
+  { BROADWAY_KERNEL_BLOCK_HASHES, "column hash" }
+};
+
+static guint32
+premultiply (guint32 a, guint32 r, guint32 g, guint32 b)
+{
+  return (a << 24) | ((r * a / 255) << 16) | ((g * a / 255) << 8) | (b * a / 255);
+}
+
+static void
+fill_frame (guint32 *data, int frame)
+{
+  GRand *rand;
+  int x, y;
+
+  rand = g_rand_new_with_seed (42);
+
+  for (y = 0; y < HEIGHT; y++)
+    for (x = 0; x < WIDTH; x++)
+      {
+        guint32 *p = &data[y * WIDTH + x];
+
+        if (y < 48)
+          /* Header bar gradient */
+          *p = premultiply (0xff, 0x30 + y, 0x30 + y, 0x38 + y);
+        else if (x < 400)
+          /* Sidebar with rows of "text" */
+          *p = ((y / 24) % 2 && x % 7 < 3 && g_rand_int (rand) % 3 == 0) ? 0xff202020 : 0xfff6f5f4;
+        else if (x > 3000 && x < 3600 && y > 300 && y < 900)
+          /* Translucent popover with a shadow */
+          *p = premultiply (0xc0 - (x - 3000) / 10, 0x40, 0x40, 0x40 + (y & 0x3f));
+        else
+          {
+            /* Scrolling content area */
+            int sy = y + frame * 40;
+
+            if (sy % 96 < 64 && (x + sy) % 5 < 2 && g_rand_int (rand) % 2)
+              *p = 0xff000000 | (g_rand_int (rand) & 0x3f3f3f);
+            else
+              *p = 0xffffffff;
+          }
+      }
+
+  g_rand_free (rand);
+}
+
+static double
+mpix_per_sec (gint64 usec)
+{
+  return (double) WIDTH * HEIGHT * iterations / usec;
+}
+
+int
+main (int argc, char *argv[])
+{
+  guint32 *frames[2];
+  GString *reference = NULL;
+  guint32 reference_checksums[G_N_ELEMENTS (kernel_names)];
+  BroadwaySimdLevel level, max_level;
+  int i, failed = 0;
+  guint k;
+
+  if (argc > 1)
+    iterations = MAX (1, atoi (argv[1]));
+
+  frames[0] = g_new (guint32, WIDTH * HEIGHT);
+  frames[1] = g_new (guint32, WIDTH * HEIGHT);
+  fill_frame (frames[0], 0);
+  fill_frame (frames[1], 1);
+
+  max_level = broadway_buffer_get_simd_level ();
+
+  for (level = BROADWAY_SIMD_NONE; level <= max_level; level++)
+    {
+      BroadwayBuffer *prev, *buffer;
+      GString *out;
+      gint64 start, copy_time, encode_time, kernel_time;
+      guint32 checksum;
+
+      broadway_buffer_set_simd_level (level);
+
+      g_print ("%s:", level_names[level]);
+
+      for (k = 0; k < G_N_ELEMENTS (kernel_names); k++)
+        {
+          checksum = 0;
+          start = g_get_monotonic_time ();
+          for (i = 0; i < iterations; i++)
+            checksum = broadway_buffer_run_kernel (kernel_names[k].kernel,
+                                                   (guint8 *) frames[1],
+                                                   WIDTH, HEIGHT, WIDTH * 4);
+          kernel_time = g_get_monotonic_time () - start;
+
+          g_print (" %s %.1f,", kernel_names[k].name, mpix_per_sec (kernel_time));
+
+          if (level == BROADWAY_SIMD_NONE)
+            reference_checksums[k] = checksum;
+          else if (checksum != reference_checksums[k])
+            {
+              g_printerr ("%s: %s output differs from %s\n",
+                          level_names[level], kernel_names[k].name,
+                          level_names[BROADWAY_SIMD_NONE]);
+              failed = 1;
+            }
+        }
+
+      out = g_string_new ("");
+      copy_time = encode_time = 0;
+
+      for (i = 0; i < iterations; i++)
+        {
+          /* Only copies the pixels, colors are unpremultiplied while encoding */
+          start = g_get_monotonic_time ();
+          prev = broadway_buffer_create (WIDTH, HEIGHT, (guint8 *) frames[0], WIDTH * 4);
+          buffer = broadway_buffer_create (WIDTH, HEIGHT, (guint8 *) frames[1], WIDTH * 4);
+          copy_time += g_get_monotonic_time () - start;
+
+          /* Encode prev too so that its blocks are in the hash table */
+          g_string_set_size (out, 0);
+          broadway_buffer_encode (prev, NULL, out);
+
+          g_string_set_size (out, 0);
+          start = g_get_monotonic_time ();
+          broadway_buffer_encode (buffer, prev, out);
+          encode_time += g_get_monotonic_time () - start;
+
+          broadway_buffer_unref (prev);
+          broadway_buffer_unref (buffer);
+        }
+
+      g_print (" copy %.1f, encode %.1f MPix/s, %" G_GSIZE_FORMAT " bytes\n",
+               mpix_per_sec (copy_time / 2),
+               mpix_per_sec (encode_time),
+               out->len);
+
+      if (reference == NULL)
+        reference = out;
+      else
+        {
+          if (out->len != reference->len ||
+              memcmp (out->str, reference->str, out->len) != 0)
+            {
+              g_printerr ("%s: encoded output differs from %s\n",
+                          level_names[level], level_names[BROADWAY_SIMD_NONE]);
+              failed = 1;
+            }
+          g_string_free (out, TRUE);
+        }
+    }
+
+  g_string_free (reference, TRUE);
+  g_free (frames[0]);
+  g_free (frames[1]);
+
+  return failed;
+}
@@ -4,6 +4,11 @@
 
 #include <string.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
 /* This code is based on some code from weston with this license:
  *
  * Copyright © 2012 Intel Corporation
@@ -35,14 +40,39 @@ struct entry {
   int index;
 };
 
+/* A band hash of the old frame and the line it is on plus one, or -1
+ * if it is on more than one line. 0 marks an empty slot. */
+struct line_slot {
+  guint32 hash;
+  int line;
+};
+
+/* Hashes of the bands of the lines inside area, see find_copy(). The
+ * index of the hashes is built when the buffer is the old frame and
+ * its memory is reused until the buffer goes away. */
+struct band_hashes {
+  BroadwayRect area;
+  guint32 *hashes;
+  struct line_slot *index;
+  int index_shift;
+  gboolean indexed;
+};
+
 struct _BroadwayBuffer {
-  guint8 *data;
+  int ref_count;
+  guint8 *data; /* Premultiplied, like the surface it came from */
+  GDestroyNotify data_notify; /* Set if data is borrowed */
+  gpointer data_notify_user_data;
   struct entry *table;
+  GMutex table_lock;
   int width, height, stride;
   int encoded;
   int block_stride, length, block_count, shift;
-  int stats[5];
+  int stats[BROADWAY_BUFFER_N_STATS];
   int clashes;
+  /* Kept from broadway_buffer_find_copy() for when this buffer is the
+   * previous frame, until the pixels change */
+  struct band_hashes row_bands, column_bands;
 };
 
 static const guint32 prime = 0x1f821e2d;
@@ -57,6 +87,438 @@ static const guint32 end_vprime = 0xcdb99001;	/* vprime^block_size */
 static const guint32 step = 0x0ac93019;
 static const int block_size = 32, block_mask = 31;
 
+/* Extra zeroed space the hash_line kernels need after width */
+#define HASH_LINE_PADDING 40
+
+static void
+unpremultiply_line_c (void *destp, void *srcp, int width)
+{
+  guint32 *src = srcp;
+  guint32 *dest = destp;
+  guint32 *end = src + width;
+  while (src < end)
+    {
+      guint32 pixel;
+      guint8 alpha, r, g, b;
+
+      pixel = *src++;
+
+      alpha = (pixel & 0xff000000) >> 24;
+
+      if (alpha == 0xff)
+        *dest++ = pixel;
+      else if (alpha == 0)
+        *dest++ = 0;
+      else
+        {
+          r = (((pixel & 0xff0000) >> 16) * 255 + alpha / 2) / alpha;
+          g = (((pixel & 0x00ff00) >>  8) * 255 + alpha / 2) / alpha;
+          b = (((pixel & 0x0000ff) >>  0) * 255 + alpha / 2) / alpha;
+          *dest++ = (guint32)alpha << 24 | (guint32)r << 16 | (guint32)g << 8 | (guint32)b;
+        }
+    }
+}
+
+static inline guint32
+unpremultiply_pixel (guint32 pixel)
+{
+  guint32 result;
+
+  unpremultiply_line_c (&result, &pixel, 1);
+
+  return result;
+}
+
+/* Sets hashes[j] to the hash of the block_size pixels starting at
+ * line[j], with pixels past the end of the line counting as 0. */
+static void
+hash_line_c (guint32 *hashes, const guint32 *line, int width)
+{
+  guint32 hash = 0;
+  int j;
+
+  for (j = 0; j < block_size; j++)
+    {
+      hash = hash * prime;
+      if (j < width)
+        hash += line[j];
+    }
+
+  for (j = 0; j < width; j++)
+    {
+      hashes[j] = hash;
+
+      hash = hash * prime - line[j] * end_prime;
+      if (j + block_size < width)
+        hash += line[j + block_size];
+    }
+}
+
+/* Slides the block hashes one row down, dropping the top row and
+ * adding the bottom one. */
+static void
+update_block_hashes_c (guint32 *block_hashes, const guint32 *top,
+                       const guint32 *bottom, int width)
+{
+  int j;
+
+  for (j = 0; j < width; j++)
+    block_hashes[j] = block_hashes[j] * vprime + bottom[j] - top[j] * end_vprime;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+/* The vector versions of hash_line build the block_size wide hashes by
+ * repeatedly combining two hashes of half the width, instead of rolling
+ * the hash one pixel at a time. This works in place, as each step only
+ * reads entries at or after the one it writes. */
+
+static inline __m128i __attribute__((target ("sse2")))
+mullo_epi32_sse2 (__m128i a, __m128i b)
+{
+  __m128i even, odd;
+
+  even = _mm_mul_epu32 (a, b);
+  odd = _mm_mul_epu32 (_mm_srli_epi64 (a, 32), _mm_srli_epi64 (b, 32));
+
+  return _mm_unpacklo_epi32 (_mm_shuffle_epi32 (even, _MM_SHUFFLE (0, 0, 2, 0)),
+                             _mm_shuffle_epi32 (odd, _MM_SHUFFLE (0, 0, 2, 0)));
+}
+
+static void __attribute__((target ("sse2")))
+hash_line_sse2 (guint32 *hashes, const guint32 *line, int width)
+{
+  guint32 factor = prime;
+  int j, n;
+
+  memcpy (hashes, line, width * sizeof (guint32));
+  memset (hashes + width, 0, HASH_LINE_PADDING * sizeof (guint32));
+
+  for (n = 1; n < block_size; n *= 2)
+    {
+      __m128i f = _mm_set1_epi32 (factor);
+
+      for (j = 0; j < width; j += 4)
+        {
+          __m128i a = _mm_loadu_si128 ((__m128i *)(hashes + j));
+          __m128i b = _mm_loadu_si128 ((__m128i *)(hashes + j + n));
+
+          _mm_storeu_si128 ((__m128i *)(hashes + j),
+                            _mm_add_epi32 (mullo_epi32_sse2 (a, f), b));
+        }
+
+      factor = factor * factor;
+    }
+}
+
+static void __attribute__((target ("avx2")))
+hash_line_avx2 (guint32 *hashes, const guint32 *line, int width)
+{
+  guint32 factor = prime;
+  int j, n;
+
+  memcpy (hashes, line, width * sizeof (guint32));
+  memset (hashes + width, 0, HASH_LINE_PADDING * sizeof (guint32));
+
+  for (n = 1; n < block_size; n *= 2)
+    {
+      __m256i f = _mm256_set1_epi32 (factor);
+
+      for (j = 0; j < width; j += 8)
+        {
+          __m256i a = _mm256_loadu_si256 ((__m256i *)(hashes + j));
+          __m256i b = _mm256_loadu_si256 ((__m256i *)(hashes + j + n));
+
+          _mm256_storeu_si256 ((__m256i *)(hashes + j),
+                               _mm256_add_epi32 (_mm256_mullo_epi32 (a, f), b));
+        }
+
+      factor = factor * factor;
+    }
+}
+
+static void __attribute__((target ("sse2")))
+update_block_hashes_sse2 (guint32 *block_hashes, const guint32 *top,
+                          const guint32 *bottom, int width)
+{
+  const __m128i v = _mm_set1_epi32 (vprime);
+  const __m128i end_v = _mm_set1_epi32 (end_vprime);
+  int j;
+
+  for (j = 0; j + 4 <= width; j += 4)
+    {
+      __m128i h = _mm_loadu_si128 ((__m128i *)(block_hashes + j));
+      __m128i t = _mm_loadu_si128 ((__m128i *)(top + j));
+      __m128i b = _mm_loadu_si128 ((__m128i *)(bottom + j));
+
+      h = _mm_sub_epi32 (_mm_add_epi32 (mullo_epi32_sse2 (h, v), b),
+                         mullo_epi32_sse2 (t, end_v));
+      _mm_storeu_si128 ((__m128i *)(block_hashes + j), h);
+    }
+
+  update_block_hashes_c (block_hashes + j, top + j, bottom + j, width - j);
+}
+
+static void __attribute__((target ("avx2")))
+update_block_hashes_avx2 (guint32 *block_hashes, const guint32 *top,
+                          const guint32 *bottom, int width)
+{
+  const __m256i v = _mm256_set1_epi32 (vprime);
+  const __m256i end_v = _mm256_set1_epi32 (end_vprime);
+  int j;
+
+  for (j = 0; j + 8 <= width; j += 8)
+    {
+      __m256i h = _mm256_loadu_si256 ((__m256i *)(block_hashes + j));
+      __m256i t = _mm256_loadu_si256 ((__m256i *)(top + j));
+      __m256i b = _mm256_loadu_si256 ((__m256i *)(bottom + j));
+
+      h = _mm256_sub_epi32 (_mm256_add_epi32 (_mm256_mullo_epi32 (h, v), b),
+                            _mm256_mullo_epi32 (t, end_v));
+      _mm256_storeu_si256 ((__m256i *)(block_hashes + j), h);
+    }
+
+  update_block_hashes_c (block_hashes + j, top + j, bottom + j, width - j);
+}
+
+/* The vector versions of unpremultiply_line divide in single precision
+ * floats. The dividend is below 2^24 and the division is correctly
+ * rounded, so truncating the quotient gives the same result as the
+ * integer division in unpremultiply_line_c. */
+
+static inline __m128i __attribute__((target ("sse2")))
+unpremultiply_channel_sse2 (__m128i pixel, int shift, __m128i half_alpha, __m128 alpha)
+{
+  __m128i c = _mm_and_si128 (_mm_srli_epi32 (pixel, shift), _mm_set1_epi32 (0xff));
+
+  /* (c * 255 + alpha / 2) / alpha */
+  c = _mm_add_epi32 (_mm_sub_epi32 (_mm_slli_epi32 (c, 8), c), half_alpha);
+  c = _mm_cvttps_epi32 (_mm_div_ps (_mm_cvtepi32_ps (c), alpha));
+
+  return _mm_slli_epi32 (_mm_and_si128 (c, _mm_set1_epi32 (0xff)), shift);
+}
+
+static void __attribute__((target ("sse2")))
+unpremultiply_line_sse2 (void *destp, void *srcp, int width)
+{
+  guint32 *src = srcp;
+  guint32 *dest = destp;
+  int i;
+
+  for (i = 0; i + 4 <= width; i += 4)
+    {
+      __m128i pixel, a, opaque, clear, res;
+      __m128 alpha;
+
+      pixel = _mm_loadu_si128 ((__m128i *)(src + i));
+      a = _mm_srli_epi32 (pixel, 24);
+      opaque = _mm_cmpeq_epi32 (a, _mm_set1_epi32 (0xff));
+      clear = _mm_cmpeq_epi32 (a, _mm_setzero_si128 ());
+
+      /* Most pixels in a window are opaque */
+      if (_mm_movemask_epi8 (opaque) == 0xffff)
+        res = pixel;
+      else if (_mm_movemask_epi8 (clear) == 0xffff)
+        res = _mm_setzero_si128 ();
+      else
+        {
+          __m128i half_alpha = _mm_srli_epi32 (a, 1);
+
+          alpha = _mm_cvtepi32_ps (a);
+          res = _mm_slli_epi32 (a, 24);
+          res = _mm_or_si128 (res, unpremultiply_channel_sse2 (pixel, 16, half_alpha, alpha));
+          res = _mm_or_si128 (res, unpremultiply_channel_sse2 (pixel, 8, half_alpha, alpha));
+          res = _mm_or_si128 (res, unpremultiply_channel_sse2 (pixel, 0, half_alpha, alpha));
+          res = _mm_andnot_si128 (clear, res);
+        }
+
+      _mm_storeu_si128 ((__m128i *)(dest + i), res);
+    }
+
+  unpremultiply_line_c (dest + i, src + i, width - i);
+}
+
+static inline __m256i __attribute__((target ("avx2")))
+unpremultiply_channel_avx2 (__m256i pixel, int shift, __m256i half_alpha, __m256 alpha)
+{
+  __m256i c = _mm256_and_si256 (_mm256_srli_epi32 (pixel, shift), _mm256_set1_epi32 (0xff));
+
+  /* (c * 255 + alpha / 2) / alpha */
+  c = _mm256_add_epi32 (_mm256_sub_epi32 (_mm256_slli_epi32 (c, 8), c), half_alpha);
+  c = _mm256_cvttps_epi32 (_mm256_div_ps (_mm256_cvtepi32_ps (c), alpha));
+
+  return _mm256_slli_epi32 (_mm256_and_si256 (c, _mm256_set1_epi32 (0xff)), shift);
+}
+
+static void __attribute__((target ("avx2")))
+unpremultiply_line_avx2 (void *destp, void *srcp, int width)
+{
+  guint32 *src = srcp;
+  guint32 *dest = destp;
+  int i;
+
+  for (i = 0; i + 8 <= width; i += 8)
+    {
+      __m256i pixel, a, opaque, clear, res;
+      __m256 alpha;
+
+      pixel = _mm256_loadu_si256 ((__m256i *)(src + i));
+      a = _mm256_srli_epi32 (pixel, 24);
+      opaque = _mm256_cmpeq_epi32 (a, _mm256_set1_epi32 (0xff));
+      clear = _mm256_cmpeq_epi32 (a, _mm256_setzero_si256 ());
+
+      /* Most pixels in a window are opaque */
+      if (_mm256_movemask_epi8 (opaque) == -1)
+        res = pixel;
+      else if (_mm256_movemask_epi8 (clear) == -1)
+        res = _mm256_setzero_si256 ();
+      else
+        {
+          __m256i half_alpha = _mm256_srli_epi32 (a, 1);
+
+          alpha = _mm256_cvtepi32_ps (a);
+          res = _mm256_slli_epi32 (a, 24);
+          res = _mm256_or_si256 (res, unpremultiply_channel_avx2 (pixel, 16, half_alpha, alpha));
+          res = _mm256_or_si256 (res, unpremultiply_channel_avx2 (pixel, 8, half_alpha, alpha));
+          res = _mm256_or_si256 (res, unpremultiply_channel_avx2 (pixel, 0, half_alpha, alpha));
+          res = _mm256_andnot_si256 (clear, res);
+        }
+
+      _mm256_storeu_si256 ((__m256i *)(dest + i), res);
+    }
+
+  unpremultiply_line_c (dest + i, src + i, width - i);
+}
+
+#endif /* HAVE_X86_KERNELS */
+
+static struct {
+  BroadwaySimdLevel level;
+  void (* unpremultiply_line)  (void *destp, void *srcp, int width);
+  void (* hash_line)           (guint32 *hashes, const guint32 *line, int width);
+  void (* update_block_hashes) (guint32 *block_hashes, const guint32 *top,
+                                const guint32 *bottom, int width);
+} kernels;
+
+static BroadwaySimdLevel
+get_supported_simd_level (void)
+{
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    return BROADWAY_SIMD_AVX2;
+  if (__builtin_cpu_supports ("sse2"))
+    return BROADWAY_SIMD_SSE2;
+#endif
+  return BROADWAY_SIMD_NONE;
+}
+
+static void
+select_kernels (BroadwaySimdLevel level)
+{
+  kernels.level = MIN (level, get_supported_simd_level ());
+
+  switch (kernels.level)
+    {
+#ifdef HAVE_X86_KERNELS
+    case BROADWAY_SIMD_AVX2:
+      kernels.unpremultiply_line = unpremultiply_line_avx2;
+      kernels.hash_line = hash_line_avx2;
+      kernels.update_block_hashes = update_block_hashes_avx2;
+      break;
+    case BROADWAY_SIMD_SSE2:
+      kernels.unpremultiply_line = unpremultiply_line_sse2;
+      kernels.hash_line = hash_line_sse2;
+      kernels.update_block_hashes = update_block_hashes_sse2;
+      break;
+#endif
+    case BROADWAY_SIMD_NONE:
+    default:
+      kernels.unpremultiply_line = unpremultiply_line_c;
+      kernels.hash_line = hash_line_c;
+      kernels.update_block_hashes = update_block_hashes_c;
+      break;
+    }
+}
+
+static void
+ensure_kernels (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      select_kernels (BROADWAY_SIMD_AVX2);
+      g_once_init_leave (&initialized, 1);
+    }
+}
+
+BroadwaySimdLevel
+broadway_buffer_get_simd_level (void)
+{
+  ensure_kernels ();
+
+  return kernels.level;
+}
+
+/* Limits the kernels to level, or what the cpu supports. This is for
+ * benchmarks and must not be called while buffers are being encoded. */
+void
+broadway_buffer_set_simd_level (BroadwaySimdLevel level)
+{
+  ensure_kernels ();
+  select_kernels (level);
+}
+
+/* Runs one kernel over every line of data, for benchmarks. The block
+ * hashes kernel takes the lines themselves as the row hashes. Returns
+ * a checksum of the output, which has to be the same at every level. */
+guint32
+broadway_buffer_run_kernel (BroadwayKernel  kernel,
+                            guint8         *data,
+                            int             width,
+                            int             height,
+                            int             stride)
+{
+  guint32 *out, *line, *zero_line;
+  guint32 checksum = 0;
+  int i;
+
+  ensure_kernels ();
+
+  out = g_new0 (guint32, width + HASH_LINE_PADDING);
+  zero_line = g_new0 (guint32, width);
+
+  for (i = 0; i < height; i++)
+    {
+      line = (guint32 *) (data + i * stride);
+
+      switch (kernel)
+        {
+        case BROADWAY_KERNEL_UNPREMULTIPLY:
+          kernels.unpremultiply_line (out, line, width);
+          break;
+        case BROADWAY_KERNEL_HASH_LINE:
+          kernels.hash_line (out, line, width);
+          break;
+        case BROADWAY_KERNEL_BLOCK_HASHES:
+          kernels.update_block_hashes (out,
+                                       i >= block_size ? (guint32 *) (data + (i - block_size) * stride) : zero_line,
+                                       line, width);
+          break;
+        default:
+          g_assert_not_reached ();
+        }
+
+      checksum = checksum * prime + out[i % width];
+    }
+
+  g_free (zero_line);
+  g_free (out);
+
+  return checksum;
+}
+
 static gboolean
 verify_block_match (BroadwayBuffer *buffer, int x, int y,
                     BroadwayBuffer *prev, struct entry *entry)
@@ -90,7 +552,7 @@ verify_block_match (BroadwayBuffer *buffer, int x, int y,
       old = prev->data + (entry->y + i) * prev->stride + entry->x * 4;
       if (memcmp (match, old, w1 * 4) != 0)
         {
-          buffer->clashes++;
+          g_atomic_int_inc (&buffer->clashes);
           return FALSE;
         }
     }
@@ -278,14 +740,43 @@ encode_block (struct encoder *encoder, struct entry *entry, int x, int y)
   emit (encoder, (x << 16) | y);
 }
 
+BroadwayBuffer *
+broadway_buffer_ref (BroadwayBuffer *buffer)
+{
+  g_atomic_int_inc (&buffer->ref_count);
+
+  return buffer;
+}
+
 void
-broadway_buffer_destroy (BroadwayBuffer *buffer)
+broadway_buffer_unref (BroadwayBuffer *buffer)
 {
-  g_free (buffer->data);
+  if (!g_atomic_int_dec_and_test (&buffer->ref_count))
+    return;
+
+  g_mutex_clear (&buffer->table_lock);
+  g_free (buffer->row_bands.hashes);
+  g_free (buffer->row_bands.index);
+  g_free (buffer->column_bands.hashes);
+  g_free (buffer->column_bands.index);
+  if (buffer->data_notify)
+    buffer->data_notify (buffer->data_notify_user_data);
+  else
+    g_free (buffer->data);
   g_free (buffer->table);
   g_free (buffer);
 }
 
+/* Only meaningful once the buffer has been encoded */
+void
+broadway_buffer_get_stats (BroadwayBuffer *buffer,
+                           int             stats[BROADWAY_BUFFER_N_STATS],
+                           int            *clashes)
+{
+  memcpy (stats, buffer->stats, sizeof buffer->stats);
+  *clashes = g_atomic_int_get (&buffer->clashes);
+}
+
 int
 broadway_buffer_get_width (BroadwayBuffer *buffer)
 {
@@ -298,42 +789,14 @@ broadway_buffer_get_height (BroadwayBuffer *buffer)
   return buffer->height;
 }
 
-static void
-unpremultiply_line (void *destp, void *srcp, int width)
-{
-  guint32 *src = srcp;
-  guint32 *dest = destp;
-  guint32 *end = src + width;
-  while (src < end)
-    {
-      guint32 pixel;
-      guint8 alpha, r, g, b;
-
-      pixel = *src++;
-
-      alpha = (pixel & 0xff000000) >> 24;
-
-      if (alpha == 0xff)
-        *dest++ = pixel;
-      else if (alpha == 0)
-        *dest++ = 0;
-      else
-        {
-          r = (((pixel & 0xff0000) >> 16) * 255 + alpha / 2) / alpha;
-          g = (((pixel & 0x00ff00) >>  8) * 255 + alpha / 2) / alpha;
-          b = (((pixel & 0x0000ff) >>  0) * 255 + alpha / 2) / alpha;
-          *dest++ = (guint32)alpha << 24 | (guint32)r << 16 | (guint32)g << 8 | (guint32)b;
-        }
-    }
-}
-
-BroadwayBuffer *
-broadway_buffer_create (int width, int height, guint8 *data, int stride)
+static BroadwayBuffer *
+buffer_new (int width, int height)
 {
   BroadwayBuffer *buffer;
-  int y, bits_required;
+  int bits_required;
 
   buffer = g_new0 (BroadwayBuffer, 1);
+  buffer->ref_count = 1;
   buffer->width = width;
   buffer->stride = width * 4;
   buffer->height = height;
@@ -346,106 +809,167 @@ broadway_buffer_create (int width, int height, guint8 *data, int stride)
   buffer->length = 1 << bits_required;
 
   buffer->table = g_malloc0 (buffer->length * sizeof buffer->table[0]);
+  g_mutex_init (&buffer->table_lock);
 
   memset (buffer->stats, 0, sizeof buffer->stats);
   buffer->clashes = 0;
 
+  ensure_kernels ();
+
+  return buffer;
+}
+
+BroadwayBuffer *
+broadway_buffer_create (int width, int height, guint8 *data, int stride)
+{
+  BroadwayBuffer *buffer;
+  int y;
+
+  buffer = buffer_new (width, height);
   buffer->data = g_malloc (buffer->stride * height);
 
   for (y = 0; y < height; y++)
-    unpremultiply_line (buffer->data + y * buffer->stride, data + y * stride, width);
+    memcpy (buffer->data + y * buffer->stride, data + y * stride, buffer->stride);
 
   return buffer;
 }
 
+/* Creates a buffer that uses data, which has width * 4 bytes per row,
+ * without copying it. The data must not change until notify is called
+ * with user_data, when the buffer is freed. Such a buffer can't be
+ * changed either, see broadway_buffer_copy(). */
+BroadwayBuffer *
+broadway_buffer_create_for_data (int             width,
+                                 int             height,
+                                 guint8         *data,
+                                 GDestroyNotify  notify,
+                                 gpointer        user_data)
+{
+  BroadwayBuffer *buffer;
+
+  g_return_val_if_fail (notify != NULL, NULL);
+
+  buffer = buffer_new (width, height);
+  buffer->data = data;
+  buffer->data_notify = notify;
+  buffer->data_notify_user_data = user_data;
+
+  return buffer;
+}
+
+gboolean
+broadway_buffer_is_borrowed (BroadwayBuffer *buffer)
+{
+  return buffer->data_notify != NULL;
+}
+
+/* Returns a buffer with a copy of the pixels of buffer, that also has
+ * the blocks of buffer to match against. Must not be called while
+ * buffer is being encoded. */
+BroadwayBuffer *
+broadway_buffer_copy (BroadwayBuffer *buffer)
+{
+  BroadwayBuffer *copy;
+
+  copy = broadway_buffer_create (buffer->width, buffer->height,
+                                 buffer->data, buffer->stride);
+  memcpy (copy->table, buffer->table, buffer->length * sizeof buffer->table[0]);
+  memcpy (copy->stats, buffer->stats, sizeof buffer->stats);
+  copy->clashes = buffer->clashes;
+  copy->encoded = buffer->encoded;
+
+  return copy;
+}
+
+/* Encodes the rows from y0 up to y1. Blocks are only matched if they
+ * fit before y1, so the rows of a buffer can be split into bands that
+ * are encoded separately, possibly in parallel, and the results
+ * appended in order. Bands should start on multiples of block_size
+ * so that every block in the buffer gets hashed for the next frame.
+ * Call broadway_buffer_encode_done() when all of the rows have been
+ * encoded. */
 void
-broadway_buffer_encode (BroadwayBuffer *buffer, BroadwayBuffer *prev, GString *dest)
+broadway_buffer_encode_rows (BroadwayBuffer *buffer, BroadwayBuffer *prev,
+                             int y0, int y1, GString *dest)
 {
   struct entry *entry;
   int i, j, k;
-  int x0, x1, y0, y1;
   guint32 *block_hashes;
-  guint32 hash, bottom_hash, h, *line, *bottom, *prev_line;
+  guint32 h, *line, *prev_line, *colors, color;
+  guint32 **row_hashes, *zero_hashes, *bottom_hashes, *tmp;
   int width, height;
   struct encoder encoder = { 0 };
   int *skyline, skyline_pixels;
   int matches;
 
+  g_return_if_fail (y0 >= 0 && y0 <= y1 && y1 <= buffer->height);
+
   width = buffer->width;
   height = buffer->height;
-  x0 = 0;
-  x1 = width;
-  y0 = 0;
-  y1 = height;
+
+  ensure_kernels ();
 
   skyline = g_malloc0 ((width + block_size) * sizeof skyline[0]);
 
   block_hashes = g_malloc0 (width * sizeof block_hashes[0]);
 
+  /* The hashes of the block_size pixels starting at each pixel, for
+   * the block_size rows the block hashes currently cover. Row i is at
+   * row_hashes[i & block_mask]. Rows below the buffer hash to 0. */
+  row_hashes = g_new (guint32 *, block_size);
+  for (i = 0; i < block_size; i++)
+    row_hashes[i] = g_new (guint32, width + HASH_LINE_PADDING);
+  bottom_hashes = g_new (guint32, width + HASH_LINE_PADDING);
+  zero_hashes = g_new0 (guint32, width);
+  colors = g_new (guint32, width);
+
   matches = 0;
   encoder.dest = dest;
 
   // Calculate the block hashes for the first row
-  for (i = y0; i < MIN(y1, y0 + block_size); i++)
+  for (i = y0; i < y0 + block_size; i++)
     {
-      line = (guint32 *)(buffer->data + i * buffer->stride);
-      hash = 0;
-      for (j = x0; j < MIN(x1, x0 + block_size); j++)
-        hash = hash * prime + line[j];
-      for (; j < x0 + block_size; j++)
-        hash = hash * prime;
-
-      for (j = x0; j < x1; j++)
+      if (i < height)
         {
-          block_hashes[j] = block_hashes[j] * vprime + hash;
-
-          hash = hash * prime - line[j] * end_prime;
-          if (j + block_size < width)
-            hash += line[j + block_size];
+          line = (guint32 *)(buffer->data + i * buffer->stride);
+          kernels.hash_line (row_hashes[i & block_mask], line, width);
+          kernels.update_block_hashes (block_hashes, zero_hashes,
+                                       row_hashes[i & block_mask], width);
         }
-    }
-  // Do the last rows if height < block_size
-  for (; i < y0 + block_size; i++)
-    {
-      for (j = x0; j < x1; j++)
-        block_hashes[j] = block_hashes[j] * vprime;
+      else
+        kernels.update_block_hashes (block_hashes, zero_hashes, zero_hashes, width);
     }
 
   for (i = y0; i < y1; i++)
     {
       line = (guint32 *) (buffer->data + i * buffer->stride);
-      bottom = (guint32 *) (buffer->data + (i + block_size) * buffer->stride);
-      bottom_hash = 0;
-      hash = 0;
       skyline_pixels = 0;
 
+      /* The encoded colors are unpremultiplied, the pixels only get
+       * compared. Equal pixels have equal colors, so unpremultiplying
+       * the pixels of prev is only needed where they differ. */
+      kernels.unpremultiply_line (colors, line, width);
+
       if (prev && i < prev->height)
         prev_line = (guint32 *) (prev->data + i * prev->stride);
       else
         prev_line = NULL;
 
-      for (j = x0; j < x0 + block_size; j++)
+      for (j = 0; j < block_size; j++)
         {
-          hash = hash * prime;
-          if (j < width)
-            hash += line[j];
-          if (i + block_size < height)
-            {
-              bottom_hash = bottom_hash * prime;
-              if (j < width)
-                bottom_hash += bottom[j];
-            }
           if (i < skyline[j])
             skyline_pixels = 0;
           else
             skyline_pixels++;
         }
 
-      for (j = x0; j < x1; j++)
+      for (j = 0; j < width; j++)
         {
+          color = colors[j];
+
           if (i < skyline[j])
-            encode_pixel (&encoder, line[j], line[j]);
-          else if (prev)
+            encode_pixel (&encoder, color, color);
+          else if (prev && (i + block_size <= y1 || y1 == height))
             {
               /* FIXME: Add back overlap exception
                * for consecutive blocks */
@@ -463,19 +987,19 @@ broadway_buffer_encode (BroadwayBuffer *buffer, BroadwayBuffer *prev, GString *d
                   for (k = 0; k < block_size; k++)
                     skyline[j + k] = i + block_size;
 
-                  encode_pixel (&encoder, line[j], line[j]);
+                  encode_pixel (&encoder, color, color);
                 }
               else
                 {
                   if (prev_line && j < prev->width)
-                    encode_pixel (&encoder, line[j],
-                                  prev_line[j]);
+                    encode_pixel (&encoder, color,
+                                  line[j] == prev_line[j] ? color : unpremultiply_pixel (prev_line[j]));
                   else
-                    encode_pixel (&encoder, line[j], 0);
+                    encode_pixel (&encoder, color, 0);
                 }
             }
           else
-            encode_pixel (&encoder, line[j], 0);
+            encode_pixel (&encoder, color, 0);
 
           if (i < skyline[j + block_size])
             skyline_pixels = 0;
@@ -485,23 +1009,30 @@ broadway_buffer_encode (BroadwayBuffer *buffer, BroadwayBuffer *prev, GString *d
           /* Insert block in hash table if we're on a
            * grid point. */
           if (((i | j) & block_mask) == 0 && !buffer->encoded)
-            insert_block (buffer, block_hashes[j], j, i);
-
-          /* Update sliding block hash */
-          block_hashes[j] =
-            block_hashes[j] * vprime + bottom_hash -
-            hash * end_vprime;
-
-          if (i + block_size < height)
             {
-              bottom_hash = bottom_hash * prime - bottom[j] * end_prime;
-              if (j + block_size < width)
-                bottom_hash += bottom[j + block_size];
+              g_mutex_lock (&buffer->table_lock);
+              insert_block (buffer, block_hashes[j], j, i);
+              g_mutex_unlock (&buffer->table_lock);
             }
-          hash = hash * prime - line[j] * end_prime;
-          if  (j + block_size < width)
-            hash += line[j + block_size] ;
         }
+
+      /* Slide the block hashes down to the next row */
+      if (i + 1 == y1)
+        break;
+      if (i + block_size < height)
+        {
+          line = (guint32 *) (buffer->data + (i + block_size) * buffer->stride);
+          kernels.hash_line (bottom_hashes, line, width);
+          kernels.update_block_hashes (block_hashes, row_hashes[i & block_mask],
+                                       bottom_hashes, width);
+
+          tmp = row_hashes[i & block_mask];
+          row_hashes[i & block_mask] = bottom_hashes;
+          bottom_hashes = tmp;
+        }
+      else
+        kernels.update_block_hashes (block_hashes, row_hashes[i & block_mask],
+                                     zero_hashes, width);
     }
 
   encoder_flush (&encoder);
@@ -521,8 +1052,614 @@ broadway_buffer_encode (BroadwayBuffer *buffer, BroadwayBuffer *prev, GString *d
           100 * encoder.bytes / (height * buffer->stride));
 #endif
 
+  for (i = 0; i < block_size; i++)
+    g_free (row_hashes[i]);
+  g_free (row_hashes);
+  g_free (bottom_hashes);
+  g_free (zero_hashes);
+  g_free (colors);
   g_free (skyline);
   g_free (block_hashes);
+}
 
+void
+broadway_buffer_encode_done (BroadwayBuffer *buffer)
+{
   buffer->encoded = TRUE;
 }
+
+void
+broadway_buffer_encode (BroadwayBuffer *buffer, BroadwayBuffer *prev, GString *dest)
+{
+  broadway_buffer_encode_rows (buffer, prev, 0, buffer->height, dest);
+  broadway_buffer_encode_done (buffer);
+}
+
+static void
+forget_band_hashes (BroadwayBuffer *buffer)
+{
+  g_free (buffer->row_bands.hashes);
+  buffer->row_bands.hashes = NULL;
+  buffer->row_bands.indexed = FALSE;
+  g_free (buffer->column_bands.hashes);
+  buffer->column_bands.hashes = NULL;
+  buffer->column_bands.indexed = FALSE;
+}
+
+/* Encodes rect of data into dest as deltas against old_data, without
+ * any block references */
+static void
+encode_rect (BroadwayRect *rect,
+             guint8       *old_data,
+             int           old_stride,
+             guint8       *data,
+             int           stride,
+             GString      *dest)
+{
+  struct encoder encoder = { 0 };
+  guint32 *line, *new_line, *colors;
+  int i, j;
+
+  ensure_kernels ();
+
+  colors = g_new (guint32, rect->width);
+  encoder.dest = dest;
+
+  for (i = rect->y; i < rect->y + rect->height; i++)
+    {
+      line = (guint32 *)(old_data + i * old_stride) + rect->x;
+      new_line = (guint32 *)(data + i * stride) + rect->x;
+
+      kernels.unpremultiply_line (colors, new_line, rect->width);
+      for (j = 0; j < rect->width; j++)
+        encode_pixel (&encoder, colors[j],
+                      line[j] == new_line[j] ? colors[j] : unpremultiply_pixel (line[j]));
+    }
+
+  encoder_flush (&encoder);
+
+  g_free (colors);
+}
+
+/* Replaces the pixels in rect with the (premultiplied) ones from data,
+ * which has the same layout as the surface the buffer was created from.
+ * If dest is not NULL the rect is encoded into it as deltas against the
+ * old contents, without any block references, for a sub-rect update. */
+void
+broadway_buffer_update_rect (BroadwayBuffer *buffer,
+                             BroadwayRect   *rect,
+                             guint8         *data,
+                             int             stride,
+                             GString        *dest)
+{
+  int i;
+
+  g_return_if_fail (rect->x >= 0 && rect->x + rect->width <= buffer->width);
+  g_return_if_fail (rect->y >= 0 && rect->y + rect->height <= buffer->height);
+  g_return_if_fail (!broadway_buffer_is_borrowed (buffer));
+
+  if (dest)
+    encode_rect (rect, buffer->data, buffer->stride, data, stride, dest);
+
+  forget_band_hashes (buffer);
+
+  for (i = rect->y; i < rect->y + rect->height; i++)
+    memcpy (buffer->data + i * buffer->stride + rect->x * 4,
+            data + i * stride + rect->x * 4,
+            rect->width * 4);
+}
+
+/* Encodes rect of buffer into dest as deltas against prev, like
+ * broadway_buffer_update_rect() does, but without changing prev. For
+ * when buffer is prev with only some rects changed. */
+void
+broadway_buffer_encode_rect (BroadwayBuffer *buffer,
+                             BroadwayBuffer *prev,
+                             BroadwayRect   *rect,
+                             GString        *dest)
+{
+  g_return_if_fail (buffer->width == prev->width && buffer->height == prev->height);
+  g_return_if_fail (rect->x >= 0 && rect->x + rect->width <= buffer->width);
+  g_return_if_fail (rect->y >= 0 && rect->y + rect->height <= buffer->height);
+
+  encode_rect (rect, prev->data, prev->stride, buffer->data, buffer->stride, dest);
+}
+
+/* Moves the blocks of from to buffer, which has the same size and
+ * hasn't been encoded, for when buffer replaces from with only some
+ * rects changed. Blocks in those rects no longer match, which
+ * verify_block_match() catches. Neither may be in use by an encode. */
+void
+broadway_buffer_take_blocks (BroadwayBuffer *buffer,
+                             BroadwayBuffer *from)
+{
+  struct entry *table;
+
+  g_return_if_fail (buffer->width == from->width && buffer->height == from->height);
+  g_return_if_fail (!buffer->encoded);
+
+  /* The table of a buffer that wasn't encoded is empty */
+  table = buffer->table;
+  buffer->table = from->table;
+  from->table = table;
+
+  memcpy (buffer->stats, from->stats, sizeof buffer->stats);
+  buffer->clashes = from->clashes;
+  buffer->encoded = from->encoded;
+  from->encoded = FALSE;
+}
+
+/* Scroll detection
+ *
+ * Scrolling moves most of a view by a few lines, and the block matcher
+ * only finds content that moved to a block aligned position in prev.
+ * Instead we look for a single translation along one axis: the lines
+ * (rows for vertical scrolling, columns for horizontal) are split into
+ * bands of copy_band pixels, each band of each line is hashed, and the
+ * offset most unique lines moved by wins. The copied area is then the
+ * widest set of adjacent bands that moved together.
+ *
+ * The hashes of a frame are kept with its buffer, so each frame is only
+ * hashed once. Columns are only looked at if enough of the rows changed
+ * for a copy to be worth it. */
+
+static const int copy_band = 64;
+static const int min_copy_area = 128 * 128;
+
+struct lines {
+  int n_lines, length;
+  int line_step, pixel_step;
+  guint32 *new_data, *old_data;
+};
+
+static inline guint32
+line_pixel (guint32 *data, struct lines *lines, int line, int pos)
+{
+  return data[line * lines->line_step + pos * lines->pixel_step];
+}
+
+static void
+hash_bands (struct lines *lines, guint32 *data, guint32 *hashes)
+{
+  int n_bands = (lines->length + copy_band - 1) / copy_band;
+  int i, b, p, end;
+
+  for (b = 0; b < n_bands; b++)
+    {
+      guint32 *band = hashes + b * lines->n_lines;
+
+      end = MIN ((b + 1) * copy_band, lines->length);
+
+      if (lines->pixel_step == 1)
+        {
+          for (i = 0; i < lines->n_lines; i++)
+            {
+              guint32 hash = b;
+
+              for (p = b * copy_band; p < end; p++)
+                hash = hash * prime + line_pixel (data, lines, i, p);
+
+              band[i] = hash;
+            }
+        }
+      else
+        {
+          /* Columns, go through the band a whole row at a time
+           * instead of jumping a stride for every pixel */
+          for (i = 0; i < lines->n_lines; i++)
+            band[i] = b;
+
+          for (p = b * copy_band; p < end; p++)
+            {
+              guint32 *row = data + p * lines->pixel_step;
+
+              for (i = 0; i < lines->n_lines; i++)
+                band[i] = band[i] * prime + row[i * lines->line_step];
+            }
+        }
+    }
+}
+
+/* Returns the band hashes of data, which belongs to the buffer that
+ * cache is part of */
+static guint32 *
+get_band_hashes (struct band_hashes *cache,
+                 struct lines       *lines,
+                 guint32            *data,
+                 BroadwayRect       *area)
+{
+  int n_bands = (lines->length + copy_band - 1) / copy_band;
+
+  if (cache->hashes == NULL ||
+      cache->area.x != area->x || cache->area.y != area->y ||
+      cache->area.width != area->width || cache->area.height != area->height)
+    {
+      g_free (cache->hashes);
+      cache->hashes = g_new (guint32, n_bands * lines->n_lines);
+      cache->area = *area;
+      cache->indexed = FALSE;
+      hash_bands (lines, data, cache->hashes);
+    }
+
+  return cache->hashes;
+}
+
+/* The number of pixels in bands that are different in the same place */
+static gint64
+changed_band_area (struct lines *lines, guint32 *new_hashes, guint32 *old_hashes)
+{
+  int n_hashes = (lines->length + copy_band - 1) / copy_band * lines->n_lines;
+  int i, n_changed = 0;
+
+  for (i = 0; i < n_hashes; i++)
+    if (new_hashes[i] != old_hashes[i])
+      n_changed++;
+
+  return (gint64) n_changed * copy_band;
+}
+
+/* Maps the hashes of the old frame to the lines they are on, in a
+ * table probed like the block table. Only done once per frame. */
+static void
+index_band_hashes (struct band_hashes *old, struct lines *lines, int n_hashes)
+{
+  struct line_slot *slot;
+  int bits, i;
+  guint32 h, k;
+
+  if (old->indexed)
+    return;
+
+  /* At most half full */
+  bits = g_bit_storage (n_hashes * 2);
+  if (old->index == NULL || old->index_shift != 32 - bits)
+    {
+      g_free (old->index);
+      old->index = g_new (struct line_slot, 1 << bits);
+      old->index_shift = 32 - bits;
+    }
+  memset (old->index, 0, sizeof (struct line_slot) << bits);
+
+  for (i = 0; i < n_hashes; i++)
+    {
+      h = old->hashes[i];
+
+      for (k = h; slot = &old->index[k >> old->index_shift], slot->line != 0; k += step)
+        if (slot->hash == h)
+          break;
+
+      if (slot->line != 0)
+        slot->line = -1;
+      else
+        {
+          slot->hash = h;
+          slot->line = i % lines->n_lines + 1;
+        }
+    }
+
+  old->indexed = TRUE;
+}
+
+/* Returns the line plus one of h in the old frame, -1 if it is on
+ * more than one and 0 if it isn't there */
+static int
+lookup_band_hash (struct band_hashes *old, guint32 h)
+{
+  struct line_slot *slot;
+  guint32 k;
+
+  for (k = h; slot = &old->index[k >> old->index_shift], slot->line != 0; k += step)
+    if (slot->hash == h)
+      return slot->line;
+
+  return 0;
+}
+
+/* Returns the offset d such that most of the unique lines at i in the
+ * new data were at i + d in the old data, or 0 if there is none. */
+static int
+vote_offset (struct lines *lines, guint32 *new_hashes, struct band_hashes *old, int n_hashes)
+{
+  int *votes;
+  int i, j, best;
+
+  index_band_hashes (old, lines, n_hashes);
+
+  votes = g_new0 (int, 2 * lines->n_lines);
+  for (i = 0; i < n_hashes; i++)
+    {
+      j = lookup_band_hash (old, new_hashes[i]) - 1;
+      if (j >= 0 && j != i % lines->n_lines)
+        votes[j - i % lines->n_lines + lines->n_lines]++;
+    }
+
+  best = 0;
+  for (i = 1; i < 2 * lines->n_lines; i++)
+    if (votes[i] > votes[best])
+      best = i;
+
+  /* A couple of stray matches are not a scroll */
+  if (votes[best] < 4)
+    best = lines->n_lines;
+
+  g_free (votes);
+
+  return best - lines->n_lines;
+}
+
+static gboolean
+find_copy (struct lines *lines, guint32 *new_hashes, struct band_hashes *old,
+           int *line_start, int *line_end, int *pos_start, int *pos_end, int *offset)
+{
+  guint32 *old_hashes = old->hashes;
+  int n_bands, n_lines, d, b, b0, b1, i, start, end, run;
+  int best_area, area, s, e, p0, p1;
+  int *starts, *ends;
+
+  n_lines = lines->n_lines;
+  n_bands = (lines->length + copy_band - 1) / copy_band;
+
+  d = vote_offset (lines, new_hashes, old, n_bands * n_lines);
+  if (d == 0)
+    return FALSE;
+
+  /* The longest run of lines in each band that moved by d */
+  starts = g_new (int, n_bands);
+  ends = g_new (int, n_bands);
+  for (b = 0; b < n_bands; b++)
+    {
+      guint32 *new_band = new_hashes + b * n_lines;
+      guint32 *old_band = old_hashes + b * n_lines;
+
+      starts[b] = ends[b] = 0;
+      run = 0;
+      for (i = MAX (0, -d); i < MIN (n_lines, n_lines - d); i++)
+        {
+          if (new_band[i] != old_band[i + d])
+            {
+              run = 0;
+              continue;
+            }
+
+          run++;
+          if (run > ends[b] - starts[b])
+            {
+              starts[b] = i + 1 - run;
+              ends[b] = i + 1;
+            }
+        }
+    }
+
+  /* The adjacent bands with the largest common run */
+  best_area = 0;
+  p0 = p1 = s = e = 0;
+  for (b0 = 0; b0 < n_bands; b0++)
+    {
+      start = starts[b0];
+      end = ends[b0];
+      for (b1 = b0; b1 < n_bands && start < end; b1++)
+        {
+          start = MAX (start, starts[b1]);
+          end = MIN (end, ends[b1]);
+          area = (end - start) * (MIN ((b1 + 1) * copy_band, lines->length) - b0 * copy_band);
+          if (end > start && area > best_area)
+            {
+              best_area = area;
+              s = start;
+              e = end;
+              p0 = b0 * copy_band;
+              p1 = MIN ((b1 + 1) * copy_band, lines->length);
+            }
+        }
+    }
+
+  g_free (starts);
+  g_free (ends);
+
+  /* Not worth a separate copy for something small */
+  if (e - s < block_size || best_area < min_copy_area)
+    return FALSE;
+
+  /* The hashes may have collided, check the pixels */
+  for (i = s; i < e; i++)
+    {
+      int k;
+
+      for (k = p0; k < p1; k++)
+        if (line_pixel (lines->new_data, lines, i, k) !=
+            line_pixel (lines->old_data, lines, i + d, k))
+          return FALSE;
+    }
+
+  /* Grow the copy into the partially matching bands at the edges */
+  for (; p0 > 0; p0--)
+    {
+      for (i = s; i < e; i++)
+        if (line_pixel (lines->new_data, lines, i, p0 - 1) !=
+            line_pixel (lines->old_data, lines, i + d, p0 - 1))
+          break;
+      if (i < e)
+        break;
+    }
+  for (; p1 < lines->length; p1++)
+    {
+      for (i = s; i < e; i++)
+        if (line_pixel (lines->new_data, lines, i, p1) !=
+            line_pixel (lines->old_data, lines, i + d, p1))
+          break;
+      if (i < e)
+        break;
+    }
+
+  /* Return the source lines */
+  *line_start = s + d;
+  *line_end = e + d;
+  *pos_start = p0;
+  *pos_end = p1;
+  *offset = -d;
+
+  return TRUE;
+}
+
+/* Looks for a large part of prev that was moved horizontally or
+ * vertically to get buffer, as happens when scrolling. Only the part
+ * inside area is considered, or the whole buffer if it is NULL. On
+ * success, rect is set to the part of prev that moved and dx, dy to
+ * how far it moved. */
+gboolean
+broadway_buffer_find_copy (BroadwayBuffer *buffer,
+                           BroadwayBuffer *prev,
+                           BroadwayRect   *area,
+                           BroadwayRect   *rect,
+                           int            *dx,
+                           int            *dy)
+{
+  BroadwayRect full = { 0, 0, buffer->width, buffer->height };
+  struct lines lines;
+  guint32 *new_hashes, *old_hashes;
+  int line_start, line_end, pos_start, pos_end, offset;
+  int stride;
+
+  g_return_val_if_fail (buffer->width == prev->width && buffer->height == prev->height, FALSE);
+
+  if (area == NULL)
+    area = &full;
+
+  if (area->width < block_size || area->height < block_size)
+    return FALSE;
+
+  stride = buffer->stride / 4;
+
+  /* Rows, for vertical scrolling */
+  lines.n_lines = area->height;
+  lines.length = area->width;
+  lines.line_step = stride;
+  lines.pixel_step = 1;
+  lines.new_data = (guint32 *) buffer->data + area->y * stride + area->x;
+  lines.old_data = (guint32 *) prev->data + area->y * stride + area->x;
+
+  new_hashes = get_band_hashes (&buffer->row_bands, &lines, lines.new_data, area);
+  old_hashes = get_band_hashes (&prev->row_bands, &lines, lines.old_data, area);
+
+  /* Anything that moved changed at least this much, whichever way */
+  if (changed_band_area (&lines, new_hashes, old_hashes) < min_copy_area)
+    return FALSE;
+
+  if (find_copy (&lines, new_hashes, &prev->row_bands,
+                 &line_start, &line_end, &pos_start, &pos_end, &offset))
+    {
+      rect->x = area->x + pos_start;
+      rect->y = area->y + line_start;
+      rect->width = pos_end - pos_start;
+      rect->height = line_end - line_start;
+      *dx = 0;
+      *dy = offset;
+      return TRUE;
+    }
+
+  /* Columns, for horizontal scrolling */
+  lines.n_lines = area->width;
+  lines.length = area->height;
+  lines.line_step = 1;
+  lines.pixel_step = stride;
+
+  new_hashes = get_band_hashes (&buffer->column_bands, &lines, lines.new_data, area);
+  get_band_hashes (&prev->column_bands, &lines, lines.old_data, area);
+
+  if (find_copy (&lines, new_hashes, &prev->column_bands,
+                 &line_start, &line_end, &pos_start, &pos_end, &offset))
+    {
+      rect->x = area->x + line_start;
+      rect->y = area->y + pos_start;
+      rect->width = line_end - line_start;
+      rect->height = pos_end - pos_start;
+      *dx = offset;
+      *dy = 0;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Moves the pixels in rect by dx, dy, the same way the client does
+ * for a copy rectangle op. */
+void
+broadway_buffer_copy_rect (BroadwayBuffer *buffer,
+                           BroadwayRect   *rect,
+                           int             dx,
+                           int             dy)
+{
+  int i, y;
+
+  g_return_if_fail (rect->x >= 0 && rect->x + rect->width <= buffer->width);
+  g_return_if_fail (rect->y >= 0 && rect->y + rect->height <= buffer->height);
+  g_return_if_fail (rect->x + dx >= 0 && rect->x + dx + rect->width <= buffer->width);
+  g_return_if_fail (rect->y + dy >= 0 && rect->y + dy + rect->height <= buffer->height);
+  g_return_if_fail (!broadway_buffer_is_borrowed (buffer));
+
+  forget_band_hashes (buffer);
+
+  for (i = 0; i < rect->height; i++)
+    {
+      /* Don't overwrite rows we have yet to move */
+      y = dy > 0 ? rect->y + rect->height - 1 - i : rect->y + i;
+
+      memmove (buffer->data + (y + dy) * buffer->stride + (rect->x + dx) * 4,
+               buffer->data + y * buffer->stride + rect->x * 4,
+               rect->width * 4);
+    }
+}
+
+/* Finds the rects that differ between buffer and prev. Changed rows
+ * less than a block apart are merged, as unchanged pixels are cheap to
+ * encode. Returns the number of rects, or -1 if more than max_rects
+ * would be needed. */
+int
+broadway_buffer_get_changed_rects (BroadwayBuffer *buffer,
+                                   BroadwayBuffer *prev,
+                                   BroadwayRect   *rects,
+                                   int             max_rects)
+{
+  int n_rects, y, x0, x1;
+  guint32 *line, *prev_line;
+  BroadwayRect *r;
+
+  g_return_val_if_fail (buffer->width == prev->width && buffer->height == prev->height, -1);
+
+  n_rects = 0;
+  r = NULL;
+  for (y = 0; y < buffer->height; y++)
+    {
+      line = (guint32 *) (buffer->data + y * buffer->stride);
+      prev_line = (guint32 *) (prev->data + y * prev->stride);
+
+      if (memcmp (line, prev_line, buffer->stride) == 0)
+        continue;
+
+      for (x0 = 0; line[x0] == prev_line[x0]; x0++)
+        ;
+      for (x1 = buffer->width; line[x1 - 1] == prev_line[x1 - 1]; x1--)
+        ;
+
+      if (r != NULL && y - (r->y + r->height) < block_size)
+        {
+          x1 = MAX (x1, r->x + r->width);
+          r->x = MIN (x0, r->x);
+          r->width = x1 - r->x;
+          r->height = y + 1 - r->y;
+        }
+      else
+        {
+          if (n_rects == max_rects)
+            return -1;
+
+          r = &rects[n_rects++];
+          r->x = x0;
+          r->y = y;
+          r->width = x1 - x0;
+          r->height = 1;
+        }
+    }
+
+  return n_rects;
+}
@@ -6,15 +6,81 @@
 
 typedef struct _BroadwayBuffer BroadwayBuffer;
 
+/* Hash table inserts are counted by how many slots they probed, the
+ * last one counts all longer probes */
+#define BROADWAY_BUFFER_N_STATS 5
+
+typedef enum {
+  BROADWAY_SIMD_NONE,
+  BROADWAY_SIMD_SSE2,
+  BROADWAY_SIMD_AVX2
+} BroadwaySimdLevel;
+
+typedef enum {
+  BROADWAY_KERNEL_UNPREMULTIPLY,
+  BROADWAY_KERNEL_HASH_LINE,
+  BROADWAY_KERNEL_BLOCK_HASHES
+} BroadwayKernel;
+
 BroadwayBuffer *broadway_buffer_create     (int             width,
                                             int             height,
                                             guint8         *data,
                                             int             stride);
-void            broadway_buffer_destroy    (BroadwayBuffer *buffer);
+BroadwayBuffer *broadway_buffer_create_for_data (int             width,
+                                                 int             height,
+                                                 guint8         *data,
+                                                 GDestroyNotify  notify,
+                                                 gpointer        user_data);
+BroadwayBuffer *broadway_buffer_copy       (BroadwayBuffer *buffer);
+gboolean        broadway_buffer_is_borrowed (BroadwayBuffer *buffer);
+BroadwayBuffer *broadway_buffer_ref        (BroadwayBuffer *buffer);
+void            broadway_buffer_unref      (BroadwayBuffer *buffer);
 void            broadway_buffer_encode     (BroadwayBuffer *buffer,
                                             BroadwayBuffer *prev,
                                             GString        *dest);
+void            broadway_buffer_encode_rows (BroadwayBuffer *buffer,
+                                             BroadwayBuffer *prev,
+                                             int             y0,
+                                             int             y1,
+                                             GString        *dest);
+void            broadway_buffer_encode_done (BroadwayBuffer *buffer);
+void            broadway_buffer_update_rect (BroadwayBuffer *buffer,
+                                             BroadwayRect   *rect,
+                                             guint8         *data,
+                                             int             stride,
+                                             GString        *dest);
+void            broadway_buffer_encode_rect (BroadwayBuffer *buffer,
+                                             BroadwayBuffer *prev,
+                                             BroadwayRect   *rect,
+                                             GString        *dest);
+void            broadway_buffer_take_blocks (BroadwayBuffer *buffer,
+                                             BroadwayBuffer *from);
+gboolean        broadway_buffer_find_copy  (BroadwayBuffer *buffer,
+                                            BroadwayBuffer *prev,
+                                            BroadwayRect   *area,
+                                            BroadwayRect   *rect,
+                                            int            *dx,
+                                            int            *dy);
+void            broadway_buffer_copy_rect  (BroadwayBuffer *buffer,
+                                            BroadwayRect   *rect,
+                                            int             dx,
+                                            int             dy);
+int             broadway_buffer_get_changed_rects (BroadwayBuffer *buffer,
+                                                   BroadwayBuffer *prev,
+                                                   BroadwayRect   *rects,
+                                                   int             max_rects);
+void            broadway_buffer_get_stats  (BroadwayBuffer *buffer,
+                                            int             stats[BROADWAY_BUFFER_N_STATS],
+                                            int            *clashes);
 int             broadway_buffer_get_width  (BroadwayBuffer *buffer);
 int             broadway_buffer_get_height (BroadwayBuffer *buffer);
 
+BroadwaySimdLevel broadway_buffer_get_simd_level (void);
+void              broadway_buffer_set_simd_level (BroadwaySimdLevel level);
+guint32           broadway_buffer_run_kernel     (BroadwayKernel    kernel,
+                                                  guint8           *data,
+                                                  int               width,
+                                                  int               height,
+                                                  int               stride);
+
 #endif /* __BROADWAY_BUFFER__ */
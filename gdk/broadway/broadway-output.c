@@ -11,25 +11,227 @@
  *                Basic I/O primitives                                  *
  ************************************************************************/
 
-struct BroadwayOutput {
+/* Buffers are encoded by a pool of worker threads, with large ones
+ * split into bands of rows that are encoded in parallel. The encoded
+ * data is then compressed in order by a per-output thread, as all
+ * buffers share one deflate stream. Everything written after a buffer
+ * is held back until it has been compressed, so the client sees the
+ * ops in the order they were made.
+ *
+ * The same bytes go to every viewer, so the cost of a frame doesn't
+ * depend on how many there are. A viewer that joins first gets a
+ * keyframe of its own, compressed separately, recreating the current
+ * state. The shared deflate stream is restarted right after it, so
+ * nothing it sends later refers to data the new viewer never saw.
+ *
+ * Every viewer has its own queue of messages, written asynchronously,
+ * so a slow one holds up neither the others nor the daemon. Only the
+ * viewer in control paces the frames. Another one that gets more than
+ * MAX_VIEWER_BACKLOG behind has the rest of its queue dropped, and
+ * stalls until it is sent a new keyframe.
+ *
+ * At most MAX_FRAMES_IN_FLIGHT buffers are encoded at a time. When the
+ * encoders fall behind, a new frame for a window whose previous frame
+ * has not been started yet replaces it, so stale intermediate frames
+ * are dropped instead of piling up. */
+
+#define MAX_FRAMES_IN_FLIGHT 2
+
+#define MAX_VIEWER_BACKLOG (8 * 1024 * 1024)
+
+/* Band heights are a multiple of this, which is a multiple of the
+ * encoder block size */
+#define ENCODE_BAND_ROWS 128
+
+typedef enum {
+  ENCODE_QUEUED,
+  ENCODE_RUNNING,
+  ENCODE_ENCODED,
+  ENCODE_COMPRESSED
+} EncodeState;
+
+typedef struct {
+  BroadwayOutput *output;
+  GString *head;		/* Data to write before this, including its op */
+  int id;
+  BroadwayBuffer *prev;
+  BroadwayBuffer *buffer;	/* NULL if already encoded when queued */
+  BroadwayViewer *viewer;	/* NULL => every viewer that joined */
+  gboolean join;		/* viewer gets the shared stream after this */
+  EncodeState state;
+  int band_rows;
+  int n_bands;
+  int bands_left;
+  GString **bands;
+  GString *encoded;
+  GString *compressed;
+} EncodeJob;
+
+typedef struct {
+  EncodeJob *job;
+  int band;
+} EncodeBand;
+
+struct BroadwayViewer {
+  int ref_count;
   GOutputStream *out;
+  GZlibCompressor *compressor;	/* For its keyframe */
+  gboolean joined;
+  gboolean closed;
+  gboolean stalled;		/* Fell behind, waits for a keyframe */
+  gboolean failed;		/* Writing failed, it's gone */
+  GQueue writes;		/* Of GBytes, the head is being written */
+  gsize backlog;
+  gboolean writing;
+};
+
+struct BroadwayOutput {
+  GList *viewers;
+  BroadwayViewer *keyframe_viewer; /* Where ops go if not NULL */
   GString *buf;
   int error;
   guint32 serial;
+  int compression_level;
+  GZlibCompressor *compressor;
+
+  GMutex lock;
+  GCond cond;
+  GQueue jobs;
+  GThreadPool *compress_pool;
+  int frames_in_flight;
+  gboolean closing;
+  guint flush_id;
 };
 
+static GThreadPool *encode_pool;
+static int encode_threads;
+
+static void
+encode_job_free (EncodeJob *job)
+{
+  int i;
+
+  if (job->head)
+    g_string_free (job->head, TRUE);
+  if (job->prev)
+    broadway_buffer_unref (job->prev);
+  if (job->buffer)
+    broadway_buffer_unref (job->buffer);
+  if (job->bands)
+    {
+      for (i = 0; i < job->n_bands; i++)
+	if (job->bands[i])
+	  g_string_free (job->bands[i], TRUE);
+      g_free (job->bands);
+    }
+  if (job->encoded)
+    g_string_free (job->encoded, TRUE);
+  if (job->compressed)
+    g_string_free (job->compressed, TRUE);
+  g_free (job);
+}
+
+static BroadwayViewer *
+viewer_ref (BroadwayViewer *viewer)
+{
+  viewer->ref_count++;
+  return viewer;
+}
+
+static void
+viewer_drop_writes (BroadwayViewer *viewer)
+{
+  GBytes *bytes;
+
+  /* The head may be half written already */
+  while (g_queue_get_length (&viewer->writes) > (viewer->writing ? 1 : 0))
+    {
+      bytes = g_queue_pop_tail (&viewer->writes);
+      viewer->backlog -= g_bytes_get_size (bytes);
+      g_bytes_unref (bytes);
+    }
+}
+
+static void
+viewer_unref (BroadwayViewer *viewer)
+{
+  if (--viewer->ref_count > 0)
+    return;
+
+  g_queue_free_full (&viewer->writes, (GDestroyNotify) g_bytes_unref);
+  g_object_unref (viewer->out);
+  g_object_unref (viewer->compressor);
+  g_free (viewer);
+}
+
+static void viewer_write_next (BroadwayViewer *viewer);
+
+static void
+viewer_write_cb (GObject      *source,
+		 GAsyncResult *result,
+		 gpointer      user_data)
+{
+  BroadwayViewer *viewer = user_data;
+  GBytes *bytes;
+  gssize written;
+  gsize size;
+
+  written = g_output_stream_write_bytes_finish (G_OUTPUT_STREAM (source), result, NULL);
+
+  bytes = g_queue_pop_head (&viewer->writes);
+  size = g_bytes_get_size (bytes);
+  viewer->writing = FALSE;
+
+  if (written < 0)
+    {
+      /* The input side notices the connection is gone */
+      viewer->backlog -= size;
+      viewer->failed = TRUE;
+      viewer_drop_writes (viewer);
+    }
+  else
+    {
+      viewer->backlog -= written;
+      if ((gsize) written < size)
+	g_queue_push_head (&viewer->writes,
+			   g_bytes_new_from_bytes (bytes, written, size - written));
+      viewer_write_next (viewer);
+    }
+
+  g_bytes_unref (bytes);
+  viewer_unref (viewer);
+}
+
+static void
+viewer_write_next (BroadwayViewer *viewer)
+{
+  GBytes *bytes;
+
+  bytes = g_queue_peek_head (&viewer->writes);
+  if (bytes == NULL || viewer->writing)
+    return;
+
+  viewer->writing = TRUE;
+  g_output_stream_write_bytes_async (viewer->out, bytes, G_PRIORITY_DEFAULT, NULL,
+				     viewer_write_cb, viewer_ref (viewer));
+}
+
 static void
-broadway_output_send_cmd (BroadwayOutput *output,
+broadway_output_send_cmd (BroadwayViewer *viewer,
 			  gboolean fin, BroadwayWSOpCode code,
 			  const void *buf, gsize count)
 {
   gboolean mask = FALSE;
   guchar header[16];
   size_t p;
+  GByteArray *message;
 
   gboolean mid_header = count > 125 && count <= 65535;
   gboolean long_header = count > 65535;
 
+  if (viewer->closed || viewer->failed)
+    return;
+
   /* NB. big-endian spec => bit 0 == MSB */
   header[0] = ( (fin ? 0x80 : 0) | (code & 0x0f) );
   header[1] = ( (mask ? 0x80 : 0) |
@@ -46,41 +248,498 @@ broadway_output_send_cmd (BroadwayOutput *output,
       p += 8;
     }
   // FIXME: if we are paranoid we should 'mask' the data
-  // FIXME: we should really emit these as a single write
-  g_output_stream_write_all (output->out, header, p, NULL, NULL, NULL);
-  g_output_stream_write_all (output->out, buf, count, NULL, NULL, NULL);
+  message = g_byte_array_sized_new (p + count);
+  g_byte_array_append (message, header, p);
+  g_byte_array_append (message, buf, count);
+
+  viewer->backlog += message->len;
+  g_queue_push_tail (&viewer->writes, g_byte_array_free_to_bytes (message));
+
+  /* Whatever it missed can't be decoded, it needs a fresh start */
+  if (viewer->joined && viewer->backlog > MAX_VIEWER_BACKLOG)
+    {
+      viewer_drop_writes (viewer);
+      viewer->joined = FALSE;
+      viewer->stalled = TRUE;
+    }
+
+  viewer_write_next (viewer);
 }
 
-void broadway_output_pong (BroadwayOutput *output)
+void broadway_output_pong (BroadwayOutput *output,
+			   BroadwayViewer *viewer)
 {
-  broadway_output_send_cmd (output, TRUE, BROADWAY_WS_CNX_PONG, NULL, 0);
+  broadway_output_send_cmd (viewer, TRUE, BROADWAY_WS_CNX_PONG, NULL, 0);
 }
 
+/* Sends data to viewer, or to all that joined if it is NULL, and
+ * frees it */
+static void
+send_data (BroadwayOutput *output,
+	   BroadwayViewer *viewer,
+	   GString        *data)
+{
+  BroadwayViewer *other;
+  GList *l;
+
+  if (data->len > 0)
+    {
+      if (viewer != NULL)
+	{
+	  if (!viewer->closed)
+	    broadway_output_send_cmd (viewer, TRUE, BROADWAY_WS_BINARY,
+				      data->str, data->len);
+	}
+      else
+	{
+	  for (l = output->viewers; l != NULL; l = l->next)
+	    {
+	      other = l->data;
+	      if (other->joined && !other->closed)
+		broadway_output_send_cmd (other, TRUE, BROADWAY_WS_BINARY,
+					  data->str, data->len);
+	    }
+	}
+    }
+
+  g_string_free (data, TRUE);
+}
+
+/* Frees the viewers that went away once no job needs their compressor */
+static void
+prune_viewers (BroadwayOutput *output)
+{
+  BroadwayViewer *viewer;
+  EncodeJob *job;
+  GList *l, *next, *j;
+
+  for (l = output->viewers; l != NULL; l = next)
+    {
+      viewer = l->data;
+      next = l->next;
+
+      if (!viewer->closed)
+	continue;
+
+      g_mutex_lock (&output->lock);
+      for (j = output->jobs.head; j != NULL; j = j->next)
+	{
+	  job = j->data;
+	  if (job->viewer == viewer)
+	    break;
+	}
+      g_mutex_unlock (&output->lock);
+
+      if (j == NULL)
+	{
+	  output->viewers = g_list_delete_link (output->viewers, l);
+	  viewer_unref (viewer);
+	}
+    }
+}
+
+/* Sends everything that is ready, up to the first buffer that is
+ * still being encoded or compressed */
 int
 broadway_output_flush (BroadwayOutput *output)
 {
-  if (output->buf->len == 0)
-    return TRUE;
+  GQueue done = G_QUEUE_INIT;
+  BroadwayViewer *viewer;
+  GString *data;
+  EncodeJob *job;
+  gboolean all_done;
+
+  g_mutex_lock (&output->lock);
+  while ((job = g_queue_peek_head (&output->jobs)) != NULL &&
+	 job->state == ENCODE_COMPRESSED)
+    g_queue_push_tail (&done, g_queue_pop_head (&output->jobs));
+  all_done = g_queue_is_empty (&output->jobs);
+  g_mutex_unlock (&output->lock);
+
+  /* Consecutive jobs for the same viewers go out as one message */
+  data = NULL;
+  viewer = NULL;
+  while ((job = g_queue_pop_head (&done)) != NULL)
+    {
+      if (data != NULL && job->viewer != viewer)
+	{
+	  send_data (output, viewer, data);
+	  data = NULL;
+	}
+
+      if (data == NULL)
+	{
+	  data = job->head;
+	  job->head = NULL;
+	  viewer = job->viewer;
+	}
+      else
+	g_string_append_len (data, job->head->str, job->head->len);
+
+      if (job->compressed)
+	g_string_append_len (data, job->compressed->str, job->compressed->len);
+
+      if (job->join)
+	{
+	  send_data (output, viewer, data);
+	  data = NULL;
+	  job->viewer->joined = TRUE;
+	}
 
-  broadway_output_send_cmd (output, TRUE, BROADWAY_WS_BINARY,
-                            output->buf->str, output->buf->len);
+      encode_job_free (job);
+    }
+
+  if (all_done && output->buf->len > 0)
+    {
+      if (data != NULL && output->keyframe_viewer != viewer)
+	{
+	  send_data (output, viewer, data);
+	  data = NULL;
+	}
+
+      if (data == NULL)
+	{
+	  data = output->buf;
+	  output->buf = g_string_new ("");
+	  viewer = output->keyframe_viewer;
+	}
+      else
+	{
+	  g_string_append_len (data, output->buf->str, output->buf->len);
+	  g_string_set_size (output->buf, 0);
+	}
+    }
 
-  g_string_set_size (output->buf, 0);
+  if (data != NULL)
+    send_data (output, viewer, data);
+
+  prune_viewers (output);
 
   return !output->error;
+}
+
+/* Waits for everything queued to be encoded and compressed, and sends
+ * it. Only for tools that have no main loop to flush from, the writes
+ * are finished by iterating the default main context. */
+int
+broadway_output_sync (BroadwayOutput *output)
+{
+  BroadwayViewer *viewer;
+  EncodeJob *job;
+  GList *l;
+  int res;
+
+  g_mutex_lock (&output->lock);
+  l = output->jobs.head;
+  while (l != NULL)
+    {
+      job = l->data;
+      if (job->state == ENCODE_COMPRESSED)
+	l = l->next;
+      else
+	g_cond_wait (&output->cond, &output->lock);
+    }
+  g_mutex_unlock (&output->lock);
+
+  res = broadway_output_flush (output);
 
+  for (l = output->viewers; l != NULL; l = l->next)
+    {
+      viewer = l->data;
+      while (viewer->writing)
+	g_main_context_iteration (NULL, TRUE);
+    }
+
+  return res;
+}
+
+static gboolean
+flush_idle_cb (gpointer user_data)
+{
+  BroadwayOutput *output = user_data;
+
+  g_mutex_lock (&output->lock);
+  output->flush_id = 0;
+  g_mutex_unlock (&output->lock);
+
+  broadway_output_flush (output);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+job_waits_for_prev (BroadwayOutput *output, GList *link)
+{
+  EncodeJob *job = link->data;
+  EncodeJob *other;
+  GList *l;
+
+  if (job->prev == NULL)
+    return FALSE;
+
+  /* The blocks of prev are hashed while it is encoded */
+  for (l = link->prev; l != NULL; l = l->prev)
+    {
+      other = l->data;
+      if (other->buffer == job->prev && other->state < ENCODE_ENCODED)
+	return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* Called with the lock held. Jobs are started in order, so the
+ * compress thread never waits for one that can't start. */
+static void
+start_jobs (BroadwayOutput *output)
+{
+  EncodeJob *job;
+  EncodeBand *band;
+  GList *l;
+  int i, height;
+
+  for (l = output->jobs.head; l != NULL; l = l->next)
+    {
+      job = l->data;
+      if (job->state != ENCODE_QUEUED)
+	continue;
+
+      if (output->closing ||
+	  output->frames_in_flight >= MAX_FRAMES_IN_FLIGHT ||
+	  job_waits_for_prev (output, l))
+	break;
+
+      height = broadway_buffer_get_height (job->buffer);
+      job->n_bands = MAX (1, MIN (encode_threads, height / (2 * ENCODE_BAND_ROWS)));
+      job->band_rows = (height + job->n_bands - 1) / job->n_bands;
+      job->band_rows = (job->band_rows + ENCODE_BAND_ROWS - 1) / ENCODE_BAND_ROWS * ENCODE_BAND_ROWS;
+      job->n_bands = MAX (1, (height + job->band_rows - 1) / job->band_rows);
+      job->bands_left = job->n_bands;
+      job->bands = g_new0 (GString *, job->n_bands);
+
+      job->state = ENCODE_RUNNING;
+      output->frames_in_flight++;
+
+      for (i = 0; i < job->n_bands; i++)
+	{
+	  band = g_new (EncodeBand, 1);
+	  band->job = job;
+	  band->band = i;
+	  g_thread_pool_push (encode_pool, band, NULL);
+	}
+    }
+}
+
+static void
+encode_band_func (gpointer data, gpointer user_data)
+{
+  EncodeBand *band = data;
+  EncodeJob *job = band->job;
+  BroadwayOutput *output = job->output;
+  GString *encoded;
+  int y0, y1, i;
+
+  y0 = band->band * job->band_rows;
+  y1 = MIN (y0 + job->band_rows, broadway_buffer_get_height (job->buffer));
+
+  encoded = g_string_new ("");
+  broadway_buffer_encode_rows (job->buffer, job->prev, y0, y1, encoded);
+
+  g_mutex_lock (&output->lock);
+
+  job->bands[band->band] = encoded;
+
+  if (--job->bands_left == 0)
+    {
+      broadway_buffer_encode_done (job->buffer);
+
+      job->encoded = job->bands[0];
+      job->bands[0] = NULL;
+      for (i = 1; i < job->n_bands; i++)
+	g_string_append_len (job->encoded, job->bands[i]->str, job->bands[i]->len);
+
+      job->state = ENCODE_ENCODED;
+      start_jobs (output);
+      g_cond_broadcast (&output->cond);
+    }
+
+  g_mutex_unlock (&output->lock);
+
+  g_free (band);
+}
+
+/* Appends the length prefixed compressed form of encoded to dest. The
+ * stream is sync flushed at the end, which byte-aligns it and makes all
+ * the data available to the client without terminating the stream. */
+static void
+compress_buffer (GZlibCompressor *compressor,
+                 GString         *encoded,
+                 GString         *dest)
+{
+  GConverterResult res;
+  GError *error = NULL;
+  gsize len_pos, start, in_pos, avail, bytes_read, bytes_written;
+  guint8 *buf;
+
+  len_pos = dest->len;
+  g_string_set_size (dest, len_pos + 4); /* Filled in below */
+  start = dest->len;
+
+  in_pos = 0;
+  do
+    {
+      gsize old_len = dest->len;
+
+      /* Enough for incompressible data plus the flush marker */
+      avail = (encoded->len - in_pos) + ((encoded->len - in_pos) >> 10) + 64;
+      g_string_set_size (dest, old_len + avail);
+
+      res = g_converter_convert (G_CONVERTER (compressor),
+                                 encoded->str + in_pos, encoded->len - in_pos,
+                                 dest->str + old_len, avail,
+                                 G_CONVERTER_FLUSH,
+                                 &bytes_read, &bytes_written, &error);
+      if (res == G_CONVERTER_ERROR)
+        {
+          bytes_read = bytes_written = 0;
+
+          /* zlib refuses to flush twice in a row if the previous
+           * flush happened to fill the output exactly */
+          if (!(in_pos == encoded->len &&
+                g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE)))
+            g_warning ("compression failed: %s\n", error->message);
+
+          g_clear_error (&error);
+          g_string_set_size (dest, old_len);
+          break;
+        }
+
+      g_string_set_size (dest, old_len + bytes_written);
+      in_pos += bytes_read;
+    }
+  while (res != G_CONVERTER_FLUSHED &&
+         (in_pos < encoded->len || bytes_written == avail));
+
+  buf = (guint8 *)dest->str + len_pos;
+  buf[0] = ((dest->len - start) >> 0) & 0xff;
+  buf[1] = ((dest->len - start) >> 8) & 0xff;
+  buf[2] = ((dest->len - start) >> 16) & 0xff;
+  buf[3] = ((dest->len - start) >> 24) & 0xff;
+}
+
+static void
+compress_func (gpointer data, gpointer user_data)
+{
+  EncodeJob *job = data;
+  BroadwayOutput *output = user_data;
+
+  g_mutex_lock (&output->lock);
+  while (job->state < ENCODE_ENCODED &&
+	 !(output->closing && job->state == ENCODE_QUEUED))
+    g_cond_wait (&output->cond, &output->lock);
+  g_mutex_unlock (&output->lock);
+
+  /* Never started, the connection is going away */
+  if (job->state != ENCODE_ENCODED)
+    return;
+
+  if (job->encoded)
+    {
+      job->compressed = g_string_new ("");
+      compress_buffer (job->viewer ? job->viewer->compressor : output->compressor,
+		       job->encoded, job->compressed);
+    }
+
+  /* Everyone that joined, including the new viewer, can decode a fresh
+   * stream after what they have got so far */
+  if (job->join)
+    {
+      g_object_unref (output->compressor);
+      output->compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW,
+						  output->compression_level);
+    }
+
+  g_mutex_lock (&output->lock);
+
+  job->state = ENCODE_COMPRESSED;
+  if (job->buffer != NULL)
+    output->frames_in_flight--;
+  start_jobs (output);
+  g_cond_broadcast (&output->cond);
+
+  if (output->flush_id == 0 && !output->closing)
+    output->flush_id = g_idle_add (flush_idle_cb, output);
+
+  g_mutex_unlock (&output->lock);
+}
+
+static void
+queue_job (BroadwayOutput *output, EncodeJob *job)
+{
+  job->output = output;
+  job->viewer = output->keyframe_viewer;
+  job->head = output->buf;
+  output->buf = g_string_new ("");
+
+  g_mutex_lock (&output->lock);
+  g_queue_push_tail (&output->jobs, job);
+  start_jobs (output);
+  g_mutex_unlock (&output->lock);
+
+  g_thread_pool_push (output->compress_pool, job, NULL);
+}
+
+/* Whether buffer is still being read by a job, so it must not be
+ * changed yet */
+gboolean
+broadway_output_is_encoding (BroadwayOutput *output,
+			     BroadwayBuffer *buffer)
+{
+  EncodeJob *job;
+  GList *l;
+  gboolean res = FALSE;
+
+  g_mutex_lock (&output->lock);
+  for (l = output->jobs.head; l != NULL && !res; l = l->next)
+    {
+      job = l->data;
+      res = job->state < ENCODE_ENCODED &&
+	(job->buffer == buffer || job->prev == buffer);
+    }
+  g_mutex_unlock (&output->lock);
+
+  return res;
 }
 
 BroadwayOutput *
-broadway_output_new (GOutputStream *out, guint32 serial)
+broadway_output_new (guint32 serial,
+		     int     compression_level)
 {
   BroadwayOutput *output;
 
   output = g_new0 (BroadwayOutput, 1);
 
-  output->out = g_object_ref (out);
   output->buf = g_string_new ("");
   output->serial = serial;
+  output->compression_level = compression_level;
+
+  if (encode_pool == NULL)
+    {
+      encode_threads = g_get_num_processors ();
+      encode_pool = g_thread_pool_new (encode_band_func, NULL,
+				       encode_threads, FALSE, NULL);
+    }
+
+  g_mutex_init (&output->lock);
+  g_cond_init (&output->cond);
+  g_queue_init (&output->jobs);
+  output->compress_pool = g_thread_pool_new (compress_func, output,
+					     1, FALSE, NULL);
+
+  /* All buffers sent share a single deflate stream, so later frames
+   * can reference data from earlier ones. */
+  output->compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW,
+					      compression_level);
 
   return output;
 }
@@ -88,10 +747,125 @@ broadway_output_new (GOutputStream *out, guint32 serial)
 void
 broadway_output_free (BroadwayOutput *output)
 {
-  g_object_unref (output->out);
+  EncodeJob *job;
+
+  /* Let the jobs that are running finish, and drop the rest */
+  g_mutex_lock (&output->lock);
+  output->closing = TRUE;
+  g_cond_broadcast (&output->cond);
+  g_mutex_unlock (&output->lock);
+
+  g_thread_pool_free (output->compress_pool, FALSE, TRUE);
+
+  if (output->flush_id != 0)
+    g_source_remove (output->flush_id);
+
+  broadway_output_flush (output);
+
+  while ((job = g_queue_pop_head (&output->jobs)) != NULL)
+    encode_job_free (job);
+
+  g_mutex_clear (&output->lock);
+  g_cond_clear (&output->cond);
+  g_string_free (output->buf, TRUE);
+  g_list_free_full (output->viewers, (GDestroyNotify) viewer_unref);
+  g_object_unref (output->compressor);
   free (output);
 }
 
+/* The viewer gets nothing until it is sent a keyframe */
+BroadwayViewer *
+broadway_output_add_viewer (BroadwayOutput *output,
+			    GOutputStream  *out)
+{
+  BroadwayViewer *viewer;
+
+  viewer = g_new0 (BroadwayViewer, 1);
+  viewer->ref_count = 1;
+  viewer->out = g_object_ref (out);
+  viewer->compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW,
+					      output->compression_level);
+
+  output->viewers = g_list_append (output->viewers, viewer);
+
+  return viewer;
+}
+
+void
+broadway_output_remove_viewer (BroadwayOutput *output,
+			       BroadwayViewer *viewer)
+{
+  viewer->closed = TRUE;
+  prune_viewers (output);
+}
+
+/* Whether viewer fell behind and needs a new keyframe */
+gboolean
+broadway_output_viewer_is_stalled (BroadwayOutput *output,
+				   BroadwayViewer *viewer)
+{
+  return viewer->stalled && !viewer->closed && !viewer->failed;
+}
+
+int
+broadway_output_get_n_viewers (BroadwayOutput *output)
+{
+  BroadwayViewer *viewer;
+  GList *l;
+  int n = 0;
+
+  for (l = output->viewers; l != NULL; l = l->next)
+    {
+      viewer = l->data;
+      if (!viewer->closed)
+	n++;
+    }
+
+  return n;
+}
+
+/* Everything written until broadway_output_end_keyframe() only goes to
+ * viewer, which then starts getting what everyone gets */
+void
+broadway_output_begin_keyframe (BroadwayOutput *output,
+				BroadwayViewer *viewer)
+{
+  EncodeJob *job;
+
+  g_return_if_fail (output->keyframe_viewer == NULL);
+
+  if (output->buf->len > 0)
+    {
+      job = g_new0 (EncodeJob, 1);
+      job->state = ENCODE_ENCODED;
+      queue_job (output, job);
+    }
+
+  /* A viewer that stalled has lost some of the data its keyframe
+   * compressor refers to */
+  g_object_unref (viewer->compressor);
+  viewer->compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW,
+					      output->compression_level);
+  viewer->stalled = FALSE;
+
+  output->keyframe_viewer = viewer;
+}
+
+void
+broadway_output_end_keyframe (BroadwayOutput *output)
+{
+  EncodeJob *job;
+
+  g_return_if_fail (output->keyframe_viewer != NULL);
+
+  job = g_new0 (EncodeJob, 1);
+  job->join = TRUE;
+  job->state = ENCODE_ENCODED;
+  queue_job (output, job);
+
+  output->keyframe_viewer = NULL;
+}
+
 guint32
 broadway_output_get_next_serial (BroadwayOutput *output)
 {
@@ -158,7 +932,13 @@ static void
 write_header(BroadwayOutput *output, char op)
 {
   append_char (output, op);
-  append_uint32 (output, output->serial++);
+
+  /* Keyframe ops are only seen by one viewer, so they don't take a
+   * serial that the others would never ack */
+  if (output->keyframe_viewer != NULL)
+    append_uint32 (output, output->serial - 1);
+  else
+    append_uint32 (output, output->serial++);
 }
 
 void
@@ -202,6 +982,13 @@ broadway_output_disconnected (BroadwayOutput *output)
   write_header (output, BROADWAY_OP_DISCONNECTED);
 }
 
+/* Starts a keyframe, dropping whatever the viewer has */
+void
+broadway_output_reset (BroadwayOutput *output)
+{
+  write_header (output, BROADWAY_OP_RESET);
+}
+
 void
 broadway_output_show_surface(BroadwayOutput *output,  int id)
 {
@@ -286,47 +1073,147 @@ broadway_output_set_transient_for (BroadwayOutput *output,
   append_uint16 (output, parent_id);
 }
 
+/* Replaces the buffer of the last frame queued for the window if it
+ * has not been started yet, as the client never needs to see it */
+static gboolean
+replace_queued_frame (BroadwayOutput *output,
+                      int             id,
+                      BroadwayBuffer *prev_buffer,
+                      BroadwayBuffer *buffer)
+{
+  EncodeJob *job;
+  GList *l;
+  gboolean replaced = FALSE;
+
+  if (prev_buffer == NULL)
+    return FALSE;
+
+  g_mutex_lock (&output->lock);
+  for (l = output->jobs.tail; l != NULL; l = l->prev)
+    {
+      job = l->data;
+
+      /* A viewer that joined since never gets the older frame */
+      if (job->join)
+        break;
+
+      if (job->id != id || job->buffer == NULL ||
+          job->viewer != output->keyframe_viewer)
+        continue;
+
+      if (job->state == ENCODE_QUEUED &&
+          job->buffer == prev_buffer &&
+          broadway_buffer_get_width (buffer) == broadway_buffer_get_width (prev_buffer) &&
+          broadway_buffer_get_height (buffer) == broadway_buffer_get_height (prev_buffer))
+        {
+          broadway_buffer_unref (job->buffer);
+          job->buffer = broadway_buffer_ref (buffer);
+          replaced = TRUE;
+        }
+      break;
+    }
+  g_mutex_unlock (&output->lock);
+
+  return replaced;
+}
+
 void
 broadway_output_put_buffer (BroadwayOutput *output,
                             int             id,
                             BroadwayBuffer *prev_buffer,
                             BroadwayBuffer *buffer)
 {
-  gsize len;
-  int w, h;
-  GZlibCompressor *compressor;
-  GOutputStream *out, *out_mem;
-  GString *encoded;
+  EncodeJob *job;
+
+  if (replace_queued_frame (output, id, prev_buffer, buffer))
+    return;
 
   write_header (output, BROADWAY_OP_PUT_BUFFER);
 
-  w = broadway_buffer_get_width (buffer);
-  h = broadway_buffer_get_height (buffer);
+  append_uint16 (output, id);
+  append_uint16 (output, broadway_buffer_get_width (buffer));
+  append_uint16 (output, broadway_buffer_get_height (buffer));
+
+  job = g_new0 (EncodeJob, 1);
+  job->id = id;
+  job->prev = prev_buffer ? broadway_buffer_ref (prev_buffer) : NULL;
+  job->buffer = broadway_buffer_ref (buffer);
+  job->state = ENCODE_QUEUED;
+
+  queue_job (output, job);
+}
+
+void
+broadway_output_put_buffer_rect (BroadwayOutput *output,
+                                 int             id,
+                                 BroadwayRect   *rect,
+                                 BroadwayBuffer *buffer,
+                                 guint8         *data,
+                                 int             stride)
+{
+  EncodeJob *job;
+
+  write_header (output, BROADWAY_OP_PUT_BUFFER_RECT);
 
   append_uint16 (output, id);
-  append_uint16 (output, w);
-  append_uint16 (output, h);
+  append_uint16 (output, rect->x);
+  append_uint16 (output, rect->y);
+  append_uint16 (output, rect->width);
+  append_uint16 (output, rect->height);
 
-  encoded = g_string_new ("");
-  broadway_buffer_encode (buffer, prev_buffer, encoded);
+  /* Small enough to encode right away, but it still has to be
+   * compressed in order with the buffers before it */
+  job = g_new0 (EncodeJob, 1);
+  job->id = id;
+  job->encoded = g_string_new ("");
+  broadway_buffer_update_rect (buffer, rect, data, stride, job->encoded);
+  job->state = ENCODE_ENCODED;
 
-  compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW, -1);
-  out_mem = g_memory_output_stream_new_resizable ();
-  out = g_converter_output_stream_new (out_mem, G_CONVERTER (compressor));
-  g_object_unref (compressor);
+  queue_job (output, job);
+}
 
-  if (!g_output_stream_write_all (out, encoded->str, encoded->len,
-                                  NULL, NULL, NULL) ||
-      !g_output_stream_close (out, NULL, NULL))
-    g_warning ("compression failed\n");
+/* Like broadway_output_put_buffer_rect(), for when buffer already has
+ * the new pixels and prev, which is left alone, the old ones */
+void
+broadway_output_put_buffer_rect_delta (BroadwayOutput *output,
+                                       int             id,
+                                       BroadwayRect   *rect,
+                                       BroadwayBuffer *prev_buffer,
+                                       BroadwayBuffer *buffer)
+{
+  EncodeJob *job;
+
+  write_header (output, BROADWAY_OP_PUT_BUFFER_RECT);
+
+  append_uint16 (output, id);
+  append_uint16 (output, rect->x);
+  append_uint16 (output, rect->y);
+  append_uint16 (output, rect->width);
+  append_uint16 (output, rect->height);
 
+  job = g_new0 (EncodeJob, 1);
+  job->id = id;
+  job->encoded = g_string_new ("");
+  broadway_buffer_encode_rect (buffer, prev_buffer, rect, job->encoded);
+  job->state = ENCODE_ENCODED;
 
-  len = g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (out_mem));
-  append_uint32 (output, len);
+  queue_job (output, job);
+}
 
-  g_string_append_len (output->buf, g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (out_mem)), len);
+void
+broadway_output_copy_rectangle (BroadwayOutput *output,
+                                int             id,
+                                BroadwayRect   *rect,
+                                int             dx,
+                                int             dy)
+{
+  write_header (output, BROADWAY_OP_COPY_RECTANGLE);
 
-  g_string_free (encoded, TRUE);
-  g_object_unref (out);
-  g_object_unref (out_mem);
+  append_uint16 (output, id);
+  append_uint16 (output, rect->x);
+  append_uint16 (output, rect->y);
+  append_uint16 (output, rect->width);
+  append_uint16 (output, rect->height);
+  append_uint16 (output, dx);
+  append_uint16 (output, dy);
 }
@@ -7,6 +7,7 @@
 #include "broadway-buffer.h"
 
 typedef struct BroadwayOutput BroadwayOutput;
+typedef struct BroadwayViewer BroadwayViewer;
 
 typedef enum {
   BROADWAY_WS_CONTINUATION = 0,
@@ -17,10 +18,21 @@ typedef enum {
   BROADWAY_WS_CNX_PONG = 0xa
 } BroadwayWSOpCode;
 
-BroadwayOutput *broadway_output_new             (GOutputStream  *out,
-						 guint32         serial);
+BroadwayOutput *broadway_output_new             (guint32         serial,
+						 int             compression_level);
 void            broadway_output_free            (BroadwayOutput *output);
+BroadwayViewer *broadway_output_add_viewer      (BroadwayOutput *output,
+						 GOutputStream  *out);
+void            broadway_output_remove_viewer   (BroadwayOutput *output,
+						 BroadwayViewer *viewer);
+gboolean        broadway_output_viewer_is_stalled (BroadwayOutput *output,
+						   BroadwayViewer *viewer);
+int             broadway_output_get_n_viewers   (BroadwayOutput *output);
+void            broadway_output_begin_keyframe  (BroadwayOutput *output,
+						 BroadwayViewer *viewer);
+void            broadway_output_end_keyframe    (BroadwayOutput *output);
 int             broadway_output_flush           (BroadwayOutput *output);
+int             broadway_output_sync            (BroadwayOutput *output);
 int             broadway_output_has_error       (BroadwayOutput *output);
 void            broadway_output_set_next_serial (BroadwayOutput *output,
 						 guint32         serial);
@@ -33,6 +45,7 @@ void            broadway_output_new_surface     (BroadwayOutput *output,
 						 int             h,
 						 gboolean        is_temp);
 void            broadway_output_disconnected    (BroadwayOutput *output);
+void            broadway_output_reset           (BroadwayOutput *output);
 void            broadway_output_show_surface    (BroadwayOutput *output,
 						 int             id);
 void            broadway_output_hide_surface    (BroadwayOutput *output,
@@ -58,11 +71,30 @@ void            broadway_output_put_buffer      (BroadwayOutput *output,
 						 int             id,
                                                  BroadwayBuffer *prev_buffer,
                                                  BroadwayBuffer *buffer);
+gboolean        broadway_output_is_encoding     (BroadwayOutput *output,
+						 BroadwayBuffer *buffer);
+void            broadway_output_put_buffer_rect (BroadwayOutput *output,
+						 int             id,
+						 BroadwayRect   *rect,
+						 BroadwayBuffer *buffer,
+						 guint8         *data,
+						 int             stride);
+void            broadway_output_put_buffer_rect_delta (BroadwayOutput *output,
+						       int             id,
+						       BroadwayRect   *rect,
+						       BroadwayBuffer *prev_buffer,
+						       BroadwayBuffer *buffer);
+void            broadway_output_copy_rectangle  (BroadwayOutput *output,
+						 int             id,
+						 BroadwayRect   *rect,
+						 int             dx,
+						 int             dy);
 void            broadway_output_grab_pointer    (BroadwayOutput *output,
 						 int id,
 						 gboolean owner_event);
 guint32         broadway_output_ungrab_pointer  (BroadwayOutput *output);
-void            broadway_output_pong            (BroadwayOutput *output);
+void            broadway_output_pong            (BroadwayOutput *output,
+						 BroadwayViewer *viewer);
 void            broadway_output_set_show_keyboard (BroadwayOutput *output,
                                                    gboolean show);
 
@@ -23,7 +23,10 @@ typedef enum {
   BROADWAY_EVENT_CONFIGURE_NOTIFY = 'w',
   BROADWAY_EVENT_DELETE_NOTIFY = 'W',
   BROADWAY_EVENT_SCREEN_SIZE_CHANGED = 'd',
-  BROADWAY_EVENT_FOCUS = 'f'
+  BROADWAY_EVENT_FOCUS = 'f',
+  BROADWAY_EVENT_ACK = 'a',
+  BROADWAY_EVENT_FRAME_DONE = 'F',
+  BROADWAY_EVENT_RELEASE_SURFACE = 'r'
 } BroadwayEventType;
 
 typedef enum {
@@ -42,7 +45,10 @@ typedef enum {
   BROADWAY_OP_AUTH_OK = 'L',
   BROADWAY_OP_DISCONNECTED = 'D',
   BROADWAY_OP_PUT_BUFFER = 'b',
+  BROADWAY_OP_PUT_BUFFER_RECT = 'B',
+  BROADWAY_OP_COPY_RECTANGLE = 'c',
   BROADWAY_OP_SET_SHOW_KEYBOARD = 'k',
+  BROADWAY_OP_RESET = 'X',
 } BroadwayOpType;
 
 typedef struct {
@@ -75,6 +81,7 @@ typedef struct {
 typedef struct {
   BroadwayInputPointerMsg pointer;
   gint32 dir;
+  guint32 n_steps; /* > 1 if the daemon merged several scroll events */
 } BroadwayInputScrollMsg;
 
 typedef struct {
@@ -128,6 +135,21 @@ typedef struct {
   gint32 old_id;
 } BroadwayInputFocusMsg;
 
+/* Sent to the owner of a window once the browser has shown its last
+ * update. The browser acks with BROADWAY_EVENT_ACK, which only carries
+ * the serial of the last op it painted. */
+typedef struct {
+  BroadwayInputBaseMsg base;
+  gint32 id;
+} BroadwayInputFrameDoneMsg;
+
+/* The surface sent in an update may be drawn into again */
+typedef struct {
+  BroadwayInputBaseMsg base;
+  gint32 id;
+  char name[36];
+} BroadwayInputReleaseSurfaceMsg;
+
 typedef union {
   BroadwayInputBaseMsg base;
   BroadwayInputPointerMsg pointer;
@@ -141,6 +163,8 @@ typedef union {
   BroadwayInputDeleteNotify delete_notify;
   BroadwayInputScreenResizeNotify screen_resize_notify;
   BroadwayInputFocusMsg focus;
+  BroadwayInputFrameDoneMsg frame_done;
+  BroadwayInputReleaseSurfaceMsg release_surface;
 } BroadwayInputMsg;
 
 typedef enum {
@@ -186,12 +210,17 @@ typedef struct {
   BroadwayRect rects[1];
 } BroadwayRequestTranslate;
 
+/* Damage with more rectangles than this is sent as its extents */
+#define BROADWAY_MAX_UPDATE_RECTS 16
+
 typedef struct {
   BroadwayRequestBase base;
   guint32 id;
   char name[36];
   guint32 width;
   guint32 height;
+  guint32 n_rects; /* 0 => the whole surface changed */
+  BroadwayRect rects[1];
 } BroadwayRequestUpdate;
 
 typedef struct {
@@ -256,7 +285,8 @@ typedef enum {
   BROADWAY_REPLY_QUERY_MOUSE,
   BROADWAY_REPLY_NEW_WINDOW,
   BROADWAY_REPLY_GRAB_POINTER,
-  BROADWAY_REPLY_UNGRAB_POINTER
+  BROADWAY_REPLY_UNGRAB_POINTER,
+  BROADWAY_REPLY_EVENTS
 } BroadwayReplyType;
 
 typedef struct {
@@ -288,9 +318,20 @@ typedef struct {
   BroadwayInputMsg msg;
 } BroadwayReplyEvent;
 
+/* Events that the daemon handled in one go are sent as a single reply,
+ * trimmed to n_events messages */
+#define BROADWAY_MAX_BATCHED_EVENTS 32
+
+typedef struct {
+  BroadwayReplyBase base;
+  guint32 n_events;
+  BroadwayInputMsg msgs[BROADWAY_MAX_BATCHED_EVENTS];
+} BroadwayReplyEvents;
+
 typedef union {
   BroadwayReplyBase base;
   BroadwayReplyEvent event;
+  BroadwayReplyEvents events;
   BroadwayReplyQueryMouse query_mouse;
   BroadwayReplyNewWindow new_window;
   BroadwayReplyGrabPointer grab_pointer;
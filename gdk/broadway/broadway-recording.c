@@ -0,0 +1,297 @@
+#include "config.h"
+
+#include "broadway-recording.h"
+
+#include <gio/gio.h>
+#include <string.h>
+
+/* Frames are copied and queued for a thread that compresses and writes
+ * them, as the recorder runs on the main loop of broadwayd. If the
+ * thread falls more than MAX_RECORDER_BACKLOG behind, adding a frame
+ * waits rather than dropping it, which would make the damage of the
+ * next one wrong. */
+#define MAX_RECORDER_BACKLOG (64 * 1024 * 1024)
+
+struct BroadwayRecorder {
+  GOutputStream *out;
+  gint64 start_time;
+
+  GThread *thread;
+  GMutex lock;
+  GCond cond;
+  GQueue frames; /* Of GBytes, NULL ends the recording */
+  gsize backlog;
+  gboolean stopped; /* After an error */
+};
+
+struct BroadwayPlayer {
+  GInputStream *in;
+  guint8 *data;
+  gsize data_size;
+};
+
+static gpointer
+recorder_thread_func (gpointer data)
+{
+  BroadwayRecorder *recorder = data;
+  GError *error = NULL;
+  GBytes *frame;
+  gsize size;
+
+  while (TRUE)
+    {
+      g_mutex_lock (&recorder->lock);
+      while (g_queue_is_empty (&recorder->frames))
+        g_cond_wait (&recorder->cond, &recorder->lock);
+      frame = g_queue_pop_head (&recorder->frames);
+      g_mutex_unlock (&recorder->lock);
+
+      if (frame == NULL)
+        break;
+
+      size = g_bytes_get_size (frame);
+
+      /* Keep the file readable up to the last frame if broadwayd is killed */
+      if (error == NULL &&
+          (!g_output_stream_write_all (recorder->out, g_bytes_get_data (frame, NULL), size,
+                                       NULL, NULL, &error) ||
+           !g_output_stream_flush (recorder->out, NULL, &error)))
+        g_warning ("Stopped recording: %s", error->message);
+
+      g_bytes_unref (frame);
+
+      g_mutex_lock (&recorder->lock);
+      recorder->backlog -= size;
+      if (error != NULL)
+        recorder->stopped = TRUE;
+      g_cond_broadcast (&recorder->cond);
+      g_mutex_unlock (&recorder->lock);
+    }
+
+  g_clear_error (&error);
+
+  return NULL;
+}
+
+BroadwayRecorder *
+broadway_recorder_new (const char  *filename,
+                       GError     **error)
+{
+  BroadwayRecorder *recorder;
+  GFileOutputStream *file_out;
+  GZlibCompressor *compressor;
+  GFile *file;
+
+  file = g_file_new_for_path (filename);
+  file_out = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, error);
+  g_object_unref (file);
+  if (file_out == NULL)
+    return NULL;
+
+  /* Fast rather than small */
+  compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, 1);
+
+  recorder = g_new0 (BroadwayRecorder, 1);
+  recorder->out = g_converter_output_stream_new (G_OUTPUT_STREAM (file_out),
+                                                 G_CONVERTER (compressor));
+  recorder->start_time = g_get_monotonic_time ();
+  g_object_unref (compressor);
+  g_object_unref (file_out);
+
+  if (!g_output_stream_write_all (recorder->out, BROADWAY_RECORDING_MAGIC,
+                                  strlen (BROADWAY_RECORDING_MAGIC),
+                                  NULL, NULL, error))
+    {
+      broadway_recorder_free (recorder);
+      return NULL;
+    }
+
+  g_mutex_init (&recorder->lock);
+  g_cond_init (&recorder->cond);
+  g_queue_init (&recorder->frames);
+  recorder->thread = g_thread_new ("broadway-recorder", recorder_thread_func, recorder);
+
+  return recorder;
+}
+
+/* Waits for the queued frames to be written */
+void
+broadway_recorder_free (BroadwayRecorder *recorder)
+{
+  if (recorder->thread != NULL)
+    {
+      g_mutex_lock (&recorder->lock);
+      g_queue_push_tail (&recorder->frames, NULL);
+      g_cond_broadcast (&recorder->cond);
+      g_mutex_unlock (&recorder->lock);
+
+      g_thread_join (recorder->thread);
+      g_mutex_clear (&recorder->lock);
+      g_cond_clear (&recorder->cond);
+    }
+
+  g_output_stream_close (recorder->out, NULL, NULL);
+  g_object_unref (recorder->out);
+  g_free (recorder);
+}
+
+void
+broadway_recorder_add_frame (BroadwayRecorder *recorder,
+                             int               id,
+                             int               width,
+                             int               height,
+                             guint8           *data,
+                             int               stride,
+                             BroadwayRect     *rects,
+                             int               n_rects)
+{
+  BroadwayRecordedFrameHeader header;
+  GByteArray *frame;
+  gboolean stopped;
+  gsize size;
+  int y;
+
+  g_mutex_lock (&recorder->lock);
+  while (!recorder->stopped && recorder->backlog > MAX_RECORDER_BACKLOG)
+    g_cond_wait (&recorder->cond, &recorder->lock);
+  stopped = recorder->stopped;
+  g_mutex_unlock (&recorder->lock);
+
+  /* Stopped after an earlier error */
+  if (stopped)
+    return;
+
+  header.id = id;
+  header.width = width;
+  header.height = height;
+  header.n_rects = n_rects;
+  header.time = g_get_monotonic_time () - recorder->start_time;
+
+  size = sizeof header + n_rects * sizeof (BroadwayRect) + (gsize) width * height * 4;
+  frame = g_byte_array_sized_new (size);
+  g_byte_array_append (frame, (guint8 *) &header, sizeof header);
+  g_byte_array_append (frame, (guint8 *) rects, n_rects * sizeof (BroadwayRect));
+  for (y = 0; y < height; y++)
+    g_byte_array_append (frame, data + y * stride, width * 4);
+
+  g_mutex_lock (&recorder->lock);
+  recorder->backlog += size;
+  g_queue_push_tail (&recorder->frames, g_byte_array_free_to_bytes (frame));
+  g_cond_broadcast (&recorder->cond);
+  g_mutex_unlock (&recorder->lock);
+}
+
+BroadwayPlayer *
+broadway_player_new (const char  *filename,
+                     GError     **error)
+{
+  BroadwayPlayer *player;
+  GFileInputStream *file_in;
+  GZlibDecompressor *decompressor;
+  char magic[sizeof BROADWAY_RECORDING_MAGIC - 1];
+  gsize bytes_read;
+  GFile *file;
+
+  file = g_file_new_for_path (filename);
+  file_in = g_file_read (file, NULL, error);
+  g_object_unref (file);
+  if (file_in == NULL)
+    return NULL;
+
+  decompressor = g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+
+  player = g_new0 (BroadwayPlayer, 1);
+  player->in = g_converter_input_stream_new (G_INPUT_STREAM (file_in),
+                                             G_CONVERTER (decompressor));
+  g_object_unref (decompressor);
+  g_object_unref (file_in);
+
+  if (!g_input_stream_read_all (player->in, magic, sizeof magic, &bytes_read, NULL, error))
+    {
+      broadway_player_free (player);
+      return NULL;
+    }
+
+  if (bytes_read != sizeof magic ||
+      memcmp (magic, BROADWAY_RECORDING_MAGIC, sizeof magic) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "%s is not a broadway recording", filename);
+      broadway_player_free (player);
+      return NULL;
+    }
+
+  return player;
+}
+
+void
+broadway_player_free (BroadwayPlayer *player)
+{
+  g_object_unref (player->in);
+  g_free (player->data);
+  g_free (player);
+}
+
+static gboolean
+read_exactly (BroadwayPlayer  *player,
+              void            *buffer,
+              gsize            size,
+              GError         **error)
+{
+  GError *local_error = NULL;
+  gsize bytes_read;
+
+  if (!g_input_stream_read_all (player->in, buffer, size, &bytes_read, NULL, &local_error))
+    {
+      /* The recording was cut short, e.g. when broadwayd was killed,
+       * everything before that is still fine */
+      if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT))
+        g_error_free (local_error);
+      else
+        g_propagate_error (error, local_error);
+      return FALSE;
+    }
+
+  return bytes_read == size;
+}
+
+/* Reads the next update into @frame, whose data is owned by @player and
+ * only valid until the next call. Returns FALSE at the end of the
+ * recording, or with @error set if it could not be read. */
+gboolean
+broadway_player_next_frame (BroadwayPlayer         *player,
+                            BroadwayRecordedFrame  *frame,
+                            GError                **error)
+{
+  BroadwayRecordedFrameHeader *header = &frame->header;
+  gsize size;
+
+  if (!read_exactly (player, header, sizeof *header, error))
+    return FALSE;
+
+  if (header->n_rects > BROADWAY_MAX_UPDATE_RECTS ||
+      header->width > G_MAXUINT16 || header->height > G_MAXUINT16)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Invalid frame in broadway recording");
+      return FALSE;
+    }
+
+  if (!read_exactly (player, frame->rects, header->n_rects * sizeof (BroadwayRect), error))
+    return FALSE;
+
+  size = (gsize) header->width * header->height * 4;
+  if (size > player->data_size)
+    {
+      g_free (player->data);
+      player->data = g_malloc (size);
+      player->data_size = size;
+    }
+
+  if (!read_exactly (player, player->data, size, error))
+    return FALSE;
+
+  frame->data = player->data;
+
+  return TRUE;
+}
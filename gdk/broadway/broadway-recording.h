@@ -0,0 +1,53 @@
+#ifndef __BROADWAY_RECORDING__
+#define __BROADWAY_RECORDING__
+
+#include "broadway-protocol.h"
+#include <glib.h>
+
+/* A recording of the window contents broadwayd got from its clients,
+ * for replaying them offline through the encoder.
+ *
+ * It is a gzip stream of BROADWAY_RECORDING_MAGIC followed by, for each
+ * update, a BroadwayRecordedFrameHeader, n_rects BroadwayRects and
+ * height rows of width premultiplied ARGB32 pixels. All in host byte
+ * order, recordings are not meant to move between machines.
+ */
+#define BROADWAY_RECORDING_MAGIC "BRWYREC1"
+
+typedef struct {
+  guint32 id;
+  guint32 width;
+  guint32 height;
+  guint32 n_rects; /* 0 => the whole surface changed */
+  gint64 time; /* Microseconds since the recording started */
+} BroadwayRecordedFrameHeader;
+
+typedef struct {
+  BroadwayRecordedFrameHeader header;
+  BroadwayRect rects[BROADWAY_MAX_UPDATE_RECTS];
+  guint8 *data; /* stride is width * 4 */
+} BroadwayRecordedFrame;
+
+typedef struct BroadwayRecorder BroadwayRecorder;
+typedef struct BroadwayPlayer BroadwayPlayer;
+
+BroadwayRecorder *broadway_recorder_new       (const char             *filename,
+                                               GError                **error);
+void              broadway_recorder_free      (BroadwayRecorder       *recorder);
+void              broadway_recorder_add_frame (BroadwayRecorder       *recorder,
+                                               int                     id,
+                                               int                     width,
+                                               int                     height,
+                                               guint8                 *data,
+                                               int                     stride,
+                                               BroadwayRect           *rects,
+                                               int                     n_rects);
+
+BroadwayPlayer   *broadway_player_new         (const char             *filename,
+                                               GError                **error);
+void              broadway_player_free        (BroadwayPlayer         *player);
+gboolean          broadway_player_next_frame  (BroadwayPlayer         *player,
+                                               BroadwayRecordedFrame  *frame,
+                                               GError                **error);
+
+#endif /* __BROADWAY_RECORDING__ */
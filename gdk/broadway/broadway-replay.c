@@ -0,0 +1,403 @@
+/* Replays a recording made with broadwayd --record
+ *
+ * Every recorded update is encoded on its own against the previous
+ * contents of its window, to time the encoder and collect its hash
+ * table statistics, and then once more through a BroadwayOutput like
+ * broadwayd does, small damage included, to see what actually goes
+ * over the wire. Reports the results in a form that is easy to track
+ * over time, and fails if they are past the given thresholds.
+ *
+ * --synthesize writes a recording of a scrolling and blinking window
+ * instead, which make check replays.
+ */
+
+#include "config.h"
+
+#include "broadway-buffer.h"
+#include "broadway-output.h"
+#include "broadway-recording.h"
+
+#include <stdlib.h>
+
+static int compression_level = -1;
+static gboolean per_frame = FALSE;
+static gboolean synthesize = FALSE;
+static double max_output_ratio = 0;
+static double max_encoded_ratio = 0;
+
+typedef struct {
+  guint64 n_frames;
+  guint64 n_pixels;
+  gint64 encode_time;
+  guint64 encoded_bytes;
+  guint64 stats[BROADWAY_BUFFER_N_STATS];
+  guint64 clashes;
+  gint64 output_time;
+  guint64 output_bytes;
+  guint64 n_partial;
+} ReplayStats;
+
+static BroadwayPlayer *
+open_recording (const char *filename)
+{
+  BroadwayPlayer *player;
+  GError *error = NULL;
+
+  player = broadway_player_new (filename, &error);
+  if (player == NULL)
+    {
+      g_printerr ("%s\n", error->message);
+      exit (1);
+    }
+
+  return player;
+}
+
+static void
+check_error (GError *error)
+{
+  if (error != NULL)
+    {
+      g_printerr ("%s\n", error->message);
+      exit (1);
+    }
+}
+
+static void
+replay_encoder (const char  *filename,
+                ReplayStats *stats)
+{
+  BroadwayRecordedFrame frame;
+  BroadwayPlayer *player;
+  BroadwayBuffer *buffer, *prev;
+  GHashTable *windows;
+  GError *error = NULL;
+  int buffer_stats[BROADWAY_BUFFER_N_STATS];
+  int clashes, i;
+  GString *out;
+  gint64 start, time;
+
+  player = open_recording (filename);
+  windows = g_hash_table_new_full (NULL, NULL, NULL,
+                                   (GDestroyNotify) broadway_buffer_unref);
+  out = g_string_new ("");
+
+  while (broadway_player_next_frame (player, &frame, &error))
+    {
+      prev = g_hash_table_lookup (windows, GUINT_TO_POINTER (frame.header.id));
+
+      g_string_set_size (out, 0);
+      start = g_get_monotonic_time ();
+      buffer = broadway_buffer_create (frame.header.width, frame.header.height,
+                                       frame.data, frame.header.width * 4);
+      broadway_buffer_encode (buffer, prev, out);
+      time = g_get_monotonic_time () - start;
+
+      broadway_buffer_get_stats (buffer, buffer_stats, &clashes);
+      for (i = 0; i < BROADWAY_BUFFER_N_STATS; i++)
+        stats->stats[i] += buffer_stats[i];
+      stats->clashes += clashes;
+
+      stats->n_frames++;
+      stats->n_pixels += frame.header.width * frame.header.height;
+      stats->encode_time += time;
+      stats->encoded_bytes += out->len;
+
+      if (per_frame)
+        g_print ("frame %" G_GUINT64_FORMAT ": window %u %ux%u, %" G_GSIZE_FORMAT " bytes, %" G_GINT64_FORMAT " µs, %d clashes\n",
+                 stats->n_frames, frame.header.id, frame.header.width, frame.header.height,
+                 out->len, time, clashes);
+
+      g_hash_table_replace (windows, GUINT_TO_POINTER (frame.header.id), buffer);
+    }
+  check_error (error);
+
+  g_string_free (out, TRUE);
+  g_hash_table_unref (windows);
+  broadway_player_free (player);
+}
+
+/* Whether broadwayd would send just the damage, which then has to be
+ * clipped to the window like it does */
+static gboolean
+is_small_damage (BroadwayRecordedFrame *frame,
+                 BroadwayBuffer        *prev)
+{
+  BroadwayRect *r;
+  gint64 area = 0;
+  int i, n, x1, y1;
+
+  if (frame->header.n_rects == 0 || prev == NULL ||
+      broadway_buffer_get_width (prev) != (int) frame->header.width ||
+      broadway_buffer_get_height (prev) != (int) frame->header.height)
+    return FALSE;
+
+  n = 0;
+  for (i = 0; i < (int) frame->header.n_rects; i++)
+    {
+      r = &frame->rects[i];
+      x1 = MIN (r->x + r->width, (int) frame->header.width);
+      y1 = MIN (r->y + r->height, (int) frame->header.height);
+      r->x = MAX (r->x, 0);
+      r->y = MAX (r->y, 0);
+      r->width = x1 - r->x;
+      r->height = y1 - r->y;
+      if (r->width <= 0 || r->height <= 0)
+        continue;
+
+      area += (gint64) r->width * r->height;
+      frame->rects[n++] = *r;
+    }
+  frame->header.n_rects = n;
+
+  return n > 0 && area * 2 <= (gint64) frame->header.width * frame->header.height;
+}
+
+static void
+replay_output (const char  *filename,
+               ReplayStats *stats)
+{
+  BroadwayRecordedFrame frame;
+  BroadwayPlayer *player;
+  BroadwayOutput *output;
+  BroadwayViewer *viewer;
+  BroadwayBuffer *buffer, *prev;
+  GOutputStream *out;
+  GHashTable *windows;
+  GError *error = NULL;
+  gint64 start;
+  int i;
+
+  player = open_recording (filename);
+  windows = g_hash_table_new_full (NULL, NULL, NULL,
+                                   (GDestroyNotify) broadway_buffer_unref);
+
+  out = g_memory_output_stream_new_resizable ();
+  output = broadway_output_new (1, compression_level);
+  viewer = broadway_output_add_viewer (output, out);
+  broadway_output_begin_keyframe (output, viewer);
+  broadway_output_end_keyframe (output);
+  broadway_output_sync (output);
+
+  while (broadway_player_next_frame (player, &frame, &error))
+    {
+      prev = g_hash_table_lookup (windows, GUINT_TO_POINTER (frame.header.id));
+
+      if (prev == NULL)
+        broadway_output_new_surface (output, frame.header.id, 0, 0,
+                                     frame.header.width, frame.header.height, FALSE);
+      else if (broadway_buffer_get_width (prev) != (int) frame.header.width ||
+               broadway_buffer_get_height (prev) != (int) frame.header.height)
+        broadway_output_move_resize_surface (output, frame.header.id, FALSE, 0, 0,
+                                             TRUE, frame.header.width, frame.header.height);
+
+      /* Only count this frame, not the ops above */
+      broadway_output_sync (output);
+      g_seekable_seek (G_SEEKABLE (out), 0, G_SEEK_SET, NULL, NULL);
+      g_seekable_truncate (G_SEEKABLE (out), 0, NULL, NULL);
+
+      start = g_get_monotonic_time ();
+      if (is_small_damage (&frame, prev))
+        {
+          /* Like broadwayd, write the damage into our copy of the window */
+          buffer = broadway_buffer_copy (prev);
+          for (i = 0; i < (int) frame.header.n_rects; i++)
+            broadway_output_put_buffer_rect (output, frame.header.id,
+                                             &frame.rects[i], buffer,
+                                             frame.data, frame.header.width * 4);
+          stats->n_partial++;
+        }
+      else
+        {
+          buffer = broadway_buffer_create (frame.header.width, frame.header.height,
+                                           frame.data, frame.header.width * 4);
+          broadway_output_put_buffer (output, frame.header.id, prev, buffer);
+        }
+      broadway_output_sync (output);
+      stats->output_time += g_get_monotonic_time () - start;
+
+      stats->output_bytes += g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (out));
+      g_seekable_seek (G_SEEKABLE (out), 0, G_SEEK_SET, NULL, NULL);
+      g_seekable_truncate (G_SEEKABLE (out), 0, NULL, NULL);
+
+      g_hash_table_replace (windows, GUINT_TO_POINTER (frame.header.id), buffer);
+    }
+  check_error (error);
+
+  broadway_output_free (output);
+  g_object_unref (out);
+  g_hash_table_unref (windows);
+  broadway_player_free (player);
+}
+
+#define SYNTH_WIDTH 800
+#define SYNTH_HEIGHT 600
+#define SYNTH_HEADER 40
+#define SYNTH_FRAMES 60
+
+/* A header bar over lines of text-like glyphs, scrolled by 8 rows on
+ * even frames, with a cursor blinking below on odd ones */
+static void
+fill_synthetic_frame (guint32 *data,
+                      int      frame)
+{
+  guint32 glyph;
+  int x, y, line, sy;
+
+  for (y = 0; y < SYNTH_HEIGHT; y++)
+    for (x = 0; x < SYNTH_WIDTH; x++)
+      {
+        guint32 *p = &data[y * SYNTH_WIDTH + x];
+
+        if (y < SYNTH_HEADER)
+          {
+            *p = 0xff303038 + (y << 16) + (y << 8) + y;
+            continue;
+          }
+
+        sy = y + (frame / 2) * 8;
+        line = sy / 20;
+        glyph = (line * 2654435761u) ^ ((x / 8) * 40503u);
+        glyph ^= glyph >> 13;
+
+        if (line % 4 != 3 && x % 8 < 6 && sy % 20 < 12 && x < SYNTH_WIDTH - 100 &&
+            (glyph >> ((sy % 20) * 2 + x % 8 % 2)) & 1)
+          *p = 0xff202020;
+        else
+          *p = 0xffffffff;
+      }
+
+  if (frame % 4 == 1)
+    for (y = SYNTH_HEIGHT - 40; y < SYNTH_HEIGHT - 24; y++)
+      for (x = 100; x < 102; x++)
+        data[y * SYNTH_WIDTH + x] = 0xff000000;
+}
+
+static void
+write_synthetic_recording (const char *filename)
+{
+  BroadwayRecorder *recorder;
+  BroadwayRect rect;
+  GError *error = NULL;
+  guint32 *data;
+  int frame;
+
+  recorder = broadway_recorder_new (filename, &error);
+  check_error (error);
+
+  data = g_new (guint32, SYNTH_WIDTH * SYNTH_HEIGHT);
+
+  for (frame = 0; frame < SYNTH_FRAMES; frame++)
+    {
+      fill_synthetic_frame (data, frame);
+
+      if (frame % 2 == 0)
+        {
+          rect.x = 0;
+          rect.y = SYNTH_HEADER;
+          rect.width = SYNTH_WIDTH;
+          rect.height = SYNTH_HEIGHT - SYNTH_HEADER;
+        }
+      else
+        {
+          rect.x = 100;
+          rect.y = SYNTH_HEIGHT - 40;
+          rect.width = 2;
+          rect.height = 16;
+        }
+
+      broadway_recorder_add_frame (recorder, 1, SYNTH_WIDTH, SYNTH_HEIGHT,
+                                   (guint8 *) data, SYNTH_WIDTH * 4,
+                                   &rect, frame == 0 ? 0 : 1);
+    }
+
+  broadway_recorder_free (recorder);
+  g_free (data);
+}
+
+/* Prints one line per threshold, returns FALSE if value is past it */
+static gboolean
+check_threshold (const char *name,
+                 double      value,
+                 double      max)
+{
+  if (max <= 0)
+    return TRUE;
+
+  g_print ("threshold %s: %.4f <= %.4f %s\n", name, value, max,
+           value <= max ? "ok" : "FAILED");
+
+  return value <= max;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  ReplayStats stats = { 0 };
+  guint64 n, raw_bytes;
+  gboolean ok;
+  int i;
+  const GOptionEntry entries[] = {
+    { "compression-level", 'z', 0, G_OPTION_ARG_INT, &compression_level, "Deflate level, like broadwayd", "LEVEL" },
+    { "per-frame", 'v', 0, G_OPTION_ARG_NONE, &per_frame, "Print the encoder results for every frame", NULL },
+    { "max-output-ratio", 0, 0, G_OPTION_ARG_DOUBLE, &max_output_ratio, "Fail if the output is more than this part of the raw pixels", "RATIO" },
+    { "max-encoded-ratio", 0, 0, G_OPTION_ARG_DOUBLE, &max_encoded_ratio, "Fail if the encoded data is more than this part of the raw pixels", "RATIO" },
+    { "synthesize", 0, 0, G_OPTION_ARG_NONE, &synthesize, "Write a synthetic recording to RECORDING instead", NULL },
+    { NULL }
+  };
+
+  context = g_option_context_new ("RECORDING - replay window updates recorded by broadwayd");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("option parsing failed: %s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (argc != 2)
+    {
+      g_printerr ("Usage: broadway-replay [OPTION…] RECORDING\n");
+      return 1;
+    }
+
+  if (compression_level < -1 || compression_level > 9)
+    {
+      g_printerr ("Invalid compression level %d\n", compression_level);
+      return 1;
+    }
+
+  if (synthesize)
+    {
+      write_synthetic_recording (argv[1]);
+      return 0;
+    }
+
+  replay_encoder (argv[1], &stats);
+  replay_output (argv[1], &stats);
+
+  n = MAX (stats.n_frames, 1);
+
+  g_print ("frames: %" G_GUINT64_FORMAT "\n", stats.n_frames);
+  g_print ("partial updates: %" G_GUINT64_FORMAT "\n", stats.n_partial);
+  g_print ("pixels/frame: %" G_GUINT64_FORMAT "\n", stats.n_pixels / n);
+  g_print ("encode µs/frame: %" G_GINT64_FORMAT "\n", stats.encode_time / (gint64) n);
+  g_print ("encoded bytes/frame: %" G_GUINT64_FORMAT "\n", stats.encoded_bytes / n);
+  g_print ("output µs/frame: %" G_GINT64_FORMAT "\n", stats.output_time / (gint64) n);
+  g_print ("output bytes/frame: %" G_GUINT64_FORMAT "\n", stats.output_bytes / n);
+  g_print ("compression ratio: %.3f\n",
+           stats.encoded_bytes ? (double) stats.output_bytes / stats.encoded_bytes : 0.0);
+  g_print ("hash clashes: %" G_GUINT64_FORMAT "\n", stats.clashes);
+  g_print ("hash probes:");
+  for (i = 0; i < BROADWAY_BUFFER_N_STATS; i++)
+    g_print ("%c%" G_GUINT64_FORMAT, i == 0 ? ' ' : '/', stats.stats[i]);
+  g_print ("\n");
+
+  raw_bytes = MAX (stats.n_pixels * 4, 1);
+  ok = check_threshold ("output-ratio", (double) stats.output_bytes / raw_bytes, max_output_ratio);
+  ok &= check_threshold ("encoded-ratio", (double) stats.encoded_bytes / raw_bytes, max_encoded_ratio);
+
+  return ok ? 0 : 1;
+}
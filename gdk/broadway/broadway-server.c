@@ -3,6 +3,7 @@
 #include "broadway-server.h"
 
 #include "broadway-output.h"
+#include "broadway-recording.h"
 
 #define _XOPEN_SOURCE /* for crypt */
 
@@ -44,12 +45,22 @@ struct _BroadwayServer {
   int port;
   GSocketService *service;
   BroadwayOutput *output;
+  int compression_level;
+  int max_unacked_frames; /* 0 => no limit */
+  GQueue unacked_frames; /* Last serial of each frame the browser hasn't painted */
+  guint32 acked_serial;
+  gboolean frame_dirty; /* Window updates were sent since the last flush */
   guint32 id_counter;
   guint32 saved_serial;
   guint64 last_seen_time;
-  BroadwayInput *input;
+  GList *inputs; /* Of every viewer, oldest first */
+  BroadwayInput *input; /* Of the viewer in control, the others just watch */
   GList *input_messages;
   guint process_input_idle;
+  guint held_input_timeout; /* Lets held input through without a frame done */
+  guint64 n_input_events; /* Received from the browser */
+  guint64 n_merged_events; /* Of those, merged into an earlier one */
+  BroadwayRecorder *recorder;
 
   GHashTable *id_ht;
   GList *toplevels;
@@ -92,7 +103,7 @@ typedef struct HttpRequest {
 
 struct BroadwayInput {
   BroadwayServer *server;
-  BroadwayOutput *output;
+  BroadwayViewer *viewer;
   GSocketConnection *connection;
   GByteArray *buffer;
   GSource *source;
@@ -103,6 +114,7 @@ struct BroadwayInput {
 
 struct BroadwayWindow {
   gint32 id;
+  gint32 client_id; /* The owner */
   gint32 x;
   gint32 y;
   gint32 width;
@@ -114,11 +126,23 @@ struct BroadwayWindow {
   BroadwayBuffer *buffer;
   gboolean buffer_synced;
 
-  char *cached_surface_name;
-  cairo_surface_t *cached_surface;
+  /* The owner waits for a BROADWAY_EVENT_FRAME_DONE after each update */
+  gboolean frame_pending;
+  guint32 frame_serial;
+
+  /* An update held back while the browser is too far behind */
+  cairo_surface_t *pending_surface; /* Lent, see window_release_surface() */
+  BroadwayRect pending_rects[BROADWAY_MAX_UPDATE_RECTS];
+  int n_pending_rects; /* 0 => the whole surface */
+
+  /* The owner alternates between two surfaces, most recent first */
+  cairo_surface_t *cached_surfaces[2];
 };
 
 static void broadway_server_resync_windows (BroadwayServer *server);
+static void broadway_server_reset_frames (BroadwayServer *server);
+static void process_ack (BroadwayServer *server, guint32 serial);
+static void window_release_surface (BroadwayServer *server, gint32 client_id, gint32 id, cairo_surface_t *surface);
 
 G_DEFINE_TYPE (BroadwayServer, broadway_server, G_TYPE_OBJECT)
 
@@ -133,6 +157,9 @@ broadway_server_init (BroadwayServer *server)
   server->last_seen_time = 1;
   server->id_ht = g_hash_table_new (NULL, NULL);
   server->id_counter = 0;
+  server->compression_level = -1;
+  server->max_unacked_frames = BROADWAY_DEFAULT_MAX_UNACKED_FRAMES;
+  g_queue_init (&server->unacked_frames);
 
   root = g_new0 (BroadwayWindow, 1);
   root->id = server->id_counter++;
@@ -153,6 +180,11 @@ broadway_server_finalize (GObject *object)
   BroadwayServer *server = BROADWAY_SERVER (object);
 
   g_free (server->address);
+  g_queue_clear (&server->unacked_frames);
+  if (server->recorder)
+    broadway_recorder_free (server->recorder);
+  if (server->held_input_timeout != 0)
+    g_source_remove (server->held_input_timeout);
 
   G_OBJECT_CLASS (broadway_server_parent_class)->finalize (object);
 }
@@ -320,6 +352,12 @@ process_input_message (BroadwayServer *server,
 {
   gint32 client;
 
+  if (message->base.type == BROADWAY_EVENT_ACK)
+    {
+      process_ack (server, message->base.serial);
+      return;
+    }
+
   update_event_state (server, message);
   client = -1;
   if (is_pointer_event (message) &&
@@ -329,12 +367,119 @@ process_input_message (BroadwayServer *server,
   broadway_events_got_input (message, client);
 }
 
+static gboolean
+is_mergeable_event (BroadwayInputMsg *message)
+{
+  return
+    message->base.type == BROADWAY_EVENT_POINTER_MOVE ||
+    message->base.type == BROADWAY_EVENT_SCROLL ||
+    (message->base.type == BROADWAY_EVENT_TOUCH &&
+     message->touch.touch_type == 1);
+}
+
+static guint32
+get_event_window_id (BroadwayInputMsg *message)
+{
+  if (message->base.type == BROADWAY_EVENT_TOUCH)
+    return message->touch.event_window_id;
+
+  return message->pointer.event_window_id;
+}
+
+/* Folds @message into @last if the client would only care about the
+ * later of the two, e.g. consecutive motion over the same window */
+static gboolean
+merge_input_message (BroadwayInputMsg *last,
+		     BroadwayInputMsg *message)
+{
+  guint32 n_steps;
+
+  if (last->base.type != message->base.type ||
+      !is_mergeable_event (last) || !is_mergeable_event (message))
+    return FALSE;
+
+  switch (message->base.type)
+    {
+    case BROADWAY_EVENT_POINTER_MOVE:
+      if (last->pointer.mouse_window_id != message->pointer.mouse_window_id ||
+	  last->pointer.event_window_id != message->pointer.event_window_id ||
+	  last->pointer.state != message->pointer.state)
+	return FALSE;
+      *last = *message;
+      return TRUE;
+
+    case BROADWAY_EVENT_SCROLL:
+      if (last->pointer.event_window_id != message->pointer.event_window_id ||
+	  last->pointer.state != message->pointer.state ||
+	  last->scroll.dir != message->scroll.dir)
+	return FALSE;
+      n_steps = last->scroll.n_steps + message->scroll.n_steps;
+      *last = *message;
+      last->scroll.n_steps = n_steps;
+      return TRUE;
+
+    case BROADWAY_EVENT_TOUCH:
+      if (last->touch.event_window_id != message->touch.event_window_id ||
+	  last->touch.sequence_id != message->touch.sequence_id ||
+	  last->touch.is_emulated != message->touch.is_emulated ||
+	  last->touch.state != message->touch.state)
+	return FALSE;
+      *last = *message;
+      return TRUE;
+
+    default:
+      return FALSE;
+    }
+}
+
+/* Motion, scroll and touch updates at the end of the queue are held back
+ * while the owner of their window is still busy with the last frame, so
+ * more of them can be merged before the next frame clock tick. Anything
+ * else arriving behind them, like the ack that ends the frame, lets them
+ * through in order. So does a timeout, for when the frame doesn't end. */
+#define MAX_INPUT_HOLD_MS 50
+
+static gboolean
+should_hold_input_message (BroadwayServer   *server,
+			   GList            *link)
+{
+  BroadwayInputMsg *message = link->data;
+  BroadwayWindow *window;
+
+  if (link->next != NULL || !is_mergeable_event (message))
+    return FALSE;
+
+  window = g_hash_table_lookup (server->id_ht,
+				GINT_TO_POINTER (get_event_window_id (message)));
+
+  return window != NULL && window->frame_pending;
+}
+
+static void process_input_messages_full (BroadwayServer *server,
+					 gboolean        release_held);
+
+static gboolean
+held_input_timeout_cb (gpointer user_data)
+{
+  BroadwayServer *server = user_data;
+
+  server->held_input_timeout = 0;
+  process_input_messages_full (server, TRUE);
+
+  return G_SOURCE_REMOVE;
+}
+
 static void
-process_input_messages (BroadwayServer *server)
+process_input_messages_full (BroadwayServer *server,
+			     gboolean        release_held)
 {
   BroadwayInputMsg *message;
 
-  while (server->input_messages)
+  broadway_events_begin_batch ();
+
+  while (server->input_messages &&
+	 (release_held ||
+	  !should_hold_input_message (server, server->input_messages)))
     {
       message = server->input_messages->data;
       server->input_messages =
@@ -352,6 +497,26 @@ process_input_messages (BroadwayServer *server)
       process_input_message (server, message);
       g_free (message);
     }
+
+  broadway_events_end_batch ();
+
+  if (server->input_messages != NULL)
+    {
+      if (server->held_input_timeout == 0)
+	server->held_input_timeout =
+	  g_timeout_add (MAX_INPUT_HOLD_MS, held_input_timeout_cb, server);
+    }
+  else if (server->held_input_timeout != 0)
+    {
+      g_source_remove (server->held_input_timeout);
+      server->held_input_timeout = 0;
+    }
+}
+
+static void
+process_input_messages (BroadwayServer *server)
+{
+  process_input_messages_full (server, FALSE);
 }
 
 static void
@@ -416,9 +581,14 @@ parse_input_message (BroadwayInput *input, const unsigned char *message)
 {
   BroadwayServer *server = input->server;
   BroadwayInputMsg msg;
+  GList *last;
   guint32 *p;
   gint64 time_;
 
+  /* Observers can't interact, and the output isn't paced to them */
+  if (input != server->input)
+    return;
+
   memset (&msg, 0, sizeof (msg));
 
   p = (guint32 *) message;
@@ -468,6 +638,7 @@ parse_input_message (BroadwayInput *input, const unsigned char *message)
     p = parse_pointer_data (p, &msg.pointer);
     update_future_pointer_info (server, &msg.pointer);
     msg.scroll.dir = ntohl (*p++);
+    msg.scroll.n_steps = 1;
     break;
 
   case BROADWAY_EVENT_TOUCH:
@@ -503,13 +674,24 @@ parse_input_message (BroadwayInput *input, const unsigned char *message)
     msg.screen_resize_notify.height = ntohl (*p++);
     break;
 
+  case BROADWAY_EVENT_ACK:
+    break;
+
   default:
     g_printerr ("parse_input_message - Unknown input command %c (%s)\n", msg.base.type, message);
     break;
   }
 
-  server->input_messages = g_list_append (server->input_messages, g_memdup (&msg, sizeof (msg)));
+  server->n_input_events++;
 
+  last = g_list_last (server->input_messages);
+  if (last != NULL && merge_input_message (last->data, &msg))
+    {
+      server->n_merged_events++;
+      return;
+    }
+
+  server->input_messages = g_list_append (server->input_messages, g_memdup (&msg, sizeof (msg)));
 }
 
 static inline void
@@ -619,7 +801,8 @@ parse_input (BroadwayInput *input)
           }
         break;
       case BROADWAY_WS_CNX_PING:
-        broadway_output_pong (input->output);
+        if (input->server->output != NULL && input->viewer != NULL)
+          broadway_output_pong (input->server->output, input->viewer);
         break;
       case BROADWAY_WS_CNX_PONG:
         break; /* we never send pings, but tolerate pongs */
@@ -653,6 +836,41 @@ queue_process_input_at_idle (BroadwayServer *server)
       g_idle_add_full (G_PRIORITY_DEFAULT, (GSourceFunc)process_input_idle_cb, server, NULL);
 }
 
+static gboolean
+input_free_idle_cb (gpointer user_data)
+{
+  broadway_input_free (user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+broadway_server_remove_input (BroadwayServer *server,
+			      BroadwayInput  *input)
+{
+  server->inputs = g_list_remove (server->inputs, input);
+
+  if (server->output != NULL && input->viewer != NULL)
+    broadway_output_remove_viewer (server->output, input->viewer);
+
+  if (server->input == input)
+    {
+      /* The viewer that has been watching the longest takes over. It has
+       * seen the same serials, so pacing carries on with its acks. */
+      server->input = server->inputs != NULL ? server->inputs->data : NULL;
+    }
+
+  if (server->inputs == NULL && server->output != NULL)
+    {
+      server->saved_serial = broadway_output_get_next_serial (server->output);
+      broadway_output_free (server->output);
+      server->output = NULL;
+      broadway_server_reset_frames (server);
+    }
+
+  broadway_input_free (input);
+}
+
 static void
 broadway_server_read_all_input_nonblocking (BroadwayInput *input)
 {
@@ -679,9 +897,7 @@ broadway_server_read_all_input_nonblocking (BroadwayInput *input)
 	  return;
 	}
 
-      if (input->server->input == input)
-	input->server->input = NULL;
-      broadway_input_free (input);
+      broadway_server_remove_input (input->server, input);
       if (res < 0)
 	{
 	  g_printerr ("input error %s\n", error->message);
@@ -740,15 +956,105 @@ broadway_server_get_screen_size (BroadwayServer   *server,
 }
 
 
+static gboolean
+serial_is_after (guint32 serial, guint32 other)
+{
+  return (gint32) (serial - other) > 0;
+}
+
+/* Brings the viewer of input up to date with a keyframe, after which it
+ * gets the frames encoded for everyone */
+static void
+send_keyframe (BroadwayServer *server,
+	       BroadwayInput  *input)
+{
+  broadway_output_begin_keyframe (server->output, input->viewer);
+
+  broadway_output_reset (server->output);
+  broadway_server_resync_windows (server);
+
+  if (server->pointer_grab_window_id != -1)
+    broadway_output_grab_pointer (server->output,
+				  server->pointer_grab_window_id,
+				  server->pointer_grab_owner_events);
+
+  broadway_output_end_keyframe (server->output);
+}
+
+static void
+resync_stalled_viewers (BroadwayServer *server)
+{
+  BroadwayInput *input, *other;
+  GList *l, *o;
+
+  for (l = server->inputs; l != NULL; l = l->next)
+    {
+      input = l->data;
+      if (input->viewer == NULL ||
+	  !broadway_output_viewer_is_stalled (server->output, input->viewer))
+	continue;
+
+      /* Most likely a connection that died without us noticing, like
+       * the one of a browser that reconnected since. Give control to a
+       * viewer that keeps up, if there is one. */
+      if (input == server->input)
+	{
+	  for (o = server->inputs; o != NULL; o = o->next)
+	    {
+	      other = o->data;
+	      if (other != input && other->viewer != NULL &&
+		  !broadway_output_viewer_is_stalled (server->output, other->viewer))
+		{
+		  server->input = other;
+		  break;
+		}
+	    }
+	}
+
+      send_keyframe (server, input);
+    }
+}
+
 void
 broadway_server_flush (BroadwayServer *server)
 {
+  guint32 serial;
+
+  if (server->output && server->frame_dirty)
+    {
+      /* Everything up to here is one frame for the browser */
+      serial = broadway_output_get_next_serial (server->output) - 1;
+      if (serial_is_after (serial, server->acked_serial) &&
+	  (g_queue_is_empty (&server->unacked_frames) ||
+	   serial_is_after (serial, GPOINTER_TO_UINT (g_queue_peek_tail (&server->unacked_frames)))))
+	g_queue_push_tail (&server->unacked_frames, GUINT_TO_POINTER (serial));
+      server->frame_dirty = FALSE;
+    }
+
+  if (server->output)
+    resync_stalled_viewers (server);
+
   if (server->output &&
       !broadway_output_flush (server->output))
     {
+      BroadwayInput *input;
+
       server->saved_serial = broadway_output_get_next_serial (server->output);
       broadway_output_free (server->output);
       server->output = NULL;
+      broadway_server_reset_frames (server);
+
+      /* Their viewers are gone with the output. We may be called while
+       * one of them is read from, so they are freed later. */
+      while (server->inputs != NULL)
+	{
+	  input = server->inputs->data;
+	  server->inputs = g_list_delete_link (server->inputs, server->inputs);
+	  input->viewer = NULL;
+	  g_source_destroy (input->source);
+	  g_idle_add (input_free_idle_cb, input);
+	}
+      server->input = NULL;
     }
 }
 
@@ -1030,9 +1336,6 @@ start_input (HttpRequest *request)
   input->buffer = g_byte_array_sized_new (data_buffer_size);
   g_byte_array_append (input->buffer, data_buffer, data_buffer_size);
 
-  input->output =
-    broadway_output_new (g_io_stream_get_output_stream (G_IO_STREAM (request->connection)), 0);
-
   /* This will free and close the data input stream, but we got all the buffered content already */
   http_request_free (request);
 
@@ -1058,36 +1361,25 @@ start (BroadwayInput *input)
 
   server = BROADWAY_SERVER (input->server);
 
-  if (server->output)
-    {
-      broadway_output_disconnected (server->output);
-      broadway_output_flush (server->output);
-    }
-
-  if (server->input != NULL)
-    {
-      broadway_input_free (server->input);
-      server->input = NULL;
-    }
-
-  server->input = input;
+  /* The first viewer is in control, later ones join as observers */
+  server->inputs = g_list_append (server->inputs, input);
+  if (server->input == NULL)
+    server->input = input;
 
-  if (server->output)
+  if (server->output == NULL)
     {
-      server->saved_serial = broadway_output_get_next_serial (server->output);
-      broadway_output_free (server->output);
+      server->output = broadway_output_new (server->saved_serial,
+					    server->compression_level);
+      broadway_server_reset_frames (server);
     }
-  server->output = input->output;
-
-  broadway_output_set_next_serial (server->output, server->saved_serial);
-  broadway_output_flush (server->output);
 
-  broadway_server_resync_windows (server);
+  input->viewer =
+    broadway_output_add_viewer (server->output,
+				g_io_stream_get_output_stream (G_IO_STREAM (input->connection)));
 
-  if (server->pointer_grab_window_id != -1)
-    broadway_output_grab_pointer (server->output,
-				  server->pointer_grab_window_id,
-				  server->pointer_grab_owner_events);
+  /* Everyone else just carries on with the frames encoded for all */
+  send_keyframe (server, input);
+  broadway_server_flush (server);
 
   process_input_messages (server);
 }
@@ -1273,6 +1565,41 @@ broadway_server_new (char *address, int port, GError **error)
   return server;
 }
 
+/* Applies to clients connecting after this, -1 is the zlib default */
+void
+broadway_server_set_compression_level (BroadwayServer *server,
+				       int             level)
+{
+  g_return_if_fail (level >= -1 && level <= 9);
+
+  server->compression_level = level;
+}
+
+/* How many frames the browser may have left to paint before window
+ * updates are held back and merged, 0 for no limit */
+void
+broadway_server_set_max_unacked_frames (BroadwayServer *server,
+					int             frames)
+{
+  g_return_if_fail (frames >= 0);
+
+  server->max_unacked_frames = frames;
+}
+
+/* Saves the contents of every window update to @filename, see
+ * broadway-replay for playing them back */
+gboolean
+broadway_server_start_recording (BroadwayServer  *server,
+				 const char      *filename,
+				 GError         **error)
+{
+  g_return_val_if_fail (server->recorder == NULL, FALSE);
+
+  server->recorder = broadway_recorder_new (filename, error);
+
+  return server->recorder != NULL;
+}
+
 guint32
 broadway_server_get_last_seen_time (BroadwayServer *server)
 {
@@ -1280,6 +1607,17 @@ broadway_server_get_last_seen_time (BroadwayServer *server)
   return (guint32) server->last_seen_time;
 }
 
+void
+broadway_server_get_input_stats (BroadwayServer *server,
+				 guint64        *n_events,
+				 guint64        *n_merged)
+{
+  if (n_events)
+    *n_events = server->n_input_events;
+  if (n_merged)
+    *n_merged = server->n_merged_events;
+}
+
 void
 broadway_server_query_mouse (BroadwayServer *server,
 			     guint32            *toplevel,
@@ -1317,6 +1655,7 @@ broadway_server_destroy_window (BroadwayServer *server,
 				gint id)
 {
   BroadwayWindow *window;
+  guint i;
 
   if (server->mouse_in_toplevel_id == id)
     {
@@ -1339,10 +1678,13 @@ broadway_server_destroy_window (BroadwayServer *server,
       g_hash_table_remove (server->id_ht,
 			   GINT_TO_POINTER (id));
 
-      if (window->cached_surface_name != NULL)
-	g_free (window->cached_surface_name);
-      if (window->cached_surface != NULL)
-	cairo_surface_destroy (window->cached_surface);
+      for (i = 0; i < G_N_ELEMENTS (window->cached_surfaces); i++)
+	if (window->cached_surfaces[i] != NULL)
+	  cairo_surface_destroy (window->cached_surfaces[i]);
+      if (window->buffer != NULL)
+	broadway_buffer_unref (window->buffer);
+      if (window->pending_surface != NULL)
+	window_release_surface (server, window->client_id, window->id, window->pending_surface);
 
       g_free (window);
     }
@@ -1477,40 +1819,564 @@ broadway_server_has_client (BroadwayServer *server)
   return server->output != NULL;
 }
 
+static const cairo_user_data_key_t shm_cairo_key;
+
+typedef struct {
+  char name[36];
+  void *data;
+  gsize data_size;
+} ShmSurfaceData;
+
+/* The owner doesn't draw into a surface it sent in an update until we
+ * give it back, so its contents can be encoded without a copy */
+static void
+window_release_surface (BroadwayServer *server,
+			gint32 client_id,
+			gint32 id,
+			cairo_surface_t *surface)
+{
+  BroadwayInputMsg ev = { {0} };
+  ShmSurfaceData *data;
+
+  data = cairo_surface_get_user_data (surface, &shm_cairo_key);
+
+  ev.base.type = BROADWAY_EVENT_RELEASE_SURFACE;
+  ev.base.serial = broadway_server_get_next_serial (server) - 1;
+  ev.base.time = server->last_seen_time;
+  ev.release_surface.id = id;
+  memcpy (ev.release_surface.name, data->name, sizeof (ev.release_surface.name));
+
+  broadway_events_got_input (&ev, client_id);
+
+  cairo_surface_destroy (surface);
+}
+
+typedef struct {
+  BroadwayServer *server;
+  gint32 client_id;
+  gint32 id;
+  cairo_surface_t *surface;
+} SurfaceLoan;
+
+static gboolean
+surface_loan_release (gpointer user_data)
+{
+  SurfaceLoan *loan = user_data;
+
+  window_release_surface (loan->server, loan->client_id, loan->id, loan->surface);
+  g_object_unref (loan->server);
+  g_free (loan);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* The last reference to the buffer is often dropped by an encode or
+ * compress thread of the output, while clients are only talked to
+ * from the main loop */
+static void
+surface_loan_free (gpointer user_data)
+{
+  g_main_context_invoke (NULL, surface_loan_release, user_data);
+}
+
+/* Takes over the loan of surface, which is given back once the
+ * buffer is no longer used */
+static BroadwayBuffer *
+window_buffer_for_surface (BroadwayServer *server,
+			   BroadwayWindow *window,
+			   cairo_surface_t *surface)
+{
+  SurfaceLoan *loan;
+
+  loan = g_new0 (SurfaceLoan, 1);
+  loan->server = g_object_ref (server);
+  loan->client_id = window->client_id;
+  loan->id = window->id;
+  loan->surface = surface;
+
+  return broadway_buffer_create_for_data (cairo_image_surface_get_width (surface),
+					  cairo_image_surface_get_height (surface),
+					  cairo_image_surface_get_data (surface),
+					  surface_loan_free, loan);
+}
+
+/* Changes to the buffer have to be made to our own copy */
+static void
+window_unshare_buffer (BroadwayWindow *window)
+{
+  BroadwayBuffer *copy;
+
+  if (!broadway_buffer_is_borrowed (window->buffer))
+    return;
+
+  copy = broadway_buffer_copy (window->buffer);
+  broadway_buffer_unref (window->buffer);
+  window->buffer = copy;
+}
+
+/* Sends only the damaged rects of surface. Takes over the loan of
+ * surface when it returns TRUE. */
+static gboolean
+window_update_damage (BroadwayServer *server,
+		      BroadwayWindow *window,
+		      cairo_surface_t *surface,
+		      BroadwayRect *rects,
+		      int n_rects)
+{
+  BroadwayRect clipped[BROADWAY_MAX_UPDATE_RECTS];
+  BroadwayBuffer *buffer;
+  int i, n_clipped;
+  gint64 area;
+
+  if (n_rects == 0 || n_rects > BROADWAY_MAX_UPDATE_RECTS ||
+      window->buffer == NULL ||
+      broadway_buffer_get_width (window->buffer) != window->width ||
+      broadway_buffer_get_height (window->buffer) != window->height)
+    return FALSE;
+
+  /* The client can only apply a partial update on top of a full buffer,
+   * and the buffer can't change while a frame using it is encoded */
+  if (server->output != NULL &&
+      (!window->buffer_synced ||
+       broadway_output_is_encoding (server->output, window->buffer)))
+    return FALSE;
+
+  area = 0;
+  n_clipped = 0;
+  for (i = 0; i < n_rects; i++)
+    {
+      BroadwayRect *r = &clipped[n_clipped];
+      int x1 = MIN (rects[i].x + rects[i].width, window->width);
+      int y1 = MIN (rects[i].y + rects[i].height, window->height);
+
+      r->x = MAX (rects[i].x, 0);
+      r->y = MAX (rects[i].y, 0);
+      r->width = x1 - r->x;
+      r->height = y1 - r->y;
+      if (r->width <= 0 || r->height <= 0)
+	continue;
+
+      area += (gint64) r->width * r->height;
+      n_clipped++;
+    }
+
+  /* Large damage is better off with a full frame, where the
+   * block matcher can pick up content that moved */
+  if (area * 2 > (gint64) window->width * window->height)
+    return FALSE;
+
+  /* The owner keeps the pixels outside the damage up to date in the
+   * surfaces it sends, so when the shown buffer is lent as well the
+   * surface can replace it, with only the rects encoded against it */
+  if (broadway_buffer_is_borrowed (window->buffer))
+    {
+      buffer = window_buffer_for_surface (server, window, surface);
+      broadway_buffer_take_blocks (buffer, window->buffer);
+
+      if (server->output != NULL)
+	for (i = 0; i < n_clipped; i++)
+	  broadway_output_put_buffer_rect_delta (server->output, window->id,
+						 &clipped[i], window->buffer, buffer);
+
+      broadway_buffer_unref (window->buffer);
+      window->buffer = buffer;
+
+      return TRUE;
+    }
+
+  for (i = 0; i < n_clipped; i++)
+    {
+      if (server->output != NULL)
+	broadway_output_put_buffer_rect (server->output, window->id,
+					 &clipped[i], window->buffer,
+					 cairo_image_surface_get_data (surface),
+					 cairo_image_surface_get_stride (surface));
+      else
+	broadway_buffer_update_rect (window->buffer, &clipped[i],
+				     cairo_image_surface_get_data (surface),
+				     cairo_image_surface_get_stride (surface),
+				     NULL);
+    }
+
+  window_release_surface (server, window->client_id, window->id, surface);
+
+  return TRUE;
+}
+
+/* Sends a full update as a copy of the part that scrolled, plus the
+ * rects that still differ after that. Takes ownership of buffer when
+ * it returns TRUE. */
+static gboolean
+window_update_copy (BroadwayServer *server,
+		    BroadwayWindow *window,
+		    BroadwayBuffer *buffer,
+		    cairo_surface_t *surface,
+		    BroadwayRect *rects,
+		    int n_rects)
+{
+  BroadwayRect area, copy, changed[BROADWAY_MAX_UPDATE_RECTS];
+  int i, n_changed, dx, dy, x1, y1;
+  gint64 changed_area;
+
+  if (server->output == NULL || !window->buffer_synced ||
+      window->buffer == NULL ||
+      broadway_buffer_get_width (window->buffer) != window->width ||
+      broadway_buffer_get_height (window->buffer) != window->height ||
+      broadway_output_is_encoding (server->output, window->buffer))
+    return FALSE;
+
+  /* Only look for scrolling inside the damage */
+  area.x = 0;
+  area.y = 0;
+  area.width = window->width;
+  area.height = window->height;
+  if (n_rects > 0)
+    {
+      area = rects[0];
+      for (i = 1; i < n_rects; i++)
+	{
+	  x1 = MAX (area.x + area.width, rects[i].x + rects[i].width);
+	  y1 = MAX (area.y + area.height, rects[i].y + rects[i].height);
+	  area.x = MIN (area.x, rects[i].x);
+	  area.y = MIN (area.y, rects[i].y);
+	  area.width = x1 - area.x;
+	  area.height = y1 - area.y;
+	}
+
+      x1 = MIN (area.x + area.width, window->width);
+      y1 = MIN (area.y + area.height, window->height);
+      area.x = MAX (area.x, 0);
+      area.y = MAX (area.y, 0);
+      area.width = x1 - area.x;
+      area.height = y1 - area.y;
+      if (area.width <= 0 || area.height <= 0)
+	return FALSE;
+    }
+
+  if (!broadway_buffer_find_copy (buffer, window->buffer, &area, &copy, &dx, &dy))
+    return FALSE;
+
+  window_unshare_buffer (window);
+
+  broadway_output_copy_rectangle (server->output, window->id, &copy, dx, dy);
+  broadway_buffer_copy_rect (window->buffer, &copy, dx, dy);
+
+  n_changed = broadway_buffer_get_changed_rects (buffer, window->buffer,
+						 changed, BROADWAY_MAX_UPDATE_RECTS);
+
+  changed_area = 0;
+  for (i = 0; i < n_changed; i++)
+    changed_area += (gint64) changed[i].width * changed[i].height;
+
+  if (n_changed < 0 || changed_area * 2 > (gint64) window->width * window->height)
+    {
+      /* The old buffer now matches what the client has, so it is
+       * still good to encode against */
+      broadway_output_put_buffer (server->output, window->id,
+				  window->buffer, buffer);
+      broadway_buffer_unref (window->buffer);
+      window->buffer = buffer;
+      return TRUE;
+    }
+
+  /* Typically only the newly exposed strip */
+  for (i = 0; i < n_changed; i++)
+    broadway_output_put_buffer_rect (server->output, window->id,
+				     &changed[i], window->buffer,
+				     cairo_image_surface_get_data (surface),
+				     cairo_image_surface_get_stride (surface));
+
+  broadway_buffer_unref (buffer);
+
+  return TRUE;
+}
+
+static void
+send_frame_done (BroadwayServer *server,
+		 gint32 client_id,
+		 gint32 id)
+{
+  BroadwayInputMsg ev = { {0} };
+
+  ev.base.type = BROADWAY_EVENT_FRAME_DONE;
+  ev.base.serial = broadway_server_get_next_serial (server) - 1;
+  ev.base.time = server->last_seen_time;
+  ev.frame_done.id = id;
+
+  broadway_events_got_input (&ev, client_id);
+}
+
+static void
+window_frame_done (BroadwayServer *server,
+		   BroadwayWindow *window)
+{
+  window->frame_pending = FALSE;
+
+  send_frame_done (server, window->client_id, window->id);
+
+  /* Let through any input that was held back for this frame */
+  if (server->input_messages != NULL)
+    queue_process_input_at_idle (server);
+}
+
+/* Takes over the loan of surface */
+static void
+window_send_update (BroadwayServer *server,
+		    BroadwayWindow *window,
+		    cairo_surface_t *surface,
+		    BroadwayRect *rects,
+		    int n_rects)
+{
+  BroadwayBuffer *buffer;
+
+  if (!window_update_damage (server, window, surface, rects, n_rects))
+    {
+      buffer = window_buffer_for_surface (server, window, surface);
+
+      if (!window_update_copy (server, window, buffer, surface, rects, n_rects))
+	{
+	  if (server->output != NULL)
+	    {
+	      window->buffer_synced = TRUE;
+	      broadway_output_put_buffer (server->output, window->id,
+					  window->buffer, buffer);
+	    }
+
+	  if (window->buffer)
+	    broadway_buffer_unref (window->buffer);
+
+	  window->buffer = buffer;
+	}
+    }
+
+  if (server->output == NULL)
+    {
+      window_frame_done (server, window);
+      return;
+    }
+
+  /* Nothing new may have been written, then the last op is all we wait for */
+  window->frame_pending = TRUE;
+  window->frame_serial = broadway_output_get_next_serial (server->output) - 1;
+  server->frame_dirty = TRUE;
+
+  if (!serial_is_after (window->frame_serial, server->acked_serial))
+    window_frame_done (server, window);
+}
+
+/* Merges an update into the one held back for window, if any, and
+ * takes over the loan of surface */
+static void
+window_hold_update (BroadwayServer *server,
+		    BroadwayWindow *window,
+		    cairo_surface_t *surface,
+		    BroadwayRect *rects,
+		    int n_rects)
+{
+  int i;
+
+  if (window->pending_surface == NULL)
+    {
+      window->n_pending_rects = n_rects;
+      for (i = 0; i < n_rects; i++)
+	window->pending_rects[i] = rects[i];
+    }
+  else
+    {
+      if (n_rects == 0 || window->n_pending_rects == 0 ||
+	  window->n_pending_rects + n_rects > BROADWAY_MAX_UPDATE_RECTS ||
+	  cairo_image_surface_get_width (surface) != cairo_image_surface_get_width (window->pending_surface) ||
+	  cairo_image_surface_get_height (surface) != cairo_image_surface_get_height (window->pending_surface))
+	window->n_pending_rects = 0;
+      else
+	{
+	  for (i = 0; i < n_rects; i++)
+	    window->pending_rects[window->n_pending_rects + i] = rects[i];
+	  window->n_pending_rects += n_rects;
+	}
+
+      window_release_surface (server, window->client_id, window->id, window->pending_surface);
+    }
+
+  /* The owner has two surfaces and waits for one of them before it
+   * draws again, so don't keep the shown one while this is held */
+  if (window->buffer != NULL &&
+      (server->output == NULL ||
+       !broadway_output_is_encoding (server->output, window->buffer)))
+    window_unshare_buffer (window);
+
+  window->pending_surface = surface;
+}
+
+static gboolean
+browser_is_behind (BroadwayServer *server)
+{
+  return
+    server->output != NULL &&
+    server->max_unacked_frames > 0 &&
+    g_queue_get_length (&server->unacked_frames) >= (guint) server->max_unacked_frames;
+}
+
+/* Sends the held back updates of all windows as one frame */
+static void
+send_pending_updates (BroadwayServer *server)
+{
+  cairo_surface_t *surface;
+  GList *l;
+  gboolean sent = FALSE;
+
+  if (browser_is_behind (server))
+    return;
+
+  for (l = server->toplevels; l != NULL; l = l->next)
+    {
+      BroadwayWindow *window = l->data;
+
+      if (window->pending_surface == NULL)
+	continue;
+
+      surface = window->pending_surface;
+      window->pending_surface = NULL;
+
+      /* Resized since, the owner sends a new update for the new size */
+      if (cairo_image_surface_get_width (surface) != window->width ||
+	  cairo_image_surface_get_height (surface) != window->height)
+	{
+	  window_release_surface (server, window->client_id, window->id, surface);
+	  window_frame_done (server, window);
+	}
+      else
+	{
+	  window_send_update (server, window, surface,
+			      window->pending_rects, window->n_pending_rects);
+	  sent = TRUE;
+	}
+    }
+
+  if (sent)
+    broadway_server_flush (server);
+}
+
+static void
+process_ack (BroadwayServer *server,
+	     guint32 serial)
+{
+  GList *l;
+
+  if (server->output == NULL ||
+      !serial_is_after (serial, server->acked_serial))
+    return;
+
+  server->acked_serial = serial;
+
+  while (!g_queue_is_empty (&server->unacked_frames) &&
+	 !serial_is_after (GPOINTER_TO_UINT (g_queue_peek_head (&server->unacked_frames)), serial))
+    g_queue_pop_head (&server->unacked_frames);
+
+  for (l = server->toplevels; l != NULL; l = l->next)
+    {
+      BroadwayWindow *window = l->data;
+
+      if (window->frame_pending && window->pending_surface == NULL &&
+	  !serial_is_after (window->frame_serial, serial))
+	window_frame_done (server, window);
+    }
+
+  send_pending_updates (server);
+}
+
+/* Nothing sent to the previous browser, if any, will be acked. Applies
+ * the held back updates so a resync sends them, and releases everyone
+ * waiting for a frame. */
+static void
+broadway_server_reset_frames (BroadwayServer *server)
+{
+  cairo_surface_t *surface;
+  GList *l;
+
+  g_queue_clear (&server->unacked_frames);
+  server->frame_dirty = FALSE;
+  if (server->output)
+    server->acked_serial = broadway_output_get_next_serial (server->output) - 1;
+
+  for (l = server->toplevels; l != NULL; l = l->next)
+    {
+      BroadwayWindow *window = l->data;
+
+      if (window->pending_surface != NULL)
+	{
+	  surface = window->pending_surface;
+	  window->pending_surface = NULL;
+
+	  if (cairo_image_surface_get_width (surface) == window->width &&
+	      cairo_image_surface_get_height (surface) == window->height)
+	    {
+	      if (window->buffer)
+		broadway_buffer_unref (window->buffer);
+	      window->buffer = window_buffer_for_surface (server, window, surface);
+	      window->buffer_synced = FALSE;
+	    }
+	  else
+	    window_release_surface (server, window->client_id, window->id, surface);
+
+	  window->frame_pending = TRUE;
+	}
+
+      if (window->frame_pending)
+	window_frame_done (server, window);
+    }
+}
+
+/* The client froze its frame clock when it sent the update, so it
+ * gets a frame done even when we drop it. A NULL surface means the
+ * update couldn't be read */
 void
 broadway_server_window_update (BroadwayServer *server,
+			       gint32 client_id,
 			       gint id,
-			       cairo_surface_t *surface)
+			       cairo_surface_t *surface,
+			       BroadwayRect *rects,
+			       int n_rects)
 {
   BroadwayWindow *window;
-  BroadwayBuffer *buffer;
-
-  if (surface == NULL)
-    return;
 
   window = g_hash_table_lookup (server->id_ht,
 				GINT_TO_POINTER (id));
-  if (window == NULL)
-    return;
+  if (window == NULL || window->client_id != client_id)
+    {
+      send_frame_done (server, client_id, id);
+      return;
+    }
+
+  if (surface == NULL)
+    {
+      window_frame_done (server, window);
+      return;
+    }
 
   g_assert (window->width == cairo_image_surface_get_width (surface));
   g_assert (window->height == cairo_image_surface_get_height (surface));
 
-  buffer = broadway_buffer_create (window->width, window->height,
-                                   cairo_image_surface_get_data (surface),
-                                   cairo_image_surface_get_stride (surface));
+  if (server->recorder)
+    broadway_recorder_add_frame (server->recorder, window->id,
+				 window->width, window->height,
+				 cairo_image_surface_get_data (surface),
+				 cairo_image_surface_get_stride (surface),
+				 rects, n_rects);
 
-  if (server->output != NULL)
+  /* The surface is lent to us from here on, until we release it */
+  surface = cairo_surface_reference (surface);
+
+  /* Past the window of unacked frames only the latest contents are
+   * kept, and sent once the browser catches up */
+  if (window->pending_surface != NULL || browser_is_behind (server))
     {
-      window->buffer_synced = TRUE;
-      broadway_output_put_buffer (server->output, window->id,
-                                  window->buffer, buffer);
+      window_hold_update (server, window, surface, rects, n_rects);
+      send_pending_updates (server);
+      return;
     }
 
-  if (window->buffer)
-    broadway_buffer_destroy (window->buffer);
-
-  window->buffer = buffer;
+  window_send_update (server, window, surface, rects, n_rects);
 }
 
 gboolean
@@ -1638,13 +2504,6 @@ broadway_server_ungrab_pointer (BroadwayServer *server,
   return serial;
 }
 
-static const cairo_user_data_key_t shm_cairo_key;
-
-typedef struct {
-  void *data;
-  gsize data_size;
-} ShmSurfaceData;
-
 static void
 shm_data_unmap (void *_data)
 {
@@ -1669,15 +2528,31 @@ broadway_server_open_surface (BroadwayServer *server,
   cairo_surface_t *surface;
   gsize size;
   void *ptr;
+  guint i, last;
 
   window = g_hash_table_lookup (server->id_ht,
 				GINT_TO_POINTER (id));
   if (window == NULL)
     return NULL;
 
-  if (window->cached_surface_name != NULL &&
-      strcmp (name, window->cached_surface_name) == 0)
-    return cairo_surface_reference (window->cached_surface);
+  last = G_N_ELEMENTS (window->cached_surfaces) - 1;
+  for (i = 0; i < G_N_ELEMENTS (window->cached_surfaces); i++)
+    {
+      surface = window->cached_surfaces[i];
+      if (surface == NULL)
+	continue;
+
+      data = cairo_surface_get_user_data (surface, &shm_cairo_key);
+      if (strncmp (name, data->name, sizeof (data->name)) == 0 &&
+	  cairo_image_surface_get_width (surface) == width &&
+	  cairo_image_surface_get_height (surface) == height)
+	{
+	  memmove (&window->cached_surfaces[1], &window->cached_surfaces[0],
+		   i * sizeof (cairo_surface_t *));
+	  window->cached_surfaces[0] = surface;
+	  return cairo_surface_reference (surface);
+	}
+    }
 
   size = width * height * sizeof (guint32);
 
@@ -1688,6 +2563,7 @@ broadway_server_open_surface (BroadwayServer *server,
 
   data = g_new0 (ShmSurfaceData, 1);
 
+  strncpy (data->name, name, sizeof (data->name) - 1);
   data->data = ptr;
   data->data_size = size;
 
@@ -1700,19 +2576,18 @@ broadway_server_open_surface (BroadwayServer *server,
   cairo_surface_set_user_data (surface, &shm_cairo_key,
 			       data, shm_data_unmap);
 
-  if (window->cached_surface_name != NULL)
-    g_free (window->cached_surface_name);
-  window->cached_surface_name = g_strdup (name);
-
-  if (window->cached_surface != NULL)
-    cairo_surface_destroy (window->cached_surface);
-  window->cached_surface = cairo_surface_reference (surface);
+  if (window->cached_surfaces[last] != NULL)
+    cairo_surface_destroy (window->cached_surfaces[last]);
+  memmove (&window->cached_surfaces[1], &window->cached_surfaces[0],
+	   last * sizeof (cairo_surface_t *));
+  window->cached_surfaces[0] = cairo_surface_reference (surface);
 
   return surface;
 }
 
 guint32
 broadway_server_new_window (BroadwayServer *server,
+			    gint32 client_id,
 			    int x,
 			    int y,
 			    int width,
@@ -1723,6 +2598,7 @@ broadway_server_new_window (BroadwayServer *server,
 
   window = g_new0 (BroadwayWindow, 1);
   window->id = server->id_counter++;
+  window->client_id = client_id;
   window->x = x;
   window->y = y;
   if (x == 0 && y == 0 && !is_temp)
@@ -1806,6 +2682,4 @@ broadway_server_resync_windows (BroadwayServer *server)
 
   if (server->show_keyboard)
     broadway_output_set_show_keyboard (server->output, TRUE);
-
-  broadway_server_flush (server);
 }
@@ -7,6 +7,12 @@
 
 void broadway_events_got_input (BroadwayInputMsg *message,
 				gint32 client_id);
+/* Events got between these are sent to each client in one reply */
+void broadway_events_begin_batch (void);
+void broadway_events_end_batch (void);
+
+/* Frames the browser may have left to paint before updates are merged */
+#define BROADWAY_DEFAULT_MAX_UNACKED_FRAMES 3
 
 typedef struct _BroadwayServer BroadwayServer;
 typedef struct _BroadwayServerClass BroadwayServerClass;
@@ -22,6 +28,13 @@ typedef struct _BroadwayServerClass BroadwayServerClass;
 BroadwayServer     *broadway_server_new                      (char             *address,
 							      int               port,
 							      GError          **error);
+void                broadway_server_set_compression_level    (BroadwayServer   *server,
+							      int               level);
+void                broadway_server_set_max_unacked_frames   (BroadwayServer   *server,
+							      int               frames);
+gboolean            broadway_server_start_recording          (BroadwayServer   *server,
+							      const char       *filename,
+							      GError          **error);
 gboolean            broadway_server_has_client               (BroadwayServer   *server);
 void                broadway_server_flush                    (BroadwayServer   *server);
 void                broadway_server_sync                     (BroadwayServer   *server);
@@ -32,6 +45,9 @@ guint32             broadway_server_get_next_serial          (BroadwayServer   *
 guint32             broadway_server_get_last_seen_time       (BroadwayServer   *server);
 gboolean            broadway_server_lookahead_event          (BroadwayServer   *server,
 							      const char       *types);
+void                broadway_server_get_input_stats          (BroadwayServer   *server,
+							      guint64          *n_events,
+							      guint64          *n_merged);
 void                broadway_server_query_mouse              (BroadwayServer   *server,
 							      guint32          *toplevel,
 							      gint32           *root_x,
@@ -49,6 +65,7 @@ gint32              broadway_server_get_mouse_toplevel       (BroadwayServer   *
 void                broadway_server_set_show_keyboard        (BroadwayServer   *server,
                                                               gboolean          show);
 guint32             broadway_server_new_window               (BroadwayServer   *server,
+							      gint32            client_id,
 							      int               x,
 							      int               y,
 							      int               width,
@@ -75,8 +92,11 @@ gboolean            broadway_server_window_translate         (BroadwayServer   *
 cairo_surface_t   * broadway_server_create_surface           (int               width,
 							      int               height);
 void                broadway_server_window_update            (BroadwayServer   *server,
+							      gint32            client_id,
 							      gint              id,
-							      cairo_surface_t  *surface);
+							      cairo_surface_t  *surface,
+							      BroadwayRect     *rects,
+							      int               n_rects);
 gboolean            broadway_server_window_move_resize       (BroadwayServer   *server,
 							      gint              id,
 							      gboolean          with_move,
@@ -271,6 +271,15 @@ function cmdDeleteSurface(id)
     delete surfaces[id];
 }
 
+function cmdReset()
+{
+    if (grab.window)
+	doUngrab();
+
+    for (var id in surfaces)
+	cmdDeleteSurface(id);
+}
+
 function cmdMoveResizeSurface(id, has_pos, x, y, has_size, w, h)
 {
     var surface = surfaces[id];
@@ -345,7 +354,6 @@ function copyRect(src, srcX, srcY, dest, destX, destY, width, height)
 
 function decodeBuffer(context, oldData, w, h, data)
 {
-    var i, j;
     var imageData = context.createImageData(w, h);
 
     if (oldData != null) {
@@ -353,6 +361,14 @@ function decodeBuffer(context, oldData, w, h, data)
         copyRect(oldData, 0, 0, imageData, 0, 0, oldData.width, oldData.height);
     }
 
+    decodeInto(imageData, oldData, data);
+
+    return imageData;
+}
+
+function decodeInto(imageData, oldData, data)
+{
+    var i;
     var src = 0;
     var dest = 0;
 
@@ -449,18 +465,57 @@ function decodeBuffer(context, oldData, w, h, data)
             }
         }
     }
-
-    return imageData;
 }
 
 
+/* All buffers on a connection are compressed as a single raw deflate
+ * stream, sync flushed after each buffer, so back references may
+ * point into data inflated for earlier buffers. Zlib.RawInflate only
+ * handles complete streams, so we feed it the last window of output as
+ * a stored block, then the new data, then an empty final block. */
+var inflateWindowSize = 32768;
+var inflateWindow = new Uint8Array(0);
+
+function inflateBuffer(compressed)
+{
+    var histLen = inflateWindow.length;
+    var input = new Uint8Array(5 + histLen + compressed.length + 5);
+    var pos = 0;
+
+    if (histLen > 0) {
+        input[pos++] = 0x00; // Stored block, not final
+        input[pos++] = histLen & 0xff;
+        input[pos++] = (histLen >> 8) & 0xff;
+        input[pos++] = ~histLen & 0xff;
+        input[pos++] = (~histLen >> 8) & 0xff;
+        input.set(inflateWindow, pos);
+        pos += histLen;
+    }
+
+    input.set(compressed, pos);
+    pos += compressed.length;
+
+    // Sync flush left us byte aligned, end with an empty final stored block
+    input[pos++] = 0x01;
+    input[pos++] = 0x00;
+    input[pos++] = 0x00;
+    input[pos++] = 0xff;
+    input[pos++] = 0xff;
+
+    var inflate = new Zlib.RawInflate(input.subarray(0, pos));
+    var output = inflate.decompress();
+
+    inflateWindow = output.slice(Math.max(0, output.length - inflateWindowSize));
+
+    return output.subarray(histLen);
+}
+
 function cmdPutBuffer(id, w, h, compressed)
 {
     var surface = surfaces[id];
     var context = surface.canvas.getContext("2d");
 
-    var inflate = new Zlib.RawInflate(compressed);
-    var data = inflate.decompress();
+    var data = inflateBuffer(compressed);
 
     var imageData = decodeBuffer (context, surface.imageData, w, h, data);
 
@@ -468,6 +523,35 @@ function cmdPutBuffer(id, w, h, compressed)
     surface.imageData = imageData;
 }
 
+function cmdPutBufferRect(id, x, y, w, h, compressed)
+{
+    var surface = surfaces[id];
+    var context = surface.canvas.getContext("2d");
+
+    var data = inflateBuffer(compressed);
+
+    // The rect is encoded as deltas against the current contents
+    var rectData = context.createImageData(w, h);
+    copyRect(surface.imageData, x, y, rectData, 0, 0, w, h);
+    decodeInto(rectData, null, data);
+    copyRect(rectData, 0, 0, surface.imageData, x, y, w, h);
+
+    context.putImageData(rectData, x, y);
+}
+
+function cmdCopyRectangle(id, x, y, w, h, dx, dy)
+{
+    var surface = surfaces[id];
+    var context = surface.canvas.getContext("2d");
+
+    // Go through a copy, as the source and destination may overlap
+    var rectData = context.createImageData(w, h);
+    copyRect(surface.imageData, x, y, rectData, 0, 0, w, h);
+    copyRect(rectData, 0, 0, surface.imageData, x + dx, y + dy, w, h);
+
+    context.putImageData(rectData, x + dx, y + dy);
+}
+
 function cmdGrabPointer(id, ownerEvents)
 {
     doGrab(id, ownerEvents, false);
@@ -481,6 +565,15 @@ function cmdUngrabPointer()
 	doUngrab();
 }
 
+/* Tell the server what we painted, once per animation frame, so it
+   doesn't send more than we can keep up with */
+var ackPending = false;
+function sendAck()
+{
+    ackPending = false;
+    sendInput ("a", []);
+}
+
 var active = false;
 function handleCommands(cmd)
 {
@@ -499,6 +592,10 @@ function handleCommands(cmd)
 	    inputSocket = null;
 	    break;
 
+	case 'X': // Reset, a keyframe follows
+	    cmdReset();
+	    break;
+
 	case 's': // create new surface
 	    id = cmd.get_16();
 	    x = cmd.get_16s();
@@ -564,6 +661,27 @@ function handleCommands(cmd)
             cmdPutBuffer(id, w, h, data);
             break;
 
+	case 'B': // Put image buffer rectangle
+	    id = cmd.get_16();
+	    x = cmd.get_16();
+	    y = cmd.get_16();
+	    w = cmd.get_16();
+	    h = cmd.get_16();
+            var data = cmd.get_data();
+            cmdPutBufferRect(id, x, y, w, h, data);
+            break;
+
+	case 'c': // Copy rectangle
+	    id = cmd.get_16();
+	    x = cmd.get_16();
+	    y = cmd.get_16();
+	    w = cmd.get_16();
+	    h = cmd.get_16();
+	    var dx = cmd.get_16s();
+	    var dy = cmd.get_16s();
+            cmdCopyRectangle(id, x, y, w, h, dx, dy);
+            break;
+
 	case 'g': // Grab
 	    id = cmd.get_16();
 	    var ownerEvents = cmd.get_bool ();
@@ -584,6 +702,12 @@ function handleCommands(cmd)
 	    alert("Unknown op " + command);
 	}
     }
+
+    if (!ackPending) {
+	ackPending = true;
+	window.requestAnimationFrame(sendAck);
+    }
+
     return true;
 }
 
@@ -51,8 +51,11 @@ typedef struct  {
   GSList *serial_mappings;
   GList *windows;
   guint disconnect_idle;
+  BroadwayReplyEvents batch; /* Events not sent yet, see broadway_events_begin_batch() */
 } BroadwayClient;
 
+static int batch_depth;
+
 static void
 client_free (BroadwayClient *client)
 {
@@ -207,6 +210,7 @@ client_handle_request (BroadwayClient *client,
     case BROADWAY_REQUEST_NEW_WINDOW:
       reply_new_window.id =
 	broadway_server_new_window (server,
+				    client->id,
 				    request->new_window.x,
 				    request->new_window.y,
 				    request->new_window.width,
@@ -254,18 +258,29 @@ client_handle_request (BroadwayClient *client,
 						request->set_transient_for.parent);
       break;
     case BROADWAY_REQUEST_UPDATE:
-      surface = broadway_server_open_surface (server,
-					      request->update.id,
-					      request->update.name,
-					      request->update.width,
-					      request->update.height);
-      if (surface != NULL)
+      /* n_rects comes from the client, make sure it sent that many */
+      if (request->base.size < G_STRUCT_OFFSET (BroadwayRequestUpdate, rects) ||
+	  (request->base.size - G_STRUCT_OFFSET (BroadwayRequestUpdate, rects)) / sizeof (BroadwayRect) < request->update.n_rects)
 	{
-	  broadway_server_window_update (server,
-					 request->update.id,
-					 surface);
-	  cairo_surface_destroy (surface);
+	  g_warning ("Update request too short for its rectangles\n");
+	  surface = NULL;
 	}
+      else
+	surface = broadway_server_open_surface (server,
+						request->update.id,
+						request->update.name,
+						request->update.width,
+						request->update.height);
+
+      /* Also called without a surface, the client still needs its frame done */
+      broadway_server_window_update (server,
+				     client->id,
+				     request->update.id,
+				     surface,
+				     request->update.rects,
+				     request->update.n_rects);
+      if (surface != NULL)
+	cairo_surface_destroy (surface);
       break;
     case BROADWAY_REQUEST_MOVE_RESIZE:
       broadway_server_window_move_resize (server,
@@ -349,6 +364,8 @@ client_fill_cb (GObject *source_object,
 	      remaining -= size;
 	      buffer += size;
 	    }
+	  else
+	    break; /* Wait for the rest of the request */
 	}
       
       /* This is guaranteed not to block */
@@ -418,11 +435,17 @@ main (int argc, char *argv[])
   char *path, *basename;
   char *http_address = NULL;
   int http_port = 0;
+  int compression_level = -1;
+  int max_unacked_frames = BROADWAY_DEFAULT_MAX_UNACKED_FRAMES;
+  char *record_file = NULL;
   char *display;
   int port = 0;
   const GOptionEntry entries[] = {
     { "port", 'p', 0, G_OPTION_ARG_INT, &http_port, "Httpd port", "PORT" },
     { "address", 'a', 0, G_OPTION_ARG_STRING, &http_address, "Ip address to bind to ", "ADDRESS" },
+    { "compression-level", 'z', 0, G_OPTION_ARG_INT, &compression_level, "Deflate level for window contents, 0-9", "LEVEL" },
+    { "max-unacked-frames", 'f', 0, G_OPTION_ARG_INT, &max_unacked_frames, "Frames the browser may lag behind, 0 for no limit", "FRAMES" },
+    { "record", 'r', 0, G_OPTION_ARG_FILENAME, &record_file, "Record window contents for broadway-replay", "FILE" },
     { NULL }
   };
 
@@ -434,6 +457,18 @@ main (int argc, char *argv[])
       exit (1);
     }
 
+  if (compression_level < -1 || compression_level > 9)
+    {
+      g_printerr ("Invalid compression level %d\n", compression_level);
+      exit (1);
+    }
+
+  if (max_unacked_frames < 0)
+    {
+      g_printerr ("Invalid number of unacked frames %d\n", max_unacked_frames);
+      exit (1);
+    }
+
   display = NULL;
   if (argc > 1)
     {
@@ -493,6 +528,16 @@ main (int argc, char *argv[])
       return 1;
     }
 
+  broadway_server_set_compression_level (server, compression_level);
+  broadway_server_set_max_unacked_frames (server, max_unacked_frames);
+
+  if (record_file != NULL &&
+      !broadway_server_start_recording (server, record_file, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return 1;
+    }
+
   listener = g_socket_service_new ();
   if (!g_socket_listener_add_address (G_SOCKET_LISTENER (listener),
 				      address,
@@ -547,12 +592,62 @@ get_event_size (int type)
       return sizeof (BroadwayInputScreenResizeNotify);
     case BROADWAY_EVENT_FOCUS:
       return sizeof (BroadwayInputFocusMsg);
+    case BROADWAY_EVENT_FRAME_DONE:
+      return sizeof (BroadwayInputFrameDoneMsg);
+    case BROADWAY_EVENT_RELEASE_SURFACE:
+      return sizeof (BroadwayInputReleaseSurfaceMsg);
     default:
       g_assert_not_reached ();
     }
   return 0;
 }
 
+static void
+send_batch (BroadwayClient *client)
+{
+  BroadwayReplyEvents *batch = &client->batch;
+
+  if (batch->n_events == 0)
+    return;
+
+  if (batch->n_events == 1)
+    {
+      BroadwayReplyEvent reply_event;
+      gsize size = get_event_size (batch->msgs[0].base.type);
+
+      memcpy (&reply_event.msg, &batch->msgs[0], size);
+      send_reply (client, NULL, (BroadwayReply *)&reply_event,
+		  G_STRUCT_OFFSET (BroadwayReplyEvent, msg) + size,
+		  BROADWAY_REPLY_EVENT);
+    }
+  else
+    send_reply (client, NULL, (BroadwayReply *)batch,
+		G_STRUCT_OFFSET (BroadwayReplyEvents, msgs) + batch->n_events * sizeof (BroadwayInputMsg),
+		BROADWAY_REPLY_EVENTS);
+
+  batch->n_events = 0;
+}
+
+void
+broadway_events_begin_batch (void)
+{
+  batch_depth++;
+}
+
+void
+broadway_events_end_batch (void)
+{
+  GList *l;
+
+  g_assert (batch_depth > 0);
+
+  if (--batch_depth > 0)
+    return;
+
+  for (l = clients; l != NULL; l = l->next)
+    send_batch (l->data);
+}
+
 void
 broadway_events_got_input (BroadwayInputMsg *message,
 			   gint32 client_id)
@@ -579,9 +674,16 @@ broadway_events_got_input (BroadwayInputMsg *message,
 	{
 	  reply_event.msg.base.serial = get_client_serial (client, daemon_serial);
 
-	  send_reply (client, NULL, (BroadwayReply *)&reply_event,
-		      G_STRUCT_OFFSET (BroadwayReplyEvent, msg) + size,
-		      BROADWAY_REPLY_EVENT);
+	  if (batch_depth > 0)
+	    {
+	      if (client->batch.n_events == BROADWAY_MAX_BATCHED_EVENTS)
+		send_batch (client);
+	      client->batch.msgs[client->batch.n_events++] = reply_event.msg;
+	    }
+	  else
+	    send_reply (client, NULL, (BroadwayReply *)&reply_event,
+			G_STRUCT_OFFSET (BroadwayReplyEvent, msg) + size,
+			BROADWAY_REPLY_EVENT);
 	}
     }
 }
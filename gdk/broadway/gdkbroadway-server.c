@@ -39,7 +39,7 @@ struct _GdkBroadwayServer {
   GSocketConnection *connection;
 
   guint32 recv_buffer_size;
-  guint8 recv_buffer[1024];
+  guint8 recv_buffer[sizeof (BroadwayReplyEvents) + 1024];
 
   guint process_input_idle;
   GList *incomming;
@@ -300,6 +300,7 @@ static void
 process_input_messages (GdkBroadwayServer *server)
 {
   BroadwayReply *reply;
+  guint32 i;
 
   if (server->process_input_idle != 0)
     {
@@ -316,6 +317,11 @@ process_input_messages (GdkBroadwayServer *server)
 
       if (reply->base.type == BROADWAY_REPLY_EVENT)
 	_gdk_broadway_events_got_input (&reply->event.msg);
+      else if (reply->base.type == BROADWAY_REPLY_EVENTS)
+	{
+	  for (i = 0; i < reply->events.n_events; i++)
+	    _gdk_broadway_events_got_input (&reply->events.msgs[i]);
+	}
       else
 	g_warning ("Unhandled reply type %d\n", reply->base.type);
       g_free (reply);
@@ -645,6 +651,7 @@ typedef struct {
   char name[36];
   void *data;
   gsize data_size;
+  int n_lent; /* Updates the daemon hasn't released yet */
 } BroadwayShmSurfaceData;
 
 static void
@@ -682,7 +689,7 @@ _gdk_broadway_server_create_surface (int                 width,
   BroadwayShmSurfaceData *data;
   cairo_surface_t *surface;
 
-  data = g_new (BroadwayShmSurfaceData, 1);
+  data = g_new0 (BroadwayShmSurfaceData, 1);
   data->data_size = width * height * sizeof (guint32);
   data->data = create_random_shm (data->name, data->data_size);
 
@@ -696,27 +703,97 @@ _gdk_broadway_server_create_surface (int                 width,
   return surface;
 }
 
-void
+/* Whether the daemon may still be reading the surface, so it must not
+ * be drawn into */
+gboolean
+_gdk_broadway_server_surface_is_lent (cairo_surface_t *surface)
+{
+  BroadwayShmSurfaceData *data;
+
+  data = cairo_surface_get_user_data (surface, &gdk_broadway_shm_cairo_key);
+
+  return data != NULL && data->n_lent > 0;
+}
+
+/* Returns TRUE if name is the surface, and it was given back */
+gboolean
+_gdk_broadway_server_release_surface (cairo_surface_t *surface,
+				      const char      *name)
+{
+  BroadwayShmSurfaceData *data;
+
+  data = cairo_surface_get_user_data (surface, &gdk_broadway_shm_cairo_key);
+  if (data == NULL || data->n_lent == 0 ||
+      strncmp (data->name, name, sizeof (data->name)) != 0)
+    return FALSE;
+
+  data->n_lent--;
+
+  return TRUE;
+}
+
+/* The daemon reads the surface straight from shared memory while it
+ * encodes it, it lends it until it sends a BROADWAY_EVENT_RELEASE_SURFACE.
+ * A %NULL @damage means all of it, an empty one sends nothing.
+ * Returns whether an update was sent, which the daemon answers with a
+ * BROADWAY_EVENT_FRAME_DONE */
+gboolean
 _gdk_broadway_server_window_update (GdkBroadwayServer *server,
 				    gint id,
-				    cairo_surface_t *surface)
+				    cairo_surface_t *surface,
+				    cairo_region_t *damage)
 {
-  BroadwayRequestUpdate msg;
+  BroadwayRequestUpdate *msg;
   BroadwayShmSurfaceData *data;
+  cairo_rectangle_int_t rect;
+  gsize size;
+  int i, n_rects;
 
-  if (surface == NULL)
-    return;
+  /* n_rects == 0 tells the daemon to take the whole surface */
+  if (surface == NULL || (damage != NULL && cairo_region_is_empty (damage)))
+    return FALSE;
 
   data = cairo_surface_get_user_data (surface, &gdk_broadway_shm_cairo_key);
   g_assert (data != NULL);
 
-  msg.id = id;
-  memcpy (msg.name, data->name, 36);
-  msg.width = cairo_image_surface_get_width (surface);
-  msg.height = cairo_image_surface_get_height (surface);
+  n_rects = damage ? cairo_region_num_rectangles (damage) : 0;
+  if (n_rects > BROADWAY_MAX_UPDATE_RECTS)
+    n_rects = 1; /* Send the extents */
 
-  gdk_broadway_server_send_message (server, msg,
-				    BROADWAY_REQUEST_UPDATE);
+  size = sizeof (BroadwayRequestUpdate) + sizeof (BroadwayRect) * (MAX (n_rects, 1) - 1);
+  msg = g_alloca (size);
+
+  msg->id = id;
+  memcpy (msg->name, data->name, 36);
+  msg->width = cairo_image_surface_get_width (surface);
+  msg->height = cairo_image_surface_get_height (surface);
+  msg->n_rects = n_rects;
+
+  if (n_rects == 1)
+    {
+      cairo_region_get_extents (damage, &rect);
+      msg->rects[0].x = rect.x;
+      msg->rects[0].y = rect.y;
+      msg->rects[0].width = rect.width;
+      msg->rects[0].height = rect.height;
+    }
+  else
+    {
+      for (i = 0; i < n_rects; i++)
+	{
+	  cairo_region_get_rectangle (damage, i, &rect);
+	  msg->rects[i].x = rect.x;
+	  msg->rects[i].y = rect.y;
+	  msg->rects[i].width = rect.width;
+	  msg->rects[i].height = rect.height;
+	}
+    }
+
+  gdk_broadway_server_send_message_with_size (server, (BroadwayRequestBase *) msg, size,
+					      BROADWAY_REQUEST_UPDATE);
+  data->n_lent++;
+
+  return TRUE;
 }
 
 gboolean
@@ -61,9 +61,13 @@ gboolean           _gdk_broadway_server_window_translate         (GdkBroadwaySer
 								  gint                dy);
 cairo_surface_t   *_gdk_broadway_server_create_surface           (int                 width,
 								  int                 height);
-void               _gdk_broadway_server_window_update            (GdkBroadwayServer  *server,
+gboolean           _gdk_broadway_server_surface_is_lent          (cairo_surface_t    *surface);
+gboolean           _gdk_broadway_server_release_surface          (cairo_surface_t    *surface,
+								  const char         *name);
+gboolean           _gdk_broadway_server_window_update            (GdkBroadwayServer  *server,
 								  gint                id,
-								  cairo_surface_t    *surface);
+								  cairo_surface_t    *surface,
+								  cairo_region_t     *damage);
 gboolean           _gdk_broadway_server_window_move_resize       (GdkBroadwayServer  *server,
 								  gint                id,
 								  gboolean            with_move,
@@ -194,18 +194,44 @@ _gdk_broadway_events_got_input (BroadwayInputMsg *message)
     window = g_hash_table_lookup (display_broadway->id_ht, GINT_TO_POINTER (message->pointer.event_window_id));
     if (window)
       {
-	event = gdk_event_new (GDK_SCROLL);
-	event->scroll.window = g_object_ref (window);
-	event->scroll.time = message->base.time;
-	event->scroll.x = message->pointer.win_x;
-	event->scroll.y = message->pointer.win_y;
-	event->scroll.x_root = message->pointer.root_x;
-	event->scroll.y_root = message->pointer.root_y;
-	event->scroll.direction = message->scroll.dir == 0 ? GDK_SCROLL_UP : GDK_SCROLL_DOWN;
-	gdk_event_set_device (event, display->core_pointer);
+	guint32 i, n_steps = MAX (message->scroll.n_steps, 1);
 
-	node = _gdk_event_queue_append (display, event);
-	_gdk_windowing_got_event (display, node, event, message->base.serial);
+	/* Several merged steps go to smooth scrolling windows as one
+	 * event, the discrete ones are only seen by the others */
+	if (n_steps > 1)
+	  {
+	    event = gdk_event_new (GDK_SCROLL);
+	    event->scroll.window = g_object_ref (window);
+	    event->scroll.time = message->base.time;
+	    event->scroll.x = message->pointer.win_x;
+	    event->scroll.y = message->pointer.win_y;
+	    event->scroll.x_root = message->pointer.root_x;
+	    event->scroll.y_root = message->pointer.root_y;
+	    event->scroll.direction = GDK_SCROLL_SMOOTH;
+	    event->scroll.delta_y = message->scroll.dir == 0 ? -(gdouble) n_steps : n_steps;
+	    gdk_event_set_device (event, display->core_pointer);
+
+	    node = _gdk_event_queue_append (display, event);
+	    _gdk_windowing_got_event (display, node, event, message->base.serial);
+	  }
+
+	for (i = 0; i < n_steps; i++)
+	  {
+	    event = gdk_event_new (GDK_SCROLL);
+	    event->scroll.window = g_object_ref (window);
+	    event->scroll.time = message->base.time;
+	    event->scroll.x = message->pointer.win_x;
+	    event->scroll.y = message->pointer.win_y;
+	    event->scroll.x_root = message->pointer.root_x;
+	    event->scroll.y_root = message->pointer.root_y;
+	    event->scroll.direction = message->scroll.dir == 0 ? GDK_SCROLL_UP : GDK_SCROLL_DOWN;
+	    if (n_steps > 1)
+	      _gdk_event_set_pointer_emulated (event, TRUE);
+	    gdk_event_set_device (event, display->core_pointer);
+
+	    node = _gdk_event_queue_append (display, event);
+	    _gdk_windowing_got_event (display, node, event, message->base.serial);
+	  }
       }
 
     break;
@@ -355,6 +381,18 @@ _gdk_broadway_events_got_input (BroadwayInputMsg *message)
       }
     break;
 
+  case BROADWAY_EVENT_FRAME_DONE:
+    window = g_hash_table_lookup (display_broadway->id_ht, GINT_TO_POINTER (message->frame_done.id));
+    if (window)
+      _gdk_broadway_window_frame_done (window);
+    break;
+
+  case BROADWAY_EVENT_RELEASE_SURFACE:
+    window = g_hash_table_lookup (display_broadway->id_ht, GINT_TO_POINTER (message->release_surface.id));
+    if (window)
+      _gdk_broadway_window_release_surface (window, message->release_surface.name);
+    break;
+
   default:
     g_printerr ("_gdk_broadway_events_got_input - Unknown input command %c\n", message->base.type);
     break;
@@ -35,6 +35,7 @@
 #include "gdkinternals.h"
 #include "gdkdeviceprivate.h"
 #include "gdkeventsource.h"
+#include "gdkframeclockprivate.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -81,16 +82,63 @@ G_DEFINE_TYPE (GdkWindowImplBroadway,
 	       gdk_window_impl_broadway,
 	       GDK_TYPE_WINDOW_IMPL)
 
+/* Browsers stop running animation frames for hidden tabs, so don't
+ * wait forever for a frame done */
+#define FRAME_DONE_TIMEOUT_MS 1000
+
+static gboolean
+frame_done_timeout_cb (gpointer data)
+{
+  GdkWindow *window = data;
+  GdkWindowImplBroadway *impl = GDK_WINDOW_IMPL_BROADWAY (window->impl);
+
+  impl->frame_done_timeout = 0;
+  _gdk_broadway_window_frame_done (window);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* How long to wait for the daemon to give back a surface before
+ * painting into a new one */
+#define RELEASE_TIMEOUT_MS 500
+
+static void
+stop_waiting_for_release (GdkWindowImplBroadway *impl)
+{
+  if (impl->release_timeout != 0)
+    {
+      g_source_remove (impl->release_timeout);
+      impl->release_timeout = 0;
+    }
+
+  if (impl->release_pending)
+    {
+      impl->release_pending = FALSE;
+      _gdk_frame_clock_thaw (gdk_window_get_frame_clock (impl->wrapper));
+    }
+}
+
+static gboolean
+release_timeout_cb (gpointer data)
+{
+  GdkWindow *window = data;
+  GdkWindowImplBroadway *impl = GDK_WINDOW_IMPL_BROADWAY (window->impl);
+
+  impl->release_timeout = 0;
+  stop_waiting_for_release (impl);
+
+  return G_SOURCE_REMOVE;
+}
+
 static void
 update_dirty_windows_and_sync (void)
 {
   GList *l;
   GdkBroadwayDisplay *display;
-  gboolean updated_surface;
+  gboolean sent;
 
   display = GDK_BROADWAY_DISPLAY (gdk_display_get_default ());
 
-  updated_surface = FALSE;
   for (l = display->toplevels; l != NULL; l = l->next)
     {
       GdkWindowImplBroadway *impl = l->data;
@@ -98,19 +146,45 @@ update_dirty_windows_and_sync (void)
       if (impl->dirty)
 	{
 	  impl->dirty = FALSE;
-	  updated_surface = TRUE;
-	  _gdk_broadway_server_window_update (display->server,
-					      impl->id,
-					      impl->surface);
+	  sent = _gdk_broadway_server_window_update (display->server,
+						     impl->id,
+						     impl->surface,
+						     impl->dirty_region);
+
+	  /* The spare surface falls behind by what we just sent */
+	  if (impl->dirty_region == NULL)
+	    g_clear_pointer (&impl->last_damage, cairo_region_destroy);
+	  else if (impl->last_damage != NULL)
+	    cairo_region_union (impl->last_damage, impl->dirty_region);
+	  g_clear_pointer (&impl->dirty_region, cairo_region_destroy);
+
+	  /* Don't draw again until the browser has shown this */
+	  if (sent && !impl->frame_pending)
+	    {
+	      impl->frame_pending = TRUE;
+	      _gdk_frame_clock_freeze (gdk_window_get_frame_clock (impl->wrapper));
+	      impl->frame_done_timeout =
+		g_timeout_add (FRAME_DONE_TIMEOUT_MS, frame_done_timeout_cb, impl->wrapper);
+	    }
+
+	  /* Painting needs a surface the daemon isn't reading, rather
+	   * than waiting for one in the middle of a paint don't start
+	   * the next until the daemon gives one back */
+	  if (sent && !impl->release_pending &&
+	      impl->last_surface != NULL &&
+	      _gdk_broadway_server_surface_is_lent (impl->last_surface))
+	    {
+	      impl->release_pending = TRUE;
+	      _gdk_frame_clock_freeze (gdk_window_get_frame_clock (impl->wrapper));
+	      impl->release_timeout =
+		g_timeout_add (RELEASE_TIMEOUT_MS, release_timeout_cb, impl->wrapper);
+	    }
 	}
     }
 
-  /* We sync here to ensure all references to the impl->surface memory
-     is done, as we may later paint new data in them. */
-  if (updated_surface)
-    gdk_display_sync (GDK_DISPLAY (display));
-  else
-    gdk_display_flush (GDK_DISPLAY (display));
+  /* No need to sync, we don't paint into impl->surface again before
+     the daemon releases it, see ensure_surface_not_lent() */
+  gdk_display_flush (GDK_DISPLAY (display));
 }
 
 static guint flush_id = 0;
@@ -167,6 +241,14 @@ gdk_window_impl_broadway_finalize (GObject *object)
 
   g_hash_table_destroy (impl->device_cursor);
 
+  g_clear_pointer (&impl->dirty_region, cairo_region_destroy);
+  g_clear_pointer (&impl->last_damage, cairo_region_destroy);
+
+  if (impl->frame_done_timeout != 0)
+    g_source_remove (impl->frame_done_timeout);
+  if (impl->release_timeout != 0)
+    g_source_remove (impl->release_timeout);
+
   broadway_display->toplevels = g_list_remove (broadway_display->toplevels, impl);
 
   G_OBJECT_CLASS (gdk_window_impl_broadway_parent_class)->finalize (object);
@@ -217,6 +299,39 @@ on_frame_clock_after_paint (GdkFrameClock *clock,
   update_dirty_windows_and_sync ();
 }
 
+void
+_gdk_broadway_window_frame_done (GdkWindow *window)
+{
+  GdkWindowImplBroadway *impl = GDK_WINDOW_IMPL_BROADWAY (window->impl);
+
+  if (impl->frame_done_timeout != 0)
+    {
+      g_source_remove (impl->frame_done_timeout);
+      impl->frame_done_timeout = 0;
+    }
+
+  if (impl->frame_pending)
+    {
+      impl->frame_pending = FALSE;
+      _gdk_frame_clock_thaw (gdk_window_get_frame_clock (window));
+    }
+}
+
+void
+_gdk_broadway_window_release_surface (GdkWindow  *window,
+				      const char *name)
+{
+  GdkWindowImplBroadway *impl = GDK_WINDOW_IMPL_BROADWAY (window->impl);
+
+  /* Surfaces we dropped meanwhile are just forgotten, the daemon
+   * has its own mapping of them */
+  if ((impl->surface != NULL &&
+       _gdk_broadway_server_release_surface (impl->surface, name)) ||
+      (impl->last_surface != NULL &&
+       _gdk_broadway_server_release_surface (impl->last_surface, name)))
+    stop_waiting_for_release (impl);
+}
+
 static void
 connect_frame_clock (GdkWindow *window)
 {
@@ -278,6 +393,12 @@ _gdk_broadway_window_resize_surface (GdkWindow *window)
 							   gdk_window_get_height (impl->wrapper));
     }
 
+  g_clear_pointer (&impl->last_surface, cairo_surface_destroy);
+  g_clear_pointer (&impl->last_damage, cairo_region_destroy);
+
+  /* The new surface isn't lent */
+  stop_waiting_for_release (impl);
+
   if (impl->ref_surface)
     {
       cairo_surface_set_user_data (impl->ref_surface, &gdk_broadway_cairo_key,
@@ -296,6 +417,65 @@ ref_surface_destroyed (void *data)
   impl->ref_surface = NULL;
 }
 
+/* While the daemon reads impl->surface we paint into the other one,
+ * after bringing it up to date with what was sent since we last did.
+ * The frame clock waits for one of them to come back, but painting
+ * can happen anyway, then a new surface is mapped. */
+static void
+ensure_surface_not_lent (GdkWindowImplBroadway *impl)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  int w, h;
+
+  if (!_gdk_broadway_server_surface_is_lent (impl->surface))
+    return;
+
+  w = cairo_image_surface_get_width (impl->surface);
+  h = cairo_image_surface_get_height (impl->surface);
+
+  /* A lent surface is just dropped, the daemon has its own mapping */
+  if (impl->last_surface == NULL ||
+      _gdk_broadway_server_surface_is_lent (impl->last_surface) ||
+      cairo_image_surface_get_width (impl->last_surface) != w ||
+      cairo_image_surface_get_height (impl->last_surface) != h)
+    {
+      if (impl->last_surface)
+	cairo_surface_destroy (impl->last_surface);
+      impl->last_surface = _gdk_broadway_server_create_surface (w, h);
+      g_clear_pointer (&impl->last_damage, cairo_region_destroy);
+    }
+
+  if (impl->last_damage == NULL || !cairo_region_is_empty (impl->last_damage))
+    {
+      cr = cairo_create (impl->last_surface);
+      cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+      cairo_set_source_surface (cr, impl->surface, 0, 0);
+      if (impl->last_damage)
+	{
+	  gdk_cairo_region (cr, impl->last_damage);
+	  cairo_clip (cr);
+	}
+      cairo_paint (cr);
+      cairo_destroy (cr);
+    }
+
+  surface = impl->surface;
+  impl->surface = impl->last_surface;
+  impl->last_surface = surface;
+
+  if (impl->last_damage)
+    cairo_region_destroy (impl->last_damage);
+  impl->last_damage = cairo_region_create ();
+
+  if (impl->ref_surface)
+    {
+      cairo_surface_set_user_data (impl->ref_surface, &gdk_broadway_cairo_key,
+				   NULL, NULL);
+      impl->ref_surface = NULL;
+    }
+}
+
 static cairo_surface_t *
 gdk_window_broadway_ref_cairo_surface (GdkWindow *window)
 {
@@ -312,6 +492,8 @@ gdk_window_broadway_ref_cairo_surface (GdkWindow *window)
   /* Create actual backing store if missing */
   if (!impl->surface)
     impl->surface = _gdk_broadway_server_create_surface (w, h);
+  else
+    ensure_surface_not_lent (impl);
 
   /* Create a destroyable surface referencing the real one */
   if (!impl->ref_surface)
@@ -358,6 +540,9 @@ _gdk_broadway_window_destroy (GdkWindow *window,
       impl->surface = NULL;
     }
 
+  g_clear_pointer (&impl->last_surface, cairo_surface_destroy);
+  g_clear_pointer (&impl->last_damage, cairo_region_destroy);
+
   broadway_display = GDK_BROADWAY_DISPLAY (gdk_window_get_display (window));
   g_hash_table_remove (broadway_display->id_ht, GINT_TO_POINTER(impl->id));
 
@@ -482,6 +667,7 @@ gdk_window_broadway_move_resize (GdkWindow *window,
 
 	  /* Resize clears the content */
 	  impl->dirty = TRUE;
+	  g_clear_pointer (&impl->dirty_region, cairo_region_destroy);
 	  impl->last_synced = FALSE;
 
 	  window->width = width;
@@ -1509,6 +1695,14 @@ gdk_broadway_window_process_updates_recurse (GdkWindow *window,
   _gdk_window_process_updates_recurse (window, region);
 
   impl = GDK_WINDOW_IMPL_BROADWAY (window->impl);
+
+  /* Track the damage so the daemon only has to encode what changed.
+   * A dirty window without a region is damaged as a whole. */
+  if (!impl->dirty)
+    impl->dirty_region = cairo_region_copy (region);
+  else if (impl->dirty_region != NULL)
+    cairo_region_union (impl->dirty_region, region);
+
   impl->dirty = TRUE;
 }
 
@@ -50,7 +50,8 @@ struct _GdkWindowImplBroadway
   GdkScreen *screen;
 
   cairo_surface_t *surface;
-  cairo_surface_t *last_surface;
+  cairo_surface_t *last_surface; /* Drawn into while surface is lent to the daemon */
+  cairo_region_t *last_damage; /* Where last_surface is behind, NULL => everywhere */
   cairo_surface_t *ref_surface;
 
   GdkCursor *cursor;
@@ -63,7 +64,12 @@ struct _GdkWindowImplBroadway
 
   gint8 toplevel_window_type;
   gboolean dirty;
+  cairo_region_t *dirty_region; /* NULL while dirty => whole window */
   gboolean last_synced;
+  gboolean frame_pending; /* Frame clock frozen until the browser shows our update */
+  guint frame_done_timeout; /* Thaws anyway if the browser stops acking */
+  gboolean release_pending; /* Frame clock frozen while both surfaces are lent */
+  guint release_timeout; /* Thaws anyway, then painting maps a new surface */
 
   GdkGeometry geometry_hints;
   GdkWindowHints geometry_hints_mask;
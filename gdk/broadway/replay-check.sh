@@ -0,0 +1,17 @@
+#! /bin/sh
+
+# Replays a synthetic recording and fails if the output grew past the
+# thresholds. The threshold lines are meant to be tracked by CI, the
+# limits can be overridden from the environment.
+
+rec=replay-check.rec
+
+./broadway-replay --synthesize $rec || exit 1
+./broadway-replay \
+  --max-output-ratio=${BROADWAY_REPLAY_MAX_OUTPUT_RATIO:-0.1} \
+  --max-encoded-ratio=${BROADWAY_REPLAY_MAX_ENCODED_RATIO:-0.5} \
+  $rec
+status=$?
+
+rm -f $rec
+exit $status
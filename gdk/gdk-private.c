@@ -22,7 +22,10 @@ gdk__private__ (void)
     gdk_get_desktop_autostart_id,
     gdk_profiler_is_running,
     gdk_profiler_start,
-    gdk_profiler_stop
+    gdk_profiler_stop,
+    gdk_profiler_add_mark,
+    gdk_profiler_define_int_counter,
+    gdk_profiler_set_int_counter
   };
 
   return &table;
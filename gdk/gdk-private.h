@@ -66,6 +66,15 @@ typedef struct {
   gboolean (* gdk_profiler_is_running) (void);
   void     (* gdk_profiler_start)      (int fd);
   void     (* gdk_profiler_stop)       (void);
+  void     (* gdk_profiler_add_mark)   (gint64      start,
+                                        guint64     duration,
+                                        const char *name,
+                                        const char *message);
+  guint    (* gdk_profiler_define_int_counter) (const char *name,
+                                                const char *description);
+  void     (* gdk_profiler_set_int_counter)    (guint       id,
+                                                gint64      time,
+                                                gint64      value);
 } GdkPrivateVTable;
 
 GDK_AVAILABLE_IN_ALL
@@ -19,7 +19,7 @@
 
 #include "config.h"
 
-#include "gtkcellrenderertext.h"
+#include "gtkcellrenderertextprivate.h"
 
 #include <stdlib.h>
 
@@ -1572,31 +1572,22 @@ add_attr (PangoAttrList  *attr_list,
   pango_attr_list_insert (attr_list, attr);
 }
 
-static PangoLayout*
-get_layout (GtkCellRendererText *celltext,
-            GtkWidget           *widget,
-            const GdkRectangle  *cell_area,
-            GtkCellRendererState flags)
+static PangoAttrList *
+get_layout_attributes (GtkCellRendererText *celltext,
+                       GtkWidget           *widget,
+                       const GdkRectangle  *cell_area,
+                       GtkCellRendererState flags)
 {
   GtkCellRendererTextPrivate *priv = celltext->priv;
   PangoAttrList *attr_list;
-  PangoLayout *layout;
   PangoUnderline uline;
-  gint xpad;
   gboolean placeholder_layout = show_placeholder_text (celltext);
 
-  layout = gtk_widget_create_pango_layout (widget, placeholder_layout ?
-                                           priv->placeholder_text : priv->text);
-
-  gtk_cell_renderer_get_padding (GTK_CELL_RENDERER (celltext), &xpad, NULL);
-
   if (priv->extra_attrs)
     attr_list = pango_attr_list_copy (priv->extra_attrs);
   else
     attr_list = pango_attr_list_new ();
 
-  pango_layout_set_single_paragraph_mode (layout, priv->single_paragraph);
-
   if (!placeholder_layout && cell_area)
     {
       /* Add options that affect appearance but not size */
@@ -1676,8 +1667,30 @@ get_layout (GtkCellRendererText *celltext,
   if (priv->rise_set)
     add_attr (attr_list, pango_attr_rise_new (priv->rise));
 
+  return attr_list;
+}
+
+static PangoLayout*
+get_layout (GtkCellRendererText *celltext,
+            GtkWidget           *widget,
+            const GdkRectangle  *cell_area,
+            GtkCellRendererState flags)
+{
+  GtkCellRendererTextPrivate *priv = celltext->priv;
+  PangoAttrList *attr_list;
+  PangoLayout *layout;
+  gint xpad;
+
+  layout = gtk_widget_create_pango_layout (widget, show_placeholder_text (celltext) ?
+                                           priv->placeholder_text : priv->text);
+
+  gtk_cell_renderer_get_padding (GTK_CELL_RENDERER (celltext), &xpad, NULL);
+
+  pango_layout_set_single_paragraph_mode (layout, priv->single_paragraph);
+
   /* Now apply the attributes as they will effect the outcome
    * of pango_layout_get_extents() */
+  attr_list = get_layout_attributes (celltext, widget, cell_area, flags);
   pango_layout_set_attributes (layout, attr_list);
   pango_attr_list_unref (attr_list);
 
@@ -2140,6 +2153,62 @@ gtk_cell_renderer_text_set_fixed_height_from_font (GtkCellRendererText *renderer
     }
 }
 
+/* @rect is the logical extents of the unwrapped text */
+static void
+compute_width (PangoEllipsizeMode    ellipsize,
+               gint                  width_chars,
+               gint                  max_width_chars,
+               gint                  wrap_width,
+               gint                  xpad,
+               const PangoRectangle *rect,
+               gint                  char_width,
+               gint                 *minimum_size,
+               gint                 *natural_size)
+{
+  gint text_width, ellipsize_chars;
+  gint min_width, nat_width;
+
+  text_width = rect->width;
+
+  /* enforce minimum width for ellipsized labels at ~3 chars */
+  if (ellipsize != PANGO_ELLIPSIZE_NONE)
+    ellipsize_chars = 3;
+  else
+    ellipsize_chars = 0;
+
+  if (ellipsize != PANGO_ELLIPSIZE_NONE || width_chars > 0)
+    min_width = xpad * 2 +
+      MIN (PANGO_PIXELS_CEIL (text_width),
+           (PANGO_PIXELS (char_width) * MAX (width_chars, ellipsize_chars)));
+  /* If no width-chars set, minimum for wrapping text will be the wrap-width */
+  else if (wrap_width > -1)
+    min_width = xpad * 2 + rect->x + MIN (PANGO_PIXELS_CEIL (text_width), wrap_width);
+  else
+    min_width = xpad * 2 + rect->x + PANGO_PIXELS_CEIL (text_width);
+
+  if (width_chars > 0)
+    nat_width = xpad * 2 +
+      MAX ((PANGO_PIXELS (char_width) * width_chars), PANGO_PIXELS_CEIL (text_width));
+  else
+    nat_width = xpad * 2 + PANGO_PIXELS_CEIL (text_width);
+
+  nat_width = MAX (nat_width, min_width);
+
+  if (max_width_chars > 0)
+    {
+      gint max_width = xpad * 2 + PANGO_PIXELS (char_width) * max_width_chars;
+      
+      min_width = MIN (min_width, max_width);
+      nat_width = MIN (nat_width, max_width);
+    }
+
+  if (minimum_size)
+    *minimum_size = min_width;
+
+  if (natural_size)
+    *natural_size = nat_width;
+}
+
 static void
 gtk_cell_renderer_text_get_preferred_width (GtkCellRenderer *cell,
                                             GtkWidget       *widget,
@@ -2152,8 +2221,7 @@ gtk_cell_renderer_text_get_preferred_width (GtkCellRenderer *cell,
   PangoContext               *context;
   PangoFontMetrics           *metrics;
   PangoRectangle              rect;
-  gint char_width, text_width, ellipsize_chars, xpad;
-  gint min_width, nat_width;
+  gint char_width, xpad;
 
   /* "width-chars" Hard-coded minimum width:
    *    - minimum size should be MAX (width-chars, strlen ("..."));
@@ -2174,7 +2242,6 @@ gtk_cell_renderer_text_get_preferred_width (GtkCellRenderer *cell,
   /* Fetch the length of the complete unwrapped text */
   pango_layout_set_width (layout, -1);
   pango_layout_get_extents (layout, NULL, &rect);
-  text_width = rect.width;
 
   /* Fetch the average size of a charachter */
   context = pango_layout_get_context (layout);
@@ -2187,43 +2254,9 @@ gtk_cell_renderer_text_get_preferred_width (GtkCellRenderer *cell,
   pango_font_metrics_unref (metrics);
   g_object_unref (layout);
 
-  /* enforce minimum width for ellipsized labels at ~3 chars */
-  if (priv->ellipsize_set && priv->ellipsize != PANGO_ELLIPSIZE_NONE)
-    ellipsize_chars = 3;
-  else
-    ellipsize_chars = 0;
-
-  if ((priv->ellipsize_set && priv->ellipsize != PANGO_ELLIPSIZE_NONE) || priv->width_chars > 0)
-    min_width = xpad * 2 +
-      MIN (PANGO_PIXELS_CEIL (text_width),
-           (PANGO_PIXELS (char_width) * MAX (priv->width_chars, ellipsize_chars)));
-  /* If no width-chars set, minimum for wrapping text will be the wrap-width */
-  else if (priv->wrap_width > -1)
-    min_width = xpad * 2 + rect.x + MIN (PANGO_PIXELS_CEIL (text_width), priv->wrap_width);
-  else
-    min_width = xpad * 2 + rect.x + PANGO_PIXELS_CEIL (text_width);
-
-  if (priv->width_chars > 0)
-    nat_width = xpad * 2 +
-      MAX ((PANGO_PIXELS (char_width) * priv->width_chars), PANGO_PIXELS_CEIL (text_width));
-  else
-    nat_width = xpad * 2 + PANGO_PIXELS_CEIL (text_width);
-
-  nat_width = MAX (nat_width, min_width);
-
-  if (priv->max_width_chars > 0)
-    {
-      gint max_width = xpad * 2 + PANGO_PIXELS (char_width) * priv->max_width_chars;
-      
-      min_width = MIN (min_width, max_width);
-      nat_width = MIN (nat_width, max_width);
-    }
-
-  if (minimum_size)
-    *minimum_size = min_width;
-
-  if (natural_size)
-    *natural_size = nat_width;
+  compute_width (priv->ellipsize_set ? priv->ellipsize : PANGO_ELLIPSIZE_NONE,
+                 priv->width_chars, priv->max_width_chars, priv->wrap_width,
+                 xpad, &rect, char_width, minimum_size, natural_size);
 }
 
 static void
@@ -2297,3 +2330,157 @@ gtk_cell_renderer_text_get_aligned_area (GtkCellRenderer       *cell,
 
   g_object_unref (layout);
 }
+
+struct _GtkCellRendererTextSnapshot
+{
+  gchar *text;
+  PangoAttrList *attrs;
+  PangoEllipsizeMode ellipsize;
+
+  gint width_chars;
+  gint max_width_chars;
+  gint wrap_width;
+  gint xpad, ypad;
+  gint fixed_width, fixed_height;
+
+  guint single_paragraph : 1;
+};
+
+/**
+ * _gtk_cell_renderer_text_snapshot:
+ * @celltext: a #GtkCellRendererText
+ * @widget: the widget the renderer measures for
+ *
+ * Copies what is needed to measure the text @celltext currently shows
+ * with _gtk_cell_renderer_text_snapshot_measure().
+ *
+ * Height-for-width requests use the width a #GtkTreeView column has at
+ * the time they are made, so only text that never wraps can be
+ * measured up front.
+ *
+ * Returns: a new snapshot or %NULL if @celltext must be measured with
+ *   the cell renderer API
+ **/
+GtkCellRendererTextSnapshot *
+_gtk_cell_renderer_text_snapshot (GtkCellRendererText *celltext,
+                                  GtkWidget           *widget)
+{
+  GtkCellRendererTextPrivate *priv = celltext->priv;
+  GtkCellRendererTextSnapshot *snapshot;
+  PangoEllipsizeMode ellipsize;
+  gint fixed_width, fixed_height;
+
+  /* Subclasses may measure differently, and the fixed height rows are
+   * converted to a fixed size on the next real size request */
+  if (G_OBJECT_TYPE (celltext) != GTK_TYPE_CELL_RENDERER_TEXT ||
+      priv->calc_fixed_height)
+    return NULL;
+
+  ellipsize = priv->ellipsize_set ? priv->ellipsize : PANGO_ELLIPSIZE_NONE;
+  gtk_cell_renderer_get_fixed_size (GTK_CELL_RENDERER (celltext), &fixed_width, &fixed_height);
+
+  /* Only a positive fixed size is taken as is when measuring, leave
+   * zero sizes to the cell renderer API */
+  if (fixed_width == 0 || fixed_height == 0)
+    return NULL;
+
+  if (fixed_height <= 0 && ellipsize == PANGO_ELLIPSIZE_NONE &&
+      (priv->wrap_width != -1 || priv->width_chars > 0 ||
+       priv->max_width_chars > 0 || fixed_width > 0))
+    return NULL;
+
+  snapshot = g_slice_new0 (GtkCellRendererTextSnapshot);
+
+  snapshot->text = g_strdup (show_placeholder_text (celltext) ?
+                             priv->placeholder_text : priv->text);
+  snapshot->attrs = get_layout_attributes (celltext, widget, NULL, 0);
+  snapshot->ellipsize = ellipsize;
+  snapshot->width_chars = priv->width_chars;
+  snapshot->max_width_chars = priv->max_width_chars;
+  snapshot->wrap_width = priv->wrap_width;
+  gtk_cell_renderer_get_padding (GTK_CELL_RENDERER (celltext), &snapshot->xpad, &snapshot->ypad);
+  snapshot->fixed_width = fixed_width;
+  snapshot->fixed_height = fixed_height;
+  snapshot->single_paragraph = priv->single_paragraph;
+
+  return snapshot;
+}
+
+void
+_gtk_cell_renderer_text_snapshot_free (GtkCellRendererTextSnapshot *snapshot)
+{
+  g_free (snapshot->text);
+  pango_attr_list_unref (snapshot->attrs);
+
+  g_slice_free (GtkCellRendererTextSnapshot, snapshot);
+}
+
+/**
+ * _gtk_cell_renderer_text_snapshot_measure:
+ * @snapshot: a snapshot from _gtk_cell_renderer_text_snapshot()
+ * @context: a #PangoContext set up like the widget's one
+ * @minimum_width: (out): the minimum width
+ * @natural_width: (out): the natural width
+ * @height: (out): the height
+ *
+ * Measures @snapshot like gtk_cell_renderer_get_preferred_width() and
+ * gtk_cell_renderer_get_preferred_height_for_width() would have measured
+ * the renderer. This may be called from any thread as long as @context
+ * is only used by that thread.
+ **/
+void
+_gtk_cell_renderer_text_snapshot_measure (GtkCellRendererTextSnapshot *snapshot,
+                                          PangoContext                *context,
+                                          gint                        *minimum_width,
+                                          gint                        *natural_width,
+                                          gint                        *height)
+{
+  PangoLayout *layout;
+  PangoRectangle rect;
+  gint char_width = 0;
+  gint text_height;
+
+  layout = pango_layout_new (context);
+  if (snapshot->text)
+    pango_layout_set_text (layout, snapshot->text, -1);
+  pango_layout_set_single_paragraph_mode (layout, snapshot->single_paragraph);
+  pango_layout_set_attributes (layout, snapshot->attrs);
+
+  pango_layout_get_extents (layout, NULL, &rect);
+
+  if (snapshot->fixed_width > 0)
+    {
+      *minimum_width = snapshot->fixed_width;
+      *natural_width = snapshot->fixed_width;
+    }
+  else
+    {
+      if (snapshot->ellipsize != PANGO_ELLIPSIZE_NONE ||
+          snapshot->width_chars > 0 ||
+          snapshot->max_width_chars > 0)
+        {
+          PangoFontMetrics *metrics;
+
+          metrics = pango_context_get_metrics (context,
+                                               pango_context_get_font_description (context),
+                                               pango_context_get_language (context));
+          char_width = pango_font_metrics_get_approximate_char_width (metrics);
+          pango_font_metrics_unref (metrics);
+        }
+
+      compute_width (snapshot->ellipsize,
+                     snapshot->width_chars, snapshot->max_width_chars, snapshot->wrap_width,
+                     snapshot->xpad, &rect, char_width, minimum_width, natural_width);
+    }
+
+  if (snapshot->fixed_height > 0)
+    *height = snapshot->fixed_height;
+  else
+    {
+      /* The text doesn't wrap, so the width doesn't matter */
+      pango_layout_get_pixel_size (layout, NULL, &text_height);
+      *height = text_height + snapshot->ypad * 2;
+    }
+
+  g_object_unref (layout);
+}
@@ -0,0 +1,39 @@
+/* GTK - The GIMP Toolkit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GTK_CELL_RENDERER_TEXT_PRIVATE_H__
+#define __GTK_CELL_RENDERER_TEXT_PRIVATE_H__
+
+#include "gtkcellrenderertext.h"
+
+G_BEGIN_DECLS
+
+/* Everything needed to measure the current text of a renderer without
+ * touching the renderer or the widget, so it can be done in a thread */
+typedef struct _GtkCellRendererTextSnapshot GtkCellRendererTextSnapshot;
+
+GtkCellRendererTextSnapshot *   _gtk_cell_renderer_text_snapshot        (GtkCellRendererText         *celltext,
+                                                                         GtkWidget                   *widget);
+void                            _gtk_cell_renderer_text_snapshot_free   (GtkCellRendererTextSnapshot *snapshot);
+void                            _gtk_cell_renderer_text_snapshot_measure(GtkCellRendererTextSnapshot *snapshot,
+                                                                         PangoContext                *context,
+                                                                         gint                        *minimum_width,
+                                                                         gint                        *natural_width,
+                                                                         gint                        *height);
+
+G_END_DECLS
+
+#endif /* __GTK_CELL_RENDERER_TEXT_PRIVATE_H__ */
@@ -38,6 +38,7 @@
 
 #include "gtkbuildable.h"
 #include "gtkbuilderprivate.h"
+#include "gtkcssprofilerprivate.h"
 #include "gtktypebuiltins.h"
 #include "gtkprivate.h"
 #include "gtkmain.h"
@@ -1664,6 +1665,8 @@ gtk_container_idle_sizer (GdkFrameClock *clock,
                                    empty);
 
       _gtk_bitmask_free (empty);
+
+      _gtk_css_profiler_report_counters ();
     }
 
   /* we may be invoked with a container_resize_queue of NULL, because
@@ -199,6 +199,8 @@ _gtk_css_animation_new (const char      *name,
                         double           iteration_count)
 {
   GtkCssAnimation *animation;
+  GtkStyleAnimation *style_animation;
+  guint i;
 
   g_return_val_if_fail (name != NULL, NULL);
   g_return_val_if_fail (keyframes != NULL, NULL);
@@ -221,7 +223,15 @@ _gtk_css_animation_new (const char      *name,
   animation->fill_mode = fill_mode;
   animation->iteration_count = iteration_count;
 
-  return GTK_STYLE_ANIMATION (animation);
+  style_animation = GTK_STYLE_ANIMATION (animation);
+  for (i = 0; i < _gtk_css_keyframes_get_n_properties (keyframes); i++)
+    {
+      style_animation->properties = _gtk_bitmask_set (style_animation->properties,
+                                                      _gtk_css_keyframes_get_property_id (keyframes, i),
+                                                      TRUE);
+    }
+
+  return style_animation;
 }
 
 const char *
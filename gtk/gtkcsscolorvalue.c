@@ -386,6 +386,16 @@ gtk_css_value_color_equal (const GtkCssValue *value1,
     }
 }
 
+static guint
+gtk_css_value_color_hash (const GtkCssValue *color)
+{
+  /* Only literal colors get interned, the others just need some hash */
+  if (color->type == COLOR_TYPE_LITERAL)
+    return gdk_rgba_hash (_gtk_css_rgba_value_get_rgba (color->last_value));
+
+  return color->type;
+}
+
 static GtkCssValue *
 gtk_css_value_color_transition (GtkCssValue *start,
                                 GtkCssValue *end,
@@ -465,7 +475,8 @@ static const GtkCssValueClass GTK_CSS_VALUE_COLOR = {
   gtk_css_value_color_compute,
   gtk_css_value_color_equal,
   gtk_css_value_color_transition,
-  gtk_css_value_color_print
+  gtk_css_value_color_print,
+  gtk_css_value_color_hash
 };
 
 GtkCssValue *
@@ -479,7 +490,7 @@ _gtk_css_color_value_new_literal (const GdkRGBA *color)
   value->type = COLOR_TYPE_LITERAL;
   value->last_value = _gtk_css_rgba_value_new_from_rgba (color);
 
-  return value;
+  return _gtk_css_value_intern (value);
 }
 
 GtkCssValue *
@@ -574,6 +585,44 @@ _gtk_css_color_value_new_win32 (const gchar *theme_class,
   return value;
 }
 
+/**
+ * _gtk_css_color_value_unpack:
+ * @value: a value
+ * @rgba: (out): the color, if @value is a literal
+ * @name: (out): the name, if @value refers to a named color
+ *
+ * Gets what _gtk_css_color_value_new_literal() or
+ * _gtk_css_color_value_new_name() created @value from.
+ *
+ * Returns: %FALSE if @value is not a literal or a named color
+ **/
+gboolean
+_gtk_css_color_value_unpack (const GtkCssValue  *value,
+                             GdkRGBA            *rgba,
+                             const char        **name)
+{
+  if (value->class != &GTK_CSS_VALUE_COLOR)
+    return FALSE;
+
+  switch (value->type)
+    {
+    case COLOR_TYPE_LITERAL:
+      *rgba = *_gtk_css_rgba_value_get_rgba (value->last_value);
+      *name = NULL;
+      return TRUE;
+    case COLOR_TYPE_NAME:
+      *name = value->sym_col.name;
+      return TRUE;
+    case COLOR_TYPE_SHADE:
+    case COLOR_TYPE_ALPHA:
+    case COLOR_TYPE_MIX:
+    case COLOR_TYPE_WIN32:
+    case COLOR_TYPE_CURRENT_COLOR:
+    default:
+      return FALSE;
+    }
+}
+
 GtkCssValue *
 _gtk_css_color_value_new_current_color (void)
 {
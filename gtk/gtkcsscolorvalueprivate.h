@@ -43,6 +43,10 @@ GtkCssValue *   _gtk_css_color_value_new_current_color  (void);
 
 GtkCssValue *   _gtk_css_color_value_parse              (GtkCssParser   *parser);
 
+gboolean        _gtk_css_color_value_unpack             (const GtkCssValue *value,
+                                                         GdkRGBA           *rgba,
+                                                         const char       **name);
+
 GtkCssValue *   _gtk_css_color_value_resolve            (GtkCssValue             *color,
                                                          GtkStyleProviderPrivate *provider,
                                                          GtkCssValue             *current,
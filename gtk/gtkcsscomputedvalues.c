@@ -29,6 +29,7 @@
 #include "gtkcssinheritvalueprivate.h"
 #include "gtkcssinitialvalueprivate.h"
 #include "gtkcssnumbervalueprivate.h"
+#include "gtkcssprofilerprivate.h"
 #include "gtkcssshorthandpropertyprivate.h"
 #include "gtkcssstringvalueprivate.h"
 #include "gtkcssstylepropertyprivate.h"
@@ -38,21 +39,271 @@
 #include "gtkstylepropertyprivate.h"
 #include "gtkstyleproviderprivate.h"
 
+#include <string.h>
+
+/* The values are kept in groups of properties that are usually set
+ * together, like all the border properties. Groups are refcounted and
+ * once all values are computed, see _gtk_css_computed_values_share_groups(),
+ * identical groups are shared by all computed values using them.
+ * Identical means the same value pointers, which is what inheriting a
+ * value from the parent or using the initial value gives. So a style
+ * that only differs from another one in its color only needs its own
+ * core group.
+ *
+ * A shared group is never changed, it is copied first.
+ */
+struct _GtkCssValueGroup {
+  guint         ref_count;
+  guint         hash;
+  guint8        type;           /* GtkCssValueGroupType */
+  guint8        n_values;
+  guint8        interned : 1;
+  guint8        dependencies;   /* all dependencies of the values */
+  GtkCssValue  *values[1];      /* really n_values, followed by their GtkCssDependencies */
+};
+
+#define GTK_CSS_VALUE_GROUP_DEPENDENCIES(group) ((guint8 *) &(group)->values[(group)->n_values])
+
+static const guint core_properties[] = {
+  GTK_CSS_PROPERTY_COLOR,
+  GTK_CSS_PROPERTY_FONT_SIZE
+};
+
+static const guint font_properties[] = {
+  GTK_CSS_PROPERTY_FONT_FAMILY,
+  GTK_CSS_PROPERTY_FONT_STYLE,
+  GTK_CSS_PROPERTY_FONT_VARIANT,
+  GTK_CSS_PROPERTY_FONT_WEIGHT,
+  GTK_CSS_PROPERTY_TEXT_SHADOW,
+  GTK_CSS_PROPERTY_ICON_SHADOW
+};
+
+static const guint background_properties[] = {
+  GTK_CSS_PROPERTY_BACKGROUND_COLOR,
+  GTK_CSS_PROPERTY_BOX_SHADOW,
+  GTK_CSS_PROPERTY_BACKGROUND_CLIP,
+  GTK_CSS_PROPERTY_BACKGROUND_ORIGIN,
+  GTK_CSS_PROPERTY_BACKGROUND_SIZE,
+  GTK_CSS_PROPERTY_BACKGROUND_POSITION,
+  GTK_CSS_PROPERTY_BACKGROUND_REPEAT,
+  GTK_CSS_PROPERTY_BACKGROUND_IMAGE
+};
+
+static const guint border_properties[] = {
+  GTK_CSS_PROPERTY_BORDER_TOP_STYLE,
+  GTK_CSS_PROPERTY_BORDER_TOP_WIDTH,
+  GTK_CSS_PROPERTY_BORDER_LEFT_STYLE,
+  GTK_CSS_PROPERTY_BORDER_LEFT_WIDTH,
+  GTK_CSS_PROPERTY_BORDER_BOTTOM_STYLE,
+  GTK_CSS_PROPERTY_BORDER_BOTTOM_WIDTH,
+  GTK_CSS_PROPERTY_BORDER_RIGHT_STYLE,
+  GTK_CSS_PROPERTY_BORDER_RIGHT_WIDTH,
+  GTK_CSS_PROPERTY_BORDER_TOP_LEFT_RADIUS,
+  GTK_CSS_PROPERTY_BORDER_TOP_RIGHT_RADIUS,
+  GTK_CSS_PROPERTY_BORDER_BOTTOM_RIGHT_RADIUS,
+  GTK_CSS_PROPERTY_BORDER_BOTTOM_LEFT_RADIUS,
+  GTK_CSS_PROPERTY_BORDER_TOP_COLOR,
+  GTK_CSS_PROPERTY_BORDER_RIGHT_COLOR,
+  GTK_CSS_PROPERTY_BORDER_BOTTOM_COLOR,
+  GTK_CSS_PROPERTY_BORDER_LEFT_COLOR,
+  GTK_CSS_PROPERTY_BORDER_IMAGE_SOURCE,
+  GTK_CSS_PROPERTY_BORDER_IMAGE_REPEAT,
+  GTK_CSS_PROPERTY_BORDER_IMAGE_SLICE,
+  GTK_CSS_PROPERTY_BORDER_IMAGE_WIDTH
+};
+
+static const guint outline_properties[] = {
+  GTK_CSS_PROPERTY_OUTLINE_STYLE,
+  GTK_CSS_PROPERTY_OUTLINE_WIDTH,
+  GTK_CSS_PROPERTY_OUTLINE_OFFSET,
+  GTK_CSS_PROPERTY_OUTLINE_COLOR
+};
+
+static const guint size_properties[] = {
+  GTK_CSS_PROPERTY_MARGIN_TOP,
+  GTK_CSS_PROPERTY_MARGIN_LEFT,
+  GTK_CSS_PROPERTY_MARGIN_BOTTOM,
+  GTK_CSS_PROPERTY_MARGIN_RIGHT,
+  GTK_CSS_PROPERTY_PADDING_TOP,
+  GTK_CSS_PROPERTY_PADDING_LEFT,
+  GTK_CSS_PROPERTY_PADDING_BOTTOM,
+  GTK_CSS_PROPERTY_PADDING_RIGHT
+};
+
+static const guint transition_properties[] = {
+  GTK_CSS_PROPERTY_TRANSITION_PROPERTY,
+  GTK_CSS_PROPERTY_TRANSITION_DURATION,
+  GTK_CSS_PROPERTY_TRANSITION_TIMING_FUNCTION,
+  GTK_CSS_PROPERTY_TRANSITION_DELAY
+};
+
+static const guint animation_properties[] = {
+  GTK_CSS_PROPERTY_ANIMATION_NAME,
+  GTK_CSS_PROPERTY_ANIMATION_DURATION,
+  GTK_CSS_PROPERTY_ANIMATION_TIMING_FUNCTION,
+  GTK_CSS_PROPERTY_ANIMATION_ITERATION_COUNT,
+  GTK_CSS_PROPERTY_ANIMATION_DIRECTION,
+  GTK_CSS_PROPERTY_ANIMATION_PLAY_STATE,
+  GTK_CSS_PROPERTY_ANIMATION_DELAY,
+  GTK_CSS_PROPERTY_ANIMATION_FILL_MODE
+};
+
+static const guint other_properties[] = {
+  GTK_CSS_PROPERTY_OPACITY,
+  GTK_CSS_PROPERTY_GTK_IMAGE_EFFECT,
+  GTK_CSS_PROPERTY_ENGINE,
+  GTK_CSS_PROPERTY_GTK_KEY_BINDINGS
+};
+
+/* indexed by GtkCssValueGroupType */
+static const struct {
+  const guint *properties;
+  guint        n_properties;
+} group_properties[GTK_CSS_VALUE_GROUP_N_GROUPS] = {
+  { core_properties, G_N_ELEMENTS (core_properties) },
+  { font_properties, G_N_ELEMENTS (font_properties) },
+  { background_properties, G_N_ELEMENTS (background_properties) },
+  { border_properties, G_N_ELEMENTS (border_properties) },
+  { outline_properties, G_N_ELEMENTS (outline_properties) },
+  { size_properties, G_N_ELEMENTS (size_properties) },
+  { transition_properties, G_N_ELEMENTS (transition_properties) },
+  { animation_properties, G_N_ELEMENTS (animation_properties) },
+  { other_properties, G_N_ELEMENTS (other_properties) }
+};
+
+/* Where to find a property, filled in from group_properties */
+static guint8 property_group[GTK_CSS_PROPERTY_N_PROPERTIES];
+static guint8 property_index[GTK_CSS_PROPERTY_N_PROPERTIES];
+
+/* the groups that can be shared */
+static GHashTable *interned_groups;
+
+static GtkCssValueGroup *
+gtk_css_value_group_new (GtkCssValueGroupType type)
+{
+  GtkCssValueGroup *group;
+  guint n_values;
+
+  n_values = group_properties[type].n_properties;
+  group = g_malloc0 (G_STRUCT_OFFSET (GtkCssValueGroup, values)
+                     + n_values * (sizeof (GtkCssValue *) + sizeof (guint8)));
+  group->ref_count = 1;
+  group->type = type;
+  group->n_values = n_values;
+
+  return group;
+}
+
+static GtkCssValueGroup *
+gtk_css_value_group_ref (GtkCssValueGroup *group)
+{
+  group->ref_count++;
+
+  return group;
+}
+
+static void
+gtk_css_value_group_unref (GtkCssValueGroup *group)
+{
+  guint i;
+
+  group->ref_count--;
+  if (group->ref_count > 0)
+    return;
+
+  if (group->interned)
+    g_hash_table_remove (interned_groups, group);
+
+  for (i = 0; i < group->n_values; i++)
+    _gtk_css_value_unref (group->values[i]);
+
+  g_free (group);
+}
+
+static GtkCssValueGroup *
+gtk_css_value_group_copy (const GtkCssValueGroup *group)
+{
+  GtkCssValueGroup *copy;
+  guint i;
+
+  copy = gtk_css_value_group_new (group->type);
+  for (i = 0; i < group->n_values; i++)
+    {
+      if (group->values[i])
+        copy->values[i] = _gtk_css_value_ref (group->values[i]);
+    }
+  memcpy (GTK_CSS_VALUE_GROUP_DEPENDENCIES (copy),
+          GTK_CSS_VALUE_GROUP_DEPENDENCIES (group),
+          group->n_values);
+  copy->dependencies = group->dependencies;
+
+  return copy;
+}
+
+static guint
+gtk_css_value_group_hash (gconstpointer data)
+{
+  const GtkCssValueGroup *group = data;
+
+  return group->hash;
+}
+
+static gboolean
+gtk_css_value_group_equal (gconstpointer a,
+                           gconstpointer b)
+{
+  const GtkCssValueGroup *group_a = a;
+  const GtkCssValueGroup *group_b = b;
+
+  return group_a->type == group_b->type &&
+         memcmp (group_a->values,
+                 group_b->values,
+                 group_a->n_values * sizeof (GtkCssValue *)) == 0 &&
+         memcmp (GTK_CSS_VALUE_GROUP_DEPENDENCIES (group_a),
+                 GTK_CSS_VALUE_GROUP_DEPENDENCIES (group_b),
+                 group_a->n_values) == 0;
+}
+
+static void
+gtk_css_value_group_update_hash (GtkCssValueGroup *group)
+{
+  guint8 *dependencies = GTK_CSS_VALUE_GROUP_DEPENDENCIES (group);
+  guint i, hash;
+
+  hash = group->type;
+  for (i = 0; i < group->n_values; i++)
+    {
+      hash = (hash << 5) - hash + GPOINTER_TO_UINT (group->values[i]);
+      hash = (hash << 5) - hash + dependencies[i];
+    }
+
+  group->hash = hash;
+}
+
 G_DEFINE_TYPE (GtkCssComputedValues, _gtk_css_computed_values, G_TYPE_OBJECT)
 
 static void
 gtk_css_computed_values_dispose (GObject *object)
 {
   GtkCssComputedValues *values = GTK_CSS_COMPUTED_VALUES (object);
+  guint i;
 
-  if (values->values)
+  for (i = 0; i < GTK_CSS_VALUE_GROUP_N_GROUPS; i++)
     {
-      g_ptr_array_unref (values->values);
-      values->values = NULL;
+      if (values->groups[i])
+        {
+          gtk_css_value_group_unref (values->groups[i]);
+          values->groups[i] = NULL;
+        }
     }
   if (values->sections)
     {
-      g_ptr_array_unref (values->sections);
+      for (i = 0; i < GTK_CSS_PROPERTY_N_PROPERTIES; i++)
+        {
+          if (values->sections[i])
+            gtk_css_section_unref (values->sections[i]);
+        }
+      g_free (values->sections);
       values->sections = NULL;
     }
   if (values->animated_values)
@@ -60,6 +311,11 @@ gtk_css_computed_values_dispose (GObject *object)
       g_ptr_array_unref (values->animated_values);
       values->animated_values = NULL;
     }
+  if (values->animated_properties)
+    {
+      _gtk_bitmask_free (values->animated_properties);
+      values->animated_properties = NULL;
+    }
 
   g_slist_free_full (values->animations, g_object_unref);
   values->animations = NULL;
@@ -67,35 +323,34 @@ gtk_css_computed_values_dispose (GObject *object)
   G_OBJECT_CLASS (_gtk_css_computed_values_parent_class)->dispose (object);
 }
 
-static void
-gtk_css_computed_values_finalize (GObject *object)
-{
-  GtkCssComputedValues *values = GTK_CSS_COMPUTED_VALUES (object);
-
-  _gtk_bitmask_free (values->depends_on_parent);
-  _gtk_bitmask_free (values->equals_parent);
-  _gtk_bitmask_free (values->depends_on_color);
-  _gtk_bitmask_free (values->depends_on_font_size);
-
-  G_OBJECT_CLASS (_gtk_css_computed_values_parent_class)->finalize (object);
-}
-
 static void
 _gtk_css_computed_values_class_init (GtkCssComputedValuesClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  guint i, j, n_assigned;
 
   object_class->dispose = gtk_css_computed_values_dispose;
-  object_class->finalize = gtk_css_computed_values_finalize;
+
+  n_assigned = 0;
+  for (i = 0; i < GTK_CSS_VALUE_GROUP_N_GROUPS; i++)
+    {
+      for (j = 0; j < group_properties[i].n_properties; j++)
+        {
+          property_group[group_properties[i].properties[j]] = i;
+          property_index[group_properties[i].properties[j]] = j;
+        }
+      n_assigned += group_properties[i].n_properties;
+    }
+  /* every property must be in exactly one group */
+  g_assert (n_assigned == GTK_CSS_PROPERTY_N_PROPERTIES);
+
+  interned_groups = g_hash_table_new (gtk_css_value_group_hash, gtk_css_value_group_equal);
 }
 
 static void
 _gtk_css_computed_values_init (GtkCssComputedValues *values)
 {
-  values->depends_on_parent = _gtk_bitmask_new ();
-  values->equals_parent = _gtk_bitmask_new ();
-  values->depends_on_color = _gtk_bitmask_new ();
-  values->depends_on_font_size = _gtk_bitmask_new ();
+  GTK_CSS_PROFILER_COUNT (COMPUTED_VALUES, 1);
 }
 
 GtkCssComputedValues *
@@ -104,11 +359,26 @@ _gtk_css_computed_values_new (void)
   return g_object_new (GTK_TYPE_CSS_COMPUTED_VALUES, NULL);
 }
 
-static void
-maybe_unref_section (gpointer section)
+/* Returns the group of @type, so that it can be changed */
+static GtkCssValueGroup *
+gtk_css_computed_values_get_writable_group (GtkCssComputedValues *values,
+                                            GtkCssValueGroupType  type)
 {
-  if (section)
-    gtk_css_section_unref (section);
+  GtkCssValueGroup *group = values->groups[type];
+
+  if (group == NULL)
+    {
+      group = gtk_css_value_group_new (type);
+      values->groups[type] = group;
+    }
+  else if (group->ref_count > 1 || group->interned)
+    {
+      group = gtk_css_value_group_copy (group);
+      gtk_css_value_group_unref (values->groups[type]);
+      values->groups[type] = group;
+    }
+
+  return group;
 }
 
 void
@@ -122,11 +392,14 @@ _gtk_css_computed_values_compute_value (GtkCssComputedValues    *values,
 {
   GtkCssDependencies dependencies;
   GtkCssValue *value;
+  gint64 before;
 
   gtk_internal_return_if_fail (GTK_IS_CSS_COMPUTED_VALUES (values));
   gtk_internal_return_if_fail (GTK_IS_STYLE_PROVIDER_PRIVATE (provider));
   gtk_internal_return_if_fail (parent_values == NULL || GTK_IS_CSS_COMPUTED_VALUES (parent_values));
 
+  before = _gtk_css_profiler_begin_mark ();
+
   /* http://www.w3.org/TR/css3-cascade/#cascade
    * Then, for every element, the value for each property can be found
    * by following this pseudo-algorithm:
@@ -150,6 +423,11 @@ _gtk_css_computed_values_compute_value (GtkCssComputedValues    *values,
 
   _gtk_css_value_unref (value);
   _gtk_css_value_unref (specified);
+
+  if (before)
+    _gtk_css_profiler_end_mark (before,
+                                "css compute value",
+                                _gtk_style_property_get_name (GTK_STYLE_PROPERTY (_gtk_css_style_property_lookup_by_id (id))));
 }
 
 void
@@ -178,41 +456,72 @@ _gtk_css_computed_values_set_value (GtkCssComputedValues *values,
                                     GtkCssDependencies    dependencies,
                                     GtkCssSection        *section)
 {
+  GtkCssValueGroup *group;
+  guint index;
+
   gtk_internal_return_if_fail (GTK_IS_CSS_COMPUTED_VALUES (values));
+  gtk_internal_return_if_fail (id < GTK_CSS_PROPERTY_N_PROPERTIES);
 
-  if (values->values == NULL)
-    values->values = g_ptr_array_new_full (_gtk_css_style_property_get_n_properties (),
-					   (GDestroyNotify)_gtk_css_value_unref);
-  if (id >= values->values->len)
-   g_ptr_array_set_size (values->values, id + 1);
+  group = gtk_css_computed_values_get_writable_group (values, property_group[id]);
+  index = property_index[id];
 
-  if (g_ptr_array_index (values->values, id))
-    _gtk_css_value_unref (g_ptr_array_index (values->values, id));
-  g_ptr_array_index (values->values, id) = _gtk_css_value_ref (value);
+  _gtk_css_value_ref (value);
+  _gtk_css_value_unref (group->values[index]);
+  group->values[index] = value;
 
-  if (dependencies & (GTK_CSS_DEPENDS_ON_PARENT | GTK_CSS_EQUALS_PARENT))
-    values->depends_on_parent = _gtk_bitmask_set (values->depends_on_parent, id, TRUE);
-  if (dependencies & (GTK_CSS_EQUALS_PARENT))
-    values->equals_parent = _gtk_bitmask_set (values->equals_parent, id, TRUE);
-  if (dependencies & (GTK_CSS_DEPENDS_ON_COLOR))
-    values->depends_on_color = _gtk_bitmask_set (values->depends_on_color, id, TRUE);
-  if (dependencies & (GTK_CSS_DEPENDS_ON_FONT_SIZE))
-    values->depends_on_font_size = _gtk_bitmask_set (values->depends_on_font_size, id, TRUE);
+  GTK_CSS_VALUE_GROUP_DEPENDENCIES (group)[index] = dependencies;
+  group->dependencies |= dependencies;
 
-  if (values->sections && values->sections->len > id && g_ptr_array_index (values->sections, id))
+  if (values->sections && values->sections[id])
     {
-      gtk_css_section_unref (g_ptr_array_index (values->sections, id));
-      g_ptr_array_index (values->sections, id) = NULL;
+      gtk_css_section_unref (values->sections[id]);
+      values->sections[id] = NULL;
     }
 
+  /* Providers only hand out sections when debugging */
   if (section)
     {
       if (values->sections == NULL)
-        values->sections = g_ptr_array_new_with_free_func (maybe_unref_section);
-      if (values->sections->len <= id)
-        g_ptr_array_set_size (values->sections, id + 1);
+        values->sections = g_new0 (GtkCssSection *, GTK_CSS_PROPERTY_N_PROPERTIES);
 
-      g_ptr_array_index (values->sections, id) = gtk_css_section_ref (section);
+      values->sections[id] = gtk_css_section_ref (section);
+    }
+}
+
+/**
+ * _gtk_css_computed_values_share_groups:
+ * @values: the values
+ *
+ * Replaces the groups of values in @values with identical ones that
+ * are already used elsewhere. Call this when all values have been
+ * computed, so the memory of groups that end up the same is shared.
+ **/
+void
+_gtk_css_computed_values_share_groups (GtkCssComputedValues *values)
+{
+  GtkCssValueGroup *group, *shared;
+  guint i;
+
+  gtk_internal_return_if_fail (GTK_IS_CSS_COMPUTED_VALUES (values));
+
+  for (i = 0; i < GTK_CSS_VALUE_GROUP_N_GROUPS; i++)
+    {
+      group = values->groups[i];
+      if (group == NULL || group->interned)
+        continue;
+
+      gtk_css_value_group_update_hash (group);
+      shared = g_hash_table_lookup (interned_groups, group);
+      if (shared)
+        {
+          values->groups[i] = gtk_css_value_group_ref (shared);
+          gtk_css_value_group_unref (group);
+        }
+      else
+        {
+          group->interned = TRUE;
+          g_hash_table_add (interned_groups, group);
+        }
     }
 }
 
@@ -234,13 +543,18 @@ GtkCssValue *
 _gtk_css_computed_values_get_intrinsic_value (GtkCssComputedValues *values,
                                               guint                 id)
 {
+  GtkCssValueGroup *group;
+
   gtk_internal_return_val_if_fail (GTK_IS_CSS_COMPUTED_VALUES (values), NULL);
 
-  if (values->values == NULL ||
-      id >= values->values->len)
+  if (id >= GTK_CSS_PROPERTY_N_PROPERTIES)
+    return NULL;
+
+  group = values->groups[property_group[id]];
+  if (group == NULL)
     return NULL;
 
-  return g_ptr_array_index (values->values, id);
+  return group->values[property_index[id]];
 }
 
 GtkCssSection *
@@ -250,10 +564,10 @@ _gtk_css_computed_values_get_section (GtkCssComputedValues *values,
   gtk_internal_return_val_if_fail (GTK_IS_CSS_COMPUTED_VALUES (values), NULL);
 
   if (values->sections == NULL ||
-      id >= values->sections->len)
+      id >= GTK_CSS_PROPERTY_N_PROPERTIES)
     return NULL;
 
-  return g_ptr_array_index (values->sections, id);
+  return values->sections[id];
 }
 
 GtkBitmask *
@@ -261,18 +575,25 @@ _gtk_css_computed_values_get_difference (GtkCssComputedValues *values,
                                          GtkCssComputedValues *other)
 {
   GtkBitmask *result;
-  guint i, len;
+  guint i, j;
 
-  len = MIN (values->values->len, other->values->len);
   result = _gtk_bitmask_new ();
-  if (values->values->len != other->values->len)
-    result = _gtk_bitmask_invert_range (result, len, MAX (values->values->len, other->values->len));
-  
-  for (i = 0; i < len; i++)
+
+  for (i = 0; i < GTK_CSS_VALUE_GROUP_N_GROUPS; i++)
     {
-      if (!_gtk_css_value_equal (g_ptr_array_index (values->values, i),
-                                 g_ptr_array_index (other->values, i)))
-        result = _gtk_bitmask_set (result, i, TRUE);
+      GtkCssValueGroup *group = values->groups[i];
+      GtkCssValueGroup *other_group = other->groups[i];
+
+      /* shared groups make this cheap */
+      if (group == other_group)
+        continue;
+
+      for (j = 0; j < group_properties[i].n_properties; j++)
+        {
+          if (!_gtk_css_value_equal0 (group ? group->values[j] : NULL,
+                                      other_group ? other_group->values[j] : NULL))
+            result = _gtk_bitmask_set (result, group_properties[i].properties[j], TRUE);
+        }
     }
 
   return result;
@@ -529,7 +850,7 @@ GtkBitmask *
 _gtk_css_computed_values_advance (GtkCssComputedValues *values,
                                   gint64                timestamp)
 {
-  GtkBitmask *changed;
+  GtkBitmask *changed, *properties;
   GPtrArray *old_computed_values;
   GSList *list;
   guint i;
@@ -541,6 +862,12 @@ _gtk_css_computed_values_advance (GtkCssComputedValues *values,
   old_computed_values = values->animated_values;
   values->animated_values = NULL;
 
+  /* Only the properties animated now or at the last tick can have changed */
+  properties = values->animated_properties;
+  if (properties == NULL)
+    properties = _gtk_bitmask_new ();
+  values->animated_properties = _gtk_bitmask_new ();
+
   list = values->animations;
   while (list)
     {
@@ -548,6 +875,8 @@ _gtk_css_computed_values_advance (GtkCssComputedValues *values,
       
       list = list->next;
 
+      values->animated_properties = _gtk_bitmask_union (values->animated_properties,
+                                                        _gtk_style_animation_get_properties (animation));
       _gtk_style_animation_set_values (animation,
                                        timestamp,
                                        GTK_CSS_COMPUTED_VALUES (values));
@@ -562,10 +891,15 @@ _gtk_css_computed_values_advance (GtkCssComputedValues *values,
   /* figure out changes */
   changed = _gtk_bitmask_new ();
 
+  properties = _gtk_bitmask_union (properties, values->animated_properties);
+
   for (i = 0; i < GTK_CSS_PROPERTY_N_PROPERTIES; i++)
     {
       GtkCssValue *old_animated, *new_animated;
 
+      if (!_gtk_bitmask_get (properties, i))
+        continue;
+
       old_animated = old_computed_values && i < old_computed_values->len ? g_ptr_array_index (old_computed_values, i) : NULL;
       new_animated = values->animated_values && i < values->animated_values->len ? g_ptr_array_index (values->animated_values, i) : NULL;
 
@@ -573,6 +907,7 @@ _gtk_css_computed_values_advance (GtkCssComputedValues *values,
         changed = _gtk_bitmask_set (changed, i, TRUE);
     }
 
+  _gtk_bitmask_free (properties);
   if (old_computed_values)
     g_ptr_array_unref (old_computed_values);
 
@@ -605,11 +940,48 @@ _gtk_css_computed_values_cancel_animations (GtkCssComputedValues *values)
       g_ptr_array_unref (values->animated_values);
       values->animated_values = NULL;
     }
+  if (values->animated_properties)
+    {
+      _gtk_bitmask_free (values->animated_properties);
+      values->animated_properties = NULL;
+    }
 
   g_slist_free_full (values->animations, g_object_unref);
   values->animations = NULL;
 }
 
+/* Adds the properties with any of @dependencies to @changes. If
+ * @parent_changes is given, only the ones whose parent value changed. */
+static GtkBitmask *
+gtk_css_computed_values_add_dependent (GtkCssComputedValues *values,
+                                       GtkBitmask           *changes,
+                                       GtkCssDependencies    dependencies,
+                                       const GtkBitmask     *parent_changes)
+{
+  guint i, j;
+
+  for (i = 0; i < GTK_CSS_VALUE_GROUP_N_GROUPS; i++)
+    {
+      GtkCssValueGroup *group = values->groups[i];
+      guint8 *group_dependencies;
+
+      if (group == NULL || !(group->dependencies & dependencies))
+        continue;
+
+      group_dependencies = GTK_CSS_VALUE_GROUP_DEPENDENCIES (group);
+      for (j = 0; j < group->n_values; j++)
+        {
+          guint id = group_properties[i].properties[j];
+
+          if ((group_dependencies[j] & dependencies) &&
+              (parent_changes == NULL || _gtk_bitmask_get (parent_changes, id)))
+            changes = _gtk_bitmask_set (changes, id, TRUE);
+        }
+    }
+
+  return changes;
+}
+
 GtkBitmask *
 _gtk_css_computed_values_compute_dependencies (GtkCssComputedValues *values,
                                                const GtkBitmask     *parent_changes)
@@ -618,13 +990,137 @@ _gtk_css_computed_values_compute_dependencies (GtkCssComputedValues *values,
 
   gtk_internal_return_val_if_fail (GTK_IS_CSS_COMPUTED_VALUES (values), _gtk_bitmask_new ());
 
-  changes = _gtk_bitmask_copy (parent_changes);
-  changes = _gtk_bitmask_intersect (changes, values->depends_on_parent);
+  changes = gtk_css_computed_values_add_dependent (values,
+                                                   _gtk_bitmask_new (),
+                                                   GTK_CSS_DEPENDS_ON_PARENT | GTK_CSS_EQUALS_PARENT,
+                                                   parent_changes);
+
+  return _gtk_css_computed_values_add_dependencies (values, changes);
+}
+
+/**
+ * _gtk_css_computed_values_add_dependencies:
+ * @values: the values
+ * @changes: (transfer full): properties of @values that are going to
+ *     change
+ *
+ * Adds the properties whose computed value depends on another one in
+ * @changes, like the ones using currentColor or em units.
+ *
+ * Returns: (transfer full): @changes with the dependent properties added
+ **/
+GtkBitmask *
+_gtk_css_computed_values_add_dependencies (GtkCssComputedValues *values,
+                                           GtkBitmask           *changes)
+{
+  GtkCssDependencies dependencies;
+
+  gtk_internal_return_val_if_fail (GTK_IS_CSS_COMPUTED_VALUES (values), changes);
+
+  dependencies = 0;
   if (_gtk_bitmask_get (changes, GTK_CSS_PROPERTY_COLOR))
-    changes = _gtk_bitmask_union (changes, values->depends_on_color);
+    dependencies |= GTK_CSS_DEPENDS_ON_COLOR;
   if (_gtk_bitmask_get (changes, GTK_CSS_PROPERTY_FONT_SIZE))
-    changes = _gtk_bitmask_union (changes, values->depends_on_font_size);
+    dependencies |= GTK_CSS_DEPENDS_ON_FONT_SIZE;
+  if (dependencies)
+    changes = gtk_css_computed_values_add_dependent (values, changes, dependencies, NULL);
 
   return changes;
 }
 
+
+/**
+ * _gtk_css_computed_values_copy:
+ * @values: the values to copy
+ *
+ * Copies the intrinsic values of @values, but not its animations. This
+ * is useful to get values that can be changed from shared ones.
+ *
+ * Returns: (transfer full): a new #GtkCssComputedValues
+ **/
+GtkCssComputedValues *
+_gtk_css_computed_values_copy (GtkCssComputedValues *values)
+{
+  GtkCssComputedValues *copy;
+  guint i;
+
+  gtk_internal_return_val_if_fail (GTK_IS_CSS_COMPUTED_VALUES (values), NULL);
+
+  copy = _gtk_css_computed_values_new ();
+
+  /* Groups are copied when they get changed */
+  for (i = 0; i < GTK_CSS_VALUE_GROUP_N_GROUPS; i++)
+    {
+      if (values->groups[i])
+        copy->groups[i] = gtk_css_value_group_ref (values->groups[i]);
+    }
+
+  if (values->sections)
+    {
+      copy->sections = g_new0 (GtkCssSection *, GTK_CSS_PROPERTY_N_PROPERTIES);
+      for (i = 0; i < GTK_CSS_PROPERTY_N_PROPERTIES; i++)
+        {
+          if (values->sections[i])
+            copy->sections[i] = gtk_css_section_ref (values->sections[i]);
+        }
+    }
+
+  copy->current_time = values->current_time;
+
+  return copy;
+}
+
+gboolean
+_gtk_css_computed_values_is_shared (GtkCssComputedValues *values)
+{
+  gtk_internal_return_val_if_fail (GTK_IS_CSS_COMPUTED_VALUES (values), FALSE);
+
+  return values->shared;
+}
+
+/**
+ * _gtk_css_computed_values_may_animate:
+ * @values: the values
+ * @source: (allow-none): the values to transition from, like for
+ *     _gtk_css_computed_values_create_animations()
+ *
+ * Checks if _gtk_css_computed_values_create_animations() could create
+ * any animations for @values. This errs on the side of %TRUE.
+ *
+ * Returns: %FALSE if @values will certainly stay static
+ **/
+gboolean
+_gtk_css_computed_values_may_animate (GtkCssComputedValues *values,
+                                      GtkCssComputedValues *source)
+{
+  GtkCssValue *animations, *durations, *delays;
+  guint i;
+
+  gtk_internal_return_val_if_fail (GTK_IS_CSS_COMPUTED_VALUES (values), TRUE);
+
+  animations = _gtk_css_computed_values_get_value (values, GTK_CSS_PROPERTY_ANIMATION_NAME);
+  for (i = 0; i < _gtk_css_array_value_get_n_values (animations); i++)
+    {
+      if (g_ascii_strcasecmp (_gtk_css_ident_value_get (_gtk_css_array_value_get_nth (animations, i)), "none") != 0)
+        return TRUE;
+    }
+
+  if (source == NULL)
+    return FALSE;
+
+  durations = _gtk_css_computed_values_get_value (values, GTK_CSS_PROPERTY_TRANSITION_DURATION);
+  delays = _gtk_css_computed_values_get_value (values, GTK_CSS_PROPERTY_TRANSITION_DELAY);
+
+  for (i = 0; i < _gtk_css_array_value_get_n_values (durations); i++)
+    {
+      if (_gtk_css_number_value_get (_gtk_css_array_value_get_nth (durations, i), 100) != 0.0)
+        return TRUE;
+    }
+  for (i = 0; i < _gtk_css_array_value_get_n_values (delays); i++)
+    {
+      if (_gtk_css_number_value_get (_gtk_css_array_value_get_nth (delays, i), 100) != 0.0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
@@ -38,22 +38,37 @@ G_BEGIN_DECLS
 
 /* typedef struct _GtkCssComputedValues           GtkCssComputedValues; */
 typedef struct _GtkCssComputedValuesClass      GtkCssComputedValuesClass;
+typedef struct _GtkCssValueGroup               GtkCssValueGroup;
+
+/* Properties are stored in groups of properties that tend to be set
+ * together, see gtkcsscomputedvalues.c for which ones go where */
+typedef enum {
+  GTK_CSS_VALUE_GROUP_CORE,
+  GTK_CSS_VALUE_GROUP_FONT,
+  GTK_CSS_VALUE_GROUP_BACKGROUND,
+  GTK_CSS_VALUE_GROUP_BORDER,
+  GTK_CSS_VALUE_GROUP_OUTLINE,
+  GTK_CSS_VALUE_GROUP_SIZE,
+  GTK_CSS_VALUE_GROUP_TRANSITION,
+  GTK_CSS_VALUE_GROUP_ANIMATION,
+  GTK_CSS_VALUE_GROUP_OTHER,
+  /* add more */
+  GTK_CSS_VALUE_GROUP_N_GROUPS
+} GtkCssValueGroupType;
 
 struct _GtkCssComputedValues
 {
   GObject parent;
 
-  GPtrArray             *values;               /* the unanimated (aka intrinsic) values */
-  GPtrArray             *sections;             /* sections the values are defined in */
+  GtkCssValueGroup      *groups[GTK_CSS_VALUE_GROUP_N_GROUPS]; /* the unanimated (aka intrinsic) values */
+  GtkCssSection        **sections;             /* sections the values are defined in, only kept for GTK_CSS_DEBUG */
 
   GPtrArray             *animated_values;      /* NULL or array of animated values/NULL if not animated */
+  GtkBitmask            *animated_properties;  /* NULL or the properties the animations set at current_time */
   gint64                 current_time;         /* the current time in our world */
   GSList                *animations;           /* the running animations, least important one first */
 
-  GtkBitmask            *depends_on_parent;    /* for intrinsic values */
-  GtkBitmask            *equals_parent;        /* dito */
-  GtkBitmask            *depends_on_color;     /* dito */
-  GtkBitmask            *depends_on_font_size; /* dito */
+  guint                  shared :1;            /* handed out by a GtkCssStyleCache, must not change */
 };
 
 struct _GtkCssComputedValuesClass
@@ -91,6 +106,9 @@ GtkBitmask *            _gtk_css_computed_values_get_difference       (GtkCssCom
                                                                        GtkCssComputedValues     *other);
 GtkBitmask *            _gtk_css_computed_values_compute_dependencies (GtkCssComputedValues     *values,
                                                                        const GtkBitmask         *parent_changes);
+GtkBitmask *            _gtk_css_computed_values_add_dependencies     (GtkCssComputedValues     *values,
+                                                                       GtkBitmask               *changes);
+void                    _gtk_css_computed_values_share_groups         (GtkCssComputedValues     *values);
 
 void                    _gtk_css_computed_values_create_animations    (GtkCssComputedValues     *values,
                                                                        GtkCssComputedValues     *parent_values,
@@ -103,6 +121,11 @@ GtkBitmask *            _gtk_css_computed_values_advance              (GtkCssCom
 void                    _gtk_css_computed_values_cancel_animations    (GtkCssComputedValues     *values);
 gboolean                _gtk_css_computed_values_is_static            (GtkCssComputedValues     *values);
 
+GtkCssComputedValues *  _gtk_css_computed_values_copy                 (GtkCssComputedValues     *values);
+gboolean                _gtk_css_computed_values_is_shared            (GtkCssComputedValues     *values);
+gboolean                _gtk_css_computed_values_may_animate          (GtkCssComputedValues     *values,
+                                                                       GtkCssComputedValues     *source);
+
 G_END_DECLS
 
 #endif /* __GTK_CSS_COMPUTED_VALUES_PRIVATE_H__ */
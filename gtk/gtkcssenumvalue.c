@@ -706,3 +706,68 @@ _gtk_css_image_effect_value_get (const GtkCssValue *value)
 
   return value->value;
 }
+
+/* theme cache */
+
+static const struct {
+  const GtkCssValueClass *class;
+  GtkCssValue *values;
+  guint n_values;
+} enum_types[] = {
+  { &GTK_CSS_VALUE_BORDER_STYLE, border_style_values, G_N_ELEMENTS (border_style_values) },
+  { &GTK_CSS_VALUE_FONT_SIZE, font_size_values, G_N_ELEMENTS (font_size_values) },
+  { &GTK_CSS_VALUE_FONT_STYLE, font_style_values, G_N_ELEMENTS (font_style_values) },
+  { &GTK_CSS_VALUE_FONT_VARIANT, font_variant_values, G_N_ELEMENTS (font_variant_values) },
+  { &GTK_CSS_VALUE_FONT_WEIGHT, font_weight_values, G_N_ELEMENTS (font_weight_values) },
+  { &GTK_CSS_VALUE_AREA, area_values, G_N_ELEMENTS (area_values) },
+  { &GTK_CSS_VALUE_DIRECTION, direction_values, G_N_ELEMENTS (direction_values) },
+  { &GTK_CSS_VALUE_PLAY_STATE, play_state_values, G_N_ELEMENTS (play_state_values) },
+  { &GTK_CSS_VALUE_FILL_MODE, fill_mode_values, G_N_ELEMENTS (fill_mode_values) },
+  { &GTK_CSS_VALUE_IMAGE_EFFECT, image_effect_values, G_N_ELEMENTS (image_effect_values) }
+};
+
+/**
+ * _gtk_css_enum_value_unpack:
+ * @value: a value
+ * @type: (out): which of the enums @value belongs to
+ * @position: (out): which value of that enum it is
+ *
+ * Returns: %FALSE if @value is not an enum value
+ **/
+gboolean
+_gtk_css_enum_value_unpack (const GtkCssValue *value,
+                            guint             *type,
+                            guint             *position)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (enum_types); i++)
+    {
+      if (value->class != enum_types[i].class)
+        continue;
+
+      *type = i;
+      *position = value - enum_types[i].values;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+/**
+ * _gtk_css_enum_value_pack:
+ * @type: as returned by _gtk_css_enum_value_unpack()
+ * @position: as returned by _gtk_css_enum_value_unpack()
+ *
+ * Returns: the value or %NULL if @type and @position don't describe one
+ **/
+GtkCssValue *
+_gtk_css_enum_value_pack (guint type,
+                          guint position)
+{
+  if (type >= G_N_ELEMENTS (enum_types) ||
+      position >= enum_types[type].n_values)
+    return NULL;
+
+  return _gtk_css_value_ref (&enum_types[type].values[position]);
+}
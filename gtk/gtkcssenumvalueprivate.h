@@ -68,6 +68,12 @@ GtkCssValue *     _gtk_css_image_effect_value_new       (GtkCssImageEffect  imag
 GtkCssValue *     _gtk_css_image_effect_value_try_parse (GtkCssParser      *parser);
 GtkCssImageEffect _gtk_css_image_effect_value_get       (const GtkCssValue *value);
 
+gboolean        _gtk_css_enum_value_unpack            (const GtkCssValue *value,
+                                                       guint             *type,
+                                                       guint             *position);
+GtkCssValue *   _gtk_css_enum_value_pack              (guint              type,
+                                                       guint              position);
+
 G_END_DECLS
 
 #endif /* __GTK_CSS_ENUM_VALUE_PRIVATE_H__ */
@@ -174,4 +174,6 @@ _gtk_css_lookup_resolve (GtkCssLookup            *lookup,
                                                 lookup->values[i].section);
       /* else not a relevant property */
     }
+
+  _gtk_css_computed_values_share_groups (values);
 }
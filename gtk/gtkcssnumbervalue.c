@@ -178,12 +178,22 @@ gtk_css_value_number_print (const GtkCssValue *number,
     g_string_append (string, names[number->unit]);
 }
 
+static guint
+gtk_css_value_number_hash (const GtkCssValue *number)
+{
+  /* -0.0 and 0.0 are equal, but not bit for bit */
+  double value = number->value == 0.0 ? 0.0 : number->value;
+
+  return g_double_hash (&value) ^ number->unit;
+}
+
 static const GtkCssValueClass GTK_CSS_VALUE_NUMBER = {
   gtk_css_value_number_free,
   gtk_css_value_number_compute,
   gtk_css_value_number_equal,
   gtk_css_value_number_transition,
-  gtk_css_value_number_print
+  gtk_css_value_number_print,
+  gtk_css_value_number_hash
 };
 
 GtkCssValue *
@@ -220,7 +230,7 @@ _gtk_css_number_value_new (double     value,
   result->unit = unit;
   result->value = value;
 
-  return result;
+  return _gtk_css_value_intern (result);
 }
 
 GtkCssUnit
@@ -231,6 +241,28 @@ _gtk_css_number_value_get_unit (const GtkCssValue *value)
   return value->unit;
 }
 
+/**
+ * _gtk_css_number_value_unpack:
+ * @value: a value
+ * @number: (out): the number
+ * @unit: (out): its unit
+ *
+ * Returns: %FALSE if @value is not a number. Use
+ *     _gtk_css_number_value_new() to turn it back into one.
+ **/
+gboolean
+_gtk_css_number_value_unpack (const GtkCssValue *value,
+                              double            *number,
+                              GtkCssUnit        *unit)
+{
+  if (value->class != &GTK_CSS_VALUE_NUMBER)
+    return FALSE;
+
+  *number = value->value;
+  *unit = value->unit;
+  return TRUE;
+}
+
 double
 _gtk_css_number_value_get (const GtkCssValue *number,
                            double             one_hundred_percent)
@@ -43,6 +43,9 @@ GtkCssValue *   _gtk_css_number_value_parse         (GtkCssParser           *par
                                                      GtkCssNumberParseFlags  flags);
 
 GtkCssUnit      _gtk_css_number_value_get_unit      (const GtkCssValue      *value);
+gboolean        _gtk_css_number_value_unpack        (const GtkCssValue      *value,
+                                                     double                 *number,
+                                                     GtkCssUnit             *unit);
 double          _gtk_css_number_value_get           (const GtkCssValue      *number,
                                                      double                  one_hundred_percent);
 
@@ -47,6 +47,8 @@ struct _GtkCssParser
 
   const char            *line_start;
   guint                  line;
+
+  GString               *scratch;       /* reused by the _interned() functions */
 };
 
 GtkCssParser *
@@ -81,6 +83,8 @@ _gtk_css_parser_free (GtkCssParser *parser)
 
   if (parser->file)
     g_object_unref (parser->file);
+  if (parser->scratch)
+    g_string_free (parser->scratch, TRUE);
 
   g_slice_free (GtkCssParser, parser);
 }
@@ -127,6 +131,15 @@ _gtk_css_parser_get_position (GtkCssParser *parser)
   return parser->data - parser->line_start;
 }
 
+/* The text that hasn't been parsed yet */
+const char *
+_gtk_css_parser_get_data (GtkCssParser *parser)
+{
+  g_return_val_if_fail (GTK_IS_CSS_PARSER (parser), NULL);
+
+  return parser->data;
+}
+
 static GFile *
 gtk_css_parser_get_base_file (GtkCssParser *parser)
 {
@@ -393,6 +406,68 @@ _gtk_css_parser_read_char (GtkCssParser *parser,
   return FALSE;
 }
 
+/* Like _gtk_css_parser_read_char(), but reads as many chars as it can.
+ * Runs of plain chars are copied in one go, which is what most names
+ * consist of. */
+static gboolean
+_gtk_css_parser_read_chars (GtkCssParser *parser,
+                            GString *     str,
+                            const char *  allowed)
+{
+  gboolean result = FALSE;
+  gsize len;
+
+  while (TRUE)
+    {
+      len = strspn (parser->data, allowed);
+      if (len > 0)
+        {
+          g_string_append_len (str, parser->data, len);
+          parser->data += len;
+        }
+      else if (!_gtk_css_parser_read_char (parser, str, allowed))
+        break;
+
+      result = TRUE;
+    }
+
+  return result;
+}
+
+static gboolean
+gtk_css_parser_read_ident (GtkCssParser *parser,
+                           GString      *ident)
+{
+  const char *start = parser->data;
+
+  if (*parser->data == '-')
+    {
+      g_string_append_c (ident, '-');
+      parser->data++;
+    }
+
+  if (!_gtk_css_parser_read_char (parser, ident, NMSTART))
+    {
+      parser->data = start;
+      return FALSE;
+    }
+
+  _gtk_css_parser_read_chars (parser, ident, NMCHAR);
+
+  return TRUE;
+}
+
+static GString *
+gtk_css_parser_get_scratch (GtkCssParser *parser)
+{
+  if (parser->scratch == NULL)
+    parser->scratch = g_string_new (NULL);
+  else
+    g_string_truncate (parser->scratch, 0);
+
+  return parser->scratch;
+}
+
 char *
 _gtk_css_parser_try_name (GtkCssParser *parser,
                           gboolean      skip_whitespace)
@@ -403,8 +478,7 @@ _gtk_css_parser_try_name (GtkCssParser *parser,
 
   name = g_string_new (NULL);
 
-  while (_gtk_css_parser_read_char (parser, name, NMCHAR))
-    ;
+  _gtk_css_parser_read_chars (parser, name, NMCHAR);
 
   if (skip_whitespace)
     _gtk_css_parser_skip_whitespace (parser);
@@ -416,37 +490,63 @@ char *
 _gtk_css_parser_try_ident (GtkCssParser *parser,
                            gboolean      skip_whitespace)
 {
-  const char *start;
   GString *ident;
 
   g_return_val_if_fail (GTK_IS_CSS_PARSER (parser), NULL);
 
-  start = parser->data;
-  
   ident = g_string_new (NULL);
 
-  if (*parser->data == '-')
+  if (!gtk_css_parser_read_ident (parser, ident))
     {
-      g_string_append_c (ident, '-');
-      parser->data++;
-    }
-
-  if (!_gtk_css_parser_read_char (parser, ident, NMSTART))
-    {
-      parser->data = start;
       g_string_free (ident, TRUE);
       return NULL;
     }
 
-  while (_gtk_css_parser_read_char (parser, ident, NMCHAR))
-    ;
-
   if (skip_whitespace)
     _gtk_css_parser_skip_whitespace (parser);
 
   return g_string_free (ident, FALSE);
 }
 
+/* Like try_name() and try_ident(), but return interned strings. That
+ * avoids allocating a copy for callers that intern the result anyway. */
+const char *
+_gtk_css_parser_try_name_interned (GtkCssParser *parser,
+                                   gboolean      skip_whitespace)
+{
+  GString *name;
+
+  g_return_val_if_fail (GTK_IS_CSS_PARSER (parser), NULL);
+
+  name = gtk_css_parser_get_scratch (parser);
+
+  _gtk_css_parser_read_chars (parser, name, NMCHAR);
+
+  if (skip_whitespace)
+    _gtk_css_parser_skip_whitespace (parser);
+
+  return g_intern_string (name->str);
+}
+
+const char *
+_gtk_css_parser_try_ident_interned (GtkCssParser *parser,
+                                    gboolean      skip_whitespace)
+{
+  GString *ident;
+
+  g_return_val_if_fail (GTK_IS_CSS_PARSER (parser), NULL);
+
+  ident = gtk_css_parser_get_scratch (parser);
+
+  if (!gtk_css_parser_read_ident (parser, ident))
+    return NULL;
+
+  if (skip_whitespace)
+    _gtk_css_parser_skip_whitespace (parser);
+
+  return g_intern_string (ident->str);
+}
+
 gboolean
 _gtk_css_parser_is_string (GtkCssParser *parser)
 {
@@ -0,0 +1,113 @@
+/* GTK - The GIMP Toolkit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gtkcssprofilerprivate.h"
+
+#include "gdk/gdk-private.h"
+
+/* Reports what the style system does to the profiler in GDK, which is
+ * started by setting GTK_TRACE or GTK_TRACE_FD. Times are in
+ * nanoseconds as the profiler wants them. */
+
+guint64 _gtk_css_profiler_counters[GTK_CSS_PROFILER_N_COUNTERS];
+
+static const struct {
+  const char *name;
+  const char *description;
+} counter_info[GTK_CSS_PROFILER_N_COUNTERS] = {
+  { "css selector nodes", "Selector tree nodes visited while matching" },
+  { "css selector checks", "Simple selectors checked outside of the selector tree" },
+  { "css rulesets matched", "Matching rulesets looked at by style lookups" },
+  { "css style cache hits", "Style lookups answered from the style cache" },
+  { "css style cache misses", "Style lookups that had to compute values" },
+  { "css computed values", "Sets of computed values created" }
+};
+
+static guint counter_ids[GTK_CSS_PROFILER_N_COUNTERS];
+
+/**
+ * _gtk_css_profiler_begin_mark:
+ *
+ * Starts a mark, see _gtk_css_profiler_end_mark().
+ *
+ * Returns: the start time or 0 if the profiler isn't running
+ **/
+gint64
+_gtk_css_profiler_begin_mark (void)
+{
+  if (!GDK_PRIVATE_CALL (gdk_profiler_is_running) ())
+    return 0;
+
+  return g_get_monotonic_time () * 1000;
+}
+
+/**
+ * _gtk_css_profiler_end_mark:
+ * @start: the value returned by _gtk_css_profiler_begin_mark()
+ * @name: the name of the mark
+ * @message: (allow-none): more information about what happened
+ *
+ * Adds a mark from @start until now. Nothing happens if the profiler
+ * wasn't running when the mark was started.
+ **/
+void
+_gtk_css_profiler_end_mark (gint64      start,
+                            const char *name,
+                            const char *message)
+{
+  if (start == 0)
+    return;
+
+  GDK_PRIVATE_CALL (gdk_profiler_add_mark) (start,
+                                            g_get_monotonic_time () * 1000 - start,
+                                            name,
+                                            message);
+}
+
+/**
+ * _gtk_css_profiler_report_counters:
+ *
+ * Reports the counters to the profiler and starts counting anew. This
+ * is done once per frame, so the counters show the work done for one
+ * frame.
+ **/
+void
+_gtk_css_profiler_report_counters (void)
+{
+  gint64 now;
+  guint i;
+
+  if (GDK_PRIVATE_CALL (gdk_profiler_is_running) ())
+    {
+      now = g_get_monotonic_time () * 1000;
+
+      for (i = 0; i < GTK_CSS_PROFILER_N_COUNTERS; i++)
+        {
+          if (counter_ids[i] == 0)
+            counter_ids[i] = GDK_PRIVATE_CALL (gdk_profiler_define_int_counter) (counter_info[i].name,
+                                                                                 counter_info[i].description);
+
+          GDK_PRIVATE_CALL (gdk_profiler_set_int_counter) (counter_ids[i],
+                                                           now,
+                                                           _gtk_css_profiler_counters[i]);
+        }
+    }
+
+  for (i = 0; i < GTK_CSS_PROFILER_N_COUNTERS; i++)
+    _gtk_css_profiler_counters[i] = 0;
+}
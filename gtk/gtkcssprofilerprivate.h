@@ -0,0 +1,51 @@
+/* GTK - The GIMP Toolkit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GTK_CSS_PROFILER_PRIVATE_H__
+#define __GTK_CSS_PROFILER_PRIVATE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  GTK_CSS_PROFILER_SELECTOR_NODES,      /* selector tree nodes visited */
+  GTK_CSS_PROFILER_SELECTOR_CHECKS,     /* simple selectors checked outside the tree */
+  GTK_CSS_PROFILER_RULESETS_MATCHED,
+  GTK_CSS_PROFILER_STYLE_CACHE_HITS,
+  GTK_CSS_PROFILER_STYLE_CACHE_MISSES,
+  GTK_CSS_PROFILER_COMPUTED_VALUES,     /* GtkCssComputedValues created */
+  /* add more */
+  GTK_CSS_PROFILER_N_COUNTERS
+} GtkCssProfilerCounter;
+
+/* Counting is cheaper than checking if anybody is interested, so
+ * counters are always updated */
+extern guint64 _gtk_css_profiler_counters[GTK_CSS_PROFILER_N_COUNTERS];
+
+#define GTK_CSS_PROFILER_COUNT(counter, n) (_gtk_css_profiler_counters[GTK_CSS_PROFILER_ ## counter] += (n))
+#define GTK_CSS_PROFILER_GET(counter) (_gtk_css_profiler_counters[GTK_CSS_PROFILER_ ## counter])
+
+gint64          _gtk_css_profiler_begin_mark            (void);
+void            _gtk_css_profiler_end_mark              (gint64          start,
+                                                         const char     *name,
+                                                         const char     *message);
+
+void            _gtk_css_profiler_report_counters       (void);
+
+G_END_DECLS
+
+#endif /* __GTK_CSS_PROFILER_PRIVATE_H__ */
@@ -30,12 +30,18 @@
 #include "gtkbitmaskprivate.h"
 #include "gtkcssarrayvalueprivate.h"
 #include "gtkcsscolorvalueprivate.h"
+#include "gtkcssenumvalueprivate.h"
 #include "gtkcsskeyframesprivate.h"
+#include "gtkcssnumbervalueprivate.h"
 #include "gtkcssparserprivate.h"
+#include "gtkcssprofilerprivate.h"
 #include "gtkcsssectionprivate.h"
 #include "gtkcssselectorprivate.h"
 #include "gtkcssshorthandpropertyprivate.h"
+#include "gtkcssstringvalueprivate.h"
 #include "gtkcssstylefuncsprivate.h"
+#include "gtkcssthemecacheprivate.h"
+#include "gtkdebug.h"
 #include "gtkstyleprovider.h"
 #include "gtkstylecontextprivate.h"
 #include "gtkstylepropertiesprivate.h"
@@ -901,9 +907,11 @@
  */
 
 typedef struct GtkCssRuleset GtkCssRuleset;
+typedef struct _SelectorCost SelectorCost;
 typedef struct _GtkCssScanner GtkCssScanner;
 typedef struct _PropertyValue PropertyValue;
 typedef struct _WidgetPropertyValue WidgetPropertyValue;
+typedef struct _GtkCssThemeRecording GtkCssThemeRecording;
 typedef enum ParserScope ParserScope;
 typedef enum ParserSymbol ParserSymbol;
 
@@ -921,6 +929,98 @@ struct _WidgetPropertyValue {
   GtkCssSection *section;
 };
 
+/* The layout of a compiled theme in the theme cache, see
+ * gtkcssthemecache.c. All offsets are relative to the start of the
+ * cache. Arrays start with their number of elements.
+ *
+ * Numbers, colors, enums and identifiers are stored in binary form.
+ * Other values, for example images, don't print to something that
+ * parses back to the same value, so for those the cache keeps the text
+ * they were declared with. All values are created when the cache is
+ * loaded. If that fails, the cache is stale and the theme is parsed
+ * again, which reports the errors.
+ */
+typedef struct _CachedRoot CachedRoot;
+typedef struct _CachedValue CachedValue;
+typedef struct _CachedCompiledValue CachedCompiledValue;
+typedef struct _CachedDefinition CachedDefinition;
+typedef struct _CachedRuleset CachedRuleset;
+typedef struct _CachedStyle CachedStyle;
+typedef struct _CachedWidgetStyle CachedWidgetStyle;
+
+typedef enum {
+  CACHED_DEFINITION_COLOR,
+  CACHED_DEFINITION_KEYFRAMES,
+  CACHED_DEFINITION_BINDING_SET,
+  CACHED_DEFINITION_BINDING
+} CachedDefinitionType;
+
+typedef enum {
+  CACHED_COMPILED_NUMBER,
+  CACHED_COMPILED_COLOR,
+  CACHED_COMPILED_COLOR_NAME,
+  CACHED_COMPILED_ENUM,
+  CACHED_COMPILED_IDENT
+} CachedCompiledType;
+
+#define CACHED_STYLE_NO_SUBPROPERTY G_MAXUINT32
+
+struct _CachedRoot {
+  guint32 n_properties;         /* to catch changes to the list of properties */
+  guint32 values;               /* CachedValue[] */
+  guint32 definitions;          /* CachedDefinition[] */
+  guint32 rulesets;             /* CachedRuleset[] */
+  guint32 tree;
+};
+
+struct _CachedValue {
+  guint32 property;             /* name of the property, maybe a shorthand */
+  guint32 text;
+  guint32 file;                 /* uri to resolve relative urls against */
+};
+
+struct _CachedCompiledValue {
+  guint32 type;                 /* CachedCompiledType */
+  guint32 data;                 /* the unit, the enum or the string */
+  guint32 position;             /* in the enum */
+  guint32 padding;
+  double numbers[4];            /* the number or red, green, blue and alpha */
+};
+
+struct _CachedDefinition {
+  guint32 type;                 /* CachedDefinitionType */
+  guint32 name;
+  guint32 text;
+  guint32 file;
+};
+
+struct _CachedRuleset {
+  guint32 selector;
+  guint32 styles;               /* CachedStyle[] */
+  guint32 widget_style;         /* CachedWidgetStyle[] */
+};
+
+struct _CachedStyle {
+  guint32 property;             /* id of the style property */
+  guint32 compiled;             /* CachedCompiledValue, if there is one */
+  guint32 value;                /* otherwise the index into the values */
+  guint32 subproperty;          /* if that is for a shorthand */
+};
+
+struct _CachedWidgetStyle {
+  guint32 name;
+  guint32 value;
+};
+
+/* How much matching a selector cost. The cost is counted in simple
+ * selectors checked, which unlike time doesn't depend on the machine. */
+struct _SelectorCost
+{
+  guint64 tests;                /* how often the selector was tested */
+  guint64 checks;               /* simple selectors checked for that */
+  guint64 matches;
+};
+
 struct GtkCssRuleset
 {
   GtkCssSelector *selector;
@@ -951,7 +1051,18 @@ struct _GtkCssProviderPrivate
 
   GArray *rulesets;
   GtkCssSelectorTree *tree;
+  GtkCssSelectorMatches matches;        /* reused by every lookup */
   GResource *resource;
+
+  /* If the rulesets were loaded from the theme cache */
+  GtkCssThemeCacheReader *cache;
+  gboolean loading_cache;               /* errors only mean the cache is stale */
+  gboolean cache_failed;
+
+  GtkCssThemeRecording *recording;      /* while loading a theme that isn't cached */
+
+  SelectorCost *selector_costs;         /* one per ruleset, for GTK_DEBUG=css-profile */
+  guint n_selector_costs;
 };
 
 enum {
@@ -968,6 +1079,38 @@ static void gtk_css_style_provider_iface_init (GtkStyleProviderIface *iface);
 static void gtk_css_style_provider_private_iface_init (GtkStyleProviderPrivateInterface *iface);
 static void widget_property_value_list_free (WidgetPropertyValue *head);
 
+/* Resources are parsed right where they are, usually in the library's
+ * read-only data. GResource data is always NUL-terminated, which the
+ * parser relies on. Other files are read into a buffer. */
+static GBytes *
+gtk_css_provider_load_bytes (GFile   *file,
+                             GError **error)
+{
+  char *contents;
+  gsize length;
+
+  if (g_file_has_uri_scheme (file, "resource"))
+    {
+      GBytes *bytes;
+      char *uri, *path;
+
+      uri = g_file_get_uri (file);
+      path = g_uri_unescape_string (uri + strlen ("resource://"), NULL);
+      bytes = g_resources_lookup_data (path, 0, error);
+      g_free (path);
+      g_free (uri);
+
+      return bytes;
+    }
+
+  if (!g_file_load_contents (file, NULL,
+                             &contents, &length,
+                             NULL, error))
+    return NULL;
+
+  return g_bytes_new_take (contents, length);
+}
+
 static gboolean
 gtk_css_provider_load_internal (GtkCssProvider *css_provider,
                                 GtkCssScanner  *scanner,
@@ -1234,6 +1377,16 @@ gtk_css_provider_emit_error (GtkCssProvider *provider,
                              GtkCssScanner  *scanner,
                              const GError   *error)
 {
+  if (provider->priv->loading_cache)
+    {
+      /* The theme is parsed again and reports the error then */
+      provider->priv->cache_failed = TRUE;
+      return;
+    }
+
+  if (provider->priv->recording)
+    provider->priv->recording->failed = TRUE;
+
   g_signal_emit (provider, css_provider_signals[PARSING_ERROR], 0,
                  scanner != NULL ? scanner->section : NULL, error);
 }
@@ -1334,6 +1487,7 @@ gtk_css_provider_init (GtkCssProvider *css_provider)
                                                            GtkCssProviderPrivate);
 
   priv->rulesets = g_array_new (FALSE, FALSE, sizeof (GtkCssRuleset));
+  _gtk_css_selector_matches_init (&priv->matches, 0);
 
   priv->symbolic_colors = g_hash_table_new_full (g_str_hash, g_str_equal,
                                                  (GDestroyNotify) g_free,
@@ -1366,6 +1520,40 @@ css_provider_dump_symbolic_colors (GtkCssProvider     *css_provider,
     }
 }
 
+static void
+gtk_css_provider_clear_cache (GtkCssProvider *css_provider)
+{
+  GtkCssProviderPrivate *priv = css_provider->priv;
+
+  if (priv->cache == NULL)
+    return;
+
+  _gtk_css_theme_cache_reader_free (priv->cache);
+  priv->cache = NULL;
+}
+
+static GtkCssScanner *
+gtk_css_provider_cache_scanner_new (GtkCssProvider *css_provider,
+                                    const char     *text,
+                                    const char     *uri)
+{
+  GtkCssSection *section;
+  GtkCssScanner *scanner;
+  GFile *file;
+
+  if (uri == NULL)
+    return gtk_css_scanner_new (css_provider, NULL, NULL, NULL, text);
+
+  /* So relative urls resolve */
+  file = g_file_new_for_uri (uri);
+  section = _gtk_css_section_new_for_file (GTK_CSS_SECTION_DOCUMENT, file);
+  scanner = gtk_css_scanner_new (css_provider, NULL, section, file, text);
+  gtk_css_section_unref (section);
+  g_object_unref (file);
+
+  return scanner;
+}
+
 static GtkStyleProperties *
 gtk_css_provider_get_style (GtkStyleProvider *provider,
                             GtkWidgetPath    *path)
@@ -1409,27 +1597,20 @@ gtk_css_provider_get_style (GtkStyleProvider *provider,
 static void
 verify_tree_match_results (GtkCssProvider *provider,
 			   const GtkCssMatcher *matcher,
-			   GPtrArray *tree_rules)
+			   const GtkCssSelectorMatches *tree_rules)
 {
 #ifdef VERIFY_TREE
   GtkCssProviderPrivate *priv = provider->priv;
   GtkCssRuleset *ruleset;
-  int i, j;
+  int i;
 
   for (i = 0; i < priv->rulesets->len; i++)
     {
-      gboolean found = FALSE;
+      gboolean found;
 
       ruleset = &g_array_index (priv->rulesets, GtkCssRuleset, i);
 
-      for (j = 0; j < tree_rules->len; j++)
-	{
-	  if (ruleset == tree_rules->pdata[j])
-	    {
-	      found = TRUE;
-	      break;
-	    }
-	}
+      found = _gtk_css_selector_matches_contains (tree_rules, i);
 
       if (found != !!gtk_css_ruleset_matches (ruleset, matcher))
 	{
@@ -1450,17 +1631,20 @@ verify_tree_get_change_results (GtkCssProvider *provider,
 #ifdef VERIFY_TREE
   {
     GtkCssChange verify_change = 0;
-    GPtrArray *tree_rules;
+    GtkCssSelectorMatches tree_rules;
     int i;
 
-    tree_rules = _gtk_css_selector_tree_match_all (provider->priv->tree, matcher);
-    verify_tree_match_results (provider, matcher, tree_rules);
+    _gtk_css_selector_matches_init (&tree_rules, provider->priv->rulesets->len);
+    _gtk_css_selector_tree_match_all (provider->priv->tree, matcher, &tree_rules);
+    verify_tree_match_results (provider, matcher, &tree_rules);
 
-    for (i = tree_rules->len - 1; i >= 0; i--)
+    for (i = _gtk_css_selector_matches_get_previous (&tree_rules, G_MAXINT);
+         i >= 0;
+         i = _gtk_css_selector_matches_get_previous (&tree_rules, i))
       {
 	GtkCssRuleset *ruleset;
 
-	ruleset = tree_rules->pdata[i];
+	ruleset = &g_array_index (provider->priv->rulesets, GtkCssRuleset, i);
 
 	verify_change |= _gtk_css_selector_tree_match_get_change (ruleset->selector_match);
       }
@@ -1479,7 +1663,7 @@ verify_tree_get_change_results (GtkCssProvider *provider,
 	g_string_free (s, TRUE);
       }
 
-    g_ptr_array_free (tree_rules, TRUE);
+    _gtk_css_selector_matches_clear (&tree_rules);
   }
 #endif
 }
@@ -1495,7 +1679,6 @@ gtk_css_provider_get_style_property (GtkStyleProvider *provider,
   GtkCssProvider *css_provider = GTK_CSS_PROVIDER (provider);
   GtkCssProviderPrivate *priv = css_provider->priv;
   WidgetPropertyValue *val;
-  GPtrArray *tree_rules;
   GtkCssMatcher matcher;
   gboolean found = FALSE;
   gchar *prop_name;
@@ -1504,16 +1687,18 @@ gtk_css_provider_get_style_property (GtkStyleProvider *provider,
   if (!_gtk_css_matcher_init (&matcher, path, state))
     return FALSE;
 
-  tree_rules = _gtk_css_selector_tree_match_all (priv->tree, &matcher);
-  verify_tree_match_results (css_provider, &matcher, tree_rules);
+  _gtk_css_selector_tree_match_all (priv->tree, &matcher, &priv->matches);
+  verify_tree_match_results (css_provider, &matcher, &priv->matches);
 
   prop_name = g_strdup_printf ("-%s-%s",
                                g_type_name (pspec->owner_type),
                                pspec->name);
 
-  for (i = tree_rules->len - 1; i >= 0; i--)
+  for (i = _gtk_css_selector_matches_get_previous (&priv->matches, G_MAXINT);
+       i >= 0;
+       i = _gtk_css_selector_matches_get_previous (&priv->matches, i))
     {
-      GtkCssRuleset *ruleset = tree_rules->pdata[i];
+      GtkCssRuleset *ruleset = &g_array_index (priv->rulesets, GtkCssRuleset, i);
 
       if (ruleset->widget_style == NULL)
         continue;
@@ -1544,7 +1729,6 @@ gtk_css_provider_get_style_property (GtkStyleProvider *provider,
     }
 
   g_free (prop_name);
-  g_ptr_array_free (tree_rules, TRUE);
 
   return found;
 }
@@ -1574,6 +1758,132 @@ gtk_css_style_provider_get_keyframes (GtkStyleProviderPrivate *provider,
   return g_hash_table_lookup (css_provider->priv->keyframes, name);
 }
 
+/* Providers that have selector costs to dump at exit */
+static GSList *profiled_providers = NULL;
+
+#define N_DUMPED_SELECTORS 20
+
+static int
+compare_selector_costs (gconstpointer a,
+                        gconstpointer b,
+                        gpointer      data)
+{
+  const SelectorCost *costs = data;
+  const SelectorCost *cost_a = &costs[*(const guint *) a];
+  const SelectorCost *cost_b = &costs[*(const guint *) b];
+
+  if (cost_a->checks != cost_b->checks)
+    return cost_a->checks < cost_b->checks ? 1 : -1;
+
+  return 0;
+}
+
+static void
+gtk_css_provider_dump_selector_costs (GtkCssProvider *css_provider)
+{
+  GtkCssProviderPrivate *priv = css_provider->priv;
+  guint *order;
+  guint i;
+
+  if (priv->selector_costs == NULL)
+    return;
+
+  order = g_new (guint, priv->n_selector_costs);
+  for (i = 0; i < priv->n_selector_costs; i++)
+    order[i] = i;
+  g_qsort_with_data (order, priv->n_selector_costs, sizeof (guint),
+                     compare_selector_costs, priv->selector_costs);
+
+  g_printerr ("Most expensive selectors of GtkCssProvider %p:\n", css_provider);
+  g_printerr ("      checks       tests     matches  selector\n");
+  for (i = 0; i < MIN (priv->n_selector_costs, N_DUMPED_SELECTORS); i++)
+    {
+      GtkCssRuleset *ruleset = &g_array_index (priv->rulesets, GtkCssRuleset, order[i]);
+      SelectorCost *cost = &priv->selector_costs[order[i]];
+      char *selector;
+
+      if (cost->checks == 0)
+        break;
+
+      selector = _gtk_css_selector_to_string (ruleset->selector);
+      g_printerr ("%12" G_GUINT64_FORMAT "%12" G_GUINT64_FORMAT "%12" G_GUINT64_FORMAT "  %s\n",
+                  cost->checks, cost->tests, cost->matches, selector);
+      g_free (selector);
+    }
+
+  g_free (order);
+}
+
+static void
+gtk_css_provider_dump_all_selector_costs (void)
+{
+  GSList *l;
+
+  for (l = profiled_providers; l; l = l->next)
+    gtk_css_provider_dump_selector_costs (l->data);
+}
+
+/* Dumps and forgets the costs, this must happen before the rulesets change */
+static void
+gtk_css_provider_clear_selector_costs (GtkCssProvider *css_provider)
+{
+  GtkCssProviderPrivate *priv = css_provider->priv;
+
+  if (priv->selector_costs == NULL)
+    return;
+
+  gtk_css_provider_dump_selector_costs (css_provider);
+
+  g_free (priv->selector_costs);
+  priv->selector_costs = NULL;
+  priv->n_selector_costs = 0;
+  profiled_providers = g_slist_remove (profiled_providers, css_provider);
+}
+
+/* The selector tree matches all selectors at once, so it can't tell
+ * which of them are expensive. Instead we match every selector on its
+ * own, like the tree did before, and count how much work that is. */
+static void
+gtk_css_provider_profile_selectors (GtkCssProvider      *css_provider,
+                                    const GtkCssMatcher *matcher)
+{
+  static gboolean dump_at_exit = FALSE;
+  GtkCssProviderPrivate *priv = css_provider->priv;
+  guint i;
+
+  if (priv->n_selector_costs != priv->rulesets->len)
+    gtk_css_provider_clear_selector_costs (css_provider);
+
+  if (priv->rulesets->len == 0)
+    return;
+
+  if (priv->selector_costs == NULL)
+    {
+      priv->selector_costs = g_new0 (SelectorCost, priv->rulesets->len);
+      priv->n_selector_costs = priv->rulesets->len;
+      profiled_providers = g_slist_prepend (profiled_providers, css_provider);
+
+      if (!dump_at_exit)
+        {
+          atexit (gtk_css_provider_dump_all_selector_costs);
+          dump_at_exit = TRUE;
+        }
+    }
+
+  for (i = 0; i < priv->rulesets->len; i++)
+    {
+      GtkCssRuleset *ruleset = &g_array_index (priv->rulesets, GtkCssRuleset, i);
+      SelectorCost *cost = &priv->selector_costs[i];
+      guint64 checks;
+
+      checks = GTK_CSS_PROFILER_GET (SELECTOR_CHECKS);
+      if (_gtk_css_selector_matches (ruleset->selector, matcher))
+        cost->matches++;
+      cost->checks += GTK_CSS_PROFILER_GET (SELECTOR_CHECKS) - checks;
+      cost->tests++;
+    }
+}
+
 static void
 gtk_css_style_provider_lookup (GtkStyleProviderPrivate *provider,
                                const GtkCssMatcher     *matcher,
@@ -1582,19 +1892,28 @@ gtk_css_style_provider_lookup (GtkStyleProviderPrivate *provider,
   GtkCssProvider *css_provider;
   GtkCssProviderPrivate *priv;
   GtkCssRuleset *ruleset;
+  gint64 before;
   guint j;
   int i;
-  GPtrArray *tree_rules;
 
   css_provider = GTK_CSS_PROVIDER (provider);
   priv = css_provider->priv;
 
-  tree_rules = _gtk_css_selector_tree_match_all (priv->tree, matcher);
-  verify_tree_match_results (css_provider, matcher, tree_rules);
+  before = _gtk_css_profiler_begin_mark ();
+
+  if (G_UNLIKELY (gtk_get_debug_flags () & GTK_DEBUG_CSS_PROFILE))
+    gtk_css_provider_profile_selectors (css_provider, matcher);
 
-  for (i = tree_rules->len - 1; i >= 0; i--)
+  _gtk_css_selector_tree_match_all (priv->tree, matcher, &priv->matches);
+  verify_tree_match_results (css_provider, matcher, &priv->matches);
+
+  for (i = _gtk_css_selector_matches_get_previous (&priv->matches, G_MAXINT);
+       i >= 0;
+       i = _gtk_css_selector_matches_get_previous (&priv->matches, i))
     {
-      ruleset = tree_rules->pdata[i];
+      ruleset = &g_array_index (priv->rulesets, GtkCssRuleset, i);
+
+      GTK_CSS_PROFILER_COUNT (RULESETS_MATCHED, 1);
 
       if (ruleset->styles == NULL)
         continue;
@@ -1621,7 +1940,7 @@ gtk_css_style_provider_lookup (GtkStyleProviderPrivate *provider,
         break;
     }
 
-  g_ptr_array_free (tree_rules, TRUE);
+  _gtk_css_profiler_end_mark (before, "css provider lookup", NULL);
 }
 
 static GtkCssChange
@@ -1642,6 +1961,44 @@ gtk_css_style_provider_get_change (GtkStyleProviderPrivate *provider,
   return change;
 }
 
+static GtkBitmask *
+gtk_css_style_provider_get_state_properties (GtkStyleProviderPrivate *provider,
+                                             const GtkCssMatcher     *matcher)
+{
+  GtkCssProvider *css_provider;
+  GtkCssProviderPrivate *priv;
+  GtkCssRuleset *ruleset;
+  GtkBitmask *properties;
+  int i;
+
+  css_provider = GTK_CSS_PROVIDER (provider);
+  priv = css_provider->priv;
+
+  properties = _gtk_bitmask_new ();
+
+  _gtk_css_selector_tree_match_all (priv->tree, matcher, &priv->matches);
+
+  /* Only rules that look at the element's own state can match in one
+   * state and not in another, everything else is the same for all
+   * states. */
+  for (i = _gtk_css_selector_matches_get_previous (&priv->matches, G_MAXINT);
+       i >= 0;
+       i = _gtk_css_selector_matches_get_previous (&priv->matches, i))
+    {
+      ruleset = &g_array_index (priv->rulesets, GtkCssRuleset, i);
+
+      if (ruleset->set_styles == NULL)
+        continue;
+
+      if (!(_gtk_css_selector_tree_match_get_change (ruleset->selector_match) & GTK_CSS_CHANGE_STATE))
+        continue;
+
+      properties = _gtk_bitmask_union (properties, ruleset->set_styles);
+    }
+
+  return properties;
+}
+
 static void
 gtk_css_style_provider_private_iface_init (GtkStyleProviderPrivateInterface *iface)
 {
@@ -1649,6 +2006,7 @@ gtk_css_style_provider_private_iface_init (GtkStyleProviderPrivateInterface *ifa
   iface->get_keyframes = gtk_css_style_provider_get_keyframes;
   iface->lookup = gtk_css_style_provider_lookup;
   iface->get_change = gtk_css_style_provider_get_change;
+  iface->get_state_properties = gtk_css_style_provider_get_state_properties;
 }
 
 static void
@@ -1661,11 +2019,15 @@ gtk_css_provider_finalize (GObject *object)
   css_provider = GTK_CSS_PROVIDER (object);
   priv = css_provider->priv;
 
+  gtk_css_provider_clear_selector_costs (css_provider);
+
   for (i = 0; i < priv->rulesets->len; i++)
     gtk_css_ruleset_clear (&g_array_index (priv->rulesets, GtkCssRuleset, i));
 
   g_array_free (priv->rulesets, TRUE);
   _gtk_css_selector_tree_free (priv->tree);
+  _gtk_css_selector_matches_clear (&priv->matches);
+  gtk_css_provider_clear_cache (css_provider);
 
   g_hash_table_destroy (priv->symbolic_colors);
   g_hash_table_destroy (priv->keyframes);
@@ -1800,12 +2162,238 @@ gtk_css_provider_reset (GtkCssProvider *css_provider)
   g_hash_table_remove_all (priv->symbolic_colors);
   g_hash_table_remove_all (priv->keyframes);
 
+  gtk_css_provider_clear_selector_costs (css_provider);
+
   for (i = 0; i < priv->rulesets->len; i++)
     gtk_css_ruleset_clear (&g_array_index (priv->rulesets, GtkCssRuleset, i));
   g_array_set_size (priv->rulesets, 0);
   _gtk_css_selector_tree_free (priv->tree);
   priv->tree = NULL;
+  _gtk_css_selector_matches_clear (&priv->matches);
+  _gtk_css_selector_matches_init (&priv->matches, 0);
+
+  gtk_css_provider_clear_cache (css_provider);
+}
+
+/* What goes into the theme cache is collected while the theme is parsed */
+typedef struct _ValueSource ValueSource;
+typedef struct _ValueOrigin ValueOrigin;
+typedef struct _Definition Definition;
+
+struct _GtkCssThemeRecording {
+  GtkCssThemeCacheWriter *writer;
+  GHashTable *sources;          /* ValueSource => itself, to share identical ones */
+  GPtrArray *source_list;       /* indexed by ValueSource.id */
+  GHashTable *values;           /* GtkCssValue => ValueOrigin */
+  GArray *definitions;
+  gboolean failed;              /* errors aren't cached */
+
+  /* while saving */
+  GHashTable *compiled;         /* GtkCssValue => offset of its CachedCompiledValue */
+  GPtrArray *saved_sources;     /* the ones that are parsed when loading */
+};
+
+struct _ValueSource {
+  guint id;
+  guint saved_id;               /* index into saved_sources */
+  GtkStyleProperty *property;
+  char *text;
+  char *uri;
+};
+
+struct _ValueOrigin {
+  ValueSource *source;
+  guint subproperty;
+};
+
+struct _Definition {
+  CachedDefinitionType type;
+  char *name;
+  char *text;
+  char *uri;
+};
+
+static guint
+value_source_hash (gconstpointer data)
+{
+  const ValueSource *source = data;
+
+  return GPOINTER_TO_UINT (source->property)
+         ^ g_str_hash (source->text)
+         ^ (source->uri ? g_str_hash (source->uri) : 0);
+}
+
+static gboolean
+value_source_equal (gconstpointer a,
+                    gconstpointer b)
+{
+  const ValueSource *source_a = a;
+  const ValueSource *source_b = b;
+
+  return source_a->property == source_b->property &&
+         g_str_equal (source_a->text, source_b->text) &&
+         g_strcmp0 (source_a->uri, source_b->uri) == 0;
+}
+
+static void
+value_source_free (gpointer data)
+{
+  ValueSource *source = data;
+
+  g_free (source->text);
+  g_free (source->uri);
+  g_slice_free (ValueSource, source);
+}
+
+static void
+value_origin_free (gpointer data)
+{
+  g_slice_free (ValueOrigin, data);
+}
+
+static void
+definition_clear (gpointer data)
+{
+  Definition *definition = data;
+
+  g_free (definition->name);
+  g_free (definition->text);
+  g_free (definition->uri);
+}
+
+static GtkCssThemeRecording *
+gtk_css_theme_recording_new (void)
+{
+  GtkCssThemeRecording *recording;
+
+  recording = g_slice_new0 (GtkCssThemeRecording);
+  recording->writer = _gtk_css_theme_cache_writer_new ();
+  recording->sources = g_hash_table_new (value_source_hash, value_source_equal);
+  recording->source_list = g_ptr_array_new_with_free_func (value_source_free);
+  recording->values = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                             (GDestroyNotify) _gtk_css_value_unref,
+                                             value_origin_free);
+  recording->definitions = g_array_new (FALSE, FALSE, sizeof (Definition));
+  g_array_set_clear_func (recording->definitions, definition_clear);
+  recording->compiled = g_hash_table_new (NULL, NULL);
+  recording->saved_sources = g_ptr_array_new ();
+
+  return recording;
+}
+
+static void
+gtk_css_theme_recording_free (GtkCssThemeRecording *recording)
+{
+  _gtk_css_theme_cache_writer_free (recording->writer);
+  g_hash_table_unref (recording->sources);
+  g_ptr_array_unref (recording->source_list);
+  g_hash_table_unref (recording->values);
+  g_array_free (recording->definitions, TRUE);
+  g_hash_table_unref (recording->compiled);
+  g_ptr_array_unref (recording->saved_sources);
+
+  g_slice_free (GtkCssThemeRecording, recording);
+}
+
+static char *
+gtk_css_scanner_get_uri (GtkCssScanner *scanner)
+{
+  GFile *file = _gtk_css_parser_get_file (scanner->parser);
+
+  return file ? g_file_get_uri (file) : NULL;
+}
+
+/* Everything between @start and the current position of the parser */
+static char *
+gtk_css_scanner_get_text (GtkCssScanner *scanner,
+                          const char    *start)
+{
+  const char *end = _gtk_css_parser_get_data (scanner->parser);
+
+  return g_strchomp (g_strndup (start, end - start));
+}
+
+/* Remembers that @value was parsed from the text starting at @start
+ * when declared for @property */
+static void
+gtk_css_scanner_record_value (GtkCssScanner    *scanner,
+                              GtkStyleProperty *property,
+                              GtkCssValue      *value,
+                              const char       *start)
+{
+  GtkCssThemeRecording *recording = scanner->provider->priv->recording;
+  ValueSource *source, lookup;
+  guint i, n;
+
+  if (recording == NULL)
+    return;
+
+  lookup.property = property;
+  lookup.text = gtk_css_scanner_get_text (scanner, start);
+  lookup.uri = gtk_css_scanner_get_uri (scanner);
+
+  source = g_hash_table_lookup (recording->sources, &lookup);
+  if (source == NULL)
+    {
+      source = g_slice_new (ValueSource);
+      *source = lookup;
+      source->id = recording->source_list->len;
+      source->saved_id = G_MAXUINT;
+      g_ptr_array_add (recording->source_list, source);
+      g_hash_table_add (recording->sources, source);
+    }
+  else
+    {
+      g_free (lookup.text);
+      g_free (lookup.uri);
+    }
+
+  if (GTK_IS_CSS_SHORTHAND_PROPERTY (property))
+    n = _gtk_css_shorthand_property_get_n_subproperties (GTK_CSS_SHORTHAND_PROPERTY (property));
+  else
+    n = 1;
+
+  for (i = 0; i < n; i++)
+    {
+      GtkCssValue *recorded;
+      ValueOrigin *origin;
+
+      if (GTK_IS_CSS_SHORTHAND_PROPERTY (property))
+        recorded = _gtk_css_array_value_get_nth (value, i);
+      else
+        recorded = value;
+
+      /* Values can be shared, for example "initial". Any of the
+       * sources they come from will parse to the same value again. */
+      if (g_hash_table_contains (recording->values, recorded))
+        continue;
 
+      origin = g_slice_new (ValueOrigin);
+      origin->source = source;
+      origin->subproperty = GTK_IS_CSS_SHORTHAND_PROPERTY (property) ? i : CACHED_STYLE_NO_SUBPROPERTY;
+      g_hash_table_insert (recording->values, _gtk_css_value_ref (recorded), origin);
+    }
+}
+
+/* Remembers an @-rule, so it can be replayed when loading the cache.
+ * The text starting at @start is parsed again, if there is any. */
+static void
+gtk_css_scanner_record_definition (GtkCssScanner        *scanner,
+                                   CachedDefinitionType  type,
+                                   const char           *name,
+                                   const char           *start)
+{
+  GtkCssThemeRecording *recording = scanner->provider->priv->recording;
+  Definition definition;
+
+  if (recording == NULL)
+    return;
+
+  definition.type = type;
+  definition.name = g_strdup (name);
+  definition.text = start ? gtk_css_scanner_get_text (scanner, start) : NULL;
+  definition.uri = gtk_css_scanner_get_uri (scanner);
+  g_array_append_val (recording->definitions, definition);
 }
 
 static void
@@ -1909,6 +2497,7 @@ static gboolean
 parse_color_definition (GtkCssScanner *scanner)
 {
   GtkCssValue *color;
+  const char *start;
   char *name;
 
   gtk_css_scanner_push_section (scanner, GTK_CSS_SECTION_COLOR_DEFINITION);
@@ -1932,6 +2521,7 @@ parse_color_definition (GtkCssScanner *scanner)
       return TRUE;
     }
 
+  start = _gtk_css_parser_get_data (scanner->parser);
   color = _gtk_css_color_value_parse (scanner->parser);
   if (color == NULL)
     {
@@ -1941,6 +2531,8 @@ parse_color_definition (GtkCssScanner *scanner)
       return TRUE;
     }
 
+  gtk_css_scanner_record_definition (scanner, CACHED_DEFINITION_COLOR, name, start);
+
   if (!_gtk_css_parser_try (scanner->parser, ";", TRUE))
     {
       g_free (name);
@@ -1994,6 +2586,7 @@ parse_binding_set (GtkCssScanner *scanner)
       binding_set = gtk_binding_set_new (name);
       binding_set->parsed = TRUE;
     }
+  gtk_css_scanner_record_definition (scanner, CACHED_DEFINITION_BINDING_SET, name, NULL);
   g_free (name);
 
   if (!_gtk_css_parser_try (scanner->parser, "{", TRUE))
@@ -2010,6 +2603,8 @@ parse_binding_set (GtkCssScanner *scanner)
   while (!_gtk_css_parser_is_eof (scanner->parser) &&
          !_gtk_css_parser_begins_with (scanner->parser, '}'))
     {
+      const char *start = _gtk_css_parser_get_data (scanner->parser);
+
       name = _gtk_css_parser_read_value (scanner->parser);
       if (name == NULL)
         {
@@ -2025,6 +2620,8 @@ parse_binding_set (GtkCssScanner *scanner)
                                           GTK_CSS_PROVIDER_ERROR_SYNTAX,
                                           "Failed to parse binding set.");
         }
+      else
+        gtk_css_scanner_record_definition (scanner, CACHED_DEFINITION_BINDING, binding_set->set_name, start);
 
       g_free (name);
 
@@ -2074,6 +2671,7 @@ static gboolean
 parse_keyframes (GtkCssScanner *scanner)
 {
   GtkCssKeyframes *keyframes;
+  const char *start;
   char *name;
 
   gtk_css_scanner_push_section (scanner, GTK_CSS_SECTION_KEYFRAMES);
@@ -2108,6 +2706,7 @@ parse_keyframes (GtkCssScanner *scanner)
       goto exit;
     }
 
+  start = _gtk_css_parser_get_data (scanner->parser);
   keyframes = _gtk_css_keyframes_parse (scanner->parser);
   if (keyframes == NULL)
     {
@@ -2128,6 +2727,11 @@ parse_keyframes (GtkCssScanner *scanner)
       if (!_gtk_css_parser_is_eof (scanner->parser))
         _gtk_css_parser_resync (scanner->parser, FALSE, 0);
     }
+  else
+    {
+      /* _gtk_css_keyframes_parse() needs to see the closing '}' again */
+      gtk_css_scanner_record_definition (scanner, CACHED_DEFINITION_KEYFRAMES, name, start);
+    }
 
 exit:
   gtk_css_scanner_pop_section (scanner, GTK_CSS_SECTION_KEYFRAMES);
@@ -2225,11 +2829,13 @@ parse_declaration (GtkCssScanner *scanner,
   if (property)
     {
       GtkCssValue *value;
+      const char *start;
 
       g_free (name);
 
       gtk_css_scanner_push_section (scanner, GTK_CSS_SECTION_VALUE);
 
+      start = _gtk_css_parser_get_data (scanner->parser);
       value = _gtk_style_property_parse_value (property,
                                                scanner->parser);
 
@@ -2256,6 +2862,8 @@ parse_declaration (GtkCssScanner *scanner,
           return;
         }
 
+      gtk_css_scanner_record_value (scanner, property, value, start);
+
       if (GTK_IS_CSS_SHORTHAND_PROPERTY (property))
         {
           GtkCssShorthandProperty *shorthand = GTK_CSS_SHORTHAND_PROPERTY (property);
@@ -2455,11 +3063,14 @@ gtk_css_provider_postprocess (GtkCssProvider *css_provider)
       _gtk_css_selector_tree_builder_add (builder,
 					  ruleset->selector,
 					  &ruleset->selector_match,
-					  ruleset);
+					  i);
     }
 
   priv->tree = _gtk_css_selector_tree_builder_build (builder);
   _gtk_css_selector_tree_builder_free (builder);
+
+  _gtk_css_selector_matches_clear (&priv->matches);
+  _gtk_css_selector_matches_init (&priv->matches, priv->rulesets->len);
 }
 
 static gboolean
@@ -2471,7 +3082,7 @@ gtk_css_provider_load_internal (GtkCssProvider *css_provider,
 {
   GtkCssScanner *scanner;
   gulong error_handler;
-  char *free_data = NULL;
+  GBytes *bytes = NULL;
 
   if (error)
     error_handler = g_signal_connect (css_provider,
@@ -2484,12 +3095,27 @@ gtk_css_provider_load_internal (GtkCssProvider *css_provider,
   if (text == NULL)
     {
       GError *load_error = NULL;
+      guint64 mtime = 0;
 
-      if (g_file_load_contents (file, NULL,
-                                &free_data, NULL,
-                                NULL, &load_error))
+      /* Before loading, so that a later change can't go unnoticed */
+      if (css_provider->priv->recording)
+        mtime = _gtk_css_theme_cache_get_mtime (file);
+
+      bytes = gtk_css_provider_load_bytes (file, &load_error);
+      if (bytes)
         {
-          text = free_data;
+          gsize length;
+
+          text = g_bytes_get_data (bytes, &length);
+          if (text == NULL)
+            text = "";
+
+          if (css_provider->priv->recording)
+            _gtk_css_theme_cache_writer_add_source (css_provider->priv->recording->writer,
+                                                    file,
+                                                    mtime,
+                                                    text,
+                                                    length);
         }
       else
         {
@@ -2527,7 +3153,8 @@ gtk_css_provider_load_internal (GtkCssProvider *css_provider,
         gtk_css_provider_postprocess (css_provider);
     }
 
-  g_free (free_data);
+  if (bytes)
+    g_bytes_unref (bytes);
 
   if (error)
     {
@@ -2662,40 +3289,17 @@ gtk_css_provider_load_from_path (GtkCssProvider  *css_provider,
   return result;
 }
 
-static void
-gtk_css_provider_load_from_resource (GtkCssProvider  *css_provider,
-			             const gchar     *resource_path)
-{
-  GFile *file;
-  char *uri, *escaped;
-
-  g_return_if_fail (GTK_IS_CSS_PROVIDER (css_provider));
-  g_return_if_fail (resource_path != NULL);
-
-  escaped = g_uri_escape_string (resource_path,
-				 G_URI_RESERVED_CHARS_ALLOWED_IN_PATH, FALSE);
-  uri = g_strconcat ("resource://", escaped, NULL);
-  g_free (escaped);
-
-  file = g_file_new_for_uri (uri);
-  g_free (uri);
-
-  gtk_css_provider_load_from_file (css_provider, file, NULL);
-
-  g_object_unref (file);
-}
-
-/**
- * gtk_css_provider_get_default:
- *
- * Returns the provider containing the style settings used as a
- * fallback for all widgets.
- *
- * Returns: (transfer none): The provider used for fallback styling.
- *          This memory is owned by GTK+, and you must not free it.
- **/
-GtkCssProvider *
-gtk_css_provider_get_default (void)
+/**
+ * gtk_css_provider_get_default:
+ *
+ * Returns the provider containing the style settings used as a
+ * fallback for all widgets.
+ *
+ * Returns: (transfer none): The provider used for fallback styling.
+ *          This memory is owned by GTK+, and you must not free it.
+ **/
+GtkCssProvider *
+gtk_css_provider_get_default (void)
 {
   static GtkCssProvider *provider;
 
@@ -2723,6 +3327,759 @@ _gtk_css_provider_get_theme_dir (void)
   return path;
 }
 
+/* Returns GTK_CSS_THEME_CACHE_NONE if @value can't be compiled */
+static guint32
+gtk_css_provider_save_compiled_value (GtkCssProvider *css_provider,
+                                      GtkCssValue    *value)
+{
+  GtkCssThemeRecording *recording = css_provider->priv->recording;
+  CachedCompiledValue compiled = { 0, };
+  const char *string;
+  GtkCssUnit unit;
+  guint enum_type, enum_position;
+  GdkRGBA rgba;
+  gpointer offset;
+
+  if (g_hash_table_lookup_extended (recording->compiled, value, NULL, &offset))
+    return GPOINTER_TO_UINT (offset);
+
+  if (_gtk_css_number_value_unpack (value, &compiled.numbers[0], &unit))
+    {
+      compiled.type = CACHED_COMPILED_NUMBER;
+      compiled.data = unit;
+    }
+  else if (_gtk_css_color_value_unpack (value, &rgba, &string))
+    {
+      if (string)
+        {
+          compiled.type = CACHED_COMPILED_COLOR_NAME;
+          compiled.data = _gtk_css_theme_cache_writer_add_string (recording->writer, string);
+        }
+      else
+        {
+          compiled.type = CACHED_COMPILED_COLOR;
+          compiled.numbers[0] = rgba.red;
+          compiled.numbers[1] = rgba.green;
+          compiled.numbers[2] = rgba.blue;
+          compiled.numbers[3] = rgba.alpha;
+        }
+    }
+  else if (_gtk_css_enum_value_unpack (value, &enum_type, &enum_position))
+    {
+      compiled.type = CACHED_COMPILED_ENUM;
+      compiled.data = enum_type;
+      compiled.position = enum_position;
+    }
+  else if (_gtk_css_ident_value_unpack (value, &string))
+    {
+      compiled.type = CACHED_COMPILED_IDENT;
+      compiled.data = _gtk_css_theme_cache_writer_add_string (recording->writer, string);
+    }
+  else
+    {
+      g_hash_table_insert (recording->compiled, value, GUINT_TO_POINTER (GTK_CSS_THEME_CACHE_NONE));
+      return GTK_CSS_THEME_CACHE_NONE;
+    }
+
+  offset = GUINT_TO_POINTER (_gtk_css_theme_cache_writer_add (recording->writer,
+                                                              &compiled,
+                                                              sizeof (CachedCompiledValue)));
+  g_hash_table_insert (recording->compiled, value, offset);
+
+  return GPOINTER_TO_UINT (offset);
+}
+
+static guint32
+gtk_css_provider_save_styles (GtkCssProvider *css_provider,
+                              GtkCssRuleset  *ruleset)
+{
+  GtkCssThemeRecording *recording = css_provider->priv->recording;
+  CachedStyle *styles;
+  guint32 offset;
+  guint i;
+
+  styles = g_new (CachedStyle, ruleset->n_styles);
+  for (i = 0; i < ruleset->n_styles; i++)
+    {
+      ValueOrigin *origin;
+
+      styles[i].property = _gtk_css_style_property_get_id (ruleset->styles[i].property);
+      styles[i].compiled = gtk_css_provider_save_compiled_value (css_provider, ruleset->styles[i].value);
+      styles[i].value = 0;
+      styles[i].subproperty = CACHED_STYLE_NO_SUBPROPERTY;
+      if (styles[i].compiled != GTK_CSS_THEME_CACHE_NONE)
+        continue;
+
+      origin = g_hash_table_lookup (recording->values, ruleset->styles[i].value);
+      if (origin == NULL)
+        {
+          g_free (styles);
+          return GTK_CSS_THEME_CACHE_NONE;
+        }
+
+      /* Only the declarations that are needed get saved */
+      if (origin->source->saved_id == G_MAXUINT)
+        {
+          origin->source->saved_id = recording->saved_sources->len;
+          g_ptr_array_add (recording->saved_sources, origin->source);
+        }
+
+      styles[i].value = origin->source->saved_id;
+      styles[i].subproperty = origin->subproperty;
+    }
+
+  offset = _gtk_css_theme_cache_writer_add_array (recording->writer,
+                                                  styles,
+                                                  ruleset->n_styles,
+                                                  sizeof (CachedStyle));
+  g_free (styles);
+
+  return offset;
+}
+
+static guint32
+gtk_css_provider_save_widget_style (GtkCssProvider *css_provider,
+                                    GtkCssRuleset  *ruleset)
+{
+  GtkCssThemeCacheWriter *writer = css_provider->priv->recording->writer;
+  WidgetPropertyValue *l;
+  GArray *array;
+  guint32 offset;
+
+  array = g_array_new (FALSE, FALSE, sizeof (CachedWidgetStyle));
+  for (l = ruleset->widget_style; l != NULL; l = l->next)
+    {
+      CachedWidgetStyle style;
+
+      style.name = _gtk_css_theme_cache_writer_add_string (writer, l->name);
+      style.value = _gtk_css_theme_cache_writer_add_string (writer, l->value);
+      g_array_append_val (array, style);
+    }
+
+  offset = _gtk_css_theme_cache_writer_add_array (writer,
+                                                  array->data,
+                                                  array->len,
+                                                  sizeof (CachedWidgetStyle));
+  g_array_free (array, TRUE);
+
+  return offset;
+}
+
+/* Writes what was recorded while loading the theme to the cache */
+static gboolean
+gtk_css_provider_save_cache (GtkCssProvider  *css_provider,
+                             const char      *filename,
+                             GError         **error)
+{
+  GtkCssProviderPrivate *priv = css_provider->priv;
+  GtkCssThemeRecording *recording = priv->recording;
+  GtkCssThemeCacheWriter *writer = recording->writer;
+  GHashTable *styles, *widget_styles;
+  CachedRuleset *rulesets;
+  CachedValue *values;
+  CachedDefinition *definitions;
+  CachedRoot root;
+  gboolean result;
+  guint i;
+
+  definitions = g_new (CachedDefinition, recording->definitions->len);
+  for (i = 0; i < recording->definitions->len; i++)
+    {
+      Definition *definition = &g_array_index (recording->definitions, Definition, i);
+
+      definitions[i].type = definition->type;
+      definitions[i].name = _gtk_css_theme_cache_writer_add_string (writer, definition->name);
+      definitions[i].text = definition->text ? _gtk_css_theme_cache_writer_add_string (writer, definition->text)
+                                             : GTK_CSS_THEME_CACHE_NONE;
+      definitions[i].file = definition->uri ? _gtk_css_theme_cache_writer_add_string (writer, definition->uri)
+                                            : GTK_CSS_THEME_CACHE_NONE;
+    }
+  root.definitions = _gtk_css_theme_cache_writer_add_array (writer,
+                                                            definitions,
+                                                            recording->definitions->len,
+                                                            sizeof (CachedDefinition));
+  g_free (definitions);
+
+  /* Copies of a ruleset share their styles, keep it that way */
+  styles = g_hash_table_new (NULL, NULL);
+  widget_styles = g_hash_table_new (NULL, NULL);
+  rulesets = g_new (CachedRuleset, priv->rulesets->len);
+  result = TRUE;
+  for (i = 0; i < priv->rulesets->len && result; i++)
+    {
+      GtkCssRuleset *ruleset = &g_array_index (priv->rulesets, GtkCssRuleset, i);
+      gpointer offset;
+
+      rulesets[i].selector = _gtk_css_selector_save (ruleset->selector, writer);
+
+      if (ruleset->styles == NULL)
+        rulesets[i].styles = GTK_CSS_THEME_CACHE_NONE;
+      else if (g_hash_table_lookup_extended (styles, ruleset->styles, NULL, &offset))
+        rulesets[i].styles = GPOINTER_TO_UINT (offset);
+      else
+        {
+          rulesets[i].styles = gtk_css_provider_save_styles (css_provider, ruleset);
+          g_hash_table_insert (styles, ruleset->styles, GUINT_TO_POINTER (rulesets[i].styles));
+          /* Can't happen, but we'd rather not write a broken cache */
+          result = rulesets[i].styles != GTK_CSS_THEME_CACHE_NONE;
+        }
+
+      if (ruleset->widget_style == NULL)
+        rulesets[i].widget_style = GTK_CSS_THEME_CACHE_NONE;
+      else if (g_hash_table_lookup_extended (widget_styles, ruleset->widget_style, NULL, &offset))
+        rulesets[i].widget_style = GPOINTER_TO_UINT (offset);
+      else
+        {
+          rulesets[i].widget_style = gtk_css_provider_save_widget_style (css_provider, ruleset);
+          g_hash_table_insert (widget_styles, ruleset->widget_style, GUINT_TO_POINTER (rulesets[i].widget_style));
+        }
+    }
+  root.rulesets = _gtk_css_theme_cache_writer_add_array (writer,
+                                                         rulesets,
+                                                         priv->rulesets->len,
+                                                         sizeof (CachedRuleset));
+  g_free (rulesets);
+  g_hash_table_unref (styles);
+  g_hash_table_unref (widget_styles);
+
+  if (!result)
+    {
+      g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "Value without source");
+      return FALSE;
+    }
+
+  /* Known once the styles are saved */
+  values = g_new (CachedValue, recording->saved_sources->len);
+  for (i = 0; i < recording->saved_sources->len; i++)
+    {
+      ValueSource *source = g_ptr_array_index (recording->saved_sources, i);
+
+      values[i].property = _gtk_css_theme_cache_writer_add_string (writer, _gtk_style_property_get_name (source->property));
+      values[i].text = _gtk_css_theme_cache_writer_add_string (writer, source->text);
+      values[i].file = source->uri ? _gtk_css_theme_cache_writer_add_string (writer, source->uri)
+                                   : GTK_CSS_THEME_CACHE_NONE;
+    }
+  root.values = _gtk_css_theme_cache_writer_add_array (writer,
+                                                       values,
+                                                       recording->saved_sources->len,
+                                                       sizeof (CachedValue));
+  g_free (values);
+
+  root.n_properties = _gtk_css_style_property_get_n_properties ();
+  root.tree = _gtk_css_selector_tree_save (priv->tree, writer);
+
+  return _gtk_css_theme_cache_writer_save (writer,
+                                           _gtk_css_theme_cache_writer_add (writer, &root, sizeof (CachedRoot)),
+                                           filename,
+                                           error);
+}
+
+/* A value that was parsed from its declaration in the cache */
+typedef struct {
+  GtkStyleProperty *property;
+  GtkCssValue *value;
+} LoadedValue;
+
+static void
+loaded_values_free (LoadedValue *loaded,
+                    guint        n_loaded)
+{
+  guint i;
+
+  for (i = 0; i < n_loaded; i++)
+    _gtk_css_value_unref (loaded[i].value);
+  g_free (loaded);
+}
+
+static gboolean
+gtk_css_provider_load_cached_values (GtkCssProvider    *css_provider,
+                                     const CachedRoot  *root,
+                                     LoadedValue      **loaded,
+                                     guint             *n_loaded)
+{
+  GtkCssProviderPrivate *priv = css_provider->priv;
+  const CachedValue *values;
+  guint i, n_values;
+
+  values = _gtk_css_theme_cache_reader_get_array (priv->cache, root->values, sizeof (CachedValue), &n_values);
+  if (values == NULL)
+    return FALSE;
+
+  *loaded = g_new0 (LoadedValue, n_values);
+  *n_loaded = n_values;
+
+  for (i = 0; i < n_values; i++)
+    {
+      const char *name, *text, *uri;
+      GtkStyleProperty *property;
+      GtkCssScanner *scanner;
+
+      name = _gtk_css_theme_cache_reader_get_string (priv->cache, values[i].property);
+      text = _gtk_css_theme_cache_reader_get_string (priv->cache, values[i].text);
+      uri = _gtk_css_theme_cache_reader_get_string (priv->cache, values[i].file);
+      if (name == NULL || text == NULL ||
+          (values[i].file != GTK_CSS_THEME_CACHE_NONE && uri == NULL))
+        return FALSE;
+
+      property = _gtk_style_property_lookup (name);
+      if (property == NULL)
+        return FALSE;
+
+      scanner = gtk_css_provider_cache_scanner_new (css_provider, text, uri);
+      (*loaded)[i].property = property;
+      (*loaded)[i].value = _gtk_style_property_parse_value (property, scanner->parser);
+      gtk_css_scanner_destroy (scanner);
+
+      /* It did parse when the cache was written, but for example an
+       * image it refers to may be gone now */
+      if ((*loaded)[i].value == NULL || priv->cache_failed)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static GtkCssValue *
+gtk_css_provider_load_compiled_value (GtkCssProvider *css_provider,
+                                      guint32         offset)
+{
+  GtkCssProviderPrivate *priv = css_provider->priv;
+  const CachedCompiledValue *compiled;
+  const char *string;
+  GdkRGBA rgba;
+
+  compiled = _gtk_css_theme_cache_reader_get (priv->cache, offset, sizeof (CachedCompiledValue));
+  if (compiled == NULL)
+    return NULL;
+
+  switch (compiled->type)
+    {
+    case CACHED_COMPILED_NUMBER:
+      if (compiled->data > GTK_CSS_MS)
+        return NULL;
+      return _gtk_css_number_value_new (compiled->numbers[0], compiled->data);
+
+    case CACHED_COMPILED_COLOR:
+      rgba.red = compiled->numbers[0];
+      rgba.green = compiled->numbers[1];
+      rgba.blue = compiled->numbers[2];
+      rgba.alpha = compiled->numbers[3];
+      return _gtk_css_color_value_new_literal (&rgba);
+
+    case CACHED_COMPILED_COLOR_NAME:
+      string = _gtk_css_theme_cache_reader_get_string (priv->cache, compiled->data);
+      return string ? _gtk_css_color_value_new_name (string) : NULL;
+
+    case CACHED_COMPILED_ENUM:
+      return _gtk_css_enum_value_pack (compiled->data, compiled->position);
+
+    case CACHED_COMPILED_IDENT:
+      string = _gtk_css_theme_cache_reader_get_string (priv->cache, compiled->data);
+      return string ? _gtk_css_ident_value_new (string) : NULL;
+
+    default:
+      return NULL;
+    }
+}
+
+/* Only colors and keyframes, binding sets can't be taken back if
+ * loading fails later on */
+static gboolean
+gtk_css_provider_load_cached_definitions (GtkCssProvider   *css_provider,
+                                          const CachedRoot *root,
+                                          gboolean          binding_sets)
+{
+  GtkCssProviderPrivate *priv = css_provider->priv;
+  const CachedDefinition *definitions;
+  guint i, n_definitions;
+
+  definitions = _gtk_css_theme_cache_reader_get_array (priv->cache, root->definitions, sizeof (CachedDefinition), &n_definitions);
+  if (definitions == NULL)
+    return FALSE;
+
+  for (i = 0; i < n_definitions; i++)
+    {
+      const char *name, *text, *uri;
+      GtkBindingSet *binding_set;
+      GtkCssScanner *scanner;
+      gpointer value;
+
+      name = _gtk_css_theme_cache_reader_get_string (priv->cache, definitions[i].name);
+      text = _gtk_css_theme_cache_reader_get_string (priv->cache, definitions[i].text);
+      uri = _gtk_css_theme_cache_reader_get_string (priv->cache, definitions[i].file);
+      if (name == NULL ||
+          (text == NULL && definitions[i].type != CACHED_DEFINITION_BINDING_SET))
+        return FALSE;
+
+      switch (definitions[i].type)
+        {
+        case CACHED_DEFINITION_COLOR:
+        case CACHED_DEFINITION_KEYFRAMES:
+          if (binding_sets)
+            break;
+
+          scanner = gtk_css_provider_cache_scanner_new (css_provider, text, uri);
+          if (definitions[i].type == CACHED_DEFINITION_COLOR)
+            value = _gtk_css_color_value_parse (scanner->parser);
+          else
+            value = _gtk_css_keyframes_parse (scanner->parser);
+          gtk_css_scanner_destroy (scanner);
+
+          if (value == NULL)
+            return FALSE;
+
+          g_hash_table_insert (definitions[i].type == CACHED_DEFINITION_COLOR ? priv->symbolic_colors
+                                                                              : priv->keyframes,
+                               g_strdup (name),
+                               value);
+          break;
+
+        case CACHED_DEFINITION_BINDING_SET:
+        case CACHED_DEFINITION_BINDING:
+          if (!binding_sets)
+            break;
+
+          binding_set = gtk_binding_set_find (name);
+          if (!binding_set)
+            {
+              binding_set = gtk_binding_set_new (name);
+              binding_set->parsed = TRUE;
+            }
+          if (text)
+            gtk_binding_entry_add_signal_from_string (binding_set, text);
+          break;
+
+        default:
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+static gboolean
+gtk_css_provider_load_cached_styles (GtkCssProvider    *css_provider,
+                                     GtkCssRuleset     *ruleset,
+                                     guint32            offset,
+                                     const LoadedValue *loaded,
+                                     guint              n_loaded)
+{
+  GtkCssProviderPrivate *priv = css_provider->priv;
+  const CachedStyle *styles;
+  guint i, n_styles, n_properties;
+
+  styles = _gtk_css_theme_cache_reader_get_array (priv->cache, offset, sizeof (CachedStyle), &n_styles);
+  if (styles == NULL || n_styles == 0)
+    return FALSE;
+
+  n_properties = _gtk_css_style_property_get_n_properties ();
+  ruleset->styles = g_new0 (PropertyValue, n_styles);
+  ruleset->n_styles = n_styles;
+  ruleset->owns_styles = TRUE;
+
+  for (i = 0; i < n_styles; i++)
+    {
+      GtkStyleProperty *property;
+      GtkCssValue *value;
+      guint id;
+
+      if (styles[i].property >= n_properties)
+        return FALSE;
+
+      ruleset->styles[i].property = _gtk_css_style_property_lookup_by_id (styles[i].property);
+
+      if (styles[i].compiled != GTK_CSS_THEME_CACHE_NONE)
+        {
+          ruleset->styles[i].value = gtk_css_provider_load_compiled_value (css_provider, styles[i].compiled);
+          if (ruleset->styles[i].value == NULL)
+            return FALSE;
+          continue;
+        }
+
+      if (styles[i].value >= n_loaded)
+        return FALSE;
+
+      /* Make sure that the parsed value is what we expect */
+      property = loaded[styles[i].value].property;
+      value = loaded[styles[i].value].value;
+      if (styles[i].subproperty == CACHED_STYLE_NO_SUBPROPERTY)
+        {
+          if (!GTK_IS_CSS_STYLE_PROPERTY (property))
+            return FALSE;
+          id = _gtk_css_style_property_get_id (GTK_CSS_STYLE_PROPERTY (property));
+        }
+      else
+        {
+          GtkCssShorthandProperty *shorthand;
+
+          if (!GTK_IS_CSS_SHORTHAND_PROPERTY (property))
+            return FALSE;
+          shorthand = GTK_CSS_SHORTHAND_PROPERTY (property);
+          if (styles[i].subproperty >= _gtk_css_shorthand_property_get_n_subproperties (shorthand))
+            return FALSE;
+          id = _gtk_css_style_property_get_id (_gtk_css_shorthand_property_get_subproperty (shorthand,
+                                                                                           styles[i].subproperty));
+          value = _gtk_css_array_value_get_nth (value, styles[i].subproperty);
+        }
+
+      if (id != styles[i].property)
+        return FALSE;
+
+      ruleset->styles[i].value = _gtk_css_value_ref (value);
+    }
+
+  return TRUE;
+}
+
+static gboolean
+gtk_css_provider_load_cached_widget_style (GtkCssProvider *css_provider,
+                                           GtkCssRuleset  *ruleset,
+                                           guint32         offset)
+{
+  GtkCssProviderPrivate *priv = css_provider->priv;
+  const CachedWidgetStyle *styles;
+  guint i, n_styles;
+
+  styles = _gtk_css_theme_cache_reader_get_array (priv->cache, offset, sizeof (CachedWidgetStyle), &n_styles);
+  if (styles == NULL)
+    return FALSE;
+
+  ruleset->owns_widget_style = TRUE;
+
+  for (i = n_styles; i-- > 0; )
+    {
+      WidgetPropertyValue *value;
+      const char *name, *text;
+
+      name = _gtk_css_theme_cache_reader_get_string (priv->cache, styles[i].name);
+      text = _gtk_css_theme_cache_reader_get_string (priv->cache, styles[i].value);
+      if (name == NULL || text == NULL)
+        return FALSE;
+
+      value = g_slice_new0 (WidgetPropertyValue);
+      value->name = g_strdup (name);
+      value->value = g_strdup (text);
+      value->next = ruleset->widget_style;
+      ruleset->widget_style = value;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+gtk_css_provider_load_cached_rulesets (GtkCssProvider    *css_provider,
+                                       const CachedRoot  *root,
+                                       const LoadedValue *loaded,
+                                       guint              n_loaded)
+{
+  GtkCssProviderPrivate *priv = css_provider->priv;
+  const CachedRuleset *rulesets;
+  GtkCssSelectorTree **selector_matches;
+  GHashTable *styles, *widget_styles;
+  gboolean result;
+  guint i, n_rulesets;
+
+  rulesets = _gtk_css_theme_cache_reader_get_array (priv->cache, root->rulesets, sizeof (CachedRuleset), &n_rulesets);
+  if (rulesets == NULL)
+    return FALSE;
+
+  g_array_set_size (priv->rulesets, n_rulesets);
+  memset (priv->rulesets->data, 0, n_rulesets * sizeof (GtkCssRuleset));
+
+  /* offset => index of the first ruleset using it */
+  styles = g_hash_table_new (NULL, NULL);
+  widget_styles = g_hash_table_new (NULL, NULL);
+  result = TRUE;
+
+  for (i = 0; i < n_rulesets; i++)
+    {
+      GtkCssRuleset *ruleset = &g_array_index (priv->rulesets, GtkCssRuleset, i);
+      gpointer first;
+      guint j;
+
+      ruleset->selector = _gtk_css_selector_load (priv->cache, rulesets[i].selector);
+      if (ruleset->selector == NULL)
+        {
+          result = FALSE;
+          break;
+        }
+
+      if (rulesets[i].styles == GTK_CSS_THEME_CACHE_NONE)
+        ;
+      else if (g_hash_table_lookup_extended (styles, GUINT_TO_POINTER (rulesets[i].styles), NULL, &first))
+        {
+          GtkCssRuleset *owner = &g_array_index (priv->rulesets, GtkCssRuleset, GPOINTER_TO_UINT (first));
+
+          ruleset->styles = owner->styles;
+          ruleset->n_styles = owner->n_styles;
+        }
+      else
+        {
+          g_hash_table_insert (styles, GUINT_TO_POINTER (rulesets[i].styles), GUINT_TO_POINTER (i));
+          if (!gtk_css_provider_load_cached_styles (css_provider, ruleset, rulesets[i].styles, loaded, n_loaded))
+            {
+              result = FALSE;
+              break;
+            }
+        }
+
+      if (ruleset->styles)
+        {
+          ruleset->set_styles = _gtk_bitmask_new ();
+          for (j = 0; j < ruleset->n_styles; j++)
+            ruleset->set_styles = _gtk_bitmask_set (ruleset->set_styles,
+                                                    _gtk_css_style_property_get_id (ruleset->styles[j].property),
+                                                    TRUE);
+        }
+
+      if (rulesets[i].widget_style == GTK_CSS_THEME_CACHE_NONE)
+        ;
+      else if (g_hash_table_lookup_extended (widget_styles, GUINT_TO_POINTER (rulesets[i].widget_style), NULL, &first))
+        ruleset->widget_style = g_array_index (priv->rulesets, GtkCssRuleset, GPOINTER_TO_UINT (first)).widget_style;
+      else
+        {
+          g_hash_table_insert (widget_styles, GUINT_TO_POINTER (rulesets[i].widget_style), GUINT_TO_POINTER (i));
+          if (!gtk_css_provider_load_cached_widget_style (css_provider, ruleset, rulesets[i].widget_style))
+            {
+              result = FALSE;
+              break;
+            }
+        }
+    }
+
+  g_hash_table_unref (styles);
+  g_hash_table_unref (widget_styles);
+
+  if (!result)
+    return FALSE;
+
+  selector_matches = g_new (GtkCssSelectorTree *, MAX (n_rulesets, 1));
+  result = _gtk_css_selector_tree_load (priv->cache, root->tree, n_rulesets, selector_matches, &priv->tree);
+  if (result)
+    {
+      for (i = 0; i < n_rulesets; i++)
+        g_array_index (priv->rulesets, GtkCssRuleset, i).selector_match = selector_matches[i];
+    }
+  g_free (selector_matches);
+
+  return result;
+}
+
+/* Loads the theme from the cache in @filename, if that is up to date */
+static gboolean
+gtk_css_provider_load_cache (GtkCssProvider *css_provider,
+                             const char     *filename)
+{
+  GtkCssProviderPrivate *priv = css_provider->priv;
+  const CachedRoot *root;
+  LoadedValue *loaded = NULL;
+  guint n_loaded = 0;
+  gboolean result;
+
+  priv->cache = _gtk_css_theme_cache_reader_new (filename);
+  if (priv->cache == NULL)
+    return FALSE;
+
+  priv->loading_cache = TRUE;
+  priv->cache_failed = FALSE;
+
+  root = _gtk_css_theme_cache_reader_get (priv->cache,
+                                          _gtk_css_theme_cache_reader_get_root (priv->cache),
+                                          sizeof (CachedRoot));
+  result = root != NULL &&
+           root->n_properties == _gtk_css_style_property_get_n_properties () &&
+           gtk_css_provider_load_cached_values (css_provider, root, &loaded, &n_loaded) &&
+           gtk_css_provider_load_cached_definitions (css_provider, root, FALSE) &&
+           gtk_css_provider_load_cached_rulesets (css_provider, root, loaded, n_loaded) &&
+           !priv->cache_failed;
+
+  loaded_values_free (loaded, n_loaded);
+  priv->loading_cache = FALSE;
+
+  if (!result)
+    {
+      GTK_NOTE (MISC, g_message ("Ignoring stale theme cache %s", filename));
+      gtk_css_provider_reset (css_provider);
+      return FALSE;
+    }
+
+  gtk_css_provider_load_cached_definitions (css_provider, root, TRUE);
+
+  _gtk_css_selector_matches_clear (&priv->matches);
+  _gtk_css_selector_matches_init (&priv->matches, priv->rulesets->len);
+
+  return TRUE;
+}
+
+static gboolean
+gtk_css_provider_use_theme_cache (void)
+{
+  return !gtk_keep_css_sections &&
+         !(gtk_get_debug_flags () & GTK_DEBUG_NO_CSS_CACHE);
+}
+
+/* Like gtk_css_provider_load_from_file(), but uses the theme cache */
+static void
+gtk_css_provider_load_theme (GtkCssProvider *css_provider,
+                             GFile          *file)
+{
+  GtkCssProviderPrivate *priv = css_provider->priv;
+  GError *error = NULL;
+  char *filename;
+
+  if (!gtk_css_provider_use_theme_cache ())
+    {
+      gtk_css_provider_load_from_file (css_provider, file, NULL);
+      return;
+    }
+
+  gtk_css_provider_reset (css_provider);
+
+  filename = _gtk_css_theme_cache_get_filename (file);
+  if (!gtk_css_provider_load_cache (css_provider, filename))
+    {
+      priv->recording = gtk_css_theme_recording_new ();
+
+      gtk_css_provider_load_internal (css_provider, NULL, file, NULL, NULL);
+
+      if (!priv->recording->failed &&
+          !gtk_css_provider_save_cache (css_provider, filename, &error))
+        {
+          GTK_NOTE (MISC, g_message ("Failed to write theme cache: %s", error->message));
+          g_error_free (error);
+        }
+
+      gtk_css_theme_recording_free (priv->recording);
+      priv->recording = NULL;
+    }
+  g_free (filename);
+
+  _gtk_style_provider_private_changed (GTK_STYLE_PROVIDER_PRIVATE (css_provider));
+}
+
+static void
+gtk_css_provider_load_from_resource (GtkCssProvider  *css_provider,
+			             const gchar     *resource_path)
+{
+  GFile *file;
+  char *uri, *escaped;
+
+  g_return_if_fail (GTK_IS_CSS_PROVIDER (css_provider));
+  g_return_if_fail (resource_path != NULL);
+
+  escaped = g_uri_escape_string (resource_path,
+				 G_URI_RESERVED_CHARS_ALLOWED_IN_PATH, FALSE);
+  uri = g_strconcat ("resource://", escaped, NULL);
+  g_free (escaped);
+
+  file = g_file_new_for_uri (uri);
+  g_free (uri);
+
+  gtk_css_provider_load_theme (css_provider, file);
+
+  g_object_unref (file);
+}
+
 /**
  * _gtk_css_provider_load_named:
  * @provider: a #GtkCssProvider
@@ -2806,6 +4163,7 @@ _gtk_css_provider_load_named (GtkCssProvider *provider,
     {
       char *dir, *resource_file;
       GResource *resource;
+      GFile *file;
 
       dir = g_path_get_dirname (path);
       resource_file = g_build_filename (dir, "gtk.gresource", NULL);
@@ -2815,9 +4173,11 @@ _gtk_css_provider_load_named (GtkCssProvider *provider,
       if (resource != NULL)
         g_resources_register (resource);
 
-      gtk_css_provider_load_from_path (provider, path, NULL);
+      file = g_file_new_for_path (path);
+      gtk_css_provider_load_theme (provider, file);
+      g_object_unref (file);
 
-      /* Only set this after load, as load_from_path will clear it */
+      /* Only set this after load, as loading will clear it */
       provider->priv->resource = resource;
 
       g_free (path);
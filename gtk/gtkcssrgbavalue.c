@@ -78,12 +78,19 @@ gtk_css_value_rgba_print (const GtkCssValue *rgba,
   g_free (s);
 }
 
+static guint
+gtk_css_value_rgba_hash (const GtkCssValue *rgba)
+{
+  return gdk_rgba_hash (&rgba->rgba);
+}
+
 static const GtkCssValueClass GTK_CSS_VALUE_RGBA = {
   gtk_css_value_rgba_free,
   gtk_css_value_rgba_compute,
   gtk_css_value_rgba_equal,
   gtk_css_value_rgba_transition,
-  gtk_css_value_rgba_print
+  gtk_css_value_rgba_print,
+  gtk_css_value_rgba_hash
 };
 
 GtkCssValue *
@@ -96,7 +103,7 @@ _gtk_css_rgba_value_new_from_rgba (const GdkRGBA *rgba)
   value = _gtk_css_value_new (GtkCssValue, &GTK_CSS_VALUE_RGBA);
   value->rgba = *rgba;
 
-  return value;
+  return _gtk_css_value_intern (value);
 }
 
 const GdkRGBA *
@@ -19,9 +19,9 @@
 
 #include "gtkcssselectorprivate.h"
 
-#include <stdlib.h>
 #include <string.h>
 
+#include "gtkcssprofilerprivate.h"
 #include "gtkcssprovider.h"
 #include "gtkstylecontextprivate.h"
 
@@ -47,7 +47,7 @@ struct _GtkCssSelectorClass {
                                      const GtkCssMatcher        *matcher);
   void              (* tree_match)  (const GtkCssSelectorTree   *tree,
                                      const GtkCssMatcher        *matcher,
-				     GHashTable                  *res);
+				     GtkCssSelectorMatches       *res);
   GtkCssChange      (* get_change)  (const GtkCssSelector       *selector,
 				     GtkCssChange                previous_change);
   GtkCssChange      (* tree_get_change)  (const GtkCssSelectorTree *tree,
@@ -71,13 +71,14 @@ struct _GtkCssSelector
 };
 
 #define GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET G_MAXINT32
+#define GTK_CSS_SELECTOR_TREE_MATCHES_END G_MAXUINT32
 struct _GtkCssSelectorTree
 {
   GtkCssSelector selector;
   gint32 parent_offset;
   gint32 previous_offset;
   gint32 sibling_offset;
-  gint32 matches_offset; /* pointers that we return as matches if selector matches */
+  gint32 matches_offset; /* match indexes that we return if selector matches */
 };
 
 static gboolean
@@ -95,38 +96,53 @@ gtk_css_selector_hash (const GtkCssSelector *selector)
   return GPOINTER_TO_UINT (selector->class) ^ GPOINTER_TO_UINT (selector->data);
 }
 
-static gpointer *
+static const guint32 *
 gtk_css_selector_tree_get_matches (const GtkCssSelectorTree *tree)
 {
   if (tree->matches_offset == GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET)
     return NULL;
 
-  return (gpointer *) ((guint8 *)tree + tree->matches_offset);
+  return (const guint32 *) ((guint8 *)tree + tree->matches_offset);
+}
+
+#define MATCHES_WORD_BITS (GLIB_SIZEOF_LONG * 8)
+
+static inline void
+gtk_css_selector_matches_add (GtkCssSelectorMatches *matches,
+                              guint                  match)
+{
+  guint word = match / MATCHES_WORD_BITS;
+
+  matches->words[word] |= 1UL << (match % MATCHES_WORD_BITS);
+  matches->first_word = MIN (matches->first_word, word);
+  matches->last_word = MAX (matches->last_word, word);
 }
 
 static void
 gtk_css_selector_tree_found_match (const GtkCssSelectorTree *tree,
-				   GHashTable *res)
+				   GtkCssSelectorMatches *res)
 {
   int i;
-  gpointer *matches;
+  const guint32 *matches;
 
   matches = gtk_css_selector_tree_get_matches (tree);
   if (matches)
     {
-      for (i = 0; matches[i] != NULL; i++)
-	g_hash_table_insert (res, matches[i], matches[i]);
+      for (i = 0; matches[i] != GTK_CSS_SELECTOR_TREE_MATCHES_END; i++)
+	gtk_css_selector_matches_add (res, matches[i]);
     }
 }
 
 static void
 gtk_css_selector_tree_match (const GtkCssSelectorTree *tree,
 			     const GtkCssMatcher  *matcher,
-			     GHashTable *res)
+			     GtkCssSelectorMatches *res)
 {
   if (tree == NULL)
     return;
 
+  GTK_CSS_PROFILER_COUNT (SELECTOR_NODES, 1);
+
   tree->selector.class->tree_match (tree, matcher, res);
 }
 
@@ -147,6 +163,8 @@ gtk_css_selector_match (const GtkCssSelector *selector,
   if (selector == NULL)
     return TRUE;
 
+  GTK_CSS_PROFILER_COUNT (SELECTOR_CHECKS, 1);
+
   return selector->class->match (selector, matcher);
 }
 
@@ -198,7 +216,7 @@ gtk_css_selector_tree_get_sibling (const GtkCssSelectorTree *tree)
 static void
 gtk_css_selector_tree_match_previous (const GtkCssSelectorTree *tree,
 				      const GtkCssMatcher *matcher,
-				      GHashTable *res)
+				      GtkCssSelectorMatches *res)
 {
   const GtkCssSelectorTree *prev;
 
@@ -252,7 +270,7 @@ gtk_css_selector_descendant_match (const GtkCssSelector *selector,
 static void
 gtk_css_selector_descendant_tree_match (const GtkCssSelectorTree *tree,
 					const GtkCssMatcher  *matcher,
-					GHashTable *res)
+					GtkCssSelectorMatches *res)
 {
   GtkCssMatcher ancestor;
 
@@ -344,7 +362,7 @@ gtk_css_selector_child_match (const GtkCssSelector *selector,
 static void
 gtk_css_selector_child_tree_match (const GtkCssSelectorTree *tree,
 				   const GtkCssMatcher  *matcher,
-				   GHashTable *res)
+				   GtkCssSelectorMatches *res)
 {
   GtkCssMatcher parent;
 
@@ -428,7 +446,7 @@ gtk_css_selector_sibling_match (const GtkCssSelector *selector,
 static void
 gtk_css_selector_sibling_tree_match (const GtkCssSelectorTree *tree,
 				     const GtkCssMatcher  *matcher,
-				     GHashTable *res)
+				     GtkCssSelectorMatches *res)
 {
   GtkCssMatcher previous;
 
@@ -522,7 +540,7 @@ gtk_css_selector_adjacent_match (const GtkCssSelector *selector,
 static void
 gtk_css_selector_adjacent_tree_match (const GtkCssSelectorTree *tree,
 				      const GtkCssMatcher  *matcher,
-				      GHashTable *res)
+				      GtkCssSelectorMatches *res)
 {
   GtkCssMatcher previous;
 
@@ -607,7 +625,7 @@ gtk_css_selector_any_match (const GtkCssSelector *selector,
 static void
 gtk_css_selector_any_tree_match (const GtkCssSelectorTree *tree,
 				 const GtkCssMatcher  *matcher,
-				 GHashTable *res)
+				 GtkCssSelectorMatches *res)
 {
   const GtkCssSelectorTree *prev;
 
@@ -761,7 +779,7 @@ gtk_css_selector_name_match (const GtkCssSelector *selector,
 static void
 gtk_css_selector_name_tree_match (const GtkCssSelectorTree *tree,
 				  const GtkCssMatcher  *matcher,
-				  GHashTable *res)
+				  GtkCssSelectorMatches *res)
 {
   if (!_gtk_css_matcher_has_type (matcher, ((TypeReference *)tree->selector.data)->type))
     return;
@@ -848,7 +866,7 @@ gtk_css_selector_region_match (const GtkCssSelector *selector,
 static void
 gtk_css_selector_region_tree_match (const GtkCssSelectorTree *tree,
 				    const GtkCssMatcher  *matcher,
-				    GHashTable *res)
+				    GtkCssSelectorMatches *res)
 {
   const GtkCssSelectorTree *prev;
 
@@ -957,7 +975,7 @@ gtk_css_selector_class_match (const GtkCssSelector *selector,
 static void
 gtk_css_selector_class_tree_match (const GtkCssSelectorTree *tree,
 				   const GtkCssMatcher  *matcher,
-				   GHashTable *res)
+				   GtkCssSelectorMatches *res)
 {
   if (!_gtk_css_matcher_has_class (matcher, GPOINTER_TO_UINT (tree->selector.data)))
     return;
@@ -1037,7 +1055,7 @@ gtk_css_selector_id_match (const GtkCssSelector *selector,
 static void
 gtk_css_selector_id_tree_match (const GtkCssSelectorTree *tree,
 				const GtkCssMatcher  *matcher,
-				GHashTable *res)
+				GtkCssSelectorMatches *res)
 {
   if (!_gtk_css_matcher_has_id (matcher, tree->selector.data))
     return;
@@ -1143,7 +1161,7 @@ gtk_css_selector_pseudoclass_state_match (const GtkCssSelector *selector,
 static void
 gtk_css_selector_pseudoclass_state_tree_match (const GtkCssSelectorTree *tree,
 					       const GtkCssMatcher  *matcher,
-					       GHashTable *res)
+					       GtkCssSelectorMatches *res)
 {
   GtkStateFlags state = GPOINTER_TO_UINT (tree->selector.data);
 
@@ -1455,7 +1473,7 @@ static void
 gtk_css_selector_pseudoclass_position_tree_match_for_region (const GtkCssSelectorTree *tree,
 							     const GtkCssSelectorTree *prev,
 							     const GtkCssMatcher  *matcher,
-							     GHashTable *res)
+							     GtkCssSelectorMatches *res)
 {
   const GtkCssSelectorTree *prev2;
   GtkRegionFlags selector_flags;
@@ -1481,7 +1499,7 @@ gtk_css_selector_pseudoclass_position_tree_match_for_region (const GtkCssSelecto
 static void
 gtk_css_selector_pseudoclass_position_tree_match (const GtkCssSelectorTree *tree,
 						  const GtkCssMatcher  *matcher,
-						  GHashTable *res)
+						  GtkCssSelectorMatches *res)
 {
   const GtkCssSelectorTree *prev;
 
@@ -1639,9 +1657,9 @@ gtk_css_selector_new (const GtkCssSelectorClass *class,
 static GtkCssSelector *
 parse_selector_class (GtkCssParser *parser, GtkCssSelector *selector)
 {
-  char *name;
+  const char *name;
     
-  name = _gtk_css_parser_try_name (parser, FALSE);
+  name = _gtk_css_parser_try_name_interned (parser, FALSE);
 
   if (name == NULL)
     {
@@ -1653,9 +1671,7 @@ parse_selector_class (GtkCssParser *parser, GtkCssSelector *selector)
 
   selector = gtk_css_selector_new (&GTK_CSS_SELECTOR_CLASS,
                                    selector,
-                                   GUINT_TO_POINTER (g_quark_from_string (name)));
-
-  g_free (name);
+                                   GUINT_TO_POINTER (g_quark_from_static_string (name)));
 
   return selector;
 }
@@ -1663,9 +1679,9 @@ parse_selector_class (GtkCssParser *parser, GtkCssSelector *selector)
 static GtkCssSelector *
 parse_selector_id (GtkCssParser *parser, GtkCssSelector *selector)
 {
-  char *name;
+  const char *name;
     
-  name = _gtk_css_parser_try_name (parser, FALSE);
+  name = _gtk_css_parser_try_name_interned (parser, FALSE);
 
   if (name == NULL)
     {
@@ -1677,9 +1693,7 @@ parse_selector_id (GtkCssParser *parser, GtkCssSelector *selector)
 
   selector = gtk_css_selector_new (&GTK_CSS_SELECTOR_ID,
                                    selector,
-                                   g_intern_string (name));
-
-  g_free (name);
+                                   name);
 
   return selector;
 }
@@ -1866,20 +1880,19 @@ static GtkCssSelector *
 try_parse_name (GtkCssParser   *parser,
                 GtkCssSelector *selector)
 {
-  char *name;
+  const char *name;
 
-  name = _gtk_css_parser_try_ident (parser, FALSE);
+  name = _gtk_css_parser_try_ident_interned (parser, FALSE);
   if (name)
     {
       if (_gtk_style_context_check_region_name (name))
 	selector = gtk_css_selector_new (&GTK_CSS_SELECTOR_REGION,
 					 selector,
-					 g_intern_string (name));
+					 name);
       else
 	selector = gtk_css_selector_new (&GTK_CSS_SELECTOR_NAME,
 					 selector,
 					 get_type_reference (name));
-      g_free (name);
     }
   else if (_gtk_css_parser_try (parser, "*", FALSE))
     selector = gtk_css_selector_new (&GTK_CSS_SELECTOR_ANY, selector, NULL);
@@ -2137,46 +2150,123 @@ gtk_css_selectors_skip_initial_selector (GtkCssSelector *selector, const GtkCssS
   return (GtkCssSelector *)gtk_css_selector_previous (selector);
 }
 
-static int
-direct_ptr_compare (const void *_a, const void *_b)
+/**
+ * _gtk_css_selector_matches_init:
+ * @matches: the matches to initialize
+ * @n_matches: the number of match indexes the tree was built with
+ *
+ * Initializes @matches so that it can be passed to
+ * _gtk_css_selector_tree_match_all() for a tree whose match indexes are
+ * all smaller than @n_matches. The same @matches should be reused for
+ * every lookup, that way matching never allocates.
+ **/
+void
+_gtk_css_selector_matches_init (GtkCssSelectorMatches *matches,
+                                guint                  n_matches)
 {
-  gpointer *a = (gpointer *)_a;
-  gpointer *b = (gpointer *)_b;
-  if (*a < *b)
-    return -1;
-  else if (*a == *b)
-    return 0;
-  return 1;
+  matches->n_words = (n_matches + MATCHES_WORD_BITS - 1) / MATCHES_WORD_BITS;
+  matches->words = g_new0 (gulong, MAX (matches->n_words, 1));
+  matches->first_word = G_MAXUINT;
+  matches->last_word = 0;
 }
 
-GPtrArray *
-_gtk_css_selector_tree_match_all (const GtkCssSelectorTree *tree,
-				  const GtkCssMatcher *matcher)
+void
+_gtk_css_selector_matches_clear (GtkCssSelectorMatches *matches)
 {
-  GHashTable *res;
-  GPtrArray *array;
-  GHashTableIter iter;
-  gpointer key;
+  g_free (matches->words);
+  matches->words = NULL;
+  matches->n_words = 0;
+  matches->first_word = G_MAXUINT;
+  matches->last_word = 0;
+}
 
-  update_type_references ();
+static void
+gtk_css_selector_matches_reset (GtkCssSelectorMatches *matches)
+{
+  if (matches->first_word <= matches->last_word)
+    memset (matches->words + matches->first_word, 0,
+            (matches->last_word - matches->first_word + 1) * sizeof (gulong));
 
-  res = g_hash_table_new (g_direct_hash, g_direct_equal);
+  matches->first_word = G_MAXUINT;
+  matches->last_word = 0;
+}
 
-  for (; tree != NULL;
-       tree = gtk_css_selector_tree_get_sibling (tree))
-    gtk_css_selector_tree_match (tree, matcher, res);
+gboolean
+_gtk_css_selector_matches_contains (const GtkCssSelectorMatches *matches,
+                                    guint                        match)
+{
+  guint word = match / MATCHES_WORD_BITS;
 
-  array = g_ptr_array_sized_new (g_hash_table_size (res));
+  if (word < matches->first_word || word > matches->last_word)
+    return FALSE;
 
-  g_hash_table_iter_init (&iter, res);
-  while (g_hash_table_iter_next (&iter, &key, NULL))
-    g_ptr_array_add (array, key);
+  return (matches->words[word] & (1UL << (match % MATCHES_WORD_BITS))) != 0;
+}
 
-  g_hash_table_destroy (res);
+/**
+ * _gtk_css_selector_matches_get_previous:
+ * @matches: the matches
+ * @match: a match index or %G_MAXINT
+ *
+ * Finds the largest index in @matches that is smaller than @match.
+ * The tree was built with match indexes in specificity order, so
+ * walking the matches from %G_MAXINT downwards visits the most
+ * specific ones first.
+ *
+ * Returns: the previous match index or -1 if there is none
+ **/
+int
+_gtk_css_selector_matches_get_previous (const GtkCssSelectorMatches *matches,
+                                        int                          match)
+{
+  gulong bits;
+  int word, bit;
+
+  if (matches->first_word > matches->last_word || match <= 0)
+    return -1;
 
-  qsort (array->pdata, array->len, sizeof (gpointer), direct_ptr_compare);
+  word = (match - 1) / MATCHES_WORD_BITS;
+  bit = (match - 1) % MATCHES_WORD_BITS;
+  if (word > (int) matches->last_word)
+    {
+      word = matches->last_word;
+      bit = MATCHES_WORD_BITS - 1;
+    }
+
+  for (; word >= (int) matches->first_word; word--, bit = MATCHES_WORD_BITS - 1)
+    {
+      bits = matches->words[word];
+      if (bit < MATCHES_WORD_BITS - 1)
+        bits &= (2UL << bit) - 1;
 
-  return array;
+      if (bits)
+        return word * MATCHES_WORD_BITS + g_bit_nth_msf (bits, -1);
+    }
+
+  return -1;
+}
+
+/**
+ * _gtk_css_selector_tree_match_all:
+ * @tree: (allow-none): the tree to match
+ * @matcher: the matcher to match with
+ * @matches: matches set up with _gtk_css_selector_matches_init()
+ *
+ * Replaces the contents of @matches with the indexes of all rules in
+ * @tree that match @matcher.
+ **/
+void
+_gtk_css_selector_tree_match_all (const GtkCssSelectorTree *tree,
+				  const GtkCssMatcher *matcher,
+				  GtkCssSelectorMatches *matches)
+{
+  update_type_references ();
+
+  gtk_css_selector_matches_reset (matches);
+
+  for (; tree != NULL;
+       tree = gtk_css_selector_tree_get_sibling (tree))
+    gtk_css_selector_tree_match (tree, matcher, matches);
 }
 
 GtkCssChange
@@ -2272,7 +2362,7 @@ _gtk_css_selector_tree_free (GtkCssSelectorTree *tree)
 
 
 typedef struct {
-  gpointer match;
+  guint match;
   GtkCssSelector *current_selector;
   GtkCssSelectorTree **selector_match;
 } GtkCssSelectorRuleSetInfo;
@@ -2307,7 +2397,7 @@ subdivide_infos (GByteArray *array, GList *infos, gint32 parent_offset)
   GHashTableIter iter;
   guint max_count;
   gpointer key, value;
-  GPtrArray *exact_matches;
+  GArray *exact_matches;
   gint32 res;
 
   if (infos == NULL)
@@ -2358,8 +2448,8 @@ subdivide_infos (GByteArray *array, GList *infos, gint32 parent_offset)
 	    {
 	      /* Matches current node */
 	      if (exact_matches == NULL)
-		exact_matches = g_ptr_array_new ();
-	      g_ptr_array_add (exact_matches, info->match);
+		exact_matches = g_array_new (FALSE, FALSE, sizeof (guint32));
+	      g_array_append_val (exact_matches, info->match);
 	      if (info->selector_match != NULL)
 		*info->selector_match = GUINT_TO_POINTER (tree_offset);
 	    }
@@ -2374,11 +2464,17 @@ subdivide_infos (GByteArray *array, GList *infos, gint32 parent_offset)
 
   if (exact_matches)
     {
-      g_ptr_array_add (exact_matches, NULL); /* Null terminate */
+      guint32 end = GTK_CSS_SELECTOR_TREE_MATCHES_END;
+      guint8 padding[sizeof (gpointer)] = { 0, };
+
+      g_array_append_val (exact_matches, end);
       res = array->len;
-      g_byte_array_append (array, (guint8 *)exact_matches->pdata,
-			   exact_matches->len * sizeof (gpointer));
-      g_ptr_array_free (exact_matches, TRUE);
+      g_byte_array_append (array, (guint8 *)exact_matches->data,
+			   exact_matches->len * sizeof (guint32));
+      /* Keep the following tree nodes aligned */
+      g_byte_array_append (array, padding,
+                           (sizeof (gpointer) - array->len % sizeof (gpointer)) % sizeof (gpointer));
+      g_array_free (exact_matches, TRUE);
     }
   else
     res = GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET;
@@ -2418,10 +2514,13 @@ void
 _gtk_css_selector_tree_builder_add (GtkCssSelectorTreeBuilder *builder,
 				    GtkCssSelector            *selectors,
 				    GtkCssSelectorTree       **selector_match,
-				    gpointer                   match)
+				    guint                      match)
 {
-  GtkCssSelectorRuleSetInfo *info = g_new0 (GtkCssSelectorRuleSetInfo, 1);
+  GtkCssSelectorRuleSetInfo *info;
+
+  g_return_if_fail (match != GTK_CSS_SELECTOR_TREE_MATCHES_END);
 
+  info = g_new0 (GtkCssSelectorRuleSetInfo, 1);
   info->match = match;
   info->current_selector = selectors;
   info->selector_match = selector_match;
@@ -2507,3 +2606,403 @@ _gtk_css_selector_get_state_flags (const GtkCssSelector *selector)
 
   return state;
 }
+
+/******************** Theme cache *****************/
+
+/* Selectors are written to the theme cache with the index of their class
+ * in this table and their data encoded like this */
+typedef enum {
+  SELECTOR_DATA_NONE,
+  SELECTOR_DATA_STRING,         /* interned string */
+  SELECTOR_DATA_QUARK,
+  SELECTOR_DATA_TYPE,           /* TypeReference */
+  SELECTOR_DATA_UINT
+} SelectorDataType;
+
+static const struct {
+  const GtkCssSelectorClass *class;
+  SelectorDataType           data_type;
+} selector_classes[] = {
+  { &GTK_CSS_SELECTOR_DESCENDANT,            SELECTOR_DATA_NONE },
+  { &GTK_CSS_SELECTOR_CHILD,                 SELECTOR_DATA_NONE },
+  { &GTK_CSS_SELECTOR_SIBLING,               SELECTOR_DATA_NONE },
+  { &GTK_CSS_SELECTOR_ADJACENT,              SELECTOR_DATA_NONE },
+  { &GTK_CSS_SELECTOR_ANY,                   SELECTOR_DATA_NONE },
+  { &GTK_CSS_SELECTOR_NAME,                  SELECTOR_DATA_TYPE },
+  { &GTK_CSS_SELECTOR_REGION,                SELECTOR_DATA_STRING },
+  { &GTK_CSS_SELECTOR_CLASS,                 SELECTOR_DATA_QUARK },
+  { &GTK_CSS_SELECTOR_ID,                    SELECTOR_DATA_STRING },
+  { &GTK_CSS_SELECTOR_PSEUDOCLASS_STATE,     SELECTOR_DATA_UINT },
+  { &GTK_CSS_SELECTOR_PSEUDOCLASS_POSITION,  SELECTOR_DATA_UINT }
+};
+
+static void
+gtk_css_selector_save_one (const GtkCssSelector   *selector,
+                           GtkCssThemeCacheWriter *writer,
+                           guint32                *class_id,
+                           guint32                *data)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (selector_classes); i++)
+    {
+      if (selector_classes[i].class == selector->class)
+        break;
+    }
+  g_assert (i < G_N_ELEMENTS (selector_classes));
+
+  *class_id = i;
+
+  switch (selector_classes[i].data_type)
+    {
+    case SELECTOR_DATA_NONE:
+      *data = 0;
+      break;
+    case SELECTOR_DATA_STRING:
+      *data = _gtk_css_theme_cache_writer_add_string (writer, selector->data);
+      break;
+    case SELECTOR_DATA_QUARK:
+      *data = _gtk_css_theme_cache_writer_add_string (writer,
+                                                      g_quark_to_string (GPOINTER_TO_UINT (selector->data)));
+      break;
+    case SELECTOR_DATA_TYPE:
+      *data = _gtk_css_theme_cache_writer_add_string (writer,
+                                                      ((TypeReference *) selector->data)->name);
+      break;
+    case SELECTOR_DATA_UINT:
+      *data = GPOINTER_TO_UINT (selector->data);
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static gboolean
+gtk_css_selector_load_one (GtkCssSelector         *selector,
+                           GtkCssThemeCacheReader *reader,
+                           guint32                 class_id,
+                           guint32                 data)
+{
+  const char *string;
+
+  if (class_id >= G_N_ELEMENTS (selector_classes))
+    return FALSE;
+
+  selector->class = selector_classes[class_id].class;
+
+  switch (selector_classes[class_id].data_type)
+    {
+    case SELECTOR_DATA_NONE:
+      selector->data = NULL;
+      return TRUE;
+    case SELECTOR_DATA_UINT:
+      selector->data = GUINT_TO_POINTER (data);
+      return TRUE;
+    default:
+      break;
+    }
+
+  string = _gtk_css_theme_cache_reader_get_string (reader, data);
+  if (string == NULL)
+    return FALSE;
+
+  switch (selector_classes[class_id].data_type)
+    {
+    case SELECTOR_DATA_STRING:
+      selector->data = g_intern_string (string);
+      break;
+    case SELECTOR_DATA_QUARK:
+      selector->data = GUINT_TO_POINTER (g_quark_from_string (string));
+      break;
+    case SELECTOR_DATA_TYPE:
+      selector->data = get_type_reference (string);
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+
+  return TRUE;
+}
+
+/**
+ * _gtk_css_selector_save:
+ * @selector: the selector
+ * @writer: the theme cache to write to
+ *
+ * Returns: the offset of @selector in the cache
+ **/
+guint32
+_gtk_css_selector_save (const GtkCssSelector   *selector,
+                        GtkCssThemeCacheWriter *writer)
+{
+  guint32 *data, offset;
+  guint i, size;
+
+  size = gtk_css_selector_size (selector);
+  data = g_new (guint32, 1 + 2 * size);
+
+  data[0] = size;
+  for (i = 0; i < size; i++)
+    gtk_css_selector_save_one (&selector[i], writer, &data[1 + 2 * i], &data[2 + 2 * i]);
+
+  offset = _gtk_css_theme_cache_writer_add (writer, data, sizeof (guint32) * (1 + 2 * size));
+
+  g_free (data);
+
+  return offset;
+}
+
+/**
+ * _gtk_css_selector_load:
+ * @reader: the theme cache to read from
+ * @offset: the offset returned by _gtk_css_selector_save()
+ *
+ * Returns: the selector or %NULL if the cache is broken
+ **/
+GtkCssSelector *
+_gtk_css_selector_load (GtkCssThemeCacheReader *reader,
+                        guint32                 offset)
+{
+  GtkCssSelector *selector;
+  const guint32 *data;
+  guint i, size;
+
+  data = _gtk_css_theme_cache_reader_get (reader, offset, sizeof (guint32));
+  if (data == NULL || data[0] == 0)
+    return NULL;
+
+  size = data[0];
+  data = _gtk_css_theme_cache_reader_get (reader, offset, sizeof (guint32) * (1 + 2 * (gsize) size));
+  if (data == NULL)
+    return NULL;
+
+  selector = g_new0 (GtkCssSelector, size + 1);
+  for (i = 0; i < size; i++)
+    {
+      if (!gtk_css_selector_load_one (&selector[i], reader, data[1 + 2 * i], data[2 + 2 * i]))
+        {
+          g_free (selector);
+          return NULL;
+        }
+    }
+
+  return selector;
+}
+
+static void
+gtk_css_selector_tree_get_size (const GtkCssSelectorTree *tree,
+                                const guint8             *start,
+                                gsize                    *size)
+{
+  const guint32 *matches;
+  guint i;
+
+  for (; tree != NULL; tree = gtk_css_selector_tree_get_sibling (tree))
+    {
+      *size = MAX (*size, (gsize) ((const guint8 *) (tree + 1) - start));
+
+      matches = gtk_css_selector_tree_get_matches (tree);
+      if (matches)
+        {
+          for (i = 0; matches[i] != GTK_CSS_SELECTOR_TREE_MATCHES_END; i++)
+            ;
+          *size = MAX (*size, (gsize) ((const guint8 *) (matches + i + 1) - start));
+        }
+
+      gtk_css_selector_tree_get_size (gtk_css_selector_tree_get_previous (tree), start, size);
+    }
+}
+
+static void
+gtk_css_selector_tree_save_selectors (GtkCssSelectorTree     *tree,
+                                      GtkCssThemeCacheWriter *writer)
+{
+  guint32 class_id, data;
+
+  for (; tree != NULL; tree = (GtkCssSelectorTree *) gtk_css_selector_tree_get_sibling (tree))
+    {
+      gtk_css_selector_tree_save_selectors ((GtkCssSelectorTree *) gtk_css_selector_tree_get_previous (tree),
+                                            writer);
+
+      gtk_css_selector_save_one (&tree->selector, writer, &class_id, &data);
+      tree->selector.class = GUINT_TO_POINTER (class_id);
+      tree->selector.data = GUINT_TO_POINTER (data);
+    }
+}
+
+/**
+ * _gtk_css_selector_tree_save:
+ * @tree: (allow-none): the tree
+ * @writer: the theme cache to write to
+ *
+ * Writes @tree to the cache. Its nodes are all in one block of memory
+ * that only uses relative offsets, so it is written as it is, with just
+ * the selectors encoded.
+ *
+ * Returns: the offset of @tree in the cache
+ **/
+guint32
+_gtk_css_selector_tree_save (const GtkCssSelectorTree *tree,
+                             GtkCssThemeCacheWriter   *writer)
+{
+  guint32 offset;
+  guint8 *data;
+  gsize size;
+
+  size = 0;
+  gtk_css_selector_tree_get_size (tree, (const guint8 *) tree, &size);
+
+  data = g_malloc (2 * sizeof (guint32) + size);
+  ((guint32 *) data)[0] = size;
+  ((guint32 *) data)[1] = 0;
+  if (size > 0)
+    {
+      memcpy (data + 2 * sizeof (guint32), tree, size);
+      gtk_css_selector_tree_save_selectors ((GtkCssSelectorTree *) (data + 2 * sizeof (guint32)), writer);
+    }
+
+  offset = _gtk_css_theme_cache_writer_add (writer, data, 2 * sizeof (guint32) + size);
+
+  g_free (data);
+
+  return offset;
+}
+
+/* Checks everything we got from the cache, so that a broken cache file
+ * can't make us crash later */
+static gboolean
+gtk_css_selector_tree_load_nodes (guint8                  *data,
+                                  gsize                    size,
+                                  gssize                   offset,
+                                  gssize                   parent,
+                                  GtkCssThemeCacheReader  *reader,
+                                  guint                    n_matches,
+                                  GtkCssSelectorTree     **selector_matches)
+{
+  GtkCssSelectorTree *tree;
+  const guint32 *matches;
+  gssize matches_offset;
+  guint i;
+
+  while (TRUE)
+    {
+      if (offset % sizeof (gpointer) != 0 ||
+          size < sizeof (GtkCssSelectorTree) ||
+          offset > (gssize) (size - sizeof (GtkCssSelectorTree)))
+        return FALSE;
+
+      tree = (GtkCssSelectorTree *) (data + offset);
+
+      if (!gtk_css_selector_load_one (&tree->selector, reader,
+                                      GPOINTER_TO_UINT (tree->selector.class),
+                                      GPOINTER_TO_UINT (tree->selector.data)))
+        return FALSE;
+
+      if (parent < 0
+          ? tree->parent_offset != GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET
+          : tree->parent_offset != parent - offset)
+        return FALSE;
+
+      if (tree->matches_offset != GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET)
+        {
+          matches_offset = offset + tree->matches_offset;
+          if (tree->matches_offset <= 0 ||
+              matches_offset % sizeof (guint32) != 0 ||
+              matches_offset >= (gssize) size)
+            return FALSE;
+
+          matches = (const guint32 *) (data + matches_offset);
+          for (i = 0; ; i++)
+            {
+              if (matches_offset + (i + 1) * sizeof (guint32) > size)
+                return FALSE;
+              if (matches[i] == GTK_CSS_SELECTOR_TREE_MATCHES_END)
+                break;
+              if (matches[i] >= n_matches || selector_matches[matches[i]] != NULL)
+                return FALSE;
+
+              selector_matches[matches[i]] = tree;
+            }
+        }
+
+      /* Nodes always come after their parent and previous siblings, so
+       * we can't loop forever */
+      if (tree->previous_offset != GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET)
+        {
+          if (tree->previous_offset <= 0 ||
+              !gtk_css_selector_tree_load_nodes (data, size,
+                                                 offset + tree->previous_offset, offset,
+                                                 reader, n_matches, selector_matches))
+            return FALSE;
+        }
+
+      if (tree->sibling_offset == GTK_CSS_SELECTOR_TREE_EMPTY_OFFSET)
+        return TRUE;
+      if (tree->sibling_offset <= 0)
+        return FALSE;
+
+      offset += tree->sibling_offset;
+    }
+}
+
+/**
+ * _gtk_css_selector_tree_load:
+ * @reader: the theme cache to read from
+ * @offset: the offset returned by _gtk_css_selector_tree_save()
+ * @n_matches: the number of matches the tree was built with
+ * @selector_matches: (out caller-allocates): for every match, the node
+ *     of the tree that returns it, like _gtk_css_selector_tree_builder_add()
+ *     fills in
+ * @tree: (out): the tree, or %NULL if it is empty
+ *
+ * Returns: %FALSE if the cache is broken
+ **/
+gboolean
+_gtk_css_selector_tree_load (GtkCssThemeCacheReader  *reader,
+                             guint32                  offset,
+                             guint                    n_matches,
+                             GtkCssSelectorTree     **selector_matches,
+                             GtkCssSelectorTree     **tree)
+{
+  const guint32 *header;
+  guint8 *data;
+  gsize size;
+  guint i;
+
+  *tree = NULL;
+
+  header = _gtk_css_theme_cache_reader_get (reader, offset, 2 * sizeof (guint32));
+  if (header == NULL)
+    return FALSE;
+
+  size = header[0];
+  if (size == 0)
+    return n_matches == 0;
+
+  header = _gtk_css_theme_cache_reader_get (reader, offset, 2 * sizeof (guint32) + size);
+  if (header == NULL)
+    return FALSE;
+
+  /* The selectors are changed in place, so this can't use the mapped data */
+  data = g_memdup (header + 2, size);
+
+  memset (selector_matches, 0, n_matches * sizeof (GtkCssSelectorTree *));
+  if (!gtk_css_selector_tree_load_nodes (data, size, 0, -1, reader, n_matches, selector_matches))
+    {
+      g_free (data);
+      return FALSE;
+    }
+
+  for (i = 0; i < n_matches; i++)
+    {
+      if (selector_matches[i] == NULL)
+        {
+          g_free (data);
+          return FALSE;
+        }
+    }
+
+  *tree = (GtkCssSelectorTree *) data;
+
+  return TRUE;
+}
@@ -25,12 +25,23 @@
 #include <gtk/gtktypes.h>
 #include "gtk/gtkcssmatcherprivate.h"
 #include "gtk/gtkcssparserprivate.h"
+#include "gtk/gtkcssthemecacheprivate.h"
 
 G_BEGIN_DECLS
 
 typedef struct _GtkCssSelector GtkCssSelector;
 typedef struct _GtkCssSelectorTree GtkCssSelectorTree;
 typedef struct _GtkCssSelectorTreeBuilder GtkCssSelectorTreeBuilder;
+typedef struct _GtkCssSelectorMatches GtkCssSelectorMatches;
+
+/* A set of match indexes, kept around and reused by the caller so that
+ * matching doesn't need to allocate anything */
+struct _GtkCssSelectorMatches {
+  gulong *words;
+  guint   n_words;
+  guint   first_word;       /* range of words that may have bits set, */
+  guint   last_word;        /* first_word > last_word when empty */
+};
 
 GtkCssSelector *  _gtk_css_selector_parse           (GtkCssParser           *parser);
 void              _gtk_css_selector_free            (GtkCssSelector         *selector);
@@ -47,8 +58,9 @@ int               _gtk_css_selector_compare         (const GtkCssSelector   *a,
                                                      const GtkCssSelector   *b);
 
 void         _gtk_css_selector_tree_free             (GtkCssSelectorTree       *tree);
-GPtrArray *  _gtk_css_selector_tree_match_all        (const GtkCssSelectorTree *tree,
-						      const GtkCssMatcher      *matcher);
+void         _gtk_css_selector_tree_match_all        (const GtkCssSelectorTree *tree,
+						      const GtkCssMatcher      *matcher,
+						      GtkCssSelectorMatches    *matches);
 GtkCssChange _gtk_css_selector_tree_get_change_all   (const GtkCssSelectorTree *tree,
 						      const GtkCssMatcher *matcher);
 void         _gtk_css_selector_tree_match_print      (const GtkCssSelectorTree *tree,
@@ -60,10 +72,30 @@ GtkCssSelectorTreeBuilder *_gtk_css_selector_tree_builder_new   (void);
 void                       _gtk_css_selector_tree_builder_add   (GtkCssSelectorTreeBuilder *builder,
 								 GtkCssSelector            *selectors,
 								 GtkCssSelectorTree       **selector_match,
-								 gpointer                   match);
+								 guint                      match);
 GtkCssSelectorTree *       _gtk_css_selector_tree_builder_build (GtkCssSelectorTreeBuilder *builder);
 void                       _gtk_css_selector_tree_builder_free  (GtkCssSelectorTreeBuilder *builder);
 
+void         _gtk_css_selector_matches_init          (GtkCssSelectorMatches    *matches,
+						      guint                     n_matches);
+void         _gtk_css_selector_matches_clear         (GtkCssSelectorMatches    *matches);
+gboolean     _gtk_css_selector_matches_contains      (const GtkCssSelectorMatches *matches,
+						      guint                     match);
+int          _gtk_css_selector_matches_get_previous  (const GtkCssSelectorMatches *matches,
+						      int                       match);
+
+guint32             _gtk_css_selector_save          (const GtkCssSelector     *selector,
+                                                     GtkCssThemeCacheWriter   *writer);
+GtkCssSelector *    _gtk_css_selector_load          (GtkCssThemeCacheReader   *reader,
+                                                     guint32                   offset);
+guint32             _gtk_css_selector_tree_save     (const GtkCssSelectorTree *tree,
+                                                     GtkCssThemeCacheWriter   *writer);
+gboolean            _gtk_css_selector_tree_load     (GtkCssThemeCacheReader   *reader,
+                                                     guint32                   offset,
+                                                     guint                     n_matches,
+                                                     GtkCssSelectorTree      **selector_matches,
+                                                     GtkCssSelectorTree      **tree);
+
 G_END_DECLS
 
 #endif /* __GTK_CSS_SELECTOR_PRIVATE_H__ */
@@ -108,6 +108,12 @@ gtk_css_value_string_print (const GtkCssValue *value,
   g_string_append_c (str, '"');
 }
 
+static guint
+gtk_css_value_ident_hash (const GtkCssValue *value)
+{
+  return g_str_hash (value->string);
+}
+
 static void
 gtk_css_value_ident_print (const GtkCssValue *value,
                             GString           *str)
@@ -161,7 +167,8 @@ static const GtkCssValueClass GTK_CSS_VALUE_IDENT = {
   gtk_css_value_string_compute,
   gtk_css_value_string_equal,
   gtk_css_value_string_transition,
-  gtk_css_value_ident_print
+  gtk_css_value_ident_print,
+  gtk_css_value_ident_hash
 };
 
 GtkCssValue *
@@ -218,7 +225,7 @@ _gtk_css_ident_value_new_take (char *ident)
   result = _gtk_css_value_new (GtkCssValue, &GTK_CSS_VALUE_IDENT);
   result->string = ident;
 
-  return result;
+  return _gtk_css_value_intern (result);
 }
 
 GtkCssValue *
@@ -235,6 +242,25 @@ _gtk_css_ident_value_try_parse (GtkCssParser *parser)
   return _gtk_css_ident_value_new_take (ident);
 }
 
+/**
+ * _gtk_css_ident_value_unpack:
+ * @value: a value
+ * @ident: (out): the identifier
+ *
+ * Returns: %FALSE if @value is not an identifier. Use
+ *     _gtk_css_ident_value_new() to turn it back into one.
+ **/
+gboolean
+_gtk_css_ident_value_unpack (const GtkCssValue  *value,
+                             const char        **ident)
+{
+  if (value->class != &GTK_CSS_VALUE_IDENT)
+    return FALSE;
+
+  *ident = value->string;
+  return TRUE;
+}
+
 const char *
 _gtk_css_ident_value_get (const GtkCssValue *value)
 {
@@ -31,6 +31,8 @@ GtkCssValue *   _gtk_css_ident_value_new_take       (char                   *ide
 GtkCssValue *   _gtk_css_ident_value_try_parse      (GtkCssParser           *parser);
 
 const char *    _gtk_css_ident_value_get            (const GtkCssValue      *ident);
+gboolean        _gtk_css_ident_value_unpack         (const GtkCssValue      *value,
+                                                     const char            **ident);
 
 GtkCssValue *   _gtk_css_string_value_new           (const char             *string);
 GtkCssValue *   _gtk_css_string_value_new_take      (char                   *string);
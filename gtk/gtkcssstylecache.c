@@ -0,0 +1,364 @@
+/* GTK - The GIMP Toolkit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gtkcssstylecacheprivate.h"
+
+#include "gtkcssprofilerprivate.h"
+#include "gtkcssstylepropertyprivate.h"
+
+#include <string.h>
+
+/* Widgets that match the same rules below the same parent style end up
+ * with the same computed values, so they can all use one copy of them.
+ * Think of the rows of a big list or the buttons of a toolbar.
+ *
+ * Values handed out by the cache are marked as shared and must not be
+ * changed anymore, see _gtk_css_computed_values_is_shared(). Only values
+ * whose parent values are shared themselves (or that have no parent) are
+ * cached, everything else could change underneath us.
+ *
+ * When the state of a widget changes, only some properties are looked
+ * up again and the others are taken from the values of the previous
+ * state. Those entries are keyed on the previous values and the
+ * properties that were looked up as well, see
+ * _gtk_css_style_cache_lookup_changes().
+ */
+
+/* Don't bother pruning before there are this many entries */
+#define GTK_CSS_STYLE_CACHE_MIN_PRUNE_SIZE 64
+
+typedef struct _GtkCssStyleCacheEntry GtkCssStyleCacheEntry;
+
+struct _GtkCssStyleCacheEntry {
+  guint hash;
+  GtkCssComputedValues *parent_values;
+  int scale;
+  GtkStateFlags state;
+  GtkCssLookupValue *lookup_values;     /* the winning declarations, one per property */
+  GtkCssComputedValues *previous;       /* values the others are taken from, or NULL */
+  GtkBitmask *changes;                  /* the properties that were looked up, if previous is set */
+
+  GtkCssComputedValues *values;
+};
+
+struct _GtkCssStyleCache {
+  GHashTable *entries;
+  guint prune_size;
+};
+
+static guint
+gtk_css_style_cache_entry_hash (gconstpointer data)
+{
+  const GtkCssStyleCacheEntry *entry = data;
+
+  return entry->hash;
+}
+
+static gboolean
+gtk_css_style_cache_entry_equal (gconstpointer a,
+                                 gconstpointer b)
+{
+  const GtkCssStyleCacheEntry *entry_a = a;
+  const GtkCssStyleCacheEntry *entry_b = b;
+
+  return entry_a->hash == entry_b->hash &&
+         entry_a->parent_values == entry_b->parent_values &&
+         entry_a->scale == entry_b->scale &&
+         entry_a->state == entry_b->state &&
+         entry_a->previous == entry_b->previous &&
+         (entry_a->previous == NULL ||
+          _gtk_bitmask_equals (entry_a->changes, entry_b->changes)) &&
+         memcmp (entry_a->lookup_values,
+                 entry_b->lookup_values,
+                 sizeof (GtkCssLookupValue) * _gtk_css_style_property_get_n_properties ()) == 0;
+}
+
+static void
+gtk_css_style_cache_entry_free (gpointer data)
+{
+  GtkCssStyleCacheEntry *entry = data;
+  guint i, n;
+
+  n = _gtk_css_style_property_get_n_properties ();
+  for (i = 0; i < n; i++)
+    {
+      GtkCssLookupValue *value = &entry->lookup_values[i];
+
+      if (value->value)
+        _gtk_css_value_unref (value->value);
+      if (value->computed)
+        _gtk_css_value_unref (value->computed);
+      if (value->section)
+        gtk_css_section_unref (value->section);
+    }
+  g_free (entry->lookup_values);
+
+  if (entry->parent_values)
+    g_object_unref (entry->parent_values);
+  if (entry->previous)
+    {
+      g_object_unref (entry->previous);
+      _gtk_bitmask_free (entry->changes);
+    }
+  g_object_unref (entry->values);
+
+  g_slice_free (GtkCssStyleCacheEntry, entry);
+}
+
+static guint
+gtk_css_style_cache_hash_lookup (GtkCssLookup         *lookup,
+                                 int                   scale,
+                                 GtkStateFlags         state,
+                                 GtkCssComputedValues *parent_values,
+                                 GtkCssComputedValues *previous)
+{
+  guint i, n, hash;
+
+  hash = GPOINTER_TO_UINT (parent_values) ^ (scale << 16) ^ state;
+  hash = (hash << 5) - hash + GPOINTER_TO_UINT (previous);
+
+  n = _gtk_css_style_property_get_n_properties ();
+  for (i = 0; i < n; i++)
+    {
+      hash = (hash << 5) - hash + GPOINTER_TO_UINT (lookup->values[i].value);
+      hash = (hash << 5) - hash + GPOINTER_TO_UINT (lookup->values[i].computed);
+    }
+
+  return hash;
+}
+
+GtkCssStyleCache *
+_gtk_css_style_cache_new (void)
+{
+  GtkCssStyleCache *cache;
+
+  cache = g_slice_new0 (GtkCssStyleCache);
+  cache->entries = g_hash_table_new_full (gtk_css_style_cache_entry_hash,
+                                          gtk_css_style_cache_entry_equal,
+                                          gtk_css_style_cache_entry_free,
+                                          NULL);
+  cache->prune_size = GTK_CSS_STYLE_CACHE_MIN_PRUNE_SIZE;
+
+  return cache;
+}
+
+void
+_gtk_css_style_cache_free (GtkCssStyleCache *cache)
+{
+  g_return_if_fail (cache != NULL);
+
+  g_hash_table_unref (cache->entries);
+  g_slice_free (GtkCssStyleCache, cache);
+}
+
+/**
+ * _gtk_css_style_cache_clear:
+ * @cache: the cache
+ *
+ * Forgets all cached values. This must be done whenever the provider
+ * the values were computed with changes, as the same declarations may
+ * then compute to something else, for example because a named color
+ * was redefined.
+ **/
+void
+_gtk_css_style_cache_clear (GtkCssStyleCache *cache)
+{
+  g_return_if_fail (cache != NULL);
+
+  g_hash_table_remove_all (cache->entries);
+  cache->prune_size = GTK_CSS_STYLE_CACHE_MIN_PRUNE_SIZE;
+}
+
+/* Drops the values that only the cache still uses. Children keep their
+ * parent values alive, so those only go away in a later pass. */
+static void
+gtk_css_style_cache_prune (GtkCssStyleCache *cache)
+{
+  GHashTableIter iter;
+  gpointer key;
+  gboolean removed;
+
+  do
+    {
+      removed = FALSE;
+
+      g_hash_table_iter_init (&iter, cache->entries);
+      while (g_hash_table_iter_next (&iter, &key, NULL))
+        {
+          GtkCssStyleCacheEntry *entry = key;
+
+          if (G_OBJECT (entry->values)->ref_count == 1)
+            {
+              g_hash_table_iter_remove (&iter);
+              removed = TRUE;
+            }
+        }
+    }
+  while (removed);
+
+  cache->prune_size = MAX (2 * g_hash_table_size (cache->entries),
+                           GTK_CSS_STYLE_CACHE_MIN_PRUNE_SIZE);
+}
+
+static GtkCssComputedValues *
+gtk_css_style_cache_lookup_full (GtkCssStyleCache        *cache,
+                                 GtkCssLookup            *lookup,
+                                 GtkStyleProviderPrivate *provider,
+                                 int                      scale,
+                                 GtkStateFlags            state,
+                                 GtkCssComputedValues    *parent_values,
+                                 GtkCssComputedValues    *previous,
+                                 const GtkBitmask        *changes)
+{
+  GtkCssStyleCacheEntry key, *entry;
+  GtkCssComputedValues *values;
+  guint i, n;
+
+  key.hash = gtk_css_style_cache_hash_lookup (lookup, scale, state, parent_values, previous);
+  key.parent_values = parent_values;
+  key.scale = scale;
+  key.state = state;
+  key.lookup_values = lookup->values;
+  key.previous = previous;
+  key.changes = (GtkBitmask *) changes;
+
+  entry = g_hash_table_lookup (cache->entries, &key);
+  if (entry)
+    {
+      GTK_CSS_PROFILER_COUNT (STYLE_CACHE_HITS, 1);
+      return g_object_ref (entry->values);
+    }
+
+  GTK_CSS_PROFILER_COUNT (STYLE_CACHE_MISSES, 1);
+
+  if (previous)
+    values = _gtk_css_computed_values_copy (previous);
+  else
+    values = _gtk_css_computed_values_new ();
+  _gtk_css_lookup_resolve (lookup, provider, scale, values, parent_values);
+
+  if (parent_values && !_gtk_css_computed_values_is_shared (parent_values))
+    return values;
+  if (previous && !_gtk_css_computed_values_is_shared (previous))
+    return values;
+
+  /* The entry keeps the declarations alive, so that their addresses
+   * can't be reused for different ones */
+  n = _gtk_css_style_property_get_n_properties ();
+  entry = g_slice_new (GtkCssStyleCacheEntry);
+  *entry = key;
+  entry->lookup_values = g_memdup (lookup->values, sizeof (GtkCssLookupValue) * n);
+  for (i = 0; i < n; i++)
+    {
+      GtkCssLookupValue *value = &entry->lookup_values[i];
+
+      if (value->value)
+        _gtk_css_value_ref (value->value);
+      if (value->computed)
+        _gtk_css_value_ref (value->computed);
+      if (value->section)
+        gtk_css_section_ref (value->section);
+    }
+  if (parent_values)
+    g_object_ref (parent_values);
+  if (previous)
+    {
+      g_object_ref (previous);
+      entry->changes = _gtk_bitmask_copy (changes);
+    }
+
+  values->shared = TRUE;
+  entry->values = g_object_ref (values);
+
+  g_hash_table_add (cache->entries, entry);
+
+  if (g_hash_table_size (cache->entries) >= cache->prune_size)
+    gtk_css_style_cache_prune (cache);
+
+  return values;
+}
+
+/**
+ * _gtk_css_style_cache_lookup:
+ * @cache: the cache
+ * @lookup: a lookup of all properties, filled in by matching the style
+ *     rules
+ * @provider: the provider that filled in @lookup
+ * @scale: the scale the values are for
+ * @state: the state the rules were matched in
+ * @parent_values: (allow-none): the values of the parent, if any
+ *
+ * Resolves @lookup like _gtk_css_lookup_resolve() does, but returns the
+ * values computed earlier for the same declarations if there are any.
+ *
+ * Returns: (transfer full): the computed values. They must not be
+ *     changed if _gtk_css_computed_values_is_shared() is %TRUE for them.
+ **/
+GtkCssComputedValues *
+_gtk_css_style_cache_lookup (GtkCssStyleCache        *cache,
+                             GtkCssLookup            *lookup,
+                             GtkStyleProviderPrivate *provider,
+                             int                      scale,
+                             GtkStateFlags            state,
+                             GtkCssComputedValues    *parent_values)
+{
+  g_return_val_if_fail (cache != NULL, NULL);
+  g_return_val_if_fail (lookup != NULL, NULL);
+
+  return gtk_css_style_cache_lookup_full (cache, lookup, provider, scale, state,
+                                          parent_values, NULL, NULL);
+}
+
+/**
+ * _gtk_css_style_cache_lookup_changes:
+ * @cache: the cache
+ * @lookup: a lookup of the properties in @changes, filled in by
+ *     matching the style rules
+ * @changes: the properties @lookup was created for
+ * @provider: the provider that filled in @lookup
+ * @scale: the scale the values are for
+ * @state: the state the rules were matched in
+ * @parent_values: (allow-none): the values of the parent, if any
+ * @previous: the values to take all other properties from
+ *
+ * Like _gtk_css_style_cache_lookup(), but only the properties in
+ * @changes are resolved and all others are copied from @previous.
+ * Widgets that change to the same state from the same shared values
+ * get the same values this way.
+ *
+ * Returns: (transfer full): the computed values. They must not be
+ *     changed if _gtk_css_computed_values_is_shared() is %TRUE for them.
+ **/
+GtkCssComputedValues *
+_gtk_css_style_cache_lookup_changes (GtkCssStyleCache        *cache,
+                                     GtkCssLookup            *lookup,
+                                     const GtkBitmask        *changes,
+                                     GtkStyleProviderPrivate *provider,
+                                     int                      scale,
+                                     GtkStateFlags            state,
+                                     GtkCssComputedValues    *parent_values,
+                                     GtkCssComputedValues    *previous)
+{
+  g_return_val_if_fail (cache != NULL, NULL);
+  g_return_val_if_fail (lookup != NULL, NULL);
+  g_return_val_if_fail (changes != NULL, NULL);
+  g_return_val_if_fail (GTK_IS_CSS_COMPUTED_VALUES (previous), NULL);
+
+  return gtk_css_style_cache_lookup_full (cache, lookup, provider, scale, state,
+                                          parent_values, previous, changes);
+}
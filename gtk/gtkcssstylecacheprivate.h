@@ -0,0 +1,51 @@
+/* GTK - The GIMP Toolkit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GTK_CSS_STYLE_CACHE_PRIVATE_H__
+#define __GTK_CSS_STYLE_CACHE_PRIVATE_H__
+
+#include "gtk/gtkcsscomputedvaluesprivate.h"
+#include "gtk/gtkcsslookupprivate.h"
+#include "gtk/gtkenums.h"
+#include "gtk/gtkstyleproviderprivate.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GtkCssStyleCache GtkCssStyleCache;
+
+GtkCssStyleCache *      _gtk_css_style_cache_new                (void);
+void                    _gtk_css_style_cache_free               (GtkCssStyleCache           *cache);
+
+void                    _gtk_css_style_cache_clear              (GtkCssStyleCache           *cache);
+
+GtkCssComputedValues *  _gtk_css_style_cache_lookup             (GtkCssStyleCache           *cache,
+                                                                 GtkCssLookup               *lookup,
+                                                                 GtkStyleProviderPrivate    *provider,
+                                                                 int                         scale,
+                                                                 GtkStateFlags               state,
+                                                                 GtkCssComputedValues       *parent_values);
+GtkCssComputedValues *  _gtk_css_style_cache_lookup_changes     (GtkCssStyleCache           *cache,
+                                                                 GtkCssLookup               *lookup,
+                                                                 const GtkBitmask           *changes,
+                                                                 GtkStyleProviderPrivate    *provider,
+                                                                 int                         scale,
+                                                                 GtkStateFlags               state,
+                                                                 GtkCssComputedValues       *parent_values,
+                                                                 GtkCssComputedValues       *previous);
+
+G_END_DECLS
+
+#endif /* __GTK_CSS_STYLE_CACHE_PRIVATE_H__ */
@@ -0,0 +1,509 @@
+/* GTK - The GIMP Toolkit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gtkcssthemecacheprivate.h"
+
+#include "gtkversion.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <string.h>
+
+/* A compiled theme is kept in a file that is mapped into memory and used
+ * in place. The file starts with a Header, everything else is referenced
+ * by its offset from the start of the file. What the root offset points
+ * to is up to the provider.
+ *
+ * The file records every CSS file that went into it. It is only used if
+ * all of them are unchanged: either their modification time is the same
+ * as when the cache was written, or their contents still have the same
+ * checksum. GTK+'s own resources can only change together with the
+ * GTK+ version, which the header already records, so they are not
+ * checked at all.
+ *
+ * Selectors, property ids and pointer sized fields are written as they
+ * are in memory, so a cache can only be used by the GTK+ build that wrote
+ * it. Bump GTK_CSS_THEME_CACHE_VERSION when changing the layout.
+ */
+
+#define GTK_CSS_THEME_CACHE_MAGIC "GTKCSSC"
+#define GTK_CSS_THEME_CACHE_VERSION 2
+
+#define ALIGNMENT 8
+
+typedef struct {
+  char    magic[8];
+  guint32 version;
+  guint32 gtk_version;
+  guint32 pointer_size;
+  guint32 size;                 /* of the whole file */
+  guint32 n_sources;
+  guint32 sources;
+  guint32 root;
+  guint32 padding;
+} Header;
+
+typedef struct {
+  guint32 uri;
+  guint32 checksum;             /* GTK_CSS_THEME_CACHE_NONE for GTK+'s resources */
+  guint64 mtime;                /* 0 if unknown */
+} Source;
+
+struct _GtkCssThemeCacheWriter {
+  GByteArray *data;
+  GHashTable *strings;          /* string => offset */
+  GArray *sources;
+};
+
+struct _GtkCssThemeCacheReader {
+  GMappedFile *file;
+  const guint8 *data;
+  gsize size;
+  const Header *header;
+};
+
+static guint32
+get_gtk_version (void)
+{
+  return GTK_MAJOR_VERSION << 16 | GTK_MINOR_VERSION << 8 | GTK_MICRO_VERSION;
+}
+
+static gboolean
+is_gtk_resource (const char *uri)
+{
+  return g_str_has_prefix (uri, "resource:///org/gtk/libgtk/");
+}
+
+/**
+ * _gtk_css_theme_cache_get_filename:
+ * @file: the CSS file the theme is loaded from
+ *
+ * Returns: (transfer full): the file the compiled form of @file is
+ *     cached in
+ **/
+char *
+_gtk_css_theme_cache_get_filename (GFile *file)
+{
+  char *uri, *checksum, *basename, *filename;
+
+  uri = g_file_get_uri (file);
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, uri, -1);
+  basename = g_strconcat (checksum, ".cache", NULL);
+  filename = g_build_filename (g_get_user_cache_dir (), "gtk-3.0", "css", basename, NULL);
+
+  g_free (basename);
+  g_free (checksum);
+  g_free (uri);
+
+  return filename;
+}
+
+/**
+ * _gtk_css_theme_cache_get_mtime:
+ * @file: a file
+ *
+ * Returns: the modification time of @file in microseconds, or 0 if it
+ *     is not known, for example for resources
+ **/
+guint64
+_gtk_css_theme_cache_get_mtime (GFile *file)
+{
+  GFileInfo *info;
+  guint64 mtime;
+
+  info = g_file_query_info (file,
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                            G_FILE_QUERY_INFO_NONE,
+                            NULL, NULL);
+  if (info == NULL)
+    return 0;
+
+  mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+          + g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+  g_object_unref (info);
+
+  return mtime;
+}
+
+GtkCssThemeCacheWriter *
+_gtk_css_theme_cache_writer_new (void)
+{
+  GtkCssThemeCacheWriter *writer;
+  Header header = { { 0, } };
+
+  writer = g_slice_new (GtkCssThemeCacheWriter);
+  writer->data = g_byte_array_new ();
+  writer->strings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  writer->sources = g_array_new (FALSE, FALSE, sizeof (Source));
+
+  /* Filled in when saving */
+  g_byte_array_append (writer->data, (guint8 *) &header, sizeof (Header));
+
+  return writer;
+}
+
+void
+_gtk_css_theme_cache_writer_free (GtkCssThemeCacheWriter *writer)
+{
+  g_byte_array_unref (writer->data);
+  g_hash_table_unref (writer->strings);
+  g_array_unref (writer->sources);
+
+  g_slice_free (GtkCssThemeCacheWriter, writer);
+}
+
+/**
+ * _gtk_css_theme_cache_writer_add:
+ * @writer: the writer
+ * @data: the data to add
+ * @size: the size of @data
+ *
+ * Appends @data to the cache, aligned so that it can be used in place
+ * once the file is mapped.
+ *
+ * Returns: the offset of the data
+ **/
+guint32
+_gtk_css_theme_cache_writer_add (GtkCssThemeCacheWriter *writer,
+                                 gconstpointer           data,
+                                 gsize                   size)
+{
+  static const guint8 padding[ALIGNMENT] = { 0, };
+  guint32 offset;
+
+  g_byte_array_append (writer->data, padding,
+                       (ALIGNMENT - writer->data->len % ALIGNMENT) % ALIGNMENT);
+
+  offset = writer->data->len;
+  g_byte_array_append (writer->data, data, size);
+
+  return offset;
+}
+
+/**
+ * _gtk_css_theme_cache_writer_add_array:
+ * @writer: the writer
+ * @elements: the elements to add
+ * @n_elements: the number of elements
+ * @element_size: the size of one element, a multiple of 4
+ *
+ * Appends @elements to the cache, preceded by their number as a guint32.
+ * Read them back with _gtk_css_theme_cache_reader_get_array().
+ *
+ * Returns: the offset of the array
+ **/
+guint32
+_gtk_css_theme_cache_writer_add_array (GtkCssThemeCacheWriter *writer,
+                                       gconstpointer           elements,
+                                       guint                   n_elements,
+                                       gsize                   element_size)
+{
+  guint32 offset, n = n_elements;
+
+  offset = _gtk_css_theme_cache_writer_add (writer, &n, sizeof (guint32));
+  g_byte_array_append (writer->data, elements, n_elements * element_size);
+
+  return offset;
+}
+
+/* Each string is only added once */
+guint32
+_gtk_css_theme_cache_writer_add_string (GtkCssThemeCacheWriter *writer,
+                                        const char             *string)
+{
+  gpointer offset;
+
+  if (g_hash_table_lookup_extended (writer->strings, string, NULL, &offset))
+    return GPOINTER_TO_UINT (offset);
+
+  offset = GUINT_TO_POINTER (_gtk_css_theme_cache_writer_add (writer, string, strlen (string) + 1));
+  g_hash_table_insert (writer->strings, g_strdup (string), offset);
+
+  return GPOINTER_TO_UINT (offset);
+}
+
+/**
+ * _gtk_css_theme_cache_writer_add_source:
+ * @writer: the writer
+ * @file: a CSS file that was loaded
+ * @mtime: the modification time of @file before it was read, as
+ *     returned by _gtk_css_theme_cache_get_mtime()
+ * @contents: the contents of @file
+ * @length: the length of @contents
+ *
+ * Records that @file was used, so that the cache is not used anymore
+ * once it changes.
+ **/
+void
+_gtk_css_theme_cache_writer_add_source (GtkCssThemeCacheWriter *writer,
+                                        GFile                  *file,
+                                        guint64                 mtime,
+                                        const char             *contents,
+                                        gsize                   length)
+{
+  Source source;
+  char *uri, *checksum;
+
+  uri = g_file_get_uri (file);
+  source.uri = _gtk_css_theme_cache_writer_add_string (writer, uri);
+  source.mtime = mtime;
+
+  if (is_gtk_resource (uri))
+    source.checksum = GTK_CSS_THEME_CACHE_NONE;
+  else
+    {
+      checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256, (const guchar *) contents, length);
+      source.checksum = _gtk_css_theme_cache_writer_add_string (writer, checksum);
+      g_free (checksum);
+    }
+
+  g_array_append_val (writer->sources, source);
+  g_free (uri);
+}
+
+gboolean
+_gtk_css_theme_cache_writer_save (GtkCssThemeCacheWriter  *writer,
+                                  guint32                  root,
+                                  const char              *filename,
+                                  GError                 **error)
+{
+  Header *header;
+  guint32 sources;
+  char *dir;
+
+  sources = _gtk_css_theme_cache_writer_add (writer,
+                                             writer->sources->data,
+                                             writer->sources->len * sizeof (Source));
+
+  header = (Header *) writer->data->data;
+  memcpy (header->magic, GTK_CSS_THEME_CACHE_MAGIC, sizeof (header->magic));
+  header->version = GTK_CSS_THEME_CACHE_VERSION;
+  header->gtk_version = get_gtk_version ();
+  header->pointer_size = sizeof (gpointer);
+  header->size = writer->data->len;
+  header->n_sources = writer->sources->len;
+  header->sources = sources;
+  header->root = root;
+
+  dir = g_path_get_dirname (filename);
+  if (g_mkdir_with_parents (dir, 0700) != 0)
+    {
+      int errsv = errno;
+
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errsv),
+                   "Failed to create %s: %s", dir, g_strerror (errsv));
+      g_free (dir);
+      return FALSE;
+    }
+  g_free (dir);
+
+  /* Written to a temporary file and renamed, so a process that has the
+   * old cache mapped keeps seeing the old contents */
+  return g_file_set_contents (filename,
+                              (const char *) writer->data->data,
+                              writer->data->len,
+                              error);
+}
+
+static gboolean
+gtk_css_theme_cache_reader_check_source (GtkCssThemeCacheReader *reader,
+                                         const Source           *source)
+{
+  const char *uri, *checksum;
+  char *contents, *current;
+  gsize length;
+  GFile *file;
+  gboolean result;
+
+  uri = _gtk_css_theme_cache_reader_get_string (reader, source->uri);
+  if (uri == NULL)
+    return FALSE;
+
+  /* Same GTK+ version, same resources */
+  if (source->checksum == GTK_CSS_THEME_CACHE_NONE)
+    return is_gtk_resource (uri);
+
+  checksum = _gtk_css_theme_cache_reader_get_string (reader, source->checksum);
+  if (checksum == NULL)
+    return FALSE;
+
+  file = g_file_new_for_uri (uri);
+
+  if (source->mtime != 0 &&
+      _gtk_css_theme_cache_get_mtime (file) == source->mtime)
+    {
+      g_object_unref (file);
+      return TRUE;
+    }
+
+  /* The file was touched, see if it actually changed */
+  if (!g_file_load_contents (file, NULL, &contents, &length, NULL, NULL))
+    {
+      g_object_unref (file);
+      return FALSE;
+    }
+
+  current = g_compute_checksum_for_data (G_CHECKSUM_SHA256, (const guchar *) contents, length);
+  result = g_str_equal (current, checksum);
+
+  g_free (current);
+  g_free (contents);
+  g_object_unref (file);
+
+  return result;
+}
+
+/**
+ * _gtk_css_theme_cache_reader_new:
+ * @filename: the cache file
+ *
+ * Maps the cache in @filename.
+ *
+ * Returns: the reader or %NULL if there is no cache, if it was written
+ *     by a different version of GTK+ or if the CSS files it was compiled
+ *     from have changed
+ **/
+GtkCssThemeCacheReader *
+_gtk_css_theme_cache_reader_new (const char *filename)
+{
+  GtkCssThemeCacheReader *reader;
+  GMappedFile *file;
+  const Header *header;
+  const Source *sources;
+  guint i;
+
+  file = g_mapped_file_new (filename, FALSE, NULL);
+  if (file == NULL)
+    return NULL;
+
+  reader = g_slice_new (GtkCssThemeCacheReader);
+  reader->file = file;
+  reader->data = (const guint8 *) g_mapped_file_get_contents (file);
+  reader->size = g_mapped_file_get_length (file);
+  reader->header = NULL;
+
+  header = _gtk_css_theme_cache_reader_get (reader, 0, sizeof (Header));
+  if (header == NULL ||
+      memcmp (header->magic, GTK_CSS_THEME_CACHE_MAGIC, sizeof (header->magic)) != 0 ||
+      header->version != GTK_CSS_THEME_CACHE_VERSION ||
+      header->gtk_version != get_gtk_version () ||
+      header->pointer_size != sizeof (gpointer) ||
+      header->size != reader->size)
+    goto invalid;
+
+  sources = _gtk_css_theme_cache_reader_get (reader,
+                                             header->sources,
+                                             (gsize) header->n_sources * sizeof (Source));
+  if (sources == NULL || header->n_sources == 0)
+    goto invalid;
+
+  for (i = 0; i < header->n_sources; i++)
+    {
+      if (!gtk_css_theme_cache_reader_check_source (reader, &sources[i]))
+        goto invalid;
+    }
+
+  reader->header = header;
+
+  return reader;
+
+ invalid:
+  _gtk_css_theme_cache_reader_free (reader);
+  return NULL;
+}
+
+void
+_gtk_css_theme_cache_reader_free (GtkCssThemeCacheReader *reader)
+{
+  g_mapped_file_unref (reader->file);
+
+  g_slice_free (GtkCssThemeCacheReader, reader);
+}
+
+guint32
+_gtk_css_theme_cache_reader_get_root (GtkCssThemeCacheReader *reader)
+{
+  return reader->header->root;
+}
+
+/**
+ * _gtk_css_theme_cache_reader_get:
+ * @reader: the reader
+ * @offset: offset of the data
+ * @size: size of the data
+ *
+ * Returns: a pointer to the data in the mapped file or %NULL if
+ *     @offset and @size do not describe valid data
+ **/
+gconstpointer
+_gtk_css_theme_cache_reader_get (GtkCssThemeCacheReader *reader,
+                                 guint32                 offset,
+                                 gsize                   size)
+{
+  if (offset % ALIGNMENT != 0 ||
+      offset > reader->size ||
+      size > reader->size - offset)
+    return NULL;
+
+  return reader->data + offset;
+}
+
+/**
+ * _gtk_css_theme_cache_reader_get_array:
+ * @reader: the reader
+ * @offset: offset returned by _gtk_css_theme_cache_writer_add_array()
+ * @element_size: the size of one element
+ * @n_elements: (out): the number of elements
+ *
+ * Returns: a pointer to the first element in the mapped file or %NULL
+ *     if @offset does not describe a valid array
+ **/
+gconstpointer
+_gtk_css_theme_cache_reader_get_array (GtkCssThemeCacheReader *reader,
+                                       guint32                 offset,
+                                       gsize                   element_size,
+                                       guint                  *n_elements)
+{
+  const guint32 *data;
+
+  data = _gtk_css_theme_cache_reader_get (reader, offset, sizeof (guint32));
+  if (data == NULL)
+    return NULL;
+
+  *n_elements = data[0];
+  if (data[0] > reader->size / element_size ||
+      _gtk_css_theme_cache_reader_get (reader, offset, sizeof (guint32) + (gsize) data[0] * element_size) == NULL)
+    return NULL;
+
+  return data + 1;
+}
+
+const char *
+_gtk_css_theme_cache_reader_get_string (GtkCssThemeCacheReader *reader,
+                                        guint32                 offset)
+{
+  if (offset == GTK_CSS_THEME_CACHE_NONE ||
+      offset % ALIGNMENT != 0 ||
+      offset >= reader->size ||
+      memchr (reader->data + offset, '\0', reader->size - offset) == NULL)
+    return NULL;
+
+  return (const char *) reader->data + offset;
+}
@@ -0,0 +1,71 @@
+/* GTK - The GIMP Toolkit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GTK_CSS_THEME_CACHE_PRIVATE_H__
+#define __GTK_CSS_THEME_CACHE_PRIVATE_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* Offset 0 is the file header, so it never points to any data */
+#define GTK_CSS_THEME_CACHE_NONE 0
+
+typedef struct _GtkCssThemeCacheWriter GtkCssThemeCacheWriter;
+typedef struct _GtkCssThemeCacheReader GtkCssThemeCacheReader;
+
+char *                   _gtk_css_theme_cache_get_filename       (GFile                  *file);
+guint64                  _gtk_css_theme_cache_get_mtime          (GFile                  *file);
+
+GtkCssThemeCacheWriter * _gtk_css_theme_cache_writer_new         (void);
+void                     _gtk_css_theme_cache_writer_free        (GtkCssThemeCacheWriter *writer);
+
+void                     _gtk_css_theme_cache_writer_add_source  (GtkCssThemeCacheWriter *writer,
+                                                                  GFile                  *file,
+                                                                  guint64                 mtime,
+                                                                  const char             *contents,
+                                                                  gsize                   length);
+guint32                  _gtk_css_theme_cache_writer_add         (GtkCssThemeCacheWriter *writer,
+                                                                  gconstpointer           data,
+                                                                  gsize                   size);
+guint32                  _gtk_css_theme_cache_writer_add_array   (GtkCssThemeCacheWriter *writer,
+                                                                  gconstpointer           elements,
+                                                                  guint                   n_elements,
+                                                                  gsize                   element_size);
+guint32                  _gtk_css_theme_cache_writer_add_string  (GtkCssThemeCacheWriter *writer,
+                                                                  const char             *string);
+gboolean                 _gtk_css_theme_cache_writer_save        (GtkCssThemeCacheWriter *writer,
+                                                                  guint32                 root,
+                                                                  const char             *filename,
+                                                                  GError                **error);
+
+GtkCssThemeCacheReader * _gtk_css_theme_cache_reader_new         (const char             *filename);
+void                     _gtk_css_theme_cache_reader_free        (GtkCssThemeCacheReader *reader);
+
+guint32                  _gtk_css_theme_cache_reader_get_root    (GtkCssThemeCacheReader *reader);
+gconstpointer            _gtk_css_theme_cache_reader_get         (GtkCssThemeCacheReader *reader,
+                                                                  guint32                 offset,
+                                                                  gsize                   size);
+gconstpointer            _gtk_css_theme_cache_reader_get_array   (GtkCssThemeCacheReader *reader,
+                                                                  guint32                 offset,
+                                                                  gsize                   element_size,
+                                                                  guint                  *n_elements);
+const char *             _gtk_css_theme_cache_reader_get_string  (GtkCssThemeCacheReader *reader,
+                                                                  guint32                 offset);
+
+G_END_DECLS
+
+#endif /* __GTK_CSS_THEME_CACHE_PRIVATE_H__ */
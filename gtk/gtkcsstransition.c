@@ -115,6 +115,7 @@ _gtk_css_transition_new (guint        property,
                          gint64       end_time_us)
 {
   GtkCssTransition *transition;
+  GtkStyleAnimation *animation;
 
   g_return_val_if_fail (start != NULL, NULL);
   g_return_val_if_fail (ease != NULL, NULL);
@@ -128,7 +129,10 @@ _gtk_css_transition_new (guint        property,
   transition->start_time = start_time_us;
   transition->end_time = end_time_us;
 
-  return GTK_STYLE_ANIMATION (transition);
+  animation = GTK_STYLE_ANIMATION (transition);
+  animation->properties = _gtk_bitmask_set (animation->properties, property, TRUE);
+
+  return animation;
 }
 
 guint
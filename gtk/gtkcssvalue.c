@@ -43,6 +43,64 @@ _gtk_css_value_alloc (const GtkCssValueClass *klass,
   return value;
 }
 
+/* All interned values. Values remove themselves when they are freed. */
+static GHashTable *interned_values = NULL;
+
+static guint
+gtk_css_value_intern_hash (gconstpointer value)
+{
+  const GtkCssValue *css_value = value;
+
+  return GPOINTER_TO_UINT (css_value->class) ^ css_value->class->hash (css_value);
+}
+
+static gboolean
+gtk_css_value_intern_equal (gconstpointer value1,
+                            gconstpointer value2)
+{
+  /* The pointer check makes sure a value always finds itself, even if
+   * it isn't equal to itself, like NaN numbers */
+  return value1 == value2 ||
+         _gtk_css_value_equal (value1, value2);
+}
+
+/**
+ * _gtk_css_value_intern:
+ * @value: (transfer full): the value to intern
+ *
+ * Looks for a value equal to @value that is already in use and returns
+ * that instead, so identical values end up being the same object. That
+ * saves memory and makes _gtk_css_value_equal() a pointer compare for
+ * them. Only works for values whose class implements the hash vfunc,
+ * others are returned unchanged.
+ *
+ * Returns: (transfer full): @value or an equal value
+ **/
+GtkCssValue *
+_gtk_css_value_intern (GtkCssValue *value)
+{
+  GtkCssValue *interned;
+
+  gtk_internal_return_val_if_fail (value != NULL, NULL);
+
+  if (value->class->hash == NULL)
+    return value;
+
+  if (interned_values == NULL)
+    interned_values = g_hash_table_new (gtk_css_value_intern_hash, gtk_css_value_intern_equal);
+
+  interned = g_hash_table_lookup (interned_values, value);
+  if (interned)
+    {
+      _gtk_css_value_unref (value);
+      return _gtk_css_value_ref (interned);
+    }
+
+  g_hash_table_add (interned_values, value);
+
+  return value;
+}
+
 GtkCssValue *
 _gtk_css_value_ref (GtkCssValue *value)
 {
@@ -62,6 +120,10 @@ _gtk_css_value_unref (GtkCssValue *value)
   if (!g_atomic_int_dec_and_test (&value->ref_count))
     return;
 
+  if (value->class->hash && interned_values &&
+      g_hash_table_lookup (interned_values, value) == value)
+    g_hash_table_remove (interned_values, value);
+
   value->class->free (value);
 }
 
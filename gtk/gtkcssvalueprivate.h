@@ -55,6 +55,8 @@ struct _GtkCssValueClass {
                                                        double                      progress);
   void          (* print)                             (const GtkCssValue          *value,
                                                        GString                    *string);
+  /* optional, only needed for _gtk_css_value_intern() */
+  guint         (* hash)                              (const GtkCssValue          *value);
 };
 
 GType        _gtk_css_value_get_type                  (void) G_GNUC_CONST;
@@ -63,6 +65,8 @@ GtkCssValue *_gtk_css_value_alloc                     (const GtkCssValueClass
                                                        gsize                       size);
 #define _gtk_css_value_new(_name, _klass) ((_name *) _gtk_css_value_alloc ((_klass), sizeof (_name)))
 
+GtkCssValue *_gtk_css_value_intern                    (GtkCssValue                *value);
+
 GtkCssValue *_gtk_css_value_ref                       (GtkCssValue                *value);
 void         _gtk_css_value_unref                     (GtkCssValue                *value);
 
@@ -24,6 +24,7 @@
 #include "gtkliststore.h"
 #include "gtktreedatalist.h"
 #include "gtktreednd.h"
+#include "gtktreeprivate.h"
 #include "gtkintl.h"
 #include "gtkbuildable.h"
 #include "gtkbuilderprivate.h"
@@ -114,6 +115,10 @@
  * access to a particular row is needed often and your code is expected to
  * run on older versions of GTK+, it is worth keeping the iter around.
  *
+ * Every cell of a #GtkListStore is allocated separately by default. For
+ * big lists, gtk_list_store_set_columnar_storage() can be used to keep
+ * the values of each column in one array instead.
+ *
  * ## Atomic Operations
  *
  * It is important to note that only the methods
@@ -192,11 +197,24 @@ struct _GtkListStorePrivate
   GtkSortType order;
 
   guint columns_dirty : 1;
+  guint columnar : 1;
 
   gpointer default_sort_data;
   gpointer seq;         /* head of the list */
+
+  /* columnar storage, see gtk_list_store_set_columnar_storage().
+   * The sequence then holds row indexes into the columns. */
+  GArray **columns;     /* one array of GtkTreeDataValue per column */
+  GArray *free_rows;    /* indexes of removed rows, for reuse */
+  guint n_rows;         /* length of the columns */
+  GHashTable *strings;  /* string => PooledString */
 };
 
+typedef struct {
+  guint ref_count;
+  char str[1];
+} PooledString;
+
 #define GTK_LIST_STORE_IS_SORTED(list) (((GtkListStore*)(list))->priv->sort_column_id != GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID)
 static void         gtk_list_store_tree_model_init (GtkTreeModelIface *iface);
 static void         gtk_list_store_drag_source_init(GtkTreeDragSourceIface *iface);
@@ -526,6 +544,67 @@ gtk_list_store_set_column_types (GtkListStore *list_store,
     }
 }
 
+/**
+ * gtk_list_store_set_columnar_storage:
+ * @list_store: A #GtkListStore
+ * @columnar: %TRUE to store the rows in per-column arrays
+ *
+ * Selects how @list_store keeps its rows. By default, every cell is
+ * allocated separately. With columnar storage, the values of each column
+ * are kept in one array, and strings go through a string pool that
+ * belongs to @list_store, so equal strings share one copy no matter
+ * which rows or columns they are in. This makes big lists much cheaper
+ * to fill and to keep around, at the cost of not giving back the memory
+ * of removed rows until the list store is cleared. Later insertions
+ * reuse those rows.
+ *
+ * The order of the rows is kept the same way in both modes, so
+ * gtk_tree_model_iter_nth_child() and gtk_tree_model_get_iter() stay
+ * O(log n), and iters, sorting and reordering behave the same.
+ *
+ * This function can only be called on an empty list store.
+ *
+ * Since: 3.12
+ **/
+void
+gtk_list_store_set_columnar_storage (GtkListStore *list_store,
+                                     gboolean      columnar)
+{
+  GtkListStorePrivate *priv;
+
+  g_return_if_fail (GTK_IS_LIST_STORE (list_store));
+
+  priv = list_store->priv;
+
+  g_return_if_fail (priv->length == 0);
+
+  columnar = columnar != FALSE;
+  if (priv->columnar == columnar)
+    return;
+
+  gtk_list_store_free_columns (list_store);
+  priv->columnar = columnar;
+}
+
+/**
+ * gtk_list_store_get_columnar_storage:
+ * @list_store: A #GtkListStore
+ *
+ * Returns whether @list_store uses columnar storage, see
+ * gtk_list_store_set_columnar_storage().
+ *
+ * Returns: %TRUE if @list_store uses columnar storage
+ *
+ * Since: 3.12
+ **/
+gboolean
+gtk_list_store_get_columnar_storage (GtkListStore *list_store)
+{
+  g_return_val_if_fail (GTK_IS_LIST_STORE (list_store), FALSE);
+
+  return list_store->priv->columnar;
+}
+
 static void
 gtk_list_store_set_n_columns (GtkListStore *list_store,
 			      gint          n_columns)
@@ -562,14 +641,173 @@ gtk_list_store_set_column_type (GtkListStore *list_store,
   priv->column_headers[column] = type;
 }
 
+static const char *
+gtk_list_store_pool_string (GtkListStore *list_store,
+                            const char   *string)
+{
+  GtkListStorePrivate *priv = list_store->priv;
+  PooledString *pooled;
+  gsize len;
+
+  if (string == NULL)
+    return NULL;
+
+  pooled = g_hash_table_lookup (priv->strings, string);
+  if (pooled)
+    {
+      pooled->ref_count++;
+      return pooled->str;
+    }
+
+  len = strlen (string);
+  pooled = g_malloc (G_STRUCT_OFFSET (PooledString, str) + len + 1);
+  pooled->ref_count = 1;
+  memcpy (pooled->str, string, len + 1);
+  g_hash_table_insert (priv->strings, pooled->str, pooled);
+
+  return pooled->str;
+}
+
+static void
+gtk_list_store_release_string (GtkListStore *list_store,
+                               const char   *string)
+{
+  GtkListStorePrivate *priv = list_store->priv;
+  PooledString *pooled;
+
+  if (string == NULL)
+    return;
+
+  pooled = g_hash_table_lookup (priv->strings, string);
+  g_assert (pooled != NULL);
+
+  pooled->ref_count--;
+  if (pooled->ref_count == 0)
+    g_hash_table_remove (priv->strings, string);
+}
+
+static void
+gtk_list_store_clear_cell (GtkListStore     *list_store,
+                           gint              column,
+                           GtkTreeDataValue *cell)
+{
+  GType type = list_store->priv->column_headers[column];
+
+  if (g_type_is_a (type, G_TYPE_STRING))
+    gtk_list_store_release_string (list_store, cell->v_pointer);
+  else if (g_type_is_a (type, G_TYPE_OBJECT) && cell->v_pointer != NULL)
+    g_object_unref (cell->v_pointer);
+  else if (g_type_is_a (type, G_TYPE_BOXED) && cell->v_pointer != NULL)
+    g_boxed_free (type, cell->v_pointer);
+  else if (g_type_is_a (type, G_TYPE_VARIANT) && cell->v_pointer != NULL)
+    g_variant_unref (cell->v_pointer);
+
+  memset (cell, 0, sizeof (GtkTreeDataValue));
+}
+
+static inline GtkTreeDataValue *
+gtk_list_store_get_cell (GtkListStore  *list_store,
+                         GSequenceIter *ptr,
+                         gint           column)
+{
+  return &g_array_index (list_store->priv->columns[column],
+                         GtkTreeDataValue,
+                         GPOINTER_TO_UINT (g_sequence_get (ptr)));
+}
+
+/* Returns the data for the sequence item of a new, empty row */
+static gpointer
+gtk_list_store_new_row (GtkListStore *list_store)
+{
+  GtkListStorePrivate *priv = list_store->priv;
+  guint row;
+  gint i;
+
+  if (!priv->columnar)
+    return NULL;
+
+  if (priv->columns == NULL)
+    {
+      priv->columns = g_new (GArray *, priv->n_columns);
+      for (i = 0; i < priv->n_columns; i++)
+        priv->columns[i] = g_array_new (FALSE, TRUE, sizeof (GtkTreeDataValue));
+      priv->free_rows = g_array_new (FALSE, FALSE, sizeof (guint));
+      priv->strings = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+    }
+
+  if (priv->free_rows->len > 0)
+    {
+      row = g_array_index (priv->free_rows, guint, priv->free_rows->len - 1);
+      g_array_set_size (priv->free_rows, priv->free_rows->len - 1);
+    }
+  else
+    {
+      row = priv->n_rows++;
+      for (i = 0; i < priv->n_columns; i++)
+        g_array_set_size (priv->columns[i], priv->n_rows);
+    }
+
+  return GUINT_TO_POINTER (row);
+}
+
+static void
+gtk_list_store_free_row (GtkListStore *list_store,
+                         gpointer      data)
+{
+  GtkListStorePrivate *priv = list_store->priv;
+  guint row;
+  gint i;
+
+  if (!priv->columnar)
+    {
+      _gtk_tree_data_list_free (data, priv->column_headers);
+      return;
+    }
+
+  row = GPOINTER_TO_UINT (data);
+  for (i = 0; i < priv->n_columns; i++)
+    gtk_list_store_clear_cell (list_store, i, &g_array_index (priv->columns[i], GtkTreeDataValue, row));
+
+  g_array_append_val (priv->free_rows, row);
+}
+
+static void
+gtk_list_store_free_columns (GtkListStore *list_store)
+{
+  GtkListStorePrivate *priv = list_store->priv;
+  guint row;
+  gint i;
+
+  if (priv->columns == NULL)
+    return;
+
+  for (i = 0; i < priv->n_columns; i++)
+    {
+      for (row = 0; row < priv->n_rows; row++)
+        gtk_list_store_clear_cell (list_store, i, &g_array_index (priv->columns[i], GtkTreeDataValue, row));
+      g_array_free (priv->columns[i], TRUE);
+    }
+
+  g_free (priv->columns);
+  priv->columns = NULL;
+  g_array_free (priv->free_rows, TRUE);
+  priv->free_rows = NULL;
+  g_hash_table_destroy (priv->strings);
+  priv->strings = NULL;
+  priv->n_rows = 0;
+}
+
 static void
 gtk_list_store_finalize (GObject *object)
 {
   GtkListStore *list_store = GTK_LIST_STORE (object);
   GtkListStorePrivate *priv = list_store->priv;
 
-  g_sequence_foreach (priv->seq,
-		      (GFunc) _gtk_tree_data_list_free, priv->column_headers);
+  if (priv->columnar)
+    gtk_list_store_free_columns (list_store);
+  else
+    g_sequence_foreach (priv->seq,
+                        (GFunc) _gtk_tree_data_list_free, priv->column_headers);
 
   g_sequence_free (priv->seq);
 
@@ -680,6 +918,18 @@ gtk_list_store_get_value (GtkTreeModel *tree_model,
 
   g_return_if_fail (column < priv->n_columns);
   g_return_if_fail (iter_is_valid (iter, list_store));
+
+  if (priv->columnar)
+    {
+      GtkTreeDataList node;
+
+      node.next = NULL;
+      node.data = *gtk_list_store_get_cell (list_store, iter->user_data, column);
+      _gtk_tree_data_list_node_to_value (&node,
+                                         priv->column_headers[column],
+                                         value);
+      return;
+    }
 		    
   list = g_sequence_get (iter->user_data);
 
@@ -856,6 +1106,36 @@ gtk_list_store_real_set_value (GtkListStore *list_store,
       converted = TRUE;
     }
 
+  if (priv->columnar)
+    {
+      GtkTreeDataValue *cell = gtk_list_store_get_cell (list_store, iter->user_data, column);
+
+      if (g_type_is_a (priv->column_headers[column], G_TYPE_STRING))
+        {
+          const char *string;
+
+          string = gtk_list_store_pool_string (list_store,
+                                               g_value_get_string (converted ? &real_value : value));
+          gtk_list_store_release_string (list_store, cell->v_pointer);
+          cell->v_pointer = (gpointer) string;
+        }
+      else
+        {
+          GtkTreeDataList node;
+
+          node.next = NULL;
+          node.data = *cell;
+          _gtk_tree_data_list_value_to_node (&node, converted ? &real_value : value);
+          *cell = node.data;
+        }
+
+      if (converted)
+        g_value_unset (&real_value);
+      if (sort && GTK_LIST_STORE_IS_SORTED (list_store))
+        gtk_list_store_sort_iter_changed (list_store, iter, old_column);
+      return TRUE;
+    }
+
   prev = list = g_sequence_get (iter->user_data);
 
   while (list != NULL)
@@ -1215,7 +1495,7 @@ gtk_list_store_remove (GtkListStore *list_store,
   ptr = iter->user_data;
   next = g_sequence_iter_next (ptr);
   
-  _gtk_tree_data_list_free (g_sequence_get (ptr), priv->column_headers);
+  gtk_list_store_free_row (list_store, g_sequence_get (ptr));
   g_sequence_remove (iter->user_data);
 
   priv->length--;
@@ -1274,7 +1554,7 @@ gtk_list_store_insert (GtkListStore *list_store,
     position = length;
 
   ptr = g_sequence_get_iter_at_pos (seq, position);
-  ptr = g_sequence_insert_before (ptr, NULL);
+  ptr = g_sequence_insert_before (ptr, gtk_list_store_new_row (list_store));
 
   iter->stamp = priv->stamp;
   iter->user_data = ptr;
@@ -1437,6 +1717,8 @@ gtk_list_store_clear (GtkListStore *list_store)
       gtk_list_store_remove (list_store, &iter);
     }
 
+  gtk_list_store_free_columns (list_store);
+
   gtk_list_store_increment_stamp (list_store);
 }
 
@@ -1568,7 +1850,27 @@ gtk_list_store_drag_data_received (GtkTreeDragDest   *drag_dest,
 
       /* If we succeeded in creating dest_iter, copy data from src
        */
-      if (retval)
+      if (retval && priv->columnar)
+        {
+	  GtkTreePath *path;
+          gint col;
+
+          for (col = 0; col < priv->n_columns; col++)
+            {
+              GValue value = G_VALUE_INIT;
+
+              gtk_list_store_get_value (tree_model, &src_iter, col, &value);
+              gtk_list_store_real_set_value (list_store, &dest_iter, col, &value, FALSE);
+              g_value_unset (&value);
+            }
+
+	  dest_iter.stamp = priv->stamp;
+
+	  path = gtk_list_store_get_path (tree_model, &dest_iter);
+	  gtk_tree_model_row_changed (tree_model, path, &dest_iter);
+	  gtk_tree_path_free (path);
+        }
+      else if (retval)
         {
           GtkTreeDataList *dl = g_sequence_get (src_iter.user_data);
           GtkTreeDataList *copy_head = NULL;
@@ -2215,7 +2517,7 @@ gtk_list_store_insert_with_values (GtkListStore *list_store,
     position = length;
 
   ptr = g_sequence_get_iter_at_pos (seq, position);
-  ptr = g_sequence_insert_before (ptr, NULL);
+  ptr = g_sequence_insert_before (ptr, gtk_list_store_new_row (list_store));
 
   iter->stamp = priv->stamp;
   iter->user_data = ptr;
@@ -2295,7 +2597,7 @@ gtk_list_store_insert_with_valuesv (GtkListStore *list_store,
     position = length;
 
   ptr = g_sequence_get_iter_at_pos (seq, position);
-  ptr = g_sequence_insert_before (ptr, NULL);
+  ptr = g_sequence_insert_before (ptr, gtk_list_store_new_row (list_store));
 
   iter->stamp = priv->stamp;
   iter->user_data = ptr;
@@ -2320,6 +2622,175 @@ gtk_list_store_insert_with_valuesv (GtkListStore *list_store,
   gtk_tree_path_free (path);
 }
 
+/**
+ * gtk_list_store_insert_rows:
+ * @list_store: A #GtkListStore
+ * @position: position to insert the first new row, or -1 to append
+ * @n_rows: the number of rows to insert
+ * @columns: (array length=n_values): an array of column numbers
+ * @values: (array): an array of @n_rows times @n_values GValues, with
+ *   the values of the first row first
+ * @n_values: the length of the @columns array
+ *
+ * Inserts @n_rows rows at @position and fills them in like
+ * gtk_list_store_insert_with_valuesv() does. This is a lot faster than
+ * inserting the rows one by one, as the position of the rows is only
+ * looked up once. In a sorted @list_store every row goes straight to
+ * its sorted position instead.
+ *
+ * #GtkTreeModel::row-inserted is still emitted for every row, but a
+ * #GtkTreeView showing @list_store adds rows that end up next to each
+ * other in one go.
+ *
+ * Since: 3.12
+ **/
+void
+gtk_list_store_insert_rows (GtkListStore *list_store,
+                            gint          position,
+                            gint          n_rows,
+                            gint         *columns,
+                            GValue       *values,
+                            gint          n_values)
+{
+  GtkListStorePrivate *priv;
+  GtkTreePath *path;
+  GSequenceIter *ptr;
+  GtkTreeIter iter;
+  gint length, i;
+  gboolean sorted;
+  gboolean changed = FALSE;
+  gboolean maybe_need_sort;
+
+  g_return_if_fail (GTK_IS_LIST_STORE (list_store));
+  g_return_if_fail (n_rows >= 0);
+  g_return_if_fail (n_values == 0 || (columns != NULL && values != NULL));
+
+  priv = list_store->priv;
+
+  if (n_rows == 0)
+    return;
+
+  priv->columns_dirty = TRUE;
+  sorted = GTK_LIST_STORE_IS_SORTED (list_store);
+
+  length = g_sequence_get_length (priv->seq);
+  if (position > length || position < 0)
+    position = length;
+
+  ptr = g_sequence_get_iter_at_pos (priv->seq, position);
+  path = gtk_tree_path_new_from_indices (position, -1);
+
+  /* Rows of a sorted store end up wherever they belong, so they are
+   * handed on in ranges of the ones that end up next to each other */
+  if (!sorted)
+    _gtk_tree_model_begin_rows_inserted (GTK_TREE_MODEL (list_store), path, n_rows);
+
+  for (i = 0; i < n_rows; i++)
+    {
+      iter.stamp = priv->stamp;
+      iter.user_data = g_sequence_insert_before (ptr, gtk_list_store_new_row (list_store));
+
+      priv->length++;
+
+      maybe_need_sort = FALSE;
+      gtk_list_store_set_vector_internal (list_store, &iter,
+                                          &changed, &maybe_need_sort,
+                                          columns, values + i * n_values, n_values);
+
+      if (sorted)
+        {
+          /* Don't emit rows_reordered here */
+          if (maybe_need_sort)
+            g_sequence_sort_changed_iter (iter.user_data,
+                                          gtk_list_store_compare_func,
+                                          list_store);
+
+          gtk_tree_path_free (path);
+          path = gtk_list_store_get_path (GTK_TREE_MODEL (list_store), &iter);
+          _gtk_tree_model_continue_rows_inserted (GTK_TREE_MODEL (list_store), path);
+        }
+
+      gtk_tree_model_row_inserted (GTK_TREE_MODEL (list_store), path, &iter);
+      gtk_tree_path_next (path);
+    }
+
+  _gtk_tree_model_end_rows_inserted (GTK_TREE_MODEL (list_store));
+
+  gtk_tree_path_free (path);
+}
+
+/**
+ * gtk_list_store_set_rows:
+ * @list_store: A #GtkListStore
+ * @position: position of the first row to change
+ * @n_rows: the number of rows to change
+ * @columns: (array length=n_values): an array of column numbers
+ * @values: (array): an array of @n_rows times @n_values GValues, with
+ *   the values of the first row first
+ * @n_values: the length of the @columns array
+ *
+ * Replaces the values of @n_rows existing rows starting at @position,
+ * like calling gtk_list_store_set_valuesv() on each of them. If
+ * @list_store is sorted and the new values change the order, it is
+ * sorted once at the end, emitting a single #GtkTreeModel::rows-reordered
+ * signal instead of one per row.
+ *
+ * Since: 3.12
+ **/
+void
+gtk_list_store_set_rows (GtkListStore *list_store,
+                         gint          position,
+                         gint          n_rows,
+                         gint         *columns,
+                         GValue       *values,
+                         gint          n_values)
+{
+  GtkListStorePrivate *priv;
+  GtkTreePath *path;
+  GSequenceIter *ptr;
+  GtkTreeIter iter;
+  gboolean maybe_need_sort = FALSE;
+  gint i;
+
+  g_return_if_fail (GTK_IS_LIST_STORE (list_store));
+  g_return_if_fail (position >= 0);
+  g_return_if_fail (n_rows >= 0);
+  g_return_if_fail (position + n_rows <= list_store->priv->length);
+  g_return_if_fail (n_values == 0 || (columns != NULL && values != NULL));
+
+  priv = list_store->priv;
+
+  if (n_rows == 0)
+    return;
+
+  ptr = g_sequence_get_iter_at_pos (priv->seq, position);
+  path = gtk_tree_path_new_from_indices (position, -1);
+
+  for (i = 0; i < n_rows; i++)
+    {
+      gboolean changed = FALSE;
+
+      iter.stamp = priv->stamp;
+      iter.user_data = ptr;
+
+      gtk_list_store_set_vector_internal (list_store, &iter,
+                                          &changed, &maybe_need_sort,
+                                          columns, values + i * n_values, n_values);
+
+      /* the next row before anybody gets a chance to move this one */
+      ptr = g_sequence_iter_next (ptr);
+
+      if (changed)
+        gtk_tree_model_row_changed (GTK_TREE_MODEL (list_store), path, &iter);
+      gtk_tree_path_next (path);
+    }
+
+  gtk_tree_path_free (path);
+
+  if (maybe_need_sort)
+    gtk_list_store_sort (list_store);
+}
+
 /* GtkBuildable custom tag implementation
  *
  * <columns>
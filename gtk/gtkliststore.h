@@ -68,6 +68,11 @@ GtkListStore *gtk_list_store_newv             (gint          n_columns,
 void          gtk_list_store_set_column_types (GtkListStore *list_store,
 					       gint          n_columns,
 					       GType        *types);
+GDK_AVAILABLE_IN_3_12
+void          gtk_list_store_set_columnar_storage (GtkListStore *list_store,
+                                                   gboolean      columnar);
+GDK_AVAILABLE_IN_3_12
+gboolean      gtk_list_store_get_columnar_storage (GtkListStore *list_store);
 
 /* NOTE: use gtk_tree_model_get to get values from a GtkListStore */
 
@@ -107,6 +112,20 @@ void          gtk_list_store_insert_with_valuesv (GtkListStore *list_store,
 						  gint         *columns,
 						  GValue       *values,
 						  gint          n_values);
+GDK_AVAILABLE_IN_3_12
+void          gtk_list_store_insert_rows      (GtkListStore *list_store,
+                                               gint          position,
+                                               gint          n_rows,
+                                               gint         *columns,
+                                               GValue       *values,
+                                               gint          n_values);
+GDK_AVAILABLE_IN_3_12
+void          gtk_list_store_set_rows         (GtkListStore *list_store,
+                                               gint          position,
+                                               gint          n_rows,
+                                               gint         *columns,
+                                               GValue       *values,
+                                               gint          n_values);
 void          gtk_list_store_prepend          (GtkListStore *list_store,
 					       GtkTreeIter  *iter);
 void          gtk_list_store_append           (GtkListStore *list_store,
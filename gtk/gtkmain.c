@@ -92,6 +92,7 @@
 #include "config.h"
 
 #include "gdk/gdk.h"
+#include "gdk/gdk-private.h"
 
 #include <locale.h>
 
@@ -256,7 +257,8 @@ static const GDebugKey gtk_debug_keys[] = {
   {"printing", GTK_DEBUG_PRINTING},
   {"builder", GTK_DEBUG_BUILDER},
   {"size-request", GTK_DEBUG_SIZE_REQUEST},
-  {"no-css-cache", GTK_DEBUG_NO_CSS_CACHE}
+  {"no-css-cache", GTK_DEBUG_NO_CSS_CACHE},
+  {"css-profile", GTK_DEBUG_CSS_PROFILE}
 };
 #endif /* G_ENABLE_DEBUG */
 
@@ -793,6 +795,12 @@ do_pre_parse_initialization (int    *argc,
   env_string = g_getenv ("GTK_MODULES");
   if (env_string)
     gtk_modules_string = g_string_new (env_string);
+
+  env_string = g_getenv ("GTK_TRACE_FD");
+  if (env_string)
+    GDK_PRIVATE_CALL (gdk_profiler_start) (atoi (env_string));
+  else if (g_getenv ("GTK_TRACE"))
+    GDK_PRIVATE_CALL (gdk_profiler_start) (-1);
 }
 
 static void
@@ -166,12 +166,23 @@ gtk_modifier_style_provider_get_change (GtkStyleProviderPrivate *provider,
                                                  matcher);
 }
 
+static GtkBitmask *
+gtk_modifier_style_provider_get_state_properties (GtkStyleProviderPrivate *provider,
+                                                  const GtkCssMatcher     *matcher)
+{
+  GtkModifierStyle *style = GTK_MODIFIER_STYLE (provider);
+
+  return _gtk_style_provider_private_get_state_properties (GTK_STYLE_PROVIDER_PRIVATE (style->priv->style),
+                                                           matcher);
+}
+
 static void
 gtk_modifier_style_provider_private_init (GtkStyleProviderPrivateInterface *iface)
 {
   iface->get_color = gtk_modifier_style_provider_get_color;
   iface->lookup = gtk_modifier_style_provider_lookup;
   iface->get_change = gtk_modifier_style_provider_get_change;
+  iface->get_state_properties = gtk_modifier_style_provider_get_state_properties;
 }
 
 static void
@@ -95,6 +95,7 @@ _gtk_rbnode_rotate_left (GtkRBTree *tree,
 			 GtkRBNode *node)
 {
   gint node_height, right_height;
+  gint node_rows, right_rows;
   GtkRBNode *right;
 
   g_return_if_fail (!_gtk_rbtree_is_nil (node));
@@ -104,6 +105,8 @@ _gtk_rbnode_rotate_left (GtkRBTree *tree,
 
   node_height = GTK_RBNODE_GET_HEIGHT (node);
   right_height = GTK_RBNODE_GET_HEIGHT (right);
+  node_rows = GTK_RBNODE_GET_ROWS (node);
+  right_rows = GTK_RBNODE_GET_ROWS (right);
   node->right = right->left;
   if (!_gtk_rbtree_is_nil (right->left))
     right->left->parent = node;
@@ -122,8 +125,8 @@ _gtk_rbnode_rotate_left (GtkRBTree *tree,
   right->left = node;
   node->parent = right;
 
-  node->count = 1 + node->left->count + node->right->count;
-  right->count = 1 + right->left->count + right->right->count;
+  node->count = node_rows + node->left->count + node->right->count;
+  right->count = right_rows + right->left->count + right->right->count;
 
   node->offset = node_height + node->left->offset + node->right->offset +
                  (node->children ? node->children->root->offset : 0);
@@ -141,6 +144,7 @@ _gtk_rbnode_rotate_right (GtkRBTree *tree,
 			  GtkRBNode *node)
 {
   gint node_height, left_height;
+  gint node_rows, left_rows;
   GtkRBNode *left;
 
   g_return_if_fail (!_gtk_rbtree_is_nil (node));
@@ -150,6 +154,8 @@ _gtk_rbnode_rotate_right (GtkRBTree *tree,
 
   node_height = GTK_RBNODE_GET_HEIGHT (node);
   left_height = GTK_RBNODE_GET_HEIGHT (left);
+  node_rows = GTK_RBNODE_GET_ROWS (node);
+  left_rows = GTK_RBNODE_GET_ROWS (left);
   
   node->left = left->right;
   if (!_gtk_rbtree_is_nil (left->right))
@@ -172,8 +178,8 @@ _gtk_rbnode_rotate_right (GtkRBTree *tree,
   left->right = node;
   node->parent = left;
 
-  node->count = 1 + node->left->count + node->right->count;
-  left->count = 1 + left->left->count + left->right->count;
+  node->count = node_rows + node->left->count + node->right->count;
+  left->count = left_rows + left->left->count + left->right->count;
 
   node->offset = node_height + node->left->offset + node->right->offset +
                  (node->children ? node->children->root->offset : 0);
@@ -334,6 +340,8 @@ _gtk_rbtree_new (void)
   retval = g_new (GtkRBTree, 1);
   retval->parent_tree = NULL;
   retval->parent_node = NULL;
+  retval->materialize_func = NULL;
+  retval->materialize_data = NULL;
 
   retval->root = (GtkRBNode *) &nil;
 
@@ -490,6 +498,374 @@ _gtk_rbtree_insert_after (GtkRBTree *tree,
   return node;
 }
 
+static GtkRBNode *
+gtk_rbtree_fill_nodes (guint n_nodes,
+                       guint depth,
+                       guint red_depth,
+                       gint  height,
+                       guint flags)
+{
+  GtkRBNode *node;
+  guint n_left;
+
+  if (n_nodes == 0)
+    return (GtkRBNode *) &nil;
+
+  n_left = (n_nodes - 1) / 2;
+
+  node = _gtk_rbnode_new (NULL, height);
+  node->left = gtk_rbtree_fill_nodes (n_left, depth + 1, red_depth, height, flags);
+  node->right = gtk_rbtree_fill_nodes (n_nodes - 1 - n_left, depth + 1, red_depth, height, flags);
+  if (!_gtk_rbtree_is_nil (node->left))
+    node->left->parent = node;
+  if (!_gtk_rbtree_is_nil (node->right))
+    node->right->parent = node;
+
+  node->flags = (depth == red_depth ? GTK_RBNODE_RED : GTK_RBNODE_BLACK) | flags;
+  node->count = n_nodes;
+  node->total_count = n_nodes;
+  node->offset = n_nodes * height;
+
+  return node;
+}
+
+/* Like _gtk_rbtree_node_mark_invalid(), lets the parents of @tree know
+ * that some of its nodes are invalid */
+static void
+gtk_rbtree_mark_parents_invalid (GtkRBTree *tree)
+{
+  GtkRBTree *parent_tree;
+  GtkRBNode *parent_node;
+
+  parent_tree = tree->parent_tree;
+  parent_node = tree->parent_node;
+  while (parent_node &&
+         !GTK_RBNODE_FLAG_SET (parent_node, GTK_RBNODE_DESCENDANTS_INVALID))
+    {
+      GTK_RBNODE_SET_FLAG (parent_node, GTK_RBNODE_DESCENDANTS_INVALID);
+      parent_node = parent_node->parent;
+      if (_gtk_rbtree_is_nil (parent_node))
+        {
+          parent_node = parent_tree->parent_node;
+          parent_tree = parent_tree->parent_tree;
+        }
+    }
+}
+
+/* Fills the empty @tree with @n_nodes nodes of @height at once. This is
+ * O(n) while inserting the nodes one by one costs a rebalancing and a walk
+ * up to the root for every node.
+ * Returns the first node or %NULL if @n_nodes is 0. */
+GtkRBNode *
+_gtk_rbtree_fill (GtkRBTree *tree,
+                  guint      n_nodes,
+                  gint       height,
+                  gboolean   valid)
+{
+  g_return_val_if_fail (tree != NULL, NULL);
+  g_return_val_if_fail (_gtk_rbtree_is_nil (tree->root), NULL);
+
+  if (n_nodes == 0)
+    return NULL;
+
+  /* Splitting at the median puts all leaves within one level of each
+   * other, so making the deepest level red and everything else black
+   * gives every path the same number of black nodes. */
+  tree->root = gtk_rbtree_fill_nodes (n_nodes,
+                                      0,
+                                      g_bit_storage (n_nodes) - 1,
+                                      height,
+                                      valid ? 0 : GTK_RBNODE_INVALID | GTK_RBNODE_DESCENDANTS_INVALID);
+  GTK_RBNODE_SET_COLOR (tree->root, GTK_RBNODE_BLACK);
+
+  gtk_rbnode_adjust (tree->parent_tree, tree->parent_node,
+                     0, n_nodes, n_nodes * height);
+
+  if (!valid)
+    gtk_rbtree_mark_parents_invalid (tree);
+
+#ifdef G_ENABLE_DEBUG  
+  if (gtk_get_debug_flags () & GTK_DEBUG_TREE)
+    {
+      g_print ("_gtk_rbtree_fill finished...\n");
+      _gtk_rbtree_debug_spew (tree);
+      g_print ("\n\n");
+      _gtk_rbtree_test (G_STRLOC, tree);
+    }
+#endif /* G_ENABLE_DEBUG */
+
+  return _gtk_rbtree_first (tree);
+}
+
+/* Number of black nodes on a path from @node down to a leaf */
+static guint
+gtk_rbnode_black_height (GtkRBNode *node)
+{
+  guint black_height = 0;
+
+  for (; !_gtk_rbtree_is_nil (node); node = node->left)
+    {
+      if (GTK_RBNODE_GET_COLOR (node) == GTK_RBNODE_BLACK)
+        black_height++;
+    }
+
+  return black_height;
+}
+
+/* Recomputes the sums kept in @node from its own @rows and @height and
+ * its current left, right and child trees */
+static void
+gtk_rbnode_update (GtkRBTree *tree,
+                   GtkRBNode *node,
+                   gint       rows,
+                   gint       height)
+{
+  node->count = rows + node->left->count + node->right->count;
+  node->offset = height + node->left->offset + node->right->offset +
+                 (node->children ? node->children->root->offset : 0);
+  _fixup_validation (tree, node);
+  _fixup_total_count (tree, node);
+}
+
+/* Joins the detached subtrees @left and @right with the detached single
+ * @node in between and returns the root of the result. @node is hung
+ * into the spine of the higher subtree where the black heights match,
+ * so only that spine is walked and rebalanced.
+ * @tree->root is used as scratch space for the rotations. */
+static GtkRBNode *
+gtk_rbtree_join (GtkRBTree *tree,
+                 GtkRBNode *left,
+                 GtkRBNode *node,
+                 GtkRBNode *right)
+{
+  GtkRBNode *current, *parent, *replaced;
+  guint left_height, right_height, current_height;
+  gint rows, height, count_diff, total_count_diff, offset_diff;
+
+  rows = GTK_RBNODE_GET_ROWS (node);
+  height = GTK_RBNODE_GET_HEIGHT (node);
+
+  /* Recoloring a root black keeps a tree valid */
+  if (!_gtk_rbtree_is_nil (left))
+    GTK_RBNODE_SET_COLOR (left, GTK_RBNODE_BLACK);
+  if (!_gtk_rbtree_is_nil (right))
+    GTK_RBNODE_SET_COLOR (right, GTK_RBNODE_BLACK);
+
+  left_height = gtk_rbnode_black_height (left);
+  right_height = gtk_rbnode_black_height (right);
+
+  if (left_height == right_height)
+    {
+      node->left = left;
+      node->right = right;
+      node->parent = (GtkRBNode *) &nil;
+      if (!_gtk_rbtree_is_nil (left))
+        left->parent = node;
+      if (!_gtk_rbtree_is_nil (right))
+        right->parent = node;
+      GTK_RBNODE_SET_COLOR (node, GTK_RBNODE_BLACK);
+      gtk_rbnode_update (tree, node, rows, height);
+
+      return node;
+    }
+
+  parent = (GtkRBNode *) &nil;
+  if (left_height > right_height)
+    {
+      current = left;
+      current_height = left_height;
+      while (current_height > right_height ||
+             GTK_RBNODE_GET_COLOR (current) == GTK_RBNODE_RED)
+        {
+          if (GTK_RBNODE_GET_COLOR (current) == GTK_RBNODE_BLACK)
+            current_height--;
+          parent = current;
+          current = current->right;
+        }
+      parent->right = node;
+      node->left = current;
+      node->right = right;
+      replaced = current;
+      tree->root = left;
+    }
+  else
+    {
+      current = right;
+      current_height = right_height;
+      while (current_height > left_height ||
+             GTK_RBNODE_GET_COLOR (current) == GTK_RBNODE_RED)
+        {
+          if (GTK_RBNODE_GET_COLOR (current) == GTK_RBNODE_BLACK)
+            current_height--;
+          parent = current;
+          current = current->left;
+        }
+      parent->left = node;
+      node->left = left;
+      node->right = current;
+      replaced = current;
+      tree->root = right;
+    }
+
+  node->parent = parent;
+  if (!_gtk_rbtree_is_nil (node->left))
+    node->left->parent = node;
+  if (!_gtk_rbtree_is_nil (node->right))
+    node->right->parent = node;
+  GTK_RBNODE_SET_COLOR (node, GTK_RBNODE_RED);
+  gtk_rbnode_update (tree, node, rows, height);
+
+  count_diff = node->count - replaced->count;
+  total_count_diff = node->total_count - replaced->total_count;
+  offset_diff = node->offset - replaced->offset;
+  for (current = parent; !_gtk_rbtree_is_nil (current); current = current->parent)
+    {
+      current->count += count_diff;
+      current->total_count += total_count_diff;
+      current->offset += offset_diff;
+      _fixup_validation (tree, current);
+    }
+
+  _gtk_rbtree_insert_fixup (tree, node);
+
+  return tree->root;
+}
+
+/* Splits the detached subtree @node into its first @count rows and
+ * the rest, both detached again. @count must not end inside a span. */
+static void
+gtk_rbtree_split (GtkRBTree  *tree,
+                  GtkRBNode  *node,
+                  gint        count,
+                  GtkRBNode **left,
+                  GtkRBNode **right)
+{
+  GtkRBNode *node_left, *node_right, *rest;
+  gint rows, height;
+
+  if (_gtk_rbtree_is_nil (node))
+    {
+      *left = node;
+      *right = node;
+      return;
+    }
+
+  rows = GTK_RBNODE_GET_ROWS (node);
+  height = GTK_RBNODE_GET_HEIGHT (node);
+  node_left = node->left;
+  node_right = node->right;
+  if (!_gtk_rbtree_is_nil (node_left))
+    node_left->parent = (GtkRBNode *) &nil;
+  if (!_gtk_rbtree_is_nil (node_right))
+    node_right->parent = (GtkRBNode *) &nil;
+  node->left = (GtkRBNode *) &nil;
+  node->right = (GtkRBNode *) &nil;
+  node->parent = (GtkRBNode *) &nil;
+  gtk_rbnode_update (tree, node, rows, height);
+
+  if (count <= node_left->count)
+    {
+      gtk_rbtree_split (tree, node_left, count, left, &rest);
+      *right = gtk_rbtree_join (tree, rest, node, node_right);
+    }
+  else
+    {
+      gtk_rbtree_split (tree, node_right, count - node_left->count - rows, &rest, right);
+      *left = gtk_rbtree_join (tree, node_left, node, rest);
+    }
+}
+
+/* Inserts @n_nodes nodes of @height after @current, or before the first
+ * node if @current is %NULL. The new nodes are built as a balanced
+ * subtree that is spliced in by splitting the tree at @current and
+ * joining the three parts, which only touches O(log n) old nodes instead
+ * of rebalancing and walking up to the root once per new node.
+ * Returns the first new node or %NULL if @n_nodes is 0. */
+GtkRBNode *
+_gtk_rbtree_insert_many_after (GtkRBTree *tree,
+                               GtkRBNode *current,
+                               guint      n_nodes,
+                               gint       height,
+                               gboolean   valid)
+{
+  GtkRBNode *before, *after, *middle, *first, *last, *node;
+  guint flags;
+  gint count;
+
+  g_return_val_if_fail (tree != NULL, NULL);
+
+  if (n_nodes == 0)
+    return NULL;
+
+  if (_gtk_rbtree_is_nil (tree->root))
+    return _gtk_rbtree_fill (tree, n_nodes, height, valid);
+
+  if (n_nodes == 1)
+    {
+      if (current == NULL)
+        return _gtk_rbtree_insert_before (tree, _gtk_rbtree_peek_first (tree), height, valid);
+      return _gtk_rbtree_insert_after (tree, current, height, valid);
+    }
+
+#ifdef G_ENABLE_DEBUG  
+  if (gtk_get_debug_flags () & GTK_DEBUG_TREE)
+    {
+      g_print ("\n\n_gtk_rbtree_insert_many_after: %p %u\n", current, n_nodes);
+      _gtk_rbtree_debug_spew (tree);
+      _gtk_rbtree_test (G_STRLOC, tree);
+    }
+#endif /* G_ENABLE_DEBUG */
+
+  /* Number of rows in front of the new ones */
+  count = 0;
+  if (current)
+    {
+      count = current->count - current->right->count;
+      for (node = current; !_gtk_rbtree_is_nil (node->parent); node = node->parent)
+        {
+          if (node == node->parent->right)
+            count += node->parent->count - node->parent->right->count;
+        }
+    }
+
+  /* The first and last new node glue the parts together */
+  flags = valid ? 0 : GTK_RBNODE_INVALID | GTK_RBNODE_DESCENDANTS_INVALID;
+  first = _gtk_rbnode_new (tree, height);
+  first->flags |= flags;
+  last = _gtk_rbnode_new (tree, height);
+  last->flags |= flags;
+  if (n_nodes > 2)
+    middle = gtk_rbtree_fill_nodes (n_nodes - 2,
+                                    0,
+                                    g_bit_storage (n_nodes - 2) - 1,
+                                    height,
+                                    flags);
+  else
+    middle = (GtkRBNode *) &nil;
+
+  gtk_rbtree_split (tree, tree->root, count, &before, &after);
+  before = gtk_rbtree_join (tree, before, first, middle);
+  tree->root = gtk_rbtree_join (tree, before, last, after);
+  GTK_RBNODE_SET_COLOR (tree->root, GTK_RBNODE_BLACK);
+
+  gtk_rbnode_adjust (tree->parent_tree, tree->parent_node,
+                     0, n_nodes, n_nodes * height);
+  if (!valid)
+    gtk_rbtree_mark_parents_invalid (tree);
+
+#ifdef G_ENABLE_DEBUG  
+  if (gtk_get_debug_flags () & GTK_DEBUG_TREE)
+    {
+      g_print ("_gtk_rbtree_insert_many_after finished...\n");
+      _gtk_rbtree_debug_spew (tree);
+      g_print ("\n\n");
+      _gtk_rbtree_test (G_STRLOC, tree);
+    }
+#endif /* G_ENABLE_DEBUG */
+
+  return first;
+}
+
 GtkRBNode *
 _gtk_rbtree_insert_before (GtkRBTree *tree,
 			   GtkRBNode *current,
@@ -558,34 +934,175 @@ _gtk_rbtree_insert_before (GtkRBTree *tree,
   return node;
 }
 
+/* Turns the single row @node into a span of @n_rows rows of @height
+ * that have @flags */
+static void
+gtk_rbnode_set_span (GtkRBTree *tree,
+                     GtkRBNode *node,
+                     gint       n_rows,
+                     gint       height,
+                     guint      flags)
+{
+  GTK_RBNODE_SET_FLAG (node, GTK_RBNODE_IS_SPAN | flags);
+
+  /* also brings the validation flags up to date */
+  gtk_rbnode_adjust (tree, node,
+                     n_rows - 1, n_rows - 1, (n_rows - 1) * height);
+}
+
+/* Inserts a span of @n_rows rows of @height after @current, or before
+ * the first node if @current is %NULL. The rows get nodes of their own
+ * only once a lookup reaches them, see gtk_rbtree_materialize(), which
+ * keeps attaching a huge model cheap.
+ * Returns the span or %NULL if @n_rows is 0. */
 GtkRBNode *
-_gtk_rbtree_find_count (GtkRBTree *tree,
-			gint       count)
+_gtk_rbtree_insert_span_after (GtkRBTree *tree,
+                               GtkRBNode *current,
+                               guint      n_rows,
+                               gint       height,
+                               gboolean   valid)
+{
+  GtkRBNode *node;
+
+  g_return_val_if_fail (tree != NULL, NULL);
+
+  if (n_rows == 0)
+    return NULL;
+
+  if (current == NULL)
+    node = _gtk_rbtree_insert_before (tree, _gtk_rbtree_peek_first (tree), height, TRUE);
+  else
+    node = _gtk_rbtree_insert_after (tree, current, height, TRUE);
+
+  gtk_rbnode_set_span (tree, node, n_rows, height,
+                       valid ? 0 : GTK_RBNODE_INVALID);
+
+#ifdef G_ENABLE_DEBUG  
+  if (gtk_get_debug_flags () & GTK_DEBUG_TREE)
+    _gtk_rbtree_test (G_STRLOC, tree);
+#endif /* G_ENABLE_DEBUG */
+
+  return node;
+}
+
+/* Sets the function that gets called for every row that gets a node of
+ * its own. @tree must be a toplevel tree, the function is used for all
+ * of its children, too. */
+void
+_gtk_rbtree_set_materialize_func (GtkRBTree                *tree,
+                                  GtkRBTreeMaterializeFunc  func,
+                                  gpointer                  data)
+{
+  g_return_if_fail (tree != NULL);
+  g_return_if_fail (tree->parent_tree == NULL);
+
+  tree->materialize_func = func;
+  tree->materialize_data = data;
+}
+
+/* Gives row @row of the span @node a node of its own and returns it. The
+ * rows in front of and behind it stay in spans of their own. */
+static GtkRBNode *
+gtk_rbtree_materialize (GtkRBTree *tree,
+                        GtkRBNode *node,
+                        gint       row)
+{
+  GtkRBTree *toplevel;
+  GtkRBNode *span;
+  guint flags;
+  gint rows, height;
+
+  rows = GTK_RBNODE_GET_ROWS (node);
+  height = GTK_RBNODE_GET_HEIGHT (node) / rows;
+  flags = node->flags & (GTK_RBNODE_IS_SELECTED |
+                         GTK_RBNODE_INVALID |
+                         GTK_RBNODE_COLUMN_INVALID);
+
+  /* The span itself becomes the row */
+  GTK_RBNODE_UNSET_FLAG (node, GTK_RBNODE_IS_SPAN);
+  if (rows > 1)
+    gtk_rbnode_adjust (tree, node, 1 - rows, 1 - rows, (1 - rows) * height);
+
+  if (row > 0)
+    {
+      span = _gtk_rbtree_insert_before (tree, node, height, TRUE);
+      gtk_rbnode_set_span (tree, span, row, height, flags);
+    }
+  if (row < rows - 1)
+    {
+      span = _gtk_rbtree_insert_after (tree, node, height, TRUE);
+      gtk_rbnode_set_span (tree, span, rows - row - 1, height, flags);
+    }
+
+  for (toplevel = tree; toplevel->parent_tree; toplevel = toplevel->parent_tree)
+    ;
+  if (toplevel->materialize_func)
+    toplevel->materialize_func (tree, node, toplevel->materialize_data);
+
+  return node;
+}
+
+/* Finds the node holding row @count, and in *@row the index of that row
+ * in the node, which is only ever not 0 for a span. */
+static GtkRBNode *
+gtk_rbtree_find_row (GtkRBTree *tree,
+                     gint       count,
+                     gint      *row)
 {
   GtkRBNode *node;
 
   node = tree->root;
-  while (!_gtk_rbtree_is_nil (node) && (node->left->count + 1 != count))
+  while (!_gtk_rbtree_is_nil (node))
     {
       if (node->left->count >= count)
 	node = node->left;
+      else if (node->count - node->right->count >= count)
+        break;
       else
 	{
-	  count -= (node->left->count + 1);
+	  count -= node->count - node->right->count;
 	  node = node->right;
 	}
     }
   if (_gtk_rbtree_is_nil (node))
     return NULL;
+
+  *row = count - node->left->count - 1;
   return node;
 }
 
+GtkRBNode *
+_gtk_rbtree_find_count (GtkRBTree *tree,
+			gint       count)
+{
+  GtkRBNode *node;
+  gint row;
+
+  node = gtk_rbtree_find_row (tree, count, &row);
+  if (node && GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
+    node = gtk_rbtree_materialize (tree, node, row);
+
+  return node;
+}
+
+/* Like _gtk_rbtree_find_count(), but returns the span holding the row
+ * instead of giving the row a node of its own. */
+GtkRBNode *
+_gtk_rbtree_peek_count (GtkRBTree *tree,
+                        gint       count)
+{
+  gint row;
+
+  return gtk_rbtree_find_row (tree, count, &row);
+}
+
+/* For a span, @height is the height of each of its rows */
 void
 _gtk_rbtree_node_set_height (GtkRBTree *tree,
 			     GtkRBNode *node,
 			     gint       height)
 {
-  gint diff = height - GTK_RBNODE_GET_HEIGHT (node);
+  gint diff = height * GTK_RBNODE_GET_ROWS (node) - GTK_RBNODE_GET_HEIGHT (node);
 
   if (diff == 0)
     return;
@@ -705,7 +1222,7 @@ _gtk_rbtree_column_invalid (GtkRBTree *tree)
   if (tree == NULL)
     return;
 
-  node = _gtk_rbtree_first (tree);
+  node = _gtk_rbtree_peek_first (tree);
 
   do
     {
@@ -716,7 +1233,7 @@ _gtk_rbtree_column_invalid (GtkRBTree *tree)
       if (node->children)
 	_gtk_rbtree_column_invalid (node->children);
     }
-  while ((node = _gtk_rbtree_next (tree, node)) != NULL);
+  while ((node = _gtk_rbtree_peek_next (tree, node)) != NULL);
 }
 
 void
@@ -727,7 +1244,7 @@ _gtk_rbtree_mark_invalid (GtkRBTree *tree)
   if (tree == NULL)
     return;
 
-  node = _gtk_rbtree_first (tree);
+  node = _gtk_rbtree_peek_first (tree);
 
   do
     {
@@ -737,7 +1254,7 @@ _gtk_rbtree_mark_invalid (GtkRBTree *tree)
       if (node->children)
 	_gtk_rbtree_mark_invalid (node->children);
     }
-  while ((node = _gtk_rbtree_next (tree, node)) != NULL);
+  while ((node = _gtk_rbtree_peek_next (tree, node)) != NULL);
 }
 
 void
@@ -750,7 +1267,7 @@ _gtk_rbtree_set_fixed_height (GtkRBTree *tree,
   if (tree == NULL)
     return;
 
-  node = _gtk_rbtree_first (tree);
+  node = _gtk_rbtree_peek_first (tree);
 
   do
     {
@@ -764,7 +1281,7 @@ _gtk_rbtree_set_fixed_height (GtkRBTree *tree,
       if (node->children)
 	_gtk_rbtree_set_fixed_height (node->children, height, mark_valid);
     }
-  while ((node = _gtk_rbtree_next (tree, node)) != NULL);
+  while ((node = _gtk_rbtree_peek_next (tree, node)) != NULL);
 }
 
 static void
@@ -773,111 +1290,125 @@ reorder_prepare (GtkRBTree *tree,
                  gpointer   data)
 {
   node->offset -= node->left->offset + node->right->offset;
+  node->count -= node->left->count + node->right->count;
   GTK_RBNODE_UNSET_FLAG (node, GTK_RBNODE_DESCENDANTS_INVALID);
 }
 
-static void
-reorder_fixup (GtkRBTree *tree,
-               GtkRBNode *node,
-               gpointer   data)
+/* Like gtk_rbtree_fill_nodes(), but builds the tree out of existing
+ * @nodes. Their count and offset only hold their own rows and height,
+ * including their children, see reorder_prepare(). */
+static GtkRBNode *
+reorder_build_nodes (GtkRBTree  *tree,
+                     GtkRBNode **nodes,
+                     guint       n_nodes,
+                     guint       depth,
+                     guint       red_depth)
 {
-  node->offset += node->left->offset + node->right->offset;
-  node->count = 1 + node->left->count + node->right->count;
-  _fixup_validation (tree, node);
-  _fixup_total_count (tree, node);
-}
+  GtkRBNode *node;
+  guint n_left;
 
-static void
-reorder_copy_node (GtkRBTree *tree,
-                   GtkRBNode *to,
-                   GtkRBNode *from)
-{
-  to->flags = (to->flags & GTK_RBNODE_NON_COLORS) | GTK_RBNODE_GET_COLOR (from);
+  if (n_nodes == 0)
+    return (GtkRBNode *) &nil;
 
-  to->left = from->left;
-  if (!_gtk_rbtree_is_nil (to->left))
-    to->left->parent = to;
+  n_left = (n_nodes - 1) / 2;
 
-  to->right = from->right;
-  if (!_gtk_rbtree_is_nil (to->right))
-    to->right->parent = to;
+  node = nodes[n_left];
+  node->left = reorder_build_nodes (tree, nodes, n_left, depth + 1, red_depth);
+  node->right = reorder_build_nodes (tree, nodes + n_left + 1, n_nodes - 1 - n_left, depth + 1, red_depth);
+  if (!_gtk_rbtree_is_nil (node->left))
+    node->left->parent = node;
+  if (!_gtk_rbtree_is_nil (node->right))
+    node->right->parent = node;
+
+  node->flags = (node->flags & ~(GTK_RBNODE_RED | GTK_RBNODE_BLACK))
+                | (depth == red_depth ? GTK_RBNODE_RED : GTK_RBNODE_BLACK);
+  node->count += node->left->count + node->right->count;
+  node->offset += node->left->offset + node->right->offset;
+  _fixup_validation (tree, node);
+  _fixup_total_count (tree, node);
 
-  to->parent = from->parent;
-  if (_gtk_rbtree_is_nil (to->parent))
-    tree->root = to;
-  else if (to->parent->left == from)
-    to->parent->left = to;
-  else if (to->parent->right == from)
-    to->parent->right = to;
+  return node;
 }
 
 /* It basically pulls everything out of the tree, rearranges it, and puts it
- * back together.  Our strategy is to keep the old RBTree intact, and just
- * rearrange the contents.  When that is done, we go through and update the
- * heights.  There is probably a more elegant way to write this function.  If
- * anyone wants to spend the time writing it, patches will be accepted.
+ * back together.  The rows of spans are scattered, so spans are replaced
+ * by new ones made of the rows that end up next to each other.  Their
+ * rows don't get nodes of their own.
  */
 void
 _gtk_rbtree_reorder (GtkRBTree *tree,
 		     gint      *new_order,
 		     gint       length)
 {
-  GtkRBNode **nodes;
-  GtkRBNode *node;
+  GtkRBNode **rows, **nodes;
+  GtkRBNode *node, *span;
+  guint n_nodes;
   gint i, j;
   
   g_return_if_fail (tree != NULL);
   g_return_if_fail (length > 0);
   g_return_if_fail (tree->root->count == length);
   
-  nodes = g_new (GtkRBNode *, length);
-
-  _gtk_rbtree_traverse (tree, tree->root, G_PRE_ORDER, reorder_prepare, NULL);
-
-  for (node = _gtk_rbtree_first (tree), i = 0;
+  /* the node of every row */
+  rows = g_new (GtkRBNode *, length);
+  for (node = _gtk_rbtree_peek_first (tree), i = 0;
        node;
-       node = _gtk_rbtree_next (tree, node), i++)
+       node = _gtk_rbtree_peek_next (tree, node))
     {
-      nodes[i] = node;
+      for (j = GTK_RBNODE_GET_ROWS (node); j > 0; j--)
+        rows[i++] = node;
     }
 
+  _gtk_rbtree_traverse (tree, tree->root, G_PRE_ORDER, reorder_prepare, NULL);
+
+  nodes = g_new (GtkRBNode *, length);
+  n_nodes = 0;
+  span = NULL;
   for (i = 0; i < length; i++)
     {
-      GtkRBNode tmp = { 0, };
-      GSList *l, *cycle = NULL;
-
-      tmp.offset = -1;
+      node = rows[new_order[i]];
 
-      /* already swapped */
-      if (nodes[i] == NULL)
-        continue;
-      /* no need to swap */
-      if (new_order[i] == i)
-        continue;
-
-      /* make a list out of the pending nodes */
-      for (j = i; new_order[j] != i; j = new_order[j])
+      if (!GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
         {
-          cycle = g_slist_prepend (cycle, nodes[j]);
-          nodes[j] = NULL;
+          nodes[n_nodes++] = node;
+          span = NULL;
+          continue;
         }
 
-      node = nodes[j];
-      reorder_copy_node (tree, &tmp, node);
-      for (l = cycle; l; l = l->next)
+      /* rows of spans that end up next to each other share one */
+      if (span == NULL ||
+          (span->flags & GTK_RBNODE_NON_COLORS) != (node->flags & GTK_RBNODE_NON_COLORS) ||
+          span->offset / span->count != node->offset / node->count)
         {
-          reorder_copy_node (tree, node, l->data);
-          node = l->data;
+          span = _gtk_rbnode_new (tree, 0);
+          span->flags = GTK_RBNODE_BLACK | (node->flags & GTK_RBNODE_NON_COLORS);
+          span->count = 0;
+          span->total_count = 0;
+          nodes[n_nodes++] = span;
         }
+      span->count++;
+      span->offset += node->offset / node->count;
+    }
 
-      reorder_copy_node (tree, node, &tmp);
-      nodes[j] = NULL;
-      g_slist_free (cycle);
+  for (i = 0; i < length; i++)
+    {
+      if ((i == 0 || rows[i - 1] != rows[i]) &&
+          GTK_RBNODE_FLAG_SET (rows[i], GTK_RBNODE_IS_SPAN))
+        _gtk_rbnode_free (rows[i]);
     }
 
-  _gtk_rbtree_traverse (tree, tree->root, G_POST_ORDER, reorder_fixup, NULL);
+  tree->root = reorder_build_nodes (tree, nodes, n_nodes,
+                                    0, g_bit_storage (n_nodes) - 1);
+  tree->root->parent = (GtkRBNode *) &nil;
+  GTK_RBNODE_SET_COLOR (tree->root, GTK_RBNODE_BLACK);
 
   g_free (nodes);
+  g_free (rows);
+
+#ifdef G_ENABLE_DEBUG  
+  if (gtk_get_debug_flags () & GTK_DEBUG_TREE)
+    _gtk_rbtree_test (G_STRLOC, tree);
+#endif /* G_ENABLE_DEBUG */
 }
 
 /**
@@ -1032,9 +1563,19 @@ gtk_rbtree_real_find_offset (GtkRBTree  *tree,
 					  new_tree,
 					  new_node);
     }
+  height -= tmp_node->left->offset;
+  if (GTK_RBNODE_FLAG_SET (tmp_node, GTK_RBNODE_IS_SPAN))
+    {
+      gint rows = GTK_RBNODE_GET_ROWS (tmp_node);
+      gint row_height = GTK_RBNODE_GET_HEIGHT (tmp_node) / rows;
+      gint row = row_height > 0 ? MIN (height / row_height, rows - 1) : 0;
+
+      tmp_node = gtk_rbtree_materialize (tree, tmp_node, row);
+      height -= row * row_height;
+    }
   *new_tree = tree;
   *new_node = tmp_node;
-  return (height - tmp_node->left->offset);
+  return height;
 }
 
 gint
@@ -1091,6 +1632,12 @@ _gtk_rbtree_find_index (GtkRBTree  *tree,
       return FALSE;
     }
 
+  if (GTK_RBNODE_FLAG_SET (tmp_node, GTK_RBNODE_IS_SPAN))
+    {
+      tmp_node = gtk_rbtree_materialize (tree, tmp_node, index);
+      index = 0;
+    }
+
   if (index > 0)
     {
       g_assert (tmp_node->children);
@@ -1111,7 +1658,7 @@ _gtk_rbtree_remove_node (GtkRBTree *tree,
 			 GtkRBNode *node)
 {
   GtkRBNode *x, *y;
-  gint y_height;
+  gint y_rows, y_height;
   guint y_total_count;
   
   g_return_if_fail (tree != NULL);
@@ -1150,9 +1697,10 @@ _gtk_rbtree_remove_node (GtkRBTree *tree,
 	y = y->left;
     }
 
+  y_rows = GTK_RBNODE_GET_ROWS (y);
   y_height = GTK_RBNODE_GET_HEIGHT (y) 
              + (y->children ? y->children->root->offset : 0);
-  y_total_count = 1 + (y->children ? y->children->root->total_count : 0);
+  y_total_count = y_rows + (y->children ? y->children->root->total_count : 0);
 
   /* x is y's only child, or nil */
   if (!_gtk_rbtree_is_nil (y->left))
@@ -1177,21 +1725,22 @@ _gtk_rbtree_remove_node (GtkRBTree *tree,
 
   /* We need to clean up the validity of the tree.
    */
-  gtk_rbnode_adjust (tree, y, -1, - y_total_count, - y_height);
+  gtk_rbnode_adjust (tree, y, - y_rows, - y_total_count, - y_height);
 
   if (GTK_RBNODE_GET_COLOR (y) == GTK_RBNODE_BLACK)
     _gtk_rbtree_remove_node_fixup (tree, x, y->parent);
 
   if (y != node)
     {
-      gint node_height, node_total_count;
+      gint node_rows, node_height, node_total_count;
 
       /* We want to see how much we remove from the aggregate values.
        * This is all the children we remove plus the node's values.
        */
+      node_rows = GTK_RBNODE_GET_ROWS (node);
       node_height = GTK_RBNODE_GET_HEIGHT (node)
                     + (node->children ? node->children->root->offset : 0);
-      node_total_count = 1
+      node_total_count = node_rows
                          + (node->children ? node->children->root->total_count : 0);
 
       /* Move the node over */
@@ -1221,7 +1770,7 @@ _gtk_rbtree_remove_node (GtkRBTree *tree,
       y->offset = node->offset;
 
       gtk_rbnode_adjust (tree, y, 
-                         0,
+                         y_rows - node_rows,
                          y_total_count - node_total_count,
                          y_height - node_height);
     }
@@ -1240,7 +1789,7 @@ _gtk_rbtree_remove_node (GtkRBTree *tree,
 }
 
 GtkRBNode *
-_gtk_rbtree_first (GtkRBTree *tree)
+_gtk_rbtree_peek_first (GtkRBTree *tree)
 {
   GtkRBNode *node;
 
@@ -1256,8 +1805,41 @@ _gtk_rbtree_first (GtkRBTree *tree)
 }
 
 GtkRBNode *
-_gtk_rbtree_next (GtkRBTree *tree,
-		  GtkRBNode *node)
+_gtk_rbtree_first (GtkRBTree *tree)
+{
+  GtkRBNode *node;
+
+  node = _gtk_rbtree_peek_first (tree);
+  if (node && GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
+    node = gtk_rbtree_materialize (tree, node, 0);
+
+  return node;
+}
+
+static GtkRBNode *
+gtk_rbtree_last (GtkRBTree *tree)
+{
+  GtkRBNode *node;
+
+  node = tree->root;
+
+  if (_gtk_rbtree_is_nil (node))
+    return NULL;
+
+  while (!_gtk_rbtree_is_nil (node->right))
+    node = node->right;
+
+  if (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
+    node = gtk_rbtree_materialize (tree, node, GTK_RBNODE_GET_ROWS (node) - 1);
+
+  return node;
+}
+
+/* Like _gtk_rbtree_next(), but returns a following span as it is
+ * instead of giving its first row a node of its own. */
+GtkRBNode *
+_gtk_rbtree_peek_next (GtkRBTree *tree,
+                       GtkRBNode *node)
 {
   g_return_val_if_fail (tree != NULL, NULL);
   g_return_val_if_fail (node != NULL, NULL);
@@ -1285,8 +1867,19 @@ _gtk_rbtree_next (GtkRBTree *tree,
 }
 
 GtkRBNode *
-_gtk_rbtree_prev (GtkRBTree *tree,
+_gtk_rbtree_next (GtkRBTree *tree,
 		  GtkRBNode *node)
+{
+  node = _gtk_rbtree_peek_next (tree, node);
+  if (node && GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
+    node = gtk_rbtree_materialize (tree, node, 0);
+
+  return node;
+}
+
+static GtkRBNode *
+gtk_rbtree_peek_prev (GtkRBTree *tree,
+                      GtkRBNode *node)
 {
   g_return_val_if_fail (tree != NULL, NULL);
   g_return_val_if_fail (node != NULL, NULL);
@@ -1313,6 +1906,17 @@ _gtk_rbtree_prev (GtkRBTree *tree,
   return NULL;
 }
 
+GtkRBNode *
+_gtk_rbtree_prev (GtkRBTree *tree,
+		  GtkRBNode *node)
+{
+  node = gtk_rbtree_peek_prev (tree, node);
+  if (node && GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
+    node = gtk_rbtree_materialize (tree, node, GTK_RBNODE_GET_ROWS (node) - 1);
+
+  return node;
+}
+
 void
 _gtk_rbtree_next_full (GtkRBTree  *tree,
 		       GtkRBNode  *node,
@@ -1327,9 +1931,7 @@ _gtk_rbtree_next_full (GtkRBTree  *tree,
   if (node->children)
     {
       *new_tree = node->children;
-      *new_node = (*new_tree)->root;
-      while (!_gtk_rbtree_is_nil ((*new_node)->left))
-	*new_node = (*new_node)->left;
+      *new_node = _gtk_rbtree_first (*new_tree);
       return;
     }
 
@@ -1370,9 +1972,7 @@ _gtk_rbtree_prev_full (GtkRBTree  *tree,
       while ((*new_node)->children)
 	{
 	  *new_tree = (*new_node)->children;
-	  *new_node = (*new_tree)->root;
-          while (!_gtk_rbtree_is_nil ((*new_node)->right))
-	    *new_node = (*new_node)->right;
+	  *new_node = gtk_rbtree_last (*new_tree);
 	}
     }
 }
@@ -1471,12 +2071,29 @@ static inline
 void _fixup_total_count (GtkRBTree *tree,
 		    GtkRBNode *node)
 {
-  node->total_count = 1 +
+  node->total_count = GTK_RBNODE_GET_ROWS (node) +
     (node->children != NULL ? node->children->root->total_count : 0) + 
     node->left->total_count + node->right->total_count;
 }
 
 #ifdef G_ENABLE_DEBUG
+/* Own rows of @node, checking that spans are sane */
+static guint
+get_rows (GtkRBNode *node)
+{
+  if (!GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
+    return 1;
+
+  if (node->children)
+    g_error ("Span has children");
+  if (GTK_RBNODE_GET_ROWS (node) < 1)
+    g_error ("Span has %d rows", GTK_RBNODE_GET_ROWS (node));
+  if (GTK_RBNODE_GET_HEIGHT (node) % GTK_RBNODE_GET_ROWS (node) != 0)
+    g_error ("Span has rows of different heights");
+
+  return GTK_RBNODE_GET_ROWS (node);
+}
+
 static guint
 get_total_count (GtkRBNode *node)
 {
@@ -1488,7 +2105,7 @@ get_total_count (GtkRBNode *node)
   if (node->children)
     child_total += (guint) node->children->root->total_count;
 
-  return child_total + 1;
+  return child_total + get_rows (node);
 }
 
 static guint
@@ -1503,7 +2120,7 @@ count_total (GtkRBTree *tree,
   res =
     count_total (tree, node->left) +
     count_total (tree, node->right) +
-    (guint)1 +
+    get_rows (node) +
     (node->children ? count_total (node->children, node->children->root) : 0);
 
   if (res != node->total_count)
@@ -1527,7 +2144,7 @@ _count_nodes (GtkRBTree *tree,
   g_assert (node->right);
 
   res = (_count_nodes (tree, node->left) +
-         _count_nodes (tree, node->right) + 1);
+         _count_nodes (tree, node->right) + get_rows (node));
 
   if (res != node->count)
     g_print ("Tree failed\n");
@@ -1660,7 +2277,7 @@ _gtk_rbtree_test (const gchar *where,
   _gtk_rbtree_test_structure (tmp_tree);
 
   g_assert ((_count_nodes (tmp_tree, tmp_tree->root->left) +
-	     _count_nodes (tmp_tree, tmp_tree->root->right) + 1) == tmp_tree->root->count);
+	     _count_nodes (tmp_tree, tmp_tree->root->right) + get_rows (tmp_tree->root)) == tmp_tree->root->count);
       
       
   _gtk_rbtree_test_height (tmp_tree, tmp_tree->root);
@@ -38,12 +38,14 @@ typedef enum
   GTK_RBNODE_INVALID = 1 << 7,
   GTK_RBNODE_COLUMN_INVALID = 1 << 8,
   GTK_RBNODE_DESCENDANTS_INVALID = 1 << 9,
+  GTK_RBNODE_IS_SPAN = 1 << 10,
   GTK_RBNODE_NON_COLORS = GTK_RBNODE_IS_PARENT |
   			  GTK_RBNODE_IS_SELECTED |
   			  GTK_RBNODE_IS_PRELIT |
                           GTK_RBNODE_INVALID |
                           GTK_RBNODE_COLUMN_INVALID |
-                          GTK_RBNODE_DESCENDANTS_INVALID
+                          GTK_RBNODE_DESCENDANTS_INVALID |
+                          GTK_RBNODE_IS_SPAN
 } GtkRBNodeColor;
 
 typedef struct _GtkRBTree GtkRBTree;
@@ -53,12 +55,19 @@ typedef struct _GtkRBTreeView GtkRBTreeView;
 typedef void (*GtkRBTreeTraverseFunc) (GtkRBTree  *tree,
                                        GtkRBNode  *node,
                                        gpointer  data);
+typedef void (*GtkRBTreeMaterializeFunc) (GtkRBTree  *tree,
+                                          GtkRBNode  *node,
+                                          gpointer  data);
 
 struct _GtkRBTree
 {
   GtkRBNode *root;
   GtkRBTree *parent_tree;
   GtkRBNode *parent_node;
+
+  /* Only set on the toplevel tree */
+  GtkRBTreeMaterializeFunc materialize_func;
+  gpointer materialize_data;
 };
 
 struct _GtkRBNode
@@ -69,11 +78,14 @@ struct _GtkRBNode
   GtkRBNode *right;
   GtkRBNode *parent;
 
-  /* count is the number of nodes beneath us, plus 1 for ourselves.
-   * i.e. node->left->count + node->right->count + 1
+  /* count is the number of rows beneath us, plus our own rows.
+   * i.e. node->left->count + node->right->count + 1, unless we are a
+   * span (GTK_RBNODE_IS_SPAN).  A span stands for rows that don't have
+   * nodes of their own yet.  They share its flags, all have the same
+   * height and never have children.
    */
   gint count;
-  /* count the number of total nodes beneath us, including nodes
+  /* count the number of total rows beneath us, including rows
    * of children trees.
    * i.e. node->left->count + node->right->count + node->children->root->count + 1
    */
@@ -94,6 +106,7 @@ struct _GtkRBNode
 #define GTK_RBNODE_GET_COLOR(node)		(node?(((node->flags&GTK_RBNODE_RED)==GTK_RBNODE_RED)?GTK_RBNODE_RED:GTK_RBNODE_BLACK):GTK_RBNODE_BLACK)
 #define GTK_RBNODE_SET_COLOR(node,color) 	if((node->flags&color)!=color)node->flags=node->flags^(GTK_RBNODE_RED|GTK_RBNODE_BLACK)
 #define GTK_RBNODE_GET_HEIGHT(node) 		(node->offset-(node->left->offset+node->right->offset+(node->children?node->children->root->offset:0)))
+#define GTK_RBNODE_GET_ROWS(node) 		(node->count-(node->left->count+node->right->count))
 #define GTK_RBNODE_SET_FLAG(node, flag)   	G_STMT_START{ (node->flags|=flag); }G_STMT_END
 #define GTK_RBNODE_UNSET_FLAG(node, flag) 	G_STMT_START{ (node->flags&=~(flag)); }G_STMT_END
 #define GTK_RBNODE_FLAG_SET(node, flag) 	(node?(((node->flags&flag)==flag)?TRUE:FALSE):FALSE)
@@ -111,6 +124,23 @@ GtkRBNode *_gtk_rbtree_insert_after     (GtkRBTree              *tree,
 					 GtkRBNode              *node,
 					 gint                    height,
 					 gboolean                valid);
+GtkRBNode *_gtk_rbtree_fill             (GtkRBTree              *tree,
+					 guint                   n_nodes,
+					 gint                    height,
+					 gboolean                valid);
+GtkRBNode *_gtk_rbtree_insert_many_after(GtkRBTree              *tree,
+					 GtkRBNode              *node,
+					 guint                   n_nodes,
+					 gint                    height,
+					 gboolean                valid);
+GtkRBNode *_gtk_rbtree_insert_span_after(GtkRBTree              *tree,
+					 GtkRBNode              *node,
+					 guint                   n_rows,
+					 gint                    height,
+					 gboolean                valid);
+void       _gtk_rbtree_set_materialize_func (GtkRBTree          *tree,
+					 GtkRBTreeMaterializeFunc func,
+					 gpointer                data);
 void       _gtk_rbtree_remove_node      (GtkRBTree              *tree,
 					 GtkRBNode              *node);
 gboolean   _gtk_rbtree_is_nil           (GtkRBNode              *node);
@@ -121,6 +151,8 @@ gboolean   _gtk_rbtree_contains         (GtkRBTree              *tree,
                                          GtkRBTree              *potential_child);
 GtkRBNode *_gtk_rbtree_find_count       (GtkRBTree              *tree,
 					 gint                    count);
+GtkRBNode *_gtk_rbtree_peek_count       (GtkRBTree              *tree,
+					 gint                    count);
 void       _gtk_rbtree_node_set_height  (GtkRBTree              *tree,
 					 GtkRBNode              *node,
 					 gint                    height);
@@ -155,6 +187,9 @@ GtkRBNode *_gtk_rbtree_next             (GtkRBTree              *tree,
 					 GtkRBNode              *node);
 GtkRBNode *_gtk_rbtree_prev             (GtkRBTree              *tree,
 					 GtkRBNode              *node);
+GtkRBNode *_gtk_rbtree_peek_first       (GtkRBTree              *tree);
+GtkRBNode *_gtk_rbtree_peek_next        (GtkRBTree              *tree,
+					 GtkRBNode              *node);
 void       _gtk_rbtree_next_full        (GtkRBTree              *tree,
 					 GtkRBNode              *node,
 					 GtkRBTree             **new_tree,
@@ -1580,6 +1580,12 @@ gtk_settings_style_provider_get_change (GtkStyleProviderPrivate *provider,
   return 0;
 }
 
+static GtkBitmask *
+gtk_settings_style_provider_get_state_properties (GtkStyleProviderPrivate *provider,
+                                                  const GtkCssMatcher     *matcher)
+{
+  return _gtk_bitmask_new ();
+}
 
 static GtkSettings *
 gtk_settings_style_provider_get_settings (GtkStyleProviderPrivate *provider)
@@ -1606,6 +1612,7 @@ gtk_settings_provider_private_init (GtkStyleProviderPrivateInterface *iface)
   iface->lookup = gtk_settings_style_provider_lookup;
   iface->get_settings = gtk_settings_style_provider_get_settings;
   iface->get_change = gtk_settings_style_provider_get_change;
+  iface->get_state_properties = gtk_settings_style_provider_get_state_properties;
 }
 
 static void
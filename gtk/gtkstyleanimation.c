@@ -44,9 +44,23 @@ gtk_style_animation_real_is_static (GtkStyleAnimation *animation,
   return FALSE;
 }
 
+static void
+gtk_style_animation_finalize (GObject *object)
+{
+  GtkStyleAnimation *animation = GTK_STYLE_ANIMATION (object);
+
+  _gtk_bitmask_free (animation->properties);
+
+  G_OBJECT_CLASS (_gtk_style_animation_parent_class)->finalize (object);
+}
+
 static void
 _gtk_style_animation_class_init (GtkStyleAnimationClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gtk_style_animation_finalize;
+
   klass->set_values = gtk_style_animation_real_set_values;
   klass->is_finished = gtk_style_animation_real_is_finished;
   klass->is_static = gtk_style_animation_real_is_static;
@@ -55,6 +69,7 @@ _gtk_style_animation_class_init (GtkStyleAnimationClass *klass)
 static void
 _gtk_style_animation_init (GtkStyleAnimation *animation)
 {
+  animation->properties = _gtk_bitmask_new ();
 }
 
 void
@@ -108,3 +123,21 @@ _gtk_style_animation_is_static (GtkStyleAnimation *animation,
 
   return klass->is_static (animation, at_time_us);
 }
+
+/**
+ * _gtk_style_animation_get_properties:
+ * @animation: The animation to query
+ *
+ * Gets the properties that @animation sets in
+ * _gtk_style_animation_set_values(). Subclasses fill this in when
+ * they are created and it doesn't change afterwards.
+ *
+ * Returns: the properties animated by @animation
+ **/
+const GtkBitmask *
+_gtk_style_animation_get_properties (GtkStyleAnimation *animation)
+{
+  g_return_val_if_fail (GTK_IS_STYLE_ANIMATION (animation), NULL);
+
+  return animation->properties;
+}
@@ -38,6 +38,8 @@ typedef struct _GtkStyleAnimationClass      GtkStyleAnimationClass;
 struct _GtkStyleAnimation
 {
   GObject parent;
+
+  GtkBitmask   *properties;             /* the properties that set_values() may set */
 };
 
 struct _GtkStyleAnimationClass
@@ -62,6 +64,8 @@ gboolean        _gtk_style_animation_is_finished        (GtkStyleAnimation
                                                          gint64                  at_time_us);
 gboolean        _gtk_style_animation_is_static          (GtkStyleAnimation      *animation,
                                                          gint64                  at_time_us);
+const GtkBitmask *
+                _gtk_style_animation_get_properties     (GtkStyleAnimation      *animation);
 
 
 G_END_DECLS
@@ -19,6 +19,7 @@
 
 #include "gtkstylecascadeprivate.h"
 
+#include "gtkcssstylepropertyprivate.h"
 #include "gtkstyleprovider.h"
 #include "gtkstyleproviderprivate.h"
 
@@ -273,6 +274,40 @@ gtk_style_cascade_get_change (GtkStyleProviderPrivate *provider,
   return change;
 }
 
+static GtkBitmask *
+gtk_style_cascade_get_state_properties (GtkStyleProviderPrivate *provider,
+                                        const GtkCssMatcher     *matcher)
+{
+  GtkStyleCascade *cascade = GTK_STYLE_CASCADE (provider);
+  GtkStyleCascadeIter iter;
+  GtkStyleProvider *item;
+  GtkBitmask *properties, *item_properties;
+
+  properties = _gtk_bitmask_new ();
+
+  for (item = gtk_style_cascade_iter_init (cascade, &iter);
+       item;
+       item = gtk_style_cascade_iter_next (cascade, &iter))
+    {
+      if (GTK_IS_STYLE_PROVIDER_PRIVATE (item))
+        {
+          item_properties = _gtk_style_provider_private_get_state_properties (GTK_STYLE_PROVIDER_PRIVATE (item),
+                                                                              matcher);
+          properties = _gtk_bitmask_union (properties, item_properties);
+          _gtk_bitmask_free (item_properties);
+        }
+      else
+        {
+          _gtk_bitmask_free (properties);
+          properties = _gtk_bitmask_new ();
+          properties = _gtk_bitmask_invert_range (properties, 0, _gtk_css_style_property_get_n_properties ());
+          g_return_val_if_reached (properties);
+        }
+    }
+
+  return properties;
+}
+
 static void
 gtk_style_cascade_provider_private_iface_init (GtkStyleProviderPrivateInterface *iface)
 {
@@ -281,6 +316,7 @@ gtk_style_cascade_provider_private_iface_init (GtkStyleProviderPrivateInterface
   iface->get_keyframes = gtk_style_cascade_get_keyframes;
   iface->lookup = gtk_style_cascade_lookup;
   iface->get_change = gtk_style_cascade_get_change;
+  iface->get_state_properties = gtk_style_cascade_get_state_properties;
 }
 
 G_DEFINE_TYPE_EXTENDED (GtkStyleCascade, _gtk_style_cascade, G_TYPE_OBJECT, 0,
@@ -297,6 +333,12 @@ gtk_style_cascade_dispose (GObject *object)
   _gtk_style_cascade_set_parent (cascade, NULL);
   g_array_unref (cascade->providers);
 
+  if (cascade->style_cache)
+    {
+      _gtk_css_style_cache_free (cascade->style_cache);
+      cascade->style_cache = NULL;
+    }
+
   G_OBJECT_CLASS (_gtk_style_cascade_parent_class)->dispose (object);
 }
 
@@ -317,11 +359,25 @@ style_provider_data_clear (gpointer data_)
   g_object_unref (data->provider);
 }
 
+static void
+gtk_style_cascade_clear_style_cache (GtkStyleCascade *cascade)
+{
+  if (cascade->style_cache)
+    _gtk_css_style_cache_clear (cascade->style_cache);
+}
+
 static void
 _gtk_style_cascade_init (GtkStyleCascade *cascade)
 {
   cascade->providers = g_array_new (FALSE, FALSE, sizeof (GtkStyleProviderData));
   g_array_set_clear_func (cascade->providers, style_provider_data_clear);
+
+  /* Connected first, so the cache is cleared before any style context
+   * gets to recompute its style */
+  g_signal_connect (cascade,
+                    "-gtk-private-changed",
+                    G_CALLBACK (gtk_style_cascade_clear_style_cache),
+                    NULL);
 }
 
 GtkStyleCascade *
@@ -438,3 +494,14 @@ _gtk_style_cascade_remove_provider (GtkStyleCascade  *cascade,
     }
 }
 
+/* Computed values shared by all style contexts using this cascade */
+GtkCssStyleCache *
+_gtk_style_cascade_get_style_cache (GtkStyleCascade *cascade)
+{
+  g_return_val_if_fail (GTK_IS_STYLE_CASCADE (cascade), NULL);
+
+  if (cascade->style_cache == NULL)
+    cascade->style_cache = _gtk_css_style_cache_new ();
+
+  return cascade->style_cache;
+}
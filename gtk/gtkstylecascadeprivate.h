@@ -19,6 +19,7 @@
 #define __GTK_STYLECASCADE_PRIVATE_H__
 
 #include <gdk/gdk.h>
+#include <gtk/gtkcssstylecacheprivate.h>
 #include <gtk/gtkstyleproviderprivate.h>
 
 G_BEGIN_DECLS
@@ -39,6 +40,7 @@ struct _GtkStyleCascade
 
   GtkStyleCascade *parent;
   GArray *providers;
+  GtkCssStyleCache *style_cache;
 };
 
 struct _GtkStyleCascadeClass
@@ -60,6 +62,8 @@ void                  _gtk_style_cascade_add_provider           (GtkStyleCascade
 void                  _gtk_style_cascade_remove_provider        (GtkStyleCascade     *cascade,
                                                                  GtkStyleProvider    *provider);
 
+GtkCssStyleCache *    _gtk_style_cascade_get_style_cache        (GtkStyleCascade     *cascade);
+
 
 G_END_DECLS
 
@@ -28,6 +28,7 @@
 #include "gtkcsscornervalueprivate.h"
 #include "gtkcssenginevalueprivate.h"
 #include "gtkcssnumbervalueprivate.h"
+#include "gtkcssprofilerprivate.h"
 #include "gtkcssrgbavalueprivate.h"
 #include "gtkdebug.h"
 #include "gtkgradientprivate.h"
@@ -302,7 +303,9 @@ struct _GtkStyleContextPrivate
   guint frame_clock_update_id;
 
   GtkCssChange relevant_changes;
+  GtkCssChange descendant_changes;      /* union of the relevant changes of all descendants */
   GtkCssChange pending_changes;
+  GtkBitmask *state_properties;         /* NULL or properties that state changes can affect */
 
   const GtkBitmask *invalidating_context;
   guint animating : 1;
@@ -657,6 +660,7 @@ gtk_style_context_init (GtkStyleContext *style_context)
 
   priv->screen = gdk_screen_get_default ();
   priv->relevant_changes = GTK_CSS_CHANGE_ANY;
+  priv->descendant_changes = GTK_CSS_CHANGE_ANY;
 
   /* Create default info store */
   priv->info = style_info_new ();
@@ -794,6 +798,9 @@ gtk_style_context_finalize (GObject *object)
 
   g_hash_table_destroy (priv->style_data);
 
+  if (priv->state_properties)
+    _gtk_bitmask_free (priv->state_properties);
+
   while (priv->info)
     priv->info = style_info_pop (priv->info);
 
@@ -906,11 +913,10 @@ create_query_path (GtkStyleContext *context,
   return path;
 }
 
-static void
-build_properties (GtkStyleContext      *context,
-                  GtkCssComputedValues *values,
-                  GtkStyleInfo         *info,
-                  const GtkBitmask     *relevant_changes)
+static GtkCssLookup *
+create_lookup (GtkStyleContext  *context,
+               GtkStyleInfo     *info,
+               const GtkBitmask *relevant_changes)
 {
   GtkStyleContextPrivate *priv;
   GtkCssMatcher matcher;
@@ -927,6 +933,26 @@ build_properties (GtkStyleContext      *context,
                                         &matcher,
                                         lookup);
 
+  gtk_widget_path_free (path);
+
+  return lookup;
+}
+
+/* Recomputes the properties in relevant_changes, or all of them if it
+ * is %NULL. Shared values must not be passed here. */
+static void
+build_properties (GtkStyleContext      *context,
+                  GtkCssComputedValues *values,
+                  GtkStyleInfo         *info,
+                  const GtkBitmask     *relevant_changes)
+{
+  GtkStyleContextPrivate *priv;
+  GtkCssLookup *lookup;
+
+  priv = context->priv;
+
+  lookup = create_lookup (context, info, relevant_changes);
+
   _gtk_css_lookup_resolve (lookup, 
                            GTK_STYLE_PROVIDER_PRIVATE (priv->cascade),
 			   priv->scale,
@@ -934,7 +960,138 @@ build_properties (GtkStyleContext      *context,
                            priv->parent ? style_data_lookup (priv->parent)->store : NULL);
 
   _gtk_css_lookup_free (lookup);
-  gtk_widget_path_free (path);
+}
+
+/* Computes all values for info. Other contexts that end up with the
+ * same values share them, see _gtk_css_style_cache_lookup(). */
+static GtkCssComputedValues *
+create_values (GtkStyleContext *context,
+               GtkStyleInfo    *info)
+{
+  GtkStyleContextPrivate *priv;
+  GtkCssComputedValues *values;
+  GtkCssLookup *lookup;
+
+  priv = context->priv;
+
+  if (G_UNLIKELY (gtk_get_debug_flags () & GTK_DEBUG_NO_CSS_CACHE))
+    {
+      values = _gtk_css_computed_values_new ();
+      build_properties (context, values, info, NULL);
+      return values;
+    }
+
+  lookup = create_lookup (context, info, NULL);
+
+  values = _gtk_css_style_cache_lookup (_gtk_style_cascade_get_style_cache (priv->cascade),
+                                        lookup,
+                                        GTK_STYLE_PROVIDER_PRIVATE (priv->cascade),
+                                        priv->scale,
+                                        info->state_flags,
+                                        priv->parent ? style_data_lookup (priv->parent)->store : NULL);
+
+  _gtk_css_lookup_free (lookup);
+
+  return values;
+}
+
+/* Returns the properties that can differ between two states of the
+ * current style info, see _gtk_style_provider_private_get_state_properties().
+ * This is kept until the next radical change. */
+static const GtkBitmask *
+gtk_style_context_get_state_properties (GtkStyleContext *context)
+{
+  GtkStyleContextPrivate *priv = context->priv;
+  GtkWidgetPath *path;
+  GtkCssMatcher matcher, superset;
+
+  if (priv->state_properties)
+    return priv->state_properties;
+
+  path = create_query_path (context, priv->info);
+  if (_gtk_css_matcher_init (&matcher, path, priv->info->state_flags))
+    {
+      _gtk_css_matcher_superset_init (&superset, &matcher, GTK_STYLE_CONTEXT_RADICAL_CHANGE & ~GTK_CSS_CHANGE_SOURCE);
+      priv->state_properties = _gtk_style_provider_private_get_state_properties (GTK_STYLE_PROVIDER_PRIVATE (priv->cascade),
+                                                                                 &superset);
+    }
+  else
+    priv->state_properties = _gtk_bitmask_new ();
+
+  gtk_widget_path_unref (path);
+
+  return priv->state_properties;
+}
+
+/* Computes the values for a state change from the ones of the previous
+ * state. Only the properties that rules depending on the state set and
+ * the ones depending on those are recomputed, all others stay the same.
+ * Like create_values(), contexts that change the same shared values to
+ * the same state share the result. */
+static GtkCssComputedValues *
+create_values_for_state_change (GtkStyleContext      *context,
+                                GtkStyleInfo         *info,
+                                GtkCssComputedValues *previous)
+{
+  GtkStyleContextPrivate *priv;
+  const GtkBitmask *state_properties;
+  GtkCssComputedValues *values;
+  GtkCssLookup *lookup;
+  GtkBitmask *changes;
+
+  priv = context->priv;
+
+  state_properties = gtk_style_context_get_state_properties (context);
+
+  if (_gtk_bitmask_is_empty (state_properties) &&
+      _gtk_css_computed_values_is_shared (previous))
+    return g_object_ref (previous);
+
+  changes = _gtk_css_computed_values_add_dependencies (previous,
+                                                       _gtk_bitmask_copy (state_properties));
+
+  if (G_UNLIKELY (gtk_get_debug_flags () & GTK_DEBUG_NO_CSS_CACHE) ||
+      !_gtk_css_computed_values_is_shared (previous))
+    {
+      values = _gtk_css_computed_values_copy (previous);
+      if (!_gtk_bitmask_is_empty (changes))
+        build_properties (context, values, info, changes);
+
+      _gtk_bitmask_free (changes);
+
+      return values;
+    }
+
+  lookup = create_lookup (context, info, changes);
+
+  values = _gtk_css_style_cache_lookup_changes (_gtk_style_cascade_get_style_cache (priv->cascade),
+                                                lookup,
+                                                changes,
+                                                GTK_STYLE_PROVIDER_PRIVATE (priv->cascade),
+                                                priv->scale,
+                                                info->state_flags,
+                                                priv->parent ? style_data_lookup (priv->parent)->store : NULL,
+                                                previous);
+
+  _gtk_css_lookup_free (lookup);
+  _gtk_bitmask_free (changes);
+
+  return values;
+}
+
+static StyleData *
+style_data_insert (GtkStyleContext *context,
+                   GtkStyleInfo    *info)
+{
+  StyleData *data;
+
+  data = style_data_new ();
+  style_info_set_data (info, data);
+  g_hash_table_insert (context->priv->style_data,
+                       style_info_copy (info),
+                       data);
+
+  return data;
 }
 
 static StyleData *
@@ -943,6 +1100,7 @@ style_data_lookup (GtkStyleContext *context)
   GtkStyleContextPrivate *priv;
   GtkStyleInfo *info;
   StyleData *data;
+  gint64 before;
 
   priv = context->priv;
   info = priv->info;
@@ -960,14 +1118,48 @@ style_data_lookup (GtkStyleContext *context)
       return data;
     }
 
-  data = style_data_new ();
-  data->store = _gtk_css_computed_values_new ();
-  style_info_set_data (info, data);
-  g_hash_table_insert (priv->style_data,
-                       style_info_copy (info),
-                       data);
+  before = _gtk_css_profiler_begin_mark ();
+
+  data = style_data_insert (context, info);
+  data->store = create_values (context, info);
+
+  _gtk_css_profiler_end_mark (before,
+                              "style data lookup",
+                              priv->widget ? G_OBJECT_TYPE_NAME (priv->widget) : NULL);
+
+  return data;
+}
+
+/* Like style_data_lookup() for when info->data was just unset, but
+ * derives new values from @previous, the data used before the state of
+ * the context changed */
+static StyleData *
+style_data_lookup_for_state_change (GtkStyleContext *context,
+                                    StyleData       *previous)
+{
+  GtkStyleContextPrivate *priv;
+  GtkStyleInfo *info;
+  StyleData *data;
+  gint64 before;
+
+  priv = context->priv;
+  info = priv->info;
+
+  data = g_hash_table_lookup (priv->style_data, info);
+  if (data)
+    {
+      style_info_set_data (info, data);
+      return data;
+    }
+
+  before = _gtk_css_profiler_begin_mark ();
 
-  build_properties (context, data->store, info, NULL);
+  data = style_data_insert (context, info);
+  data->store = create_values_for_state_change (context, info, previous->store);
+
+  _gtk_css_profiler_end_mark (before,
+                              "style data lookup",
+                              priv->widget ? G_OBJECT_TYPE_NAME (priv->widget) : NULL);
 
   return data;
 }
@@ -1011,6 +1203,17 @@ gtk_style_context_set_invalid (GtkStyleContext *context,
     }
 }
 
+/* Call this when the relevant changes of @context may have grown, so
+ * that validating its ancestors doesn't skip it */
+static void
+gtk_style_context_reset_descendant_changes (GtkStyleContext *context)
+{
+  GtkStyleContext *parent;
+
+  for (parent = context->priv->parent; parent; parent = parent->priv->parent)
+    parent->priv->descendant_changes = GTK_CSS_CHANGE_ANY;
+}
+
 /* returns TRUE if someone called gtk_style_context_save() but hasn't
  * called gtk_style_context_restore() yet.
  * In those situations we don't invalidate the context when somebody
@@ -1632,6 +1835,7 @@ gtk_style_context_set_parent (GtkStyleContext *context,
     }
 
   priv->parent = parent;
+  gtk_style_context_reset_descendant_changes (context);
 
   g_object_notify (G_OBJECT (context), "parent");
   _gtk_style_context_queue_invalidate (context, GTK_CSS_CHANGE_ANY_PARENT | GTK_CSS_CHANGE_ANY_SIBLING);
@@ -3054,7 +3258,15 @@ gtk_style_context_update_cache (GtkStyleContext  *context,
       changes = _gtk_css_computed_values_compute_dependencies (data->store, parent_changes);
 
       if (!_gtk_bitmask_is_empty (changes))
-	build_properties (context, data->store, info, changes);
+        {
+          if (_gtk_css_computed_values_is_shared (data->store))
+            {
+              g_object_unref (data->store);
+              data->store = create_values (context, info);
+            }
+          else
+            build_properties (context, data->store, info, changes);
+        }
 
       _gtk_bitmask_free (changes);
     }
@@ -3109,6 +3321,7 @@ gtk_style_context_needs_full_revalidate (GtkStyleContext  *context,
   if (change & GTK_STYLE_CONTEXT_RADICAL_CHANGE)
     {
       priv->relevant_changes = GTK_CSS_CHANGE_ANY;
+      gtk_style_context_reset_descendant_changes (context);
     }
   else
     {
@@ -3160,6 +3373,65 @@ gtk_style_context_should_create_transitions (GtkStyleContext *context)
   return animate;
 }
 
+static void
+style_data_create_animations (GtkStyleContext      *context,
+                              StyleData            *data,
+                              gint64                timestamp,
+                              GtkCssComputedValues *source)
+{
+  GtkStyleContextPrivate *priv = context->priv;
+  GtkCssComputedValues *values;
+
+  /* Shared values can't be animated, so animations get their own copy.
+   * That copy is only kept if some animation was actually created. */
+  if (_gtk_css_computed_values_is_shared (data->store))
+    {
+      if (!_gtk_css_computed_values_may_animate (data->store, source))
+        return;
+
+      values = _gtk_css_computed_values_copy (data->store);
+    }
+  else
+    values = g_object_ref (data->store);
+
+  _gtk_css_computed_values_create_animations (values,
+                                              priv->parent ? style_data_lookup (priv->parent)->store : NULL,
+                                              timestamp,
+                                              GTK_STYLE_PROVIDER_PRIVATE (priv->cascade),
+                                              priv->scale,
+                                              source);
+
+  if (values->animations != NULL)
+    {
+      g_object_unref (data->store);
+      data->store = g_object_ref (values);
+    }
+
+  g_object_unref (values);
+}
+
+/* Checks if @change can affect the values of @context or any of its
+ * descendants. If it can't, validating the subtree does nothing. */
+static gboolean
+gtk_style_context_change_affects_subtree (GtkStyleContext *context,
+                                          GtkCssChange     change)
+{
+  GtkStyleContextPrivate *priv = context->priv;
+
+  if (change == 0)
+    return FALSE;
+
+  /* These aren't part of the relevant changes */
+  if (change & (GTK_STYLE_CONTEXT_RADICAL_CHANGE | GTK_CSS_CHANGE_ANIMATE | GTK_CSS_CHANGE_FORCE_INVALIDATE))
+    return TRUE;
+
+  if (priv->info->data == NULL)
+    return TRUE;
+
+  return (priv->relevant_changes & change) ||
+         (priv->descendant_changes & _gtk_css_change_for_child (change));
+}
+
 void
 _gtk_style_context_validate (GtkStyleContext  *context,
                              gint64            timestamp,
@@ -3170,6 +3442,7 @@ _gtk_style_context_validate (GtkStyleContext  *context,
   GtkStyleInfo *info;
   StyleData *current;
   GtkBitmask *changes;
+  GtkCssChange descendant_changes;
   GSList *list;
 
   g_return_if_fail (GTK_IS_STYLE_CONTEXT (context));
@@ -3193,12 +3466,22 @@ _gtk_style_context_validate (GtkStyleContext  *context,
   if (G_UNLIKELY (gtk_get_debug_flags () & GTK_DEBUG_NO_CSS_CACHE))
     change = GTK_CSS_CHANGE_ANY;
 
-  if (!priv->invalid && change == 0 && _gtk_bitmask_is_empty (parent_changes))
+  /* Nothing below us was invalidated and nothing that was changed
+   * above matters for any of our rules, so there's nothing to do */
+  if (!priv->invalid &&
+      _gtk_bitmask_is_empty (parent_changes) &&
+      !gtk_style_context_change_affects_subtree (context, change))
     return;
 
   priv->pending_changes = 0;
   gtk_style_context_set_invalid (context, FALSE);
 
+  if ((change & GTK_STYLE_CONTEXT_RADICAL_CHANGE) && priv->state_properties)
+    {
+      _gtk_bitmask_free (priv->state_properties);
+      priv->state_properties = NULL;
+    }
+
   info = priv->info;
   if (info->data)
     current = style_data_ref (info->data);
@@ -3214,21 +3497,22 @@ _gtk_style_context_validate (GtkStyleContext  *context,
       if ((priv->relevant_changes & change) & ~GTK_STYLE_CONTEXT_CACHED_CHANGE)
         {
           gtk_style_context_clear_cache (context);
+          data = style_data_lookup (context);
         }
       else
         {
           gtk_style_context_update_cache (context, parent_changes);
           style_info_set_data (info, NULL);
+          if (current)
+            data = style_data_lookup_for_state_change (context, current);
+          else
+            data = style_data_lookup (context);
         }
 
-      data = style_data_lookup (context);
-
-      _gtk_css_computed_values_create_animations (data->store,
-                                                  priv->parent ? style_data_lookup (priv->parent)->store : NULL,
-                                                  timestamp,
-                                                  GTK_STYLE_PROVIDER_PRIVATE (priv->cascade),
-						  priv->scale,
-                                                  current && gtk_style_context_should_create_transitions (context) ? current->store : NULL);
+      style_data_create_animations (context,
+                                    data,
+                                    timestamp,
+                                    current && gtk_style_context_should_create_transitions (context) ? current->store : NULL);
       if (_gtk_css_computed_values_is_static (data->store))
         change &= ~GTK_CSS_CHANGE_ANIMATE;
       else
@@ -3283,10 +3567,16 @@ _gtk_style_context_validate (GtkStyleContext  *context,
     }
 
   change = _gtk_css_change_for_child (change);
+  descendant_changes = 0;
   for (list = priv->children; list; list = list->next)
     {
-      _gtk_style_context_validate (list->data, timestamp, change, changes);
+      GtkStyleContext *child = list->data;
+
+      _gtk_style_context_validate (child, timestamp, change, changes);
+
+      descendant_changes |= child->priv->relevant_changes | child->priv->descendant_changes;
     }
+  priv->descendant_changes = descendant_changes;
 
   _gtk_bitmask_free (changes);
 }
@@ -346,12 +346,35 @@ gtk_style_properties_provider_get_change (GtkStyleProviderPrivate *provider,
   return GTK_CSS_CHANGE_STATE;
 }
 
+static GtkBitmask *
+gtk_style_properties_provider_get_state_properties (GtkStyleProviderPrivate *provider,
+                                                    const GtkCssMatcher     *matcher)
+{
+  GtkStyleProperties *props;
+  GHashTableIter iter;
+  GtkBitmask *properties;
+  gpointer key;
+
+  props = GTK_STYLE_PROPERTIES (provider);
+  properties = _gtk_bitmask_new ();
+
+  /* Values may be set for any state, so all of them can change */
+  g_hash_table_iter_init (&iter, props->priv->properties);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    properties = _gtk_bitmask_set (properties,
+                                   _gtk_css_style_property_get_id (key),
+                                   TRUE);
+
+  return properties;
+}
+
 static void
 gtk_style_properties_provider_private_init (GtkStyleProviderPrivateInterface *iface)
 {
   iface->get_color = gtk_style_properties_provider_get_color;
   iface->lookup = gtk_style_properties_provider_lookup;
   iface->get_change = gtk_style_properties_provider_get_change;
+  iface->get_state_properties = gtk_style_properties_provider_get_state_properties;
 }
 
 /* GtkStyleProperties methods */
@@ -21,6 +21,7 @@
 
 #include "gtkstyleproviderprivate.h"
 
+#include "gtkcssstylepropertyprivate.h"
 #include "gtkintl.h"
 #include "gtkstyleprovider.h"
 
@@ -119,6 +120,41 @@ _gtk_style_provider_private_get_change (GtkStyleProviderPrivate *provider,
   return iface->get_change (provider, matcher);
 }
 
+/**
+ * _gtk_style_provider_private_get_state_properties:
+ * @provider: the provider
+ * @matcher: a matcher for the element, usually a superset matcher that
+ *     ignores the state
+ *
+ * Queries the properties that rules depending on the state of the element
+ * matched by @matcher can set. When only the state of an element changes,
+ * all other properties keep the values they had before. Providers that
+ * can't tell return all properties.
+ *
+ * Returns: (transfer full): the properties that may differ between two
+ *     states of the element
+ **/
+GtkBitmask *
+_gtk_style_provider_private_get_state_properties (GtkStyleProviderPrivate *provider,
+                                                  const GtkCssMatcher     *matcher)
+{
+  GtkStyleProviderPrivateInterface *iface;
+  GtkBitmask *properties;
+
+  g_return_val_if_fail (GTK_IS_STYLE_PROVIDER_PRIVATE (provider), NULL);
+  g_return_val_if_fail (matcher != NULL, NULL);
+
+  iface = GTK_STYLE_PROVIDER_PRIVATE_GET_INTERFACE (provider);
+
+  if (!iface->get_state_properties)
+    {
+      properties = _gtk_bitmask_new ();
+      return _gtk_bitmask_invert_range (properties, 0, _gtk_css_style_property_get_n_properties ());
+    }
+
+  return iface->get_state_properties (provider, matcher);
+}
+
 void
 _gtk_style_provider_private_changed (GtkStyleProviderPrivate *provider)
 {
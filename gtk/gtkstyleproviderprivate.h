@@ -21,6 +21,7 @@
 #define __GTK_STYLE_PROVIDER_PRIVATE_H__
 
 #include <glib-object.h>
+#include "gtk/gtkbitmaskprivate.h"
 #include "gtk/gtkcsskeyframesprivate.h"
 #include "gtk/gtkcsslookupprivate.h"
 #include "gtk/gtkcssmatcherprivate.h"
@@ -51,6 +52,8 @@ struct _GtkStyleProviderPrivateInterface
                                                  GtkCssLookup            *lookup);
   GtkCssChange          (* get_change)          (GtkStyleProviderPrivate *provider,
                                                  const GtkCssMatcher     *matcher);
+  GtkBitmask *          (* get_state_properties)(GtkStyleProviderPrivate *provider,
+                                                 const GtkCssMatcher     *matcher);
 
   /* signal */
   void                  (* changed)             (GtkStyleProviderPrivate *provider);
@@ -68,6 +71,9 @@ void                    _gtk_style_provider_private_lookup       (GtkStyleProvid
                                                                   GtkCssLookup            *lookup);
 GtkCssChange            _gtk_style_provider_private_get_change   (GtkStyleProviderPrivate *provider,
                                                                   const GtkCssMatcher     *matcher);
+GtkBitmask *            _gtk_style_provider_private_get_state_properties
+                                                                 (GtkStyleProviderPrivate *provider,
+                                                                  const GtkCssMatcher     *matcher);
 
 void                    _gtk_style_provider_private_changed      (GtkStyleProviderPrivate *provider);
 
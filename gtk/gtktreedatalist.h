@@ -23,24 +23,28 @@
 #include <gtk/gtktreemodel.h>
 #include <gtk/gtktreesortable.h>
 
+typedef union _GtkTreeDataValue GtkTreeDataValue;
+union _GtkTreeDataValue
+{
+  gint           v_int;
+  gint8          v_char;
+  guint8         v_uchar;
+  guint          v_uint;
+  glong          v_long;
+  gulong         v_ulong;
+  gint64         v_int64;
+  guint64        v_uint64;
+  gfloat         v_float;
+  gdouble        v_double;
+  gpointer       v_pointer;
+};
+
 typedef struct _GtkTreeDataList GtkTreeDataList;
 struct _GtkTreeDataList
 {
   GtkTreeDataList *next;
 
-  union {
-    gint	   v_int;
-    gint8          v_char;
-    guint8         v_uchar;
-    guint	   v_uint;
-    glong	   v_long;
-    gulong	   v_ulong;
-    gint64	   v_int64;
-    guint64        v_uint64;
-    gfloat	   v_float;
-    gdouble        v_double;
-    gpointer	   v_pointer;
-  } data;
+  GtkTreeDataValue data;
 };
 
 typedef struct _GtkTreeDataSortHeader
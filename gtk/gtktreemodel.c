@@ -236,6 +236,7 @@
     }G_STMT_END
 
 #define ROW_REF_DATA_STRING "gtk-tree-row-refs"
+#define ROWS_INSERTED_DATA_STRING "gtk-tree-model-rows-inserted"
 
 enum {
   ROW_CHANGED,
@@ -260,6 +261,20 @@ typedef struct
   GSList *list;
 } RowRefList;
 
+typedef struct
+{
+  GtkTreeModelRowsInsertedFunc func;
+  gpointer                     data;
+} RowsInsertedHook;
+
+typedef struct
+{
+  GSList      *hooks;
+  GtkTreePath *path;     /* first row of the pending range */
+  gint         n_rows;
+  gint         depth;
+} RowsInsertedData;
+
 static void      gtk_tree_model_base_init   (gpointer           g_class);
 
 /* custom closures */
@@ -1958,6 +1973,217 @@ gtk_tree_model_rows_reordered_with_length (GtkTreeModel *tree_model,
   g_signal_emit (tree_model, tree_model_signals[ROWS_REORDERED], 0, path, iter, new_order);
 }
 
+/*
+ * Rows inserted in bulk
+ *
+ * Models that add many consecutive rows at once still emit
+ * #GtkTreeModel::row-inserted for each of them, as other listeners
+ * expect the model to grow by exactly one row per emission. Views
+ * that registered a hook skip those emissions and get the whole range
+ * in one call once the model is done.
+ */
+
+static void
+rows_inserted_data_free (gpointer data)
+{
+  RowsInsertedData *rows = data;
+
+  g_slist_free_full (rows->hooks, g_free);
+  if (rows->path)
+    gtk_tree_path_free (rows->path);
+  g_slice_free (RowsInsertedData, rows);
+}
+
+void
+_gtk_tree_model_add_rows_inserted_hook (GtkTreeModel                 *model,
+                                        GtkTreeModelRowsInsertedFunc  func,
+                                        gpointer                      data)
+{
+  RowsInsertedData *rows;
+  RowsInsertedHook *hook;
+
+  rows = g_object_get_data (G_OBJECT (model), ROWS_INSERTED_DATA_STRING);
+  if (rows == NULL)
+    {
+      rows = g_slice_new0 (RowsInsertedData);
+      g_object_set_data_full (G_OBJECT (model), I_(ROWS_INSERTED_DATA_STRING),
+                              rows, rows_inserted_data_free);
+    }
+
+  hook = g_new (RowsInsertedHook, 1);
+  hook->func = func;
+  hook->data = data;
+  rows->hooks = g_slist_prepend (rows->hooks, hook);
+}
+
+void
+_gtk_tree_model_remove_rows_inserted_hook (GtkTreeModel                 *model,
+                                           GtkTreeModelRowsInsertedFunc  func,
+                                           gpointer                      data)
+{
+  RowsInsertedData *rows;
+  GSList *l;
+
+  rows = g_object_get_data (G_OBJECT (model), ROWS_INSERTED_DATA_STRING);
+  if (rows == NULL)
+    return;
+
+  for (l = rows->hooks; l; l = l->next)
+    {
+      RowsInsertedHook *hook = l->data;
+
+      if (hook->func == func && hook->data == data)
+        {
+          rows->hooks = g_slist_delete_link (rows->hooks, l);
+          g_free (hook);
+          break;
+        }
+    }
+
+  if (rows->hooks == NULL && rows->path == NULL)
+    g_object_set_data (G_OBJECT (model), I_(ROWS_INSERTED_DATA_STRING), NULL);
+}
+
+/* Called by a model before it emits row-inserted for the @n_rows
+ * consecutive rows starting at @path, in order. Must be paired with
+ * _gtk_tree_model_end_rows_inserted(); nested ranges are folded into
+ * the outer one.
+ */
+void
+_gtk_tree_model_begin_rows_inserted (GtkTreeModel *model,
+                                     GtkTreePath  *path,
+                                     gint          n_rows)
+{
+  RowsInsertedData *rows;
+
+  rows = g_object_get_data (G_OBJECT (model), ROWS_INSERTED_DATA_STRING);
+  if (rows == NULL)
+    return;
+
+  if (rows->depth++ > 0)
+    return;
+
+  rows->path = gtk_tree_path_copy (path);
+  rows->n_rows = n_rows;
+}
+
+void
+_gtk_tree_model_end_rows_inserted (GtkTreeModel *model)
+{
+  RowsInsertedData *rows;
+  GtkTreePath *path;
+  GSList *hooks, *l;
+  gint n_rows;
+
+  rows = g_object_get_data (G_OBJECT (model), ROWS_INSERTED_DATA_STRING);
+  if (rows == NULL || rows->depth == 0)
+    return;
+
+  if (--rows->depth > 0)
+    return;
+
+  path = rows->path;
+  n_rows = rows->n_rows;
+  rows->path = NULL;
+  rows->n_rows = 0;
+
+  /* a hook may remove itself */
+  hooks = NULL;
+  for (l = rows->hooks; l; l = l->next)
+    hooks = g_slist_prepend (hooks, g_memdup (l->data, sizeof (RowsInsertedHook)));
+
+  for (l = hooks; l; l = l->next)
+    {
+      RowsInsertedHook *hook = l->data;
+
+      hook->func (model, path, n_rows, hook->data);
+    }
+  g_slist_free_full (hooks, g_free);
+
+  gtk_tree_path_free (path);
+}
+
+/* Called by a model that can't tell its rows up front before it emits
+ * row-inserted for @path. The pending range grows if @path directly
+ * follows it, otherwise it is handed to the hooks and a new one starts
+ * at @path. The last range is ended with _gtk_tree_model_end_rows_inserted().
+ */
+void
+_gtk_tree_model_continue_rows_inserted (GtkTreeModel *model,
+                                        GtkTreePath  *path)
+{
+  RowsInsertedData *rows;
+  gint *indices, *pending;
+  gint depth, i;
+
+  rows = g_object_get_data (G_OBJECT (model), ROWS_INSERTED_DATA_STRING);
+  if (rows == NULL)
+    return;
+
+  depth = 0;
+  if (rows->path != NULL)
+    {
+      if (gtk_tree_path_get_depth (path) == gtk_tree_path_get_depth (rows->path))
+        {
+          indices = gtk_tree_path_get_indices (path);
+          pending = gtk_tree_path_get_indices (rows->path);
+          for (i = 0; i < gtk_tree_path_get_depth (path) - 1; i++)
+            if (indices[i] != pending[i])
+              break;
+
+          if (i == gtk_tree_path_get_depth (path) - 1 &&
+              indices[i] == pending[i] + rows->n_rows)
+            {
+              rows->n_rows++;
+              return;
+            }
+        }
+
+      /* Flush the range, but keep the nesting of the caller */
+      depth = rows->depth;
+      rows->depth = 1;
+      _gtk_tree_model_end_rows_inserted (model);
+
+      /* a hook may remove itself */
+      rows = g_object_get_data (G_OBJECT (model), ROWS_INSERTED_DATA_STRING);
+      if (rows == NULL)
+        return;
+    }
+
+  _gtk_tree_model_begin_rows_inserted (model, path, 1);
+  if (depth > 0)
+    rows->depth = depth;
+}
+
+/* Returns whether the row-inserted signal for @path is part of a
+ * range that the registered hooks will be told about as a whole.
+ */
+gboolean
+_gtk_tree_model_is_pending_row (GtkTreeModel *model,
+                                GtkTreePath  *path)
+{
+  RowsInsertedData *rows;
+  gint *indices, *pending;
+  gint depth, i;
+
+  rows = g_object_get_data (G_OBJECT (model), ROWS_INSERTED_DATA_STRING);
+  if (rows == NULL || rows->path == NULL)
+    return FALSE;
+
+  depth = gtk_tree_path_get_depth (rows->path);
+  if (gtk_tree_path_get_depth (path) != depth)
+    return FALSE;
+
+  indices = gtk_tree_path_get_indices (path);
+  pending = gtk_tree_path_get_indices (rows->path);
+  for (i = 0; i < depth - 1; i++)
+    if (indices[i] != pending[i])
+      return FALSE;
+
+  return indices[depth - 1] >= pending[depth - 1] &&
+         indices[depth - 1] < pending[depth - 1] + rows->n_rows;
+}
+
 static gboolean
 gtk_tree_model_foreach_helper (GtkTreeModel            *model,
                                GtkTreeIter             *iter,
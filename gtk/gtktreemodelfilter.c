@@ -22,6 +22,7 @@
 #include "gtktreemodelfilter.h"
 #include "gtkintl.h"
 #include "gtktreednd.h"
+#include "gtktreeprivate.h"
 #include "gtkprivate.h"
 #include <string.h>
 
@@ -349,6 +350,10 @@ static void         gtk_tree_model_filter_row_inserted                    (GtkTr
                                                                            GtkTreePath            *c_path,
                                                                            GtkTreeIter            *c_iter,
                                                                            gpointer                data);
+static void         gtk_tree_model_filter_rows_inserted                   (GtkTreeModel           *c_model,
+                                                                           GtkTreePath            *c_path,
+                                                                           gint                    n_rows,
+                                                                           gpointer                data);
 static void         gtk_tree_model_filter_row_has_child_toggled           (GtkTreeModel           *c_model,
                                                                            GtkTreePath            *c_path,
                                                                            GtkTreeIter            *c_iter,
@@ -1962,7 +1967,17 @@ gtk_tree_model_filter_emit_row_inserted_for_path (GtkTreeModelFilter *filter,
 
       if (!signals_emitted &&
           (!level->parent_level || level->ext_ref_count > 0))
-        gtk_tree_model_row_inserted (GTK_TREE_MODEL (filter), path, &iter);
+        {
+          /* Rows the child model inserts as a range stay one, unless
+           * the view has to hear about their children right away */
+          if (_gtk_tree_model_is_pending_row (c_model, c_path) &&
+              !gtk_tree_model_iter_has_child (c_model, c_iter))
+            _gtk_tree_model_continue_rows_inserted (GTK_TREE_MODEL (filter), path);
+          else
+            _gtk_tree_model_end_rows_inserted (GTK_TREE_MODEL (filter));
+
+          gtk_tree_model_row_inserted (GTK_TREE_MODEL (filter), path, &iter);
+        }
 
       if (level->parent_level && level->parent_elt->ext_ref_count > 0 &&
           g_sequence_get_length (level->visible_seq) == 1)
@@ -2301,6 +2316,16 @@ done:
     gtk_tree_path_free (c_path);
 }
 
+static void
+gtk_tree_model_filter_rows_inserted (GtkTreeModel *c_model,
+                                     GtkTreePath  *c_path,
+                                     gint          n_rows,
+                                     gpointer      data)
+{
+  /* The visible rows of the range were collected as they came in */
+  _gtk_tree_model_end_rows_inserted (GTK_TREE_MODEL (data));
+}
+
 static void
 gtk_tree_model_filter_row_has_child_toggled (GtkTreeModel *c_model,
                                              GtkTreePath  *c_path,
@@ -3659,6 +3684,9 @@ gtk_tree_model_filter_set_model (GtkTreeModelFilter *filter,
                                    filter->priv->deleted_id);
       g_signal_handler_disconnect (filter->priv->child_model,
                                    filter->priv->reordered_id);
+      _gtk_tree_model_remove_rows_inserted_hook (filter->priv->child_model,
+                                                 gtk_tree_model_filter_rows_inserted,
+                                                 filter);
 
       /* reset our state */
       if (filter->priv->root)
@@ -3697,6 +3725,9 @@ gtk_tree_model_filter_set_model (GtkTreeModelFilter *filter,
         g_signal_connect (child_model, "rows-reordered",
                           G_CALLBACK (gtk_tree_model_filter_rows_reordered),
                           filter);
+      _gtk_tree_model_add_rows_inserted_hook (child_model,
+                                              gtk_tree_model_filter_rows_inserted,
+                                              filter);
 
       filter->priv->child_flags = gtk_tree_model_get_flags (child_model);
       filter->priv->stamp = g_random_int ();
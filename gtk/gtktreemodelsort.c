@@ -28,6 +28,7 @@
 #include "gtkintl.h"
 #include "gtkprivate.h"
 #include "gtktreednd.h"
+#include "gtktreeprivate.h"
 
 
 /**
@@ -333,6 +334,10 @@ static void gtk_tree_model_sort_row_inserted          (GtkTreeModel          *mo
 						       GtkTreePath           *path,
 						       GtkTreeIter           *iter,
 						       gpointer               data);
+static void gtk_tree_model_sort_rows_inserted         (GtkTreeModel          *model,
+						       GtkTreePath           *path,
+						       gint                   n_rows,
+						       gpointer               data);
 static void gtk_tree_model_sort_row_has_child_toggled (GtkTreeModel          *model,
 						       GtkTreePath           *path,
 						       GtkTreeIter           *iter,
@@ -994,6 +999,14 @@ gtk_tree_model_sort_row_inserted (GtkTreeModel          *s_model,
   gtk_tree_model_sort_increment_stamp (tree_model_sort);
 
   gtk_tree_model_get_iter (GTK_TREE_MODEL (data), &iter, path);
+
+  /* Rows the child model inserts as a range stay one where they end
+   * up next to each other */
+  if (_gtk_tree_model_is_pending_row (s_model, s_path))
+    _gtk_tree_model_continue_rows_inserted (GTK_TREE_MODEL (data), path);
+  else
+    _gtk_tree_model_end_rows_inserted (GTK_TREE_MODEL (data));
+
   gtk_tree_model_row_inserted (GTK_TREE_MODEL (data), path, &iter);
   gtk_tree_path_free (path);
 
@@ -1004,6 +1017,16 @@ gtk_tree_model_sort_row_inserted (GtkTreeModel          *s_model,
   return;
 }
 
+static void
+gtk_tree_model_sort_rows_inserted (GtkTreeModel *s_model,
+                                   GtkTreePath  *s_path,
+                                   gint          n_rows,
+                                   gpointer      data)
+{
+  /* The rows of the range were collected as they came in */
+  _gtk_tree_model_end_rows_inserted (GTK_TREE_MODEL (data));
+}
+
 static void
 gtk_tree_model_sort_row_has_child_toggled (GtkTreeModel *s_model,
 					   GtkTreePath  *s_path,
@@ -2156,6 +2179,9 @@ gtk_tree_model_sort_set_model (GtkTreeModelSort *tree_model_sort,
                                    priv->deleted_id);
       g_signal_handler_disconnect (priv->child_model,
 				   priv->reordered_id);
+      _gtk_tree_model_remove_rows_inserted_hook (priv->child_model,
+                                                 gtk_tree_model_sort_rows_inserted,
+                                                 tree_model_sort);
 
       /* reset our state */
       if (priv->root)
@@ -2193,6 +2219,9 @@ gtk_tree_model_sort_set_model (GtkTreeModelSort *tree_model_sort,
 	g_signal_connect (child_model, "rows-reordered",
 			  G_CALLBACK (gtk_tree_model_sort_rows_reordered),
 			  tree_model_sort);
+      _gtk_tree_model_add_rows_inserted_hook (child_model,
+                                              gtk_tree_model_sort_rows_inserted,
+                                              tree_model_sort);
 
       priv->child_flags = gtk_tree_model_get_flags (child_model);
       n_columns = gtk_tree_model_get_n_columns (child_model);
@@ -37,6 +37,11 @@ typedef enum
 }
 GtkTreeSelectMode;
 
+typedef void (* GtkTreeModelRowsInsertedFunc) (GtkTreeModel *model,
+                                               GtkTreePath  *path,
+                                               gint          n_rows,
+                                               gpointer      data);
+
 /* functions that shouldn't be exported */
 void         _gtk_tree_selection_internal_select_node (GtkTreeSelection  *selection,
 						       GtkRBNode         *node,
@@ -94,6 +99,21 @@ void               _gtk_tree_view_set_focus_column    (GtkTreeView
 GdkWindow         *_gtk_tree_view_get_header_window   (GtkTreeView                 *tree_view);
 
 
+void         _gtk_tree_model_add_rows_inserted_hook    (GtkTreeModel                 *model,
+                                                        GtkTreeModelRowsInsertedFunc  func,
+                                                        gpointer                      data);
+void         _gtk_tree_model_remove_rows_inserted_hook (GtkTreeModel                 *model,
+                                                        GtkTreeModelRowsInsertedFunc  func,
+                                                        gpointer                      data);
+void         _gtk_tree_model_begin_rows_inserted       (GtkTreeModel                 *model,
+                                                        GtkTreePath                  *path,
+                                                        gint                          n_rows);
+void         _gtk_tree_model_end_rows_inserted         (GtkTreeModel                 *model);
+void         _gtk_tree_model_continue_rows_inserted    (GtkTreeModel                 *model,
+                                                        GtkTreePath                  *path);
+gboolean     _gtk_tree_model_is_pending_row            (GtkTreeModel                 *model,
+                                                        GtkTreePath                  *path);
+
 GtkTreeSelection* _gtk_tree_selection_new                (void);
 GtkTreeSelection* _gtk_tree_selection_new_with_tree_view (GtkTreeView      *tree_view);
 void              _gtk_tree_selection_set_tree_view      (GtkTreeSelection *selection,
@@ -153,6 +173,10 @@ void              _gtk_tree_view_column_push_padding          (GtkTreeViewColumn
 gint              _gtk_tree_view_column_get_requested_width   (GtkTreeViewColumn  *column);
 gint              _gtk_tree_view_column_get_drag_x            (GtkTreeViewColumn  *column);
 GtkCellAreaContext *_gtk_tree_view_column_get_context         (GtkTreeViewColumn  *column);
+GtkCellRenderer  *_gtk_tree_view_column_get_sole_cell         (GtkTreeViewColumn  *column);
+void              _gtk_tree_view_column_push_cell_width       (GtkTreeViewColumn  *column,
+                                                               gint                minimum_width,
+                                                               gint                natural_width);
 void              _gtk_tree_view_reset_header_styles       (GtkTreeView        *tree_view);
 
 
@@ -541,6 +541,16 @@ gtk_tree_selection_get_selected (GtkTreeSelection  *selection,
   return retval;
 }
 
+/* Moves @path on by @n_rows rows, to get past the rows of a span */
+static void
+skip_rows (GtkTreePath *path,
+           gint         n_rows)
+{
+  gint *indices = gtk_tree_path_get_indices (path);
+
+  indices[gtk_tree_path_get_depth (path) - 1] += n_rows;
+}
+
 /**
  * gtk_tree_selection_get_selected_rows:
  * @selection: A #GtkTreeSelection.
@@ -604,18 +614,30 @@ gtk_tree_selection_get_selected_rows (GtkTreeSelection   *selection,
       return NULL;
     }
 
-  node = _gtk_rbtree_first (tree);
+  node = _gtk_rbtree_peek_first (tree);
   path = gtk_tree_path_new_first ();
 
   do
     {
+      gint rows = GTK_RBNODE_GET_ROWS (node);
+
+      /* all rows of a span share its flags, path ends up on the last one */
       if (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SELECTED))
-	list = g_list_prepend (list, gtk_tree_path_copy (path));
+        {
+	  list = g_list_prepend (list, gtk_tree_path_copy (path));
+          while (--rows > 0)
+            {
+              gtk_tree_path_next (path);
+              list = g_list_prepend (list, gtk_tree_path_copy (path));
+            }
+        }
+      else if (rows > 1)
+        skip_rows (path, rows - 1);
 
       if (node->children)
         {
 	  tree = node->children;
-          node = _gtk_rbtree_first (tree);
+          node = _gtk_rbtree_peek_first (tree);
 
 	  gtk_tree_path_append_index (path, 0);
 	}
@@ -625,7 +647,7 @@ gtk_tree_selection_get_selected_rows (GtkTreeSelection   *selection,
 
 	  do
 	    {
-	      node = _gtk_rbtree_next (tree, node);
+	      node = _gtk_rbtree_peek_next (tree, node);
 	      if (node != NULL)
 	        {
 		  done = TRUE;
@@ -665,7 +687,7 @@ gtk_tree_selection_count_selected_rows_helper (GtkRBTree *tree,
   gint *count = (gint *)data;
 
   if (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SELECTED))
-    (*count)++;
+    (*count) += GTK_RBNODE_GET_ROWS (node);
 
   if (node->children)
     _gtk_rbtree_traverse (node->children, node->children->root,
@@ -779,7 +801,7 @@ gtk_tree_selection_selected_foreach (GtkTreeSelection            *selection,
       return;
     }
 
-  node = _gtk_rbtree_first (tree);
+  node = _gtk_rbtree_peek_first (tree);
 
   g_object_ref (model);
 
@@ -802,11 +824,24 @@ gtk_tree_selection_selected_foreach (GtkTreeSelection            *selection,
 
   do
     {
+      gint rows = GTK_RBNODE_GET_ROWS (node);
+
+      /* all rows of a span share its flags, path ends up on the last one */
       if (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SELECTED))
         {
-          gtk_tree_model_get_iter (model, &iter, path);
-	  (* func) (model, path, &iter, data);
+          while (TRUE)
+            {
+              gtk_tree_model_get_iter (model, &iter, path);
+              (* func) (model, path, &iter, data);
+
+              if (stop || --rows == 0)
+                break;
+
+              gtk_tree_path_next (path);
+            }
         }
+      else if (rows > 1)
+        skip_rows (path, rows - 1);
 
       if (stop)
 	goto out;
@@ -814,7 +849,7 @@ gtk_tree_selection_selected_foreach (GtkTreeSelection            *selection,
       if (node->children)
 	{
 	  tree = node->children;
-          node = _gtk_rbtree_first (tree);
+          node = _gtk_rbtree_peek_first (tree);
 
 	  gtk_tree_path_append_index (path, 0);
 	}
@@ -824,7 +859,7 @@ gtk_tree_selection_selected_foreach (GtkTreeSelection            *selection,
 
 	  do
 	    {
-	      node = _gtk_rbtree_next (tree, node);
+	      node = _gtk_rbtree_peek_next (tree, node);
 	      if (node != NULL)
 		{
 		  done = TRUE;
@@ -1108,6 +1143,46 @@ struct _TempTuple {
   gint dirty;
 };
 
+/* A span is selected as a whole, unless every row has to be asked
+ * whether it can be. Then the rows of the spans that would change get
+ * nodes of their own first, as that can't happen while traversing.
+ */
+static void
+materialize_spans (GtkTreeSelection *selection,
+                   GtkRBTree        *tree,
+                   gboolean          select)
+{
+  GtkTreeSelectionPrivate *priv = selection->priv;
+  GtkTreeViewRowSeparatorFunc separator_func;
+  gpointer separator_data;
+  GtkRBNode *node;
+  gint index = 0;
+
+  _gtk_tree_view_get_row_separator_func (priv->tree_view,
+					 &separator_func, &separator_data);
+  if (priv->user_func == NULL && separator_func == NULL)
+    return;
+
+  while (index < tree->root->count)
+    {
+      node = _gtk_rbtree_peek_count (tree, index + 1);
+
+      if (!GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
+        {
+          if (node->children)
+            materialize_spans (selection, node->children, select);
+          index++;
+        }
+      else if (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SELECTED) != select)
+        {
+          _gtk_rbtree_find_count (tree, index + 1);
+          index++;
+        }
+      else
+        index += GTK_RBNODE_GET_ROWS (node);
+    }
+}
+
 static void
 select_all_helper (GtkRBTree  *tree,
 		   GtkRBNode  *node,
@@ -1143,6 +1218,8 @@ gtk_tree_selection_real_select_all (GtkTreeSelection *selection)
   if (tree == NULL)
     return FALSE;
 
+  materialize_spans (selection, tree, TRUE);
+
   /* Mark all nodes selected */
   tuple = g_new (struct _TempTuple, 1);
   tuple->selection = selection;
@@ -1255,6 +1332,7 @@ gtk_tree_selection_real_unselect_all (GtkTreeSelection *selection)
       tuple->dirty = FALSE;
 
       tree = _gtk_tree_view_get_rbtree (priv->tree_view);
+      materialize_spans (selection, tree, FALSE);
       _gtk_rbtree_traverse (tree, tree->root,
                             G_PRE_ORDER,
                             unselect_all_helper,
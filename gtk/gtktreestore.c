@@ -24,6 +24,7 @@
 #include "gtktreestore.h"
 #include "gtktreedatalist.h"
 #include "gtktreednd.h"
+#include "gtktreeprivate.h"
 #include "gtkbuildable.h"
 #include "gtkdebug.h"
 #include "gtkintl.h"
@@ -148,6 +149,9 @@ static gboolean gtk_tree_store_row_drop_possible  (GtkTreeDragDest   *drag_dest,
 /* Sortable Interfaces */
 
 static void     gtk_tree_store_sort                    (GtkTreeStore           *tree_store);
+static void     gtk_tree_store_sort_helper             (GtkTreeStore           *tree_store,
+							GNode                  *parent,
+							gboolean                recurse);
 static void     gtk_tree_store_sort_iter_changed       (GtkTreeStore           *tree_store,
 							GtkTreeIter            *iter,
 							gint                    column,
@@ -1654,6 +1658,134 @@ gtk_tree_store_insert_with_valuesv (GtkTreeStore *tree_store,
   validate_tree ((GtkTreeStore *)tree_store);
 }
 
+/**
+ * gtk_tree_store_insert_rows:
+ * @tree_store: A #GtkTreeStore
+ * @parent: (allow-none): A valid #GtkTreeIter, or %NULL
+ * @position: position to insert the first new row, or -1 to append
+ * @n_rows: the number of rows to insert
+ * @columns: (array length=n_values): an array of column numbers
+ * @values: (array): an array of @n_rows times @n_values GValues, with
+ *   the values of the first row first
+ * @n_values: the length of the @columns array
+ *
+ * Inserts @n_rows children of @parent at @position and fills them in
+ * like gtk_tree_store_insert_with_valuesv() does. This is a lot faster
+ * than inserting the rows one by one, as neither the position nor the
+ * path of every row has to be looked up among its siblings. In a sorted
+ * @tree_store every row goes straight to its sorted position instead.
+ *
+ * #GtkTreeModel::row-inserted is still emitted for every row, but a
+ * #GtkTreeView showing @tree_store adds rows that end up next to each
+ * other in one go.
+ *
+ * Since: 3.12
+ */
+void
+gtk_tree_store_insert_rows (GtkTreeStore *tree_store,
+                            GtkTreeIter  *parent,
+                            gint          position,
+                            gint          n_rows,
+                            gint         *columns,
+                            GValue       *values,
+                            gint          n_values)
+{
+  GtkTreeStorePrivate *priv;
+  GtkTreePath *path;
+  GNode *parent_node;
+  GNode *prev_node;
+  GNode *new_node;
+  GtkTreeIter iter;
+  gboolean had_children;
+  gboolean sorted;
+  gboolean changed = FALSE;
+  gboolean maybe_need_sort;
+  gint n_children, i;
+
+  g_return_if_fail (GTK_IS_TREE_STORE (tree_store));
+  g_return_if_fail (n_rows >= 0);
+  g_return_if_fail (n_values == 0 || (columns != NULL && values != NULL));
+  if (parent)
+    g_return_if_fail (VALID_ITER (parent, tree_store));
+
+  priv = tree_store->priv;
+
+  if (n_rows == 0)
+    return;
+
+  if (parent)
+    parent_node = parent->user_data;
+  else
+    parent_node = priv->root;
+
+  priv->columns_dirty = TRUE;
+  sorted = GTK_TREE_STORE_IS_SORTED (tree_store);
+
+  n_children = g_node_n_children (parent_node);
+  if (position > n_children || position < 0)
+    position = n_children;
+
+  had_children = parent_node->children != NULL;
+  if (position == 0)
+    prev_node = NULL;
+  else
+    prev_node = g_node_nth_child (parent_node, position - 1);
+
+  if (parent)
+    path = gtk_tree_store_get_path (GTK_TREE_MODEL (tree_store), parent);
+  else
+    path = gtk_tree_path_new ();
+  gtk_tree_path_append_index (path, position);
+
+  /* Rows of a sorted store end up wherever they belong, so they are
+   * handed on in ranges of the ones that end up next to each other */
+  if (!sorted)
+    _gtk_tree_model_begin_rows_inserted (GTK_TREE_MODEL (tree_store), path, n_rows);
+
+  for (i = 0; i < n_rows; i++)
+    {
+      new_node = g_node_new (NULL);
+      g_node_insert_after (parent_node, prev_node, new_node);
+
+      iter.stamp = priv->stamp;
+      iter.user_data = new_node;
+
+      maybe_need_sort = FALSE;
+      gtk_tree_store_set_vector_internal (tree_store, &iter,
+                                          &changed, &maybe_need_sort,
+                                          columns, values + i * n_values, n_values);
+
+      if (sorted && maybe_need_sort)
+        gtk_tree_store_sort_iter_changed (tree_store, &iter, priv->sort_column_id, FALSE);
+      else
+        prev_node = new_node;
+
+      if (sorted)
+        {
+          gtk_tree_path_free (path);
+          path = gtk_tree_store_get_path (GTK_TREE_MODEL (tree_store), &iter);
+          _gtk_tree_model_continue_rows_inserted (GTK_TREE_MODEL (tree_store), path);
+        }
+
+      gtk_tree_model_row_inserted (GTK_TREE_MODEL (tree_store), path, &iter);
+
+      if (i == 0 && !had_children && parent_node != priv->root)
+        {
+          gtk_tree_path_up (path);
+          gtk_tree_model_row_has_child_toggled (GTK_TREE_MODEL (tree_store), path, parent);
+          gtk_tree_path_down (path);
+        }
+
+      gtk_tree_path_next (path);
+    }
+
+  _gtk_tree_model_end_rows_inserted (GTK_TREE_MODEL (tree_store));
+
+  gtk_tree_path_free (path);
+
+  validate_tree (tree_store);
+}
+
 /**
  * gtk_tree_store_prepend:
  * @tree_store: A #GtkTreeStore
@@ -28,6 +28,7 @@
 #include "gtktreednd.h"
 #include "gtktreeprivate.h"
 #include "gtkcellrenderer.h"
+#include "gtkcellrenderertextprivate.h"
 #include "gtkmarshalers.h"
 #include "gtkbuildable.h"
 #include "gtkbutton.h"
@@ -220,6 +221,9 @@ typedef enum {
 #define GTK_TREE_VIEW_PRIORITY_VALIDATE (GDK_PRIORITY_REDRAW + 5)
 #define GTK_TREE_VIEW_PRIORITY_SCROLL_SYNC (GTK_TREE_VIEW_PRIORITY_VALIDATE + 2)
 #define GTK_TREE_VIEW_TIME_MS_PER_IDLE 30
+#define GTK_TREE_VIEW_ROWS_PER_VALIDATE_BATCH 1000
+#define GTK_TREE_VIEW_MAX_VALIDATE_DISCARDS 3
+#define GTK_TREE_VIEW_ROW_CACHE_FACTOR 2
 #define SCROLL_EDGE_SIZE 15
 #define GTK_TREE_VIEW_SEARCH_DIALOG_TIMEOUT 5000
 #define AUTO_EXPAND_TIMEOUT 500
@@ -263,6 +267,89 @@ struct _TreeViewDragInfo
   guint dest_set : 1;
 };
 
+/* Rows measured in a thread when #GtkTreeView:threaded-validation is set.
+ * The cells of a row are in the order of the visible columns. */
+typedef struct _TreeViewValidateCell TreeViewValidateCell;
+struct _TreeViewValidateCell
+{
+  GtkCellRendererTextSnapshot *snapshot; /* NULL if the renderer is hidden */
+  gint minimum_width;
+  gint natural_width;
+  gint height;
+};
+
+typedef struct _TreeViewValidateRow TreeViewValidateRow;
+struct _TreeViewValidateRow
+{
+  GtkRBTree *tree;
+  GtkRBNode *node;
+  gint depth;
+};
+
+typedef struct _TreeViewValidateBatch TreeViewValidateBatch;
+struct _TreeViewValidateBatch
+{
+  guint stamp;
+  guint n_columns;
+  GtkTreeViewColumn **columns;
+  GtkCellRenderer **cells;
+  GArray *rows;
+  GArray *row_cells;
+
+  /* nodes that changed while the batch was measured */
+  GHashTable *stale_nodes;
+
+  /* how to set up the PangoContext in the thread */
+  PangoFontDescription *font_desc;
+  PangoLanguage *language;
+  PangoDirection base_dir;
+  gdouble resolution;
+  cairo_font_options_t *font_options;
+  gint focus_line_width;
+};
+
+/* Rendered rows when #GtkTreeView:cache-rows is set. Changes to a row
+ * drop it from the cache, changes to all rows clear the cache. Things
+ * that are set up before drawing, like the column widths, are compared
+ * in row_cache_check(). */
+typedef struct _TreeViewCachedRow TreeViewCachedRow;
+struct _TreeViewCachedRow
+{
+  cairo_surface_t *surfaces[2]; /* without and with prelight */
+  gint height;
+  guint serial;
+  gboolean selected;
+  gboolean parity;
+};
+
+typedef struct _TreeViewCachedColumn TreeViewCachedColumn;
+struct _TreeViewCachedColumn
+{
+  GtkTreeViewColumn *column;
+  gint width;
+  gboolean visible;
+  gboolean sort_indicator;
+};
+
+typedef struct _TreeViewRowCache TreeViewRowCache;
+struct _TreeViewRowCache
+{
+  GHashTable *rows; /* GtkRBNode -> TreeViewCachedRow */
+  GArray *columns;  /* TreeViewCachedColumn */
+  GtkTreeViewColumn *expander_column;
+  gint level_indentation;
+  gint width;
+  gint height;
+  gint scale;
+  guint serial;
+  guint n_drawn;   /* rows drawn since the last trim */
+  guint n_visible; /* most rows drawn at once at this height */
+  GtkTreeViewGridLines grid_lines;
+  gboolean show_expanders;
+  gboolean tree_lines_enabled;
+  gboolean has_rules;
+};
+
 
 struct _GtkTreeViewPrivate
 {
@@ -270,6 +357,8 @@ struct _GtkTreeViewPrivate
 
   /* tree information */
   GtkRBTree *tree;
+  /* the row being removed in row-deleted, which the model no longer has */
+  GtkTreePath *deleted_path;
 
   /* Container info */
   GList *children;
@@ -399,6 +488,19 @@ struct _GtkTreeViewPrivate
   /* fixed height */
   gint fixed_height;
 
+  /* height of the first rows that were measured, given to new rows
+   * until they are validated */
+  gint estimated_row_height;
+
+  /* the batch being measured in a thread */
+  TreeViewValidateBatch *validate_batch;
+
+  /* created on the first draw if cache_rows is set */
+  TreeViewRowCache *row_cache;
+  guint validate_stamp;
+  /* batches thrown away in a row */
+  guint validate_discards;
+
   /* Scroll-to functionality when unrealized */
   GtkTreeRowReference *scroll_to_path;
   GtkTreeViewColumn *scroll_to_column;
@@ -441,6 +543,8 @@ struct _GtkTreeViewPrivate
 
   guint fixed_height_mode : 1;
   guint fixed_height_check : 1;
+  guint threaded_validation : 1;
+  guint cache_rows : 1;
 
   guint activate_on_single_click : 1;
   guint reorderable : 1;
@@ -538,7 +642,9 @@ enum {
   PROP_ENABLE_GRID_LINES,
   PROP_ENABLE_TREE_LINES,
   PROP_TOOLTIP_COLUMN,
-  PROP_ACTIVATE_ON_SINGLE_CLICK
+  PROP_ACTIVATE_ON_SINGLE_CLICK,
+  PROP_THREADED_VALIDATION,
+  PROP_CACHE_ROWS
 };
 
 /* object signals */
@@ -669,6 +775,10 @@ static void gtk_tree_view_row_inserted                    (GtkTreeModel    *mode
 							   GtkTreePath     *path,
 							   GtkTreeIter     *iter,
 							   gpointer         data);
+static void gtk_tree_view_rows_inserted                   (GtkTreeModel    *model,
+							   GtkTreePath     *path,
+							   gint             n_rows,
+							   gpointer         data);
 static void gtk_tree_view_row_has_child_toggled           (GtkTreeModel    *model,
 							   GtkTreePath     *path,
 							   GtkTreeIter     *iter,
@@ -729,11 +839,20 @@ static void     gtk_tree_view_get_arrow_xrange               (GtkTreeView
 							      gint               *x2);
 static void     gtk_tree_view_adjustment_changed             (GtkAdjustment      *adjustment,
 							      GtkTreeView        *tree_view);
+static GtkRBTree *gtk_tree_view_new_rbtree                   (GtkTreeView        *tree_view);
+static gboolean gtk_tree_view_real_find_node                 (GtkTreeView        *tree_view,
+							      GtkTreePath        *path,
+							      gboolean            materialize,
+							      GtkRBTree         **tree,
+							      GtkRBNode         **node);
 static void     gtk_tree_view_build_tree                     (GtkTreeView        *tree_view,
 							      GtkRBTree          *tree,
+							      GtkTreeIter        *parent,
 							      GtkTreeIter        *iter,
 							      gint                depth,
 							      gboolean            recurse);
+static void     gtk_tree_view_clear_row_cache                (GtkTreeView        *tree_view);
+static void     gtk_tree_view_free_row_cache                 (GtkTreeView        *tree_view);
 static void     gtk_tree_view_clamp_node_visible             (GtkTreeView        *tree_view,
 							      GtkRBTree          *tree,
 							      GtkRBNode          *node);
@@ -1170,6 +1289,38 @@ gtk_tree_view_class_init (GtkTreeViewClass *class)
 							 FALSE,
 							 GTK_PARAM_READWRITE));
 
+  /**
+   * GtkTreeView:threaded-validation:
+   *
+   * Whether the heights of rows outside of the visible area are
+   * measured in a thread. See gtk_tree_view_set_threaded_validation().
+   *
+   * Since: 3.12
+   */
+  g_object_class_install_property (o_class,
+                                   PROP_THREADED_VALIDATION,
+                                   g_param_spec_boolean ("threaded-validation",
+							 P_("Threaded Validation"),
+							 P_("Whether to measure rows outside of the visible area in a thread"),
+							 FALSE,
+							 GTK_PARAM_READWRITE));
+
+  /**
+   * GtkTreeView:cache-rows:
+   *
+   * Whether rendered rows are kept around and reused when they haven't
+   * changed. See gtk_tree_view_set_cache_rows().
+   *
+   * Since: 3.12
+   */
+  g_object_class_install_property (o_class,
+                                   PROP_CACHE_ROWS,
+                                   g_param_spec_boolean ("cache-rows",
+							 P_("Cache Rows"),
+							 P_("Whether to reuse rendered rows that haven't changed"),
+							 FALSE,
+							 GTK_PARAM_READWRITE));
+
   /* Style properties */
 #define _TREE_VIEW_EXPANDER_SIZE 14
 #define _TREE_VIEW_VERTICAL_SEPARATOR 2
@@ -1728,6 +1879,7 @@ gtk_tree_view_init (GtkTreeView *tree_view)
   tree_view->priv->fixed_height = -1;
   tree_view->priv->fixed_height_mode = FALSE;
   tree_view->priv->fixed_height_check = 0;
+  tree_view->priv->estimated_row_height = -1;
   tree_view->priv->selection = _gtk_tree_selection_new_with_tree_view (tree_view);
   tree_view->priv->enable_search = TRUE;
   tree_view->priv->search_column = -1;
@@ -1848,6 +2000,12 @@ gtk_tree_view_set_property (GObject         *object,
     case PROP_ACTIVATE_ON_SINGLE_CLICK:
       gtk_tree_view_set_activate_on_single_click (tree_view, g_value_get_boolean (value));
       break;
+    case PROP_THREADED_VALIDATION:
+      gtk_tree_view_set_threaded_validation (tree_view, g_value_get_boolean (value));
+      break;
+    case PROP_CACHE_ROWS:
+      gtk_tree_view_set_cache_rows (tree_view, g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1932,6 +2090,12 @@ gtk_tree_view_get_property (GObject    *object,
     case PROP_ACTIVATE_ON_SINGLE_CLICK:
       g_value_set_boolean (value, tree_view->priv->activate_on_single_click);
       break;
+    case PROP_THREADED_VALIDATION:
+      g_value_set_boolean (value, tree_view->priv->threaded_validation);
+      break;
+    case PROP_CACHE_ROWS:
+      g_value_set_boolean (value, tree_view->priv->cache_rows);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -2339,6 +2503,8 @@ gtk_tree_view_unrealize (GtkWidget *widget)
   for (list = priv->columns; list; list = list->next)
     _gtk_tree_view_column_unrealize_button (GTK_TREE_VIEW_COLUMN (list->data));
 
+  gtk_tree_view_free_row_cache (tree_view);
+
   gtk_widget_unregister_window (widget, priv->bin_window);
   gdk_window_destroy (priv->bin_window);
   priv->bin_window = NULL;
@@ -4691,6 +4857,192 @@ gtk_tree_view_draw_grid_lines (GtkTreeView    *tree_view,
     }
 }
 
+static void
+cached_row_clear (TreeViewCachedRow *row)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (row->surfaces); i++)
+    {
+      if (row->surfaces[i])
+        {
+          cairo_surface_destroy (row->surfaces[i]);
+          row->surfaces[i] = NULL;
+        }
+    }
+}
+
+static void
+cached_row_free (gpointer data)
+{
+  TreeViewCachedRow *row = data;
+
+  cached_row_clear (row);
+  g_slice_free (TreeViewCachedRow, row);
+}
+
+static TreeViewRowCache *
+row_cache_new (void)
+{
+  TreeViewRowCache *cache;
+
+  cache = g_slice_new0 (TreeViewRowCache);
+  cache->rows = g_hash_table_new_full (NULL, NULL, NULL, cached_row_free);
+  cache->columns = g_array_new (FALSE, FALSE, sizeof (TreeViewCachedColumn));
+
+  return cache;
+}
+
+/* Throws away all rows if something changed that affects all of them */
+static void
+row_cache_check (TreeViewRowCache *cache,
+                 GtkTreeView      *tree_view,
+                 gint              width,
+                 gint              height)
+{
+  GtkTreeViewPrivate *priv = tree_view->priv;
+  GList *list;
+  gboolean changed;
+  guint i;
+
+  /* the rows stay valid, but fewer of them may fit now */
+  if (cache->height != height)
+    {
+      cache->height = height;
+      cache->n_visible = 0;
+    }
+
+  changed = cache->width != width ||
+            cache->scale != gdk_window_get_scale_factor (priv->bin_window) ||
+            cache->expander_column != priv->expander_column ||
+            cache->level_indentation != priv->level_indentation ||
+            cache->grid_lines != priv->grid_lines ||
+            cache->show_expanders != priv->show_expanders ||
+            cache->tree_lines_enabled != priv->tree_lines_enabled ||
+            cache->has_rules != priv->has_rules ||
+            cache->columns->len != g_list_length (priv->columns);
+
+  for (list = priv->columns, i = 0; list && !changed; list = list->next, i++)
+    {
+      TreeViewCachedColumn *cached = &g_array_index (cache->columns, TreeViewCachedColumn, i);
+      GtkTreeViewColumn *column = list->data;
+
+      changed = cached->column != column ||
+                cached->width != gtk_tree_view_column_get_width (column) ||
+                cached->visible != gtk_tree_view_column_get_visible (column) ||
+                cached->sort_indicator != gtk_tree_view_column_get_sort_indicator (column);
+    }
+
+  if (!changed)
+    return;
+
+  g_hash_table_remove_all (cache->rows);
+
+  cache->n_visible = 0;
+  cache->width = width;
+  cache->scale = gdk_window_get_scale_factor (priv->bin_window);
+  cache->expander_column = priv->expander_column;
+  cache->level_indentation = priv->level_indentation;
+  cache->grid_lines = priv->grid_lines;
+  cache->show_expanders = priv->show_expanders;
+  cache->tree_lines_enabled = priv->tree_lines_enabled;
+  cache->has_rules = priv->has_rules;
+
+  g_array_set_size (cache->columns, 0);
+  for (list = priv->columns; list; list = list->next)
+    {
+      TreeViewCachedColumn cached;
+
+      cached.column = list->data;
+      cached.width = gtk_tree_view_column_get_width (cached.column);
+      cached.visible = gtk_tree_view_column_get_visible (cached.column);
+      cached.sort_indicator = gtk_tree_view_column_get_sort_indicator (cached.column);
+      g_array_append_val (cache->columns, cached);
+    }
+}
+
+/* Forgets what was rendered for @node if it looks different now */
+static TreeViewCachedRow *
+row_cache_lookup (TreeViewRowCache *cache,
+                  GtkRBNode        *node,
+                  gint              height,
+                  gboolean          parity)
+{
+  TreeViewCachedRow *row;
+  gboolean selected;
+
+  selected = GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SELECTED);
+
+  row = g_hash_table_lookup (cache->rows, node);
+  if (row == NULL)
+    {
+      row = g_slice_new0 (TreeViewCachedRow);
+      g_hash_table_insert (cache->rows, node, row);
+    }
+  else if (row->height != height ||
+           row->selected != selected ||
+           row->parity != parity)
+    {
+      cached_row_clear (row);
+    }
+
+  row->height = height;
+  row->selected = selected;
+  row->parity = parity;
+  row->serial = cache->serial;
+  cache->n_drawn++;
+
+  return row;
+}
+
+static gboolean
+cached_row_is_unused (gpointer key,
+                      gpointer value,
+                      gpointer data)
+{
+  TreeViewCachedRow *row = value;
+  TreeViewRowCache *cache = data;
+
+  return row->serial != cache->serial;
+}
+
+/* Keeps the rows that were just drawn, and others while there's room.
+ * The room is a few screenfuls, counted by the most rows a single
+ * draw needed, so that exposing a single row doesn't empty the cache. */
+static void
+row_cache_trim (TreeViewRowCache *cache)
+{
+  cache->n_visible = MAX (cache->n_visible, cache->n_drawn);
+
+  if (g_hash_table_size (cache->rows) > GTK_TREE_VIEW_ROW_CACHE_FACTOR * cache->n_visible)
+    g_hash_table_foreach_remove (cache->rows, cached_row_is_unused, cache);
+
+  cache->n_drawn = 0;
+  cache->serial++;
+}
+
+static void
+gtk_tree_view_clear_row_cache (GtkTreeView *tree_view)
+{
+  if (tree_view->priv->row_cache)
+    g_hash_table_remove_all (tree_view->priv->row_cache->rows);
+}
+
+static void
+gtk_tree_view_free_row_cache (GtkTreeView *tree_view)
+{
+  TreeViewRowCache *cache = tree_view->priv->row_cache;
+
+  if (cache == NULL)
+    return;
+
+  g_hash_table_unref (cache->rows);
+  g_array_unref (cache->columns);
+  g_slice_free (TreeViewRowCache, cache);
+
+  tree_view->priv->row_cache = NULL;
+}
+
 /* Warning: Very scary function.
  * Modify at your own risk
  *
@@ -4734,6 +5086,11 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
   gboolean draw_vgrid_lines, draw_hgrid_lines;
   GtkStyleContext *context;
   gboolean parity;
+  TreeViewRowCache *row_cache = NULL;
+  TreeViewCachedRow *cached_row;
+  gboolean prelit;
+  cairo_t *row_cr;
+  GdkRectangle row_clip;
 
   rtl = (gtk_widget_get_direction (widget) == GTK_TEXT_DIR_RTL);
   context = gtk_widget_get_style_context (widget);
@@ -4806,6 +5163,16 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
 
   if (draw_vgrid_lines || draw_hgrid_lines)
     gtk_widget_style_get (widget, "grid-line-width", &grid_line_width, NULL);
+
+  /* horizontal grid lines depend on the area being drawn */
+  if (tree_view->priv->cache_rows && !draw_hgrid_lines)
+    {
+      if (tree_view->priv->row_cache == NULL)
+        tree_view->priv->row_cache = row_cache_new ();
+
+      row_cache = tree_view->priv->row_cache;
+      row_cache_check (row_cache, tree_view, bin_window_width, bin_window_height);
+    }
   
   n_visible_columns = 0;
   for (list = tree_view->priv->columns; list; list = list->next)
@@ -4863,6 +5230,42 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
       if (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SELECTED))
         flags |= GTK_CELL_RENDERER_SELECTED;
 
+      prelit = (flags & GTK_CELL_RENDERER_PRELIT) != 0;
+      cached_row = NULL;
+      row_cr = cr;
+      row_clip = clip;
+
+      /* The cursor row and the drop target get more drawn on top of
+       * the cells and the expander arrow has its own prelight, so
+       * those are always drawn as usual */
+      if (row_cache != NULL &&
+          max_height > 0 &&
+          node != tree_view->priv->cursor_node &&
+          node != drag_highlight &&
+          !(prelit && tree_view->priv->arrow_prelit))
+        {
+          cached_row = row_cache_lookup (row_cache, node, max_height, parity);
+
+          if (cached_row->surfaces[prelit] != NULL)
+            {
+              has_can_focus_cell = FALSE;
+              goto draw_cached_row;
+            }
+
+          /* Render the whole row, not just the part in the clip area */
+          cached_row->surfaces[prelit] =
+            gdk_window_create_similar_surface (tree_view->priv->bin_window,
+                                               CAIRO_CONTENT_COLOR_ALPHA,
+                                               bin_window_width, max_height);
+          row_cr = cairo_create (cached_row->surfaces[prelit]);
+          cairo_translate (row_cr, 0, - background_area.y);
+
+          row_clip.x = 0;
+          row_clip.y = background_area.y;
+          row_clip.width = bin_window_width;
+          row_clip.height = max_height;
+        }
+
       /* we *need* to set cell data on all cells before the call
        * to _has_can_focus_cell, else _has_can_focus_cell() does not
        * return a correct value.
@@ -4897,8 +5300,8 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
           n_col++;
           width = gtk_tree_view_column_get_width (column);
 
-	  if (cell_offset > clip.x + clip.width ||
-	      cell_offset + width < clip.x)
+	  if (cell_offset > row_clip.x + row_clip.width ||
+	      cell_offset + width < row_clip.x)
 	    {
 	      cell_offset += width;
 	      continue;
@@ -4957,7 +5360,7 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
 	      cell_area.height -= grid_line_width;
 	    }
 
-	  if (!gdk_rectangle_intersect (&clip, &background_area, NULL))
+	  if (!gdk_rectangle_intersect (&row_clip, &background_area, NULL))
 	    {
 	      cell_offset += gtk_tree_view_column_get_width (column);
 	      continue;
@@ -5018,14 +5421,14 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
             draw_focus = FALSE;
 
 	  /* Draw background */
-          gtk_render_background (context, cr,
+          gtk_render_background (context, row_cr,
                                  background_area.x,
                                  background_area.y,
                                  background_area.width,
                                  background_area.height);
 
           /* Draw frame */
-          gtk_render_frame (context, cr,
+          gtk_render_frame (context, row_cr,
                             background_area.x,
                             background_area.y,
                             background_area.width,
@@ -5057,7 +5460,7 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
                   gtk_style_context_save (context);
                   gtk_style_context_add_class (context, GTK_STYLE_CLASS_SEPARATOR);
 
-                  gtk_render_line (context, cr,
+                  gtk_render_line (context, row_cr,
                                    cell_area.x,
                                    cell_area.y + cell_area.height / 2,
                                    cell_area.x + cell_area.width,
@@ -5068,7 +5471,7 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
 	      else
                 {
                   _gtk_tree_view_column_cell_render (column,
-                                                     cr,
+                                                     row_cr,
                                                      &background_area,
                                                      &cell_area,
                                                      flags,
@@ -5079,7 +5482,7 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
 		  && (node->flags & GTK_RBNODE_IS_PARENT) == GTK_RBNODE_IS_PARENT)
 		{
 		  gtk_tree_view_draw_arrow (GTK_TREE_VIEW (widget),
-                                            cr,
+                                            row_cr,
 					    tree,
 					    node);
 		}
@@ -5091,7 +5494,7 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
                   gtk_style_context_save (context);
                   gtk_style_context_add_class (context, GTK_STYLE_CLASS_SEPARATOR);
 
-                  gtk_render_line (context, cr,
+                  gtk_render_line (context, row_cr,
                                    cell_area.x,
                                    cell_area.y + cell_area.height / 2,
                                    cell_area.x + cell_area.width,
@@ -5101,7 +5504,7 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
                 }
 	      else
 		_gtk_tree_view_column_cell_render (column,
-						   cr,
+						   row_cr,
 						   &background_area,
 						   &cell_area,
 						   flags,
@@ -5111,14 +5514,14 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
 	  if (draw_hgrid_lines)
 	    {
 	      if (background_area.y > 0)
-                gtk_tree_view_draw_line (tree_view, cr,
+                gtk_tree_view_draw_line (tree_view, row_cr,
                                          GTK_TREE_VIEW_GRID_LINE,
                                          background_area.x, background_area.y,
                                          background_area.x + background_area.width,
 			                 background_area.y);
 
 	      if (y_offset + max_height >= clip.height)
-                gtk_tree_view_draw_line (tree_view, cr,
+                gtk_tree_view_draw_line (tree_view, row_cr,
                                          GTK_TREE_VIEW_GRID_LINE,
                                          background_area.x, background_area.y + max_height,
                                          background_area.x + background_area.width,
@@ -5140,7 +5543,7 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
 	      if ((node->flags & GTK_RBNODE_IS_PARENT) == GTK_RBNODE_IS_PARENT
 		  && depth > 1)
 	        {
-                  gtk_tree_view_draw_line (tree_view, cr,
+                  gtk_tree_view_draw_line (tree_view, row_cr,
                                            GTK_TREE_VIEW_TREE_LINE,
                                            x + expander_size * (depth - 1.5) * mult,
                                            y1,
@@ -5149,7 +5552,7 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
 	        }
 	      else if (depth > 1)
 	        {
-                  gtk_tree_view_draw_line (tree_view, cr,
+                  gtk_tree_view_draw_line (tree_view, row_cr,
                                            GTK_TREE_VIEW_TREE_LINE,
                                            x + expander_size * (depth - 1.5) * mult,
                                            y1,
@@ -5163,15 +5566,15 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
 		  GtkRBNode *tmp_node;
 		  GtkRBTree *tmp_tree;
 
-	          if (!_gtk_rbtree_next (tree, node))
-                    gtk_tree_view_draw_line (tree_view, cr,
+	          if (!_gtk_rbtree_peek_next (tree, node))
+                    gtk_tree_view_draw_line (tree_view, row_cr,
                                              GTK_TREE_VIEW_TREE_LINE,
                                              x + expander_size * (depth - 1.5) * mult,
                                              y0,
                                              x + expander_size * (depth - 1.5) * mult,
                                              y1);
 		  else
-                    gtk_tree_view_draw_line (tree_view, cr,
+                    gtk_tree_view_draw_line (tree_view, row_cr,
                                              GTK_TREE_VIEW_TREE_LINE,
                                              x + expander_size * (depth - 1.5) * mult,
                                              y0,
@@ -5183,8 +5586,8 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
 
 		  for (i = depth - 2; i > 0; i--)
 		    {
-	              if (_gtk_rbtree_next (tmp_tree, tmp_node))
-                        gtk_tree_view_draw_line (tree_view, cr,
+	              if (_gtk_rbtree_peek_next (tmp_tree, tmp_node))
+                        gtk_tree_view_draw_line (tree_view, row_cr,
                                                  GTK_TREE_VIEW_TREE_LINE,
                                                  x + expander_size * (i - 0.5) * mult,
                                                  y0,
@@ -5201,6 +5604,17 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
 	  cell_offset += gtk_tree_view_column_get_width (column);
 	}
 
+      if (cached_row != NULL)
+        cairo_destroy (row_cr);
+
+    draw_cached_row:
+      if (cached_row != NULL)
+        {
+          cairo_set_source_surface (cr, cached_row->surfaces[prelit],
+                                    0, background_area.y);
+          cairo_paint (cr);
+        }
+
       if (node == drag_highlight)
         {
           /* Draw indicator for the drop
@@ -5340,6 +5754,9 @@ gtk_tree_view_bin_draw (GtkWidget      *widget,
   while (y_offset < clip.height);
 
 done:
+  if (row_cache)
+    row_cache_trim (row_cache);
+
   gtk_tree_view_draw_grid_lines (tree_view, cr);
 
   if (tree_view->priv->rubber_band_status == RUBBER_BAND_ACTIVE)
@@ -5993,21 +6410,24 @@ node_is_visible (GtkTreeView *tree_view,
   return FALSE;
 }
 
-/* Returns TRUE if it updated the size
+/* Returns TRUE if it updated the size.
+ * If @cells is given, it contains the already measured sizes of the
+ * cells in the visible columns and @iter is %NULL.
  */
 static gboolean
-validate_row (GtkTreeView *tree_view,
-	      GtkRBTree   *tree,
-	      GtkRBNode   *node,
-	      GtkTreeIter *iter,
-	      GtkTreePath *path)
+validate_row_full (GtkTreeView                *tree_view,
+                   GtkRBTree                  *tree,
+                   GtkRBNode                  *node,
+                   GtkTreeIter                *iter,
+                   gint                        depth,
+                   const TreeViewValidateCell *cells)
 {
   GtkTreeViewColumn *column;
   GList *list, *first_column, *last_column;
   gint height = 0;
   gint horizontal_separator;
   gint vertical_separator;
-  gint depth = gtk_tree_path_get_depth (path);
+  gint i;
   gboolean retval = FALSE;
   gboolean is_separator = FALSE;
   gboolean draw_vgrid_lines, draw_hgrid_lines;
@@ -6022,7 +6442,8 @@ validate_row (GtkTreeView *tree_view,
       ! GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_COLUMN_INVALID))
     return FALSE;
 
-  is_separator = row_is_separator (tree_view, iter, NULL);
+  if (iter)
+    is_separator = row_is_separator (tree_view, iter, NULL);
 
   gtk_widget_style_get (GTK_WIDGET (tree_view),
 			"focus-padding", &focus_pad,
@@ -6053,6 +6474,7 @@ validate_row (GtkTreeView *tree_view,
        first_column = first_column->next)
     ;
 
+  i = -1;
   for (list = tree_view->priv->columns; list; list = list->next)
     {
       gint padding = 0;
@@ -6065,18 +6487,31 @@ validate_row (GtkTreeView *tree_view,
       if (!gtk_tree_view_column_get_visible (column))
 	continue;
 
+      i++;
+
       if (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_COLUMN_INVALID) && 
 	  !_gtk_tree_view_column_cell_get_dirty (column))
 	continue;
 
       original_width = _gtk_tree_view_column_get_requested_width (column);
 
-      gtk_tree_view_column_cell_set_cell_data (column, tree_view->priv->model, iter,
-					       GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_PARENT),
-					       node->children?TRUE:FALSE);
-      gtk_tree_view_column_cell_get_size (column,
-					  NULL, NULL, NULL,
-					  NULL, &row_height);
+      if (cells)
+        {
+          if (cells[i].snapshot)
+            _gtk_tree_view_column_push_cell_width (column,
+                                                   cells[i].minimum_width,
+                                                   cells[i].natural_width);
+          row_height = cells[i].height;
+        }
+      else
+        {
+          gtk_tree_view_column_cell_set_cell_data (column, tree_view->priv->model, iter,
+                                                   GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_PARENT),
+                                                   node->children?TRUE:FALSE);
+          gtk_tree_view_column_cell_get_size (column,
+                                              NULL, NULL, NULL,
+                                              NULL, &row_height);
+        }
 
       if (!is_separator)
 	{
@@ -6131,6 +6566,17 @@ validate_row (GtkTreeView *tree_view,
   return retval;
 }
 
+static gboolean
+validate_row (GtkTreeView *tree_view,
+	      GtkRBTree   *tree,
+	      GtkRBNode   *node,
+	      GtkTreeIter *iter,
+	      GtkTreePath *path)
+{
+  return validate_row_full (tree_view, tree, node, iter,
+                            gtk_tree_path_get_depth (path), NULL);
+}
+
 
 static void
 validate_visible_area (GtkTreeView *tree_view)
@@ -6516,7 +6962,8 @@ initialize_fixed_height_mode (GtkTreeView *tree_view)
       GtkRBNode *node = NULL;
 
       tree = tree_view->priv->tree;
-      node = tree->root;
+      /* not the root, that may be a span */
+      node = _gtk_rbtree_first (tree);
 
       path = _gtk_tree_path_new_from_rbtree (tree, node);
       gtk_tree_model_get_iter (tree_view->priv->model, &iter, path);
@@ -6532,83 +6979,482 @@ initialize_fixed_height_mode (GtkTreeView *tree_view)
                                  tree_view->priv->fixed_height, TRUE);
 }
 
-/* Our strategy for finding nodes to validate is a little convoluted.  We find
- * the left-most uninvalidated node.  We then try walking right, validating
- * nodes.  Once we find a valid node, we repeat the previous process of finding
- * the first invalid node.
- */
+static gboolean prevent_recursion_hack = FALSE;
 
-static gboolean
-do_validate_rows (GtkTreeView *tree_view, gboolean queue_resize)
+static void
+update_size_for_validated_rows (GtkTreeView *tree_view,
+                                gint         y,
+                                gboolean     queue_resize)
 {
-  static gboolean prevent_recursion_hack = FALSE;
-
-  GtkRBTree *tree = NULL;
-  GtkRBNode *node = NULL;
-  gboolean validated_area = FALSE;
-  gint retval = TRUE;
-  GtkTreePath *path = NULL;
-  GtkTreeIter iter;
-  GTimer *timer;
-  gint i = 0;
+  GtkRequisition requisition;
 
-  gint y = -1;
-  gint prev_height = -1;
-  gboolean fixed_height = TRUE;
+  /* We temporarily guess a size, under the assumption that it will be the
+   * same when we get our next size_allocate.  If we don't do this, we'll be
+   * in an inconsistent state when we call top_row_to_dy. */
 
-  g_assert (tree_view);
+  /* FIXME: This is called from size_request, for some reason it is not infinitely
+   * recursing, we cannot call gtk_widget_get_preferred_size() here because that's
+   * not allowed (from inside ->get_preferred_width/height() implementations, one
+   * should call the vfuncs directly). However what is desired here is the full
+   * size including any margins and limited by any alignment (i.e. after 
+   * GtkWidget:adjust_size_request() is called).
+   *
+   * Currently bypassing this but the real solution is to not update the scroll adjustments
+   * untill we've recieved an allocation (never update scroll adjustments from size-requests).
+   */
+  prevent_recursion_hack = TRUE;
+  gtk_tree_view_get_preferred_width (GTK_WIDGET (tree_view), &requisition.width, NULL);
+  gtk_tree_view_get_preferred_height (GTK_WIDGET (tree_view), &requisition.height, NULL);
+  prevent_recursion_hack = FALSE;
 
-  /* prevent infinite recursion via get_preferred_width() */
-  if (prevent_recursion_hack)
-    return FALSE;
+  /* If rows above the current position have changed height, this has
+   * affected the current view and thus needs a redraw.
+   */
+  if (y != -1 && y < gtk_adjustment_get_value (tree_view->priv->vadjustment))
+    gtk_widget_queue_draw (GTK_WIDGET (tree_view));
 
-  if (tree_view->priv->tree == NULL)
-      return FALSE;
+  gtk_adjustment_set_upper (tree_view->priv->hadjustment,
+                            MAX (gtk_adjustment_get_upper (tree_view->priv->hadjustment), requisition.width));
+  gtk_adjustment_set_upper (tree_view->priv->vadjustment,
+                            MAX (gtk_adjustment_get_upper (tree_view->priv->vadjustment), requisition.height));
 
-  if (tree_view->priv->fixed_height_mode)
-    {
-      if (tree_view->priv->fixed_height < 0)
-        initialize_fixed_height_mode (tree_view);
+  if (queue_resize)
+    gtk_widget_queue_resize_no_redraw (GTK_WIDGET (tree_view));
+}
 
-      return FALSE;
-    }
+/* Threaded validation
+ *
+ * Measuring text is what makes validating rows slow, and the text of a
+ * GtkCellRendererText can be measured without the renderer or the
+ * widget. So with threaded validation do_validate_rows() only takes
+ * snapshots of the cells and a thread measures them. The visible area
+ * and rows that can't be measured that way are still validated right
+ * away. The results are applied in validate_batch_done() unless the
+ * rows might have changed in the meantime.
+ */
 
-  timer = g_timer_new ();
-  g_timer_start (timer);
+static GPrivate validate_font_map = G_PRIVATE_INIT (g_object_unref);
 
-  do
-    {
-      gboolean changed = FALSE;
+/* The rows in the batch that is being measured might have changed or
+ * be gone, so throw away the results */
+static void
+discard_validate_batch (GtkTreeView *tree_view)
+{
+  tree_view->priv->validate_stamp++;
+}
 
-      if (! GTK_RBNODE_FLAG_SET (tree_view->priv->tree->root, GTK_RBNODE_DESCENDANTS_INVALID))
-	{
-	  retval = FALSE;
-	  goto done;
-	}
+/* Only the results for @node are outdated */
+static void
+validate_batch_mark_stale (GtkTreeView *tree_view,
+                           GtkRBNode   *node)
+{
+  TreeViewValidateBatch *batch = tree_view->priv->validate_batch;
 
-      if (path != NULL)
-	{
-	  node = _gtk_rbtree_next (tree, node);
-	  if (node != NULL)
-	    {
-	      TREE_VIEW_INTERNAL_ASSERT (gtk_tree_model_iter_next (tree_view->priv->model, &iter), FALSE);
-	      gtk_tree_path_next (path);
-	    }
-	  else
-	    {
-	      gtk_tree_path_free (path);
-	      path = NULL;
-	    }
-	}
+  if (batch == NULL)
+    return;
 
-      if (path == NULL)
-	{
-	  tree = tree_view->priv->tree;
-	  node = tree_view->priv->tree->root;
+  if (batch->stale_nodes == NULL)
+    batch->stale_nodes = g_hash_table_new (NULL, NULL);
 
-	  g_assert (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_DESCENDANTS_INVALID));
+  g_hash_table_add (batch->stale_nodes, node);
+}
 
-	  do
+static void
+validate_cell_clear (TreeViewValidateCell *cell)
+{
+  if (cell->snapshot)
+    _gtk_cell_renderer_text_snapshot_free (cell->snapshot);
+}
+
+static void
+validate_batch_free (TreeViewValidateBatch *batch)
+{
+  guint i;
+
+  for (i = 0; i < batch->n_columns; i++)
+    {
+      g_object_unref (batch->columns[i]);
+      g_object_unref (batch->cells[i]);
+    }
+  g_free (batch->columns);
+  g_free (batch->cells);
+
+  if (batch->rows)
+    g_array_unref (batch->rows);
+  if (batch->row_cells)
+    g_array_unref (batch->row_cells);
+  if (batch->stale_nodes)
+    g_hash_table_unref (batch->stale_nodes);
+
+  if (batch->font_desc)
+    pango_font_description_free (batch->font_desc);
+  if (batch->font_options)
+    cairo_font_options_destroy (batch->font_options);
+
+  g_slice_free (TreeViewValidateBatch, batch);
+}
+
+/* Returns %NULL unless every visible column shows a single text renderer */
+static TreeViewValidateBatch *
+validate_batch_new (GtkTreeView *tree_view)
+{
+  TreeViewValidateBatch *batch;
+  const cairo_font_options_t *font_options;
+  PangoContext *context;
+  GList *list;
+  guint n_columns = 0;
+
+  for (list = tree_view->priv->columns; list; list = list->next)
+    if (gtk_tree_view_column_get_visible (list->data))
+      n_columns++;
+
+  if (n_columns == 0)
+    return NULL;
+
+  batch = g_slice_new0 (TreeViewValidateBatch);
+  batch->stamp = tree_view->priv->validate_stamp;
+  batch->columns = g_new0 (GtkTreeViewColumn *, n_columns);
+  batch->cells = g_new0 (GtkCellRenderer *, n_columns);
+
+  for (list = tree_view->priv->columns; list; list = list->next)
+    {
+      GtkTreeViewColumn *column = list->data;
+      GtkCellRenderer *cell;
+
+      if (!gtk_tree_view_column_get_visible (column))
+        continue;
+
+      cell = _gtk_tree_view_column_get_sole_cell (column);
+      if (cell == NULL || !GTK_IS_CELL_RENDERER_TEXT (cell))
+        {
+          validate_batch_free (batch);
+          return NULL;
+        }
+
+      batch->columns[batch->n_columns] = g_object_ref (column);
+      batch->cells[batch->n_columns] = g_object_ref (cell);
+      batch->n_columns++;
+    }
+
+  batch->rows = g_array_new (FALSE, FALSE, sizeof (TreeViewValidateRow));
+  batch->row_cells = g_array_new (FALSE, FALSE, sizeof (TreeViewValidateCell));
+  g_array_set_clear_func (batch->row_cells, (GDestroyNotify) validate_cell_clear);
+
+  context = gtk_widget_get_pango_context (GTK_WIDGET (tree_view));
+  batch->font_desc = pango_font_description_copy (pango_context_get_font_description (context));
+  batch->language = pango_context_get_language (context);
+  batch->base_dir = pango_context_get_base_dir (context);
+  batch->resolution = pango_cairo_context_get_resolution (context);
+  font_options = pango_cairo_context_get_font_options (context);
+  if (font_options)
+    batch->font_options = cairo_font_options_copy (font_options);
+
+  gtk_widget_style_get (GTK_WIDGET (tree_view),
+                        "focus-line-width", &batch->focus_line_width,
+                        NULL);
+
+  return batch;
+}
+
+/* Returns FALSE if the row must be validated with validate_row() */
+static gboolean
+validate_batch_add_row (TreeViewValidateBatch *batch,
+                        GtkTreeView           *tree_view,
+                        GtkRBTree             *tree,
+                        GtkRBNode             *node,
+                        GtkTreeIter           *iter,
+                        GtkTreePath           *path)
+{
+  TreeViewValidateRow row;
+  guint first, i;
+
+  if (!GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_INVALID) ||
+      row_is_separator (tree_view, iter, NULL))
+    return FALSE;
+
+  first = batch->row_cells->len;
+
+  for (i = 0; i < batch->n_columns; i++)
+    {
+      TreeViewValidateCell cell = { NULL, 0, 0, 0 };
+
+      gtk_tree_view_column_cell_set_cell_data (batch->columns[i], tree_view->priv->model, iter,
+                                               GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_PARENT),
+                                               node->children?TRUE:FALSE);
+
+      if (gtk_cell_renderer_get_visible (batch->cells[i]))
+        {
+          cell.snapshot = _gtk_cell_renderer_text_snapshot (GTK_CELL_RENDERER_TEXT (batch->cells[i]),
+                                                            GTK_WIDGET (tree_view));
+          if (cell.snapshot == NULL)
+            {
+              g_array_set_size (batch->row_cells, first);
+              return FALSE;
+            }
+        }
+
+      g_array_append_val (batch->row_cells, cell);
+    }
+
+  row.tree = tree;
+  row.node = node;
+  row.depth = gtk_tree_path_get_depth (path);
+  g_array_append_val (batch->rows, row);
+
+  return TRUE;
+}
+
+static void
+validate_batch_thread (GTask        *task,
+                       gpointer      source_object,
+                       gpointer      task_data,
+                       GCancellable *cancellable)
+{
+  TreeViewValidateBatch *batch = task_data;
+  PangoFontMap *font_map;
+  PangoContext *context;
+  gint focus_line_width;
+  guint i;
+
+  /* Pango objects must not be shared between threads, so every thread
+   * gets a font map of its own */
+  font_map = g_private_get (&validate_font_map);
+  if (font_map == NULL)
+    {
+      font_map = pango_cairo_font_map_new ();
+      g_private_set (&validate_font_map, font_map);
+    }
+
+  context = pango_font_map_create_context (font_map);
+  pango_context_set_font_description (context, batch->font_desc);
+  pango_context_set_language (context, batch->language);
+  pango_context_set_base_dir (context, batch->base_dir);
+  pango_cairo_context_set_resolution (context, batch->resolution);
+  pango_cairo_context_set_font_options (context, batch->font_options);
+
+  /* gtk_cell_area_request_renderer() adds the focus line around the cell */
+  focus_line_width = batch->focus_line_width * 2;
+
+  for (i = 0; i < batch->row_cells->len; i++)
+    {
+      TreeViewValidateCell *cell = &g_array_index (batch->row_cells, TreeViewValidateCell, i);
+
+      if (cell->snapshot == NULL)
+        continue;
+
+      _gtk_cell_renderer_text_snapshot_measure (cell->snapshot, context,
+                                                &cell->minimum_width,
+                                                &cell->natural_width,
+                                                &cell->height);
+
+      cell->minimum_width += focus_line_width;
+      cell->natural_width += focus_line_width;
+      cell->height += focus_line_width;
+    }
+
+  g_object_unref (context);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static gboolean
+validate_batch_columns_match (TreeViewValidateBatch *batch,
+                              GtkTreeView           *tree_view)
+{
+  GList *list;
+  guint i = 0;
+
+  for (list = tree_view->priv->columns; list; list = list->next)
+    {
+      if (!gtk_tree_view_column_get_visible (list->data))
+        continue;
+
+      if (i >= batch->n_columns || batch->columns[i] != list->data)
+        return FALSE;
+
+      i++;
+    }
+
+  return i == batch->n_columns;
+}
+
+static void
+validate_batch_apply (TreeViewValidateBatch *batch,
+                      GtkTreeView           *tree_view)
+{
+  gboolean validated_area = FALSE;
+  gboolean fixed_height = TRUE;
+  gint prev_height = -1;
+  gint y = -1;
+  guint i;
+
+  for (i = 0; i < batch->rows->len; i++)
+    {
+      TreeViewValidateRow *row = &g_array_index (batch->rows, TreeViewValidateRow, i);
+      TreeViewValidateCell *cells;
+      gint height;
+
+      /* validated with the visible area in the meantime */
+      if (!GTK_RBNODE_FLAG_SET (row->node, GTK_RBNODE_INVALID))
+        continue;
+
+      /* changed in the meantime, stays invalid */
+      if (batch->stale_nodes &&
+          g_hash_table_contains (batch->stale_nodes, row->node))
+        continue;
+
+      cells = &g_array_index (batch->row_cells, TreeViewValidateCell, i * batch->n_columns);
+
+      if (validate_row_full (tree_view, row->tree, row->node, NULL, row->depth, cells))
+        {
+          gint offset = gtk_tree_view_get_row_y_offset (tree_view, row->tree, row->node);
+
+          validated_area = TRUE;
+          if (y == -1 || y > offset)
+            y = offset;
+        }
+
+      height = gtk_tree_view_get_row_height (tree_view, row->node);
+      if (prev_height < 0)
+        prev_height = height;
+      else if (prev_height != height)
+        fixed_height = FALSE;
+    }
+
+  if (!tree_view->priv->fixed_height_check && prev_height >= 0)
+    {
+      if (fixed_height)
+        _gtk_rbtree_set_fixed_height (tree_view->priv->tree, prev_height, FALSE);
+
+      tree_view->priv->estimated_row_height = prev_height;
+      tree_view->priv->fixed_height_check = 1;
+    }
+
+  if (validated_area)
+    update_size_for_validated_rows (tree_view, y, TRUE);
+}
+
+static void
+validate_batch_done (GObject      *source_object,
+                     GAsyncResult *result,
+                     gpointer      user_data)
+{
+  GtkTreeView *tree_view = GTK_TREE_VIEW (source_object);
+  TreeViewValidateBatch *batch = g_task_get_task_data (G_TASK (result));
+
+  tree_view->priv->validate_batch = NULL;
+
+  if (batch->stamp == tree_view->priv->validate_stamp &&
+      tree_view->priv->tree != NULL &&
+      validate_batch_columns_match (batch, tree_view))
+    {
+      validate_batch_apply (batch, tree_view);
+      tree_view->priv->validate_discards = 0;
+    }
+  else
+    tree_view->priv->validate_discards++;
+
+  /* do_validate_rows() stopped while the batch was measured */
+  if (gtk_widget_get_realized (GTK_WIDGET (tree_view)) &&
+      !tree_view->priv->validate_rows_timer)
+    tree_view->priv->validate_rows_timer =
+      gdk_threads_add_idle_full (GTK_TREE_VIEW_PRIORITY_VALIDATE, (GSourceFunc) validate_rows, tree_view, NULL);
+}
+
+/* Our strategy for finding nodes to validate is a little convoluted.  We find
+ * the left-most uninvalidated node.  We then try walking right, validating
+ * nodes.  Once we find a valid node, we repeat the previous process of finding
+ * the first invalid node.
+ */
+
+static gboolean
+do_validate_rows (GtkTreeView *tree_view, gboolean queue_resize)
+{
+  TreeViewValidateBatch *batch = NULL;
+  GtkRBTree *tree = NULL;
+  GtkRBNode *node = NULL;
+  gboolean validated_area = FALSE;
+  gint retval = TRUE;
+  GtkTreePath *path = NULL;
+  GtkTreeIter iter;
+  GTimer *timer;
+  gint i = 0;
+
+  gint y = -1;
+  gint prev_height = -1;
+  gboolean fixed_height = TRUE;
+
+  g_assert (tree_view);
+
+  /* prevent infinite recursion via get_preferred_width() */
+  if (prevent_recursion_hack)
+    return FALSE;
+
+  if (tree_view->priv->tree == NULL)
+      return FALSE;
+
+  if (tree_view->priv->fixed_height_mode)
+    {
+      if (tree_view->priv->fixed_height < 0)
+        initialize_fixed_height_mode (tree_view);
+
+      return FALSE;
+    }
+
+  /* validate_batch_done() continues */
+  if (tree_view->priv->validate_batch)
+    return FALSE;
+
+  /* Batches keep getting thrown away while the rows change a lot, so
+   * do a round in the main thread then */
+  if (tree_view->priv->threaded_validation)
+    {
+      if (tree_view->priv->validate_discards < GTK_TREE_VIEW_MAX_VALIDATE_DISCARDS)
+        batch = validate_batch_new (tree_view);
+      else
+        tree_view->priv->validate_discards = 0;
+    }
+
+  timer = g_timer_new ();
+  g_timer_start (timer);
+
+  do
+    {
+      gboolean changed = FALSE;
+
+      if (! GTK_RBNODE_FLAG_SET (tree_view->priv->tree->root, GTK_RBNODE_DESCENDANTS_INVALID))
+	{
+	  retval = FALSE;
+	  goto done;
+	}
+
+      if (path != NULL)
+	{
+	  node = _gtk_rbtree_peek_next (tree, node);
+	  if (node != NULL && !GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
+	    {
+	      TREE_VIEW_INTERNAL_ASSERT (gtk_tree_model_iter_next (tree_view->priv->model, &iter), FALSE);
+	      gtk_tree_path_next (path);
+	    }
+	  else
+	    {
+	      gtk_tree_path_free (path);
+	      path = NULL;
+	    }
+	}
+
+      if (path == NULL)
+	{
+          /* the rows in the batch are still invalid and would be found again */
+          if (batch && batch->rows->len > 0)
+            break;
+
+	  tree = tree_view->priv->tree;
+	  node = tree_view->priv->tree->root;
+
+	  g_assert (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_DESCENDANTS_INVALID));
+
+	  do
 	    {
 	      if (!_gtk_rbtree_is_nil (node->left) &&
 		  GTK_RBNODE_FLAG_SET (node->left, GTK_RBNODE_DESCENDANTS_INVALID))
@@ -6635,10 +7481,43 @@ do_validate_rows (GtkTreeView *tree_view, gboolean queue_resize)
 		g_assert_not_reached ();
 	    }
 	  while (TRUE);
+
+	  if (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN) &&
+	      tree_view->priv->estimated_row_height >= 0)
+	    {
+	      gint offset = gtk_tree_view_get_row_y_offset (tree_view, tree, node);
+
+	      /* Measuring all rows of a huge model takes ages, so once
+	       * there is a guess, the rows of spans get that instead */
+	      _gtk_rbtree_node_set_height (tree, node, tree_view->priv->estimated_row_height);
+	      _gtk_rbtree_node_mark_valid (tree, node);
+	      validated_area = TRUE;
+	      if (y == -1 || y > offset)
+		y = offset;
+	      continue;
+	    }
+
 	  path = _gtk_tree_path_new_from_rbtree (tree, node);
+
+	  /* otherwise the first row of the span is measured to get one */
+	  if (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
+	    {
+	      gint depth = gtk_tree_path_get_depth (path);
+
+	      node = _gtk_rbtree_find_count (tree, gtk_tree_path_get_indices (path)[depth - 1] + 1);
+	    }
+
 	  gtk_tree_model_get_iter (tree_view->priv->model, &iter, path);
 	}
 
+      if (batch && validate_batch_add_row (batch, tree_view, tree, node, &iter, path))
+        {
+          if (batch->rows->len >= GTK_TREE_VIEW_ROWS_PER_VALIDATE_BATCH)
+            break;
+
+          continue;
+        }
+
       changed = validate_row (tree_view, tree, node, &iter, path);
       validated_area = changed || validated_area;
 
@@ -6665,52 +7544,35 @@ do_validate_rows (GtkTreeView *tree_view, gboolean queue_resize)
     }
   while (g_timer_elapsed (timer, NULL) < GTK_TREE_VIEW_TIME_MS_PER_IDLE / 1000.);
 
-  if (!tree_view->priv->fixed_height_check)
+  if (!tree_view->priv->fixed_height_check && prev_height >= 0)
    {
      if (fixed_height)
        _gtk_rbtree_set_fixed_height (tree_view->priv->tree, prev_height, FALSE);
 
+     tree_view->priv->estimated_row_height = prev_height;
      tree_view->priv->fixed_height_check = 1;
    }
   
  done:
   if (validated_area)
-    {
-      GtkRequisition requisition;
+    update_size_for_validated_rows (tree_view, y, queue_resize);
 
-      /* We temporarily guess a size, under the assumption that it will be the
-       * same when we get our next size_allocate.  If we don't do this, we'll be
-       * in an inconsistent state when we call top_row_to_dy. */
-
-      /* FIXME: This is called from size_request, for some reason it is not infinitely
-       * recursing, we cannot call gtk_widget_get_preferred_size() here because that's
-       * not allowed (from inside ->get_preferred_width/height() implementations, one
-       * should call the vfuncs directly). However what is desired here is the full
-       * size including any margins and limited by any alignment (i.e. after 
-       * GtkWidget:adjust_size_request() is called).
-       *
-       * Currently bypassing this but the real solution is to not update the scroll adjustments
-       * untill we've recieved an allocation (never update scroll adjustments from size-requests).
-       */
-      prevent_recursion_hack = TRUE;
-      gtk_tree_view_get_preferred_width (GTK_WIDGET (tree_view), &requisition.width, NULL);
-      gtk_tree_view_get_preferred_height (GTK_WIDGET (tree_view), &requisition.height, NULL);
-      prevent_recursion_hack = FALSE;
+  if (batch && batch->rows->len > 0)
+    {
+      GTask *task;
 
-      /* If rows above the current position have changed height, this has
-       * affected the current view and thus needs a redraw.
-       */
-      if (y != -1 && y < gtk_adjustment_get_value (tree_view->priv->vadjustment))
-        gtk_widget_queue_draw (GTK_WIDGET (tree_view));
+      tree_view->priv->validate_batch = batch;
 
-      gtk_adjustment_set_upper (tree_view->priv->hadjustment,
-                                MAX (gtk_adjustment_get_upper (tree_view->priv->hadjustment), requisition.width));
-      gtk_adjustment_set_upper (tree_view->priv->vadjustment,
-                                MAX (gtk_adjustment_get_upper (tree_view->priv->vadjustment), requisition.height));
+      task = g_task_new (tree_view, NULL, validate_batch_done, NULL);
+      g_task_set_task_data (task, batch, (GDestroyNotify) validate_batch_free);
+      g_task_run_in_thread (task, validate_batch_thread);
+      g_object_unref (task);
 
-      if (queue_resize)
-        gtk_widget_queue_resize_no_redraw (GTK_WIDGET (tree_view));
+      /* validate_batch_done() continues */
+      retval = FALSE;
     }
+  else if (batch)
+    validate_batch_free (batch);
 
   if (path) gtk_tree_path_free (path);
   g_timer_destroy (timer);
@@ -6945,6 +7807,8 @@ _gtk_tree_view_install_mark_rows_col_dirty (GtkTreeView *tree_view,
 					    gboolean     install_handler)
 {
   tree_view->priv->mark_rows_col_dirty = TRUE;
+  discard_validate_batch (tree_view);
+  gtk_tree_view_clear_row_cache (tree_view);
 
   if (install_handler)
     install_presize_handler (tree_view);
@@ -8463,7 +9327,10 @@ gtk_tree_view_style_updated (GtkWidget *widget)
 
       tree_view->priv->fixed_height = -1;
       _gtk_rbtree_mark_invalid (tree_view->priv->tree);
+      discard_validate_batch (tree_view);
     }
+
+  gtk_tree_view_clear_row_cache (tree_view);
 }
 
 
@@ -8719,18 +9586,25 @@ gtk_tree_view_row_changed (GtkTreeModel *model,
   else if (iter == NULL)
     gtk_tree_model_get_iter (model, iter, path);
 
-  if (_gtk_tree_view_find_node (tree_view,
-				path,
-				&tree,
-				&node))
+  if (gtk_tree_view_real_find_node (tree_view,
+				    path,
+				    FALSE,
+				    &tree,
+				    &node))
     /* We aren't actually showing the node */
     goto done;
 
-  if (tree == NULL)
+  /* Rows of spans are set up once they get a node of their own */
+  if (tree == NULL || GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
     goto done;
 
   _gtk_tree_view_accessible_changed (tree_view, tree, node);
 
+  validate_batch_mark_stale (tree_view, node);
+
+  if (tree_view->priv->row_cache)
+    g_hash_table_remove (tree_view->priv->row_cache->rows, node);
+
   if (tree_view->priv->fixed_height_mode
       && tree_view->priv->fixed_height >= 0)
     {
@@ -8796,14 +9670,27 @@ gtk_tree_view_row_inserted (GtkTreeModel *model,
   else if (iter == NULL)
     gtk_tree_model_get_iter (model, iter, path);
 
+  /* Part of a range, gtk_tree_view_rows_inserted() adds it */
+  if (_gtk_tree_model_is_pending_row (model, path))
+    {
+      if (free_path)
+        gtk_tree_path_free (path);
+      return;
+    }
+
   if (tree_view->priv->tree == NULL)
-    tree_view->priv->tree = _gtk_rbtree_new ();
+    tree_view->priv->tree = gtk_tree_view_new_rbtree (tree_view);
 
   tree = tree_view->priv->tree;
 
   /* Update all row-references */
   gtk_tree_row_reference_inserted (G_OBJECT (data), path);
   depth = gtk_tree_path_get_depth (path);
+
+  /* Parity is checked for every row, but tree lines depend on the
+   * neighbouring rows */
+  if (tree_view->priv->tree_lines_enabled)
+    gtk_tree_view_clear_row_cache (tree_view);
   indices = gtk_tree_path_get_indices (path);
 
   /* First, find the parent tree */
@@ -8850,7 +9737,8 @@ gtk_tree_view_row_inserted (GtkTreeModel *model,
   gtk_tree_model_ref_node (tree_view->priv->model, iter);
   if (indices[depth - 1] == 0)
     {
-      tmpnode = _gtk_rbtree_find_count (tree, 1);
+      /* don't give the old first row a node, the model moved it on */
+      tmpnode = _gtk_rbtree_peek_first (tree);
       tmpnode = _gtk_rbtree_insert_before (tree, tmpnode, height, FALSE);
     }
   else
@@ -8878,6 +9766,116 @@ gtk_tree_view_row_inserted (GtkTreeModel *model,
     gtk_tree_path_free (path);
 }
 
+/* Adds the rows of a range whose row-inserted signals
+ * gtk_tree_view_row_inserted() skipped. The number of rows is taken
+ * from the model, so rows that got into the tree some other way in
+ * the meantime, e.g. by expanding the parent from a signal handler,
+ * are not added twice.
+ */
+static void
+gtk_tree_view_rows_inserted (GtkTreeModel *model,
+			     GtkTreePath  *path,
+			     gint          n_rows,
+			     gpointer      data)
+{
+  GtkTreeView *tree_view = (GtkTreeView *) data;
+  GtkTreePath *tmppath;
+  GtkTreeIter parent;
+  GtkTreeIter iter;
+  GtkRBTree *tree;
+  GtkRBNode *node;
+  gint depth;
+  gint position;
+  gint missing;
+  gint height;
+  gint i;
+  gboolean valid;
+
+  /* Update all row-references */
+  tmppath = gtk_tree_path_copy (path);
+  for (i = 0; i < n_rows; i++)
+    {
+      gtk_tree_row_reference_inserted (G_OBJECT (data), tmppath);
+      gtk_tree_path_next (tmppath);
+    }
+  gtk_tree_path_free (tmppath);
+
+  depth = gtk_tree_path_get_depth (path);
+  position = gtk_tree_path_get_indices (path)[depth - 1];
+
+  /* First, find the level the rows went to */
+  if (depth == 1)
+    {
+      if (tree_view->priv->tree == NULL)
+        tree_view->priv->tree = gtk_tree_view_new_rbtree (tree_view);
+      tree = tree_view->priv->tree;
+      missing = gtk_tree_model_iter_n_children (model, NULL);
+    }
+  else
+    {
+      tmppath = gtk_tree_path_copy (path);
+      gtk_tree_path_up (tmppath);
+      if (_gtk_tree_view_find_node (tree_view, tmppath, &tree, &node) ||
+          node == NULL ||
+          !gtk_tree_model_get_iter (model, &parent, tmppath))
+        tree = NULL;
+      else
+        tree = node->children;
+      gtk_tree_path_free (tmppath);
+
+      /* We aren't showing the rows */
+      if (tree == NULL)
+        return;
+
+      missing = gtk_tree_model_iter_n_children (model, &parent);
+    }
+
+  missing -= tree->root->count;
+  if (missing <= 0)
+    return;
+  missing = MIN (missing, n_rows);
+  position += n_rows - missing;
+
+  /* like gtk_tree_view_build_tree() */
+  if (tree_view->priv->fixed_height > 0)
+    {
+      height = tree_view->priv->fixed_height;
+      valid = TRUE;
+    }
+  else
+    {
+      height = MAX (tree_view->priv->estimated_row_height, 0);
+      valid = FALSE;
+    }
+
+  if (!gtk_tree_model_iter_nth_child (model, &iter, depth == 1 ? NULL : &parent, position))
+    return;
+
+  /* Splicing in all nodes at once is a lot faster than inserting them
+   * one by one */
+  node = position > 0 ? _gtk_rbtree_find_count (tree, position) : NULL;
+  node = _gtk_rbtree_insert_many_after (tree, node, missing, height, valid);
+
+  for (i = 0; i < missing; i++)
+    {
+      /* ref the node */
+      gtk_tree_model_ref_node (tree_view->priv->model, &iter);
+
+      _gtk_tree_view_accessible_add (tree_view, tree, node);
+      node = _gtk_rbtree_peek_next (tree, node);
+
+      gtk_tree_model_iter_next (model, &iter);
+    }
+
+  if (tree_view->priv->tree_lines_enabled)
+    gtk_tree_view_clear_row_cache (tree_view);
+
+  if (valid)
+    gtk_widget_queue_resize (GTK_WIDGET (tree_view));
+  else
+    install_presize_handler (tree_view);
+}
+
 static void
 gtk_tree_view_row_has_child_toggled (GtkTreeModel *model,
 				     GtkTreePath  *path,
@@ -8893,6 +9891,9 @@ gtk_tree_view_row_has_child_toggled (GtkTreeModel *model,
 
   g_return_if_fail (path != NULL || iter != NULL);
 
+  discard_validate_batch (tree_view);
+  gtk_tree_view_clear_row_cache (tree_view);
+
   if (iter)
     real_iter = *iter;
 
@@ -8904,14 +9905,16 @@ gtk_tree_view_row_has_child_toggled (GtkTreeModel *model,
   else if (iter == NULL)
     gtk_tree_model_get_iter (model, &real_iter, path);
 
-  if (_gtk_tree_view_find_node (tree_view,
-				path,
-				&tree,
-				&node))
+  if (gtk_tree_view_real_find_node (tree_view,
+				    path,
+				    FALSE,
+				    &tree,
+				    &node))
     /* We aren't actually showing the node */
     goto done;
 
-  if (tree == NULL)
+  /* Rows of spans are set up once they get a node of their own */
+  if (tree == NULL || GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
     goto done;
 
   has_child = gtk_tree_model_iter_has_child (model, &real_iter);
@@ -8964,7 +9967,7 @@ count_children_helper (GtkRBTree *tree,
 {
   if (node->children)
     _gtk_rbtree_traverse (node->children, node->children->root, G_POST_ORDER, count_children_helper, data);
-  (*((gint *)data))++;
+  (*((gint *)data)) += GTK_RBNODE_GET_ROWS (node);
 }
 
 static void
@@ -8995,13 +9998,20 @@ gtk_tree_view_row_deleted (GtkTreeModel *model,
 
   g_return_if_fail (path != NULL);
 
+  discard_validate_batch (tree_view);
+  gtk_tree_view_clear_row_cache (tree_view);
+
   gtk_tree_row_reference_deleted (G_OBJECT (data), path);
 
-  if (_gtk_tree_view_find_node (tree_view, path, &tree, &node))
-    return;
+  /* Rows getting a node of their own need to know the model moved on */
+  tree_view->priv->deleted_path = path;
 
-  if (tree == NULL)
-    return;
+  if (_gtk_tree_view_find_node (tree_view, path, &tree, &node) ||
+      tree == NULL)
+    {
+      tree_view->priv->deleted_path = NULL;
+      return;
+    }
 
   /* check if the selection has been changed */
   _gtk_rbtree_traverse (tree, node, G_POST_ORDER,
@@ -9073,6 +10083,8 @@ gtk_tree_view_row_deleted (GtkTreeModel *model,
       tree_view->priv->destroy_count_func (tree_view, path, child_count, tree_view->priv->destroy_count_data);
     }
 
+  tree_view->priv->deleted_path = NULL;
+
   if (tree->root->count == 1)
     {
       if (tree_view->priv->tree == tree)
@@ -9088,6 +10100,9 @@ gtk_tree_view_row_deleted (GtkTreeModel *model,
     {
       _gtk_tree_view_accessible_remove (tree_view, tree, node);
       _gtk_rbtree_remove_node (tree, node);
+
+      /* see gtk_tree_view_build_tree() */
+      _gtk_rbtree_first (tree);
     }
 
   if (! gtk_tree_row_reference_valid (tree_view->priv->top_row))
@@ -9132,6 +10147,9 @@ gtk_tree_view_rows_reordered (GtkTreeModel *model,
   if (len < 2)
     return;
 
+  discard_validate_batch (tree_view);
+  gtk_tree_view_clear_row_cache (tree_view);
+
   gtk_tree_row_reference_reordered (G_OBJECT (data),
 				    parent,
 				    iter,
@@ -9159,6 +10177,8 @@ gtk_tree_view_rows_reordered (GtkTreeModel *model,
   ensure_unprelighted (tree_view);
 
   _gtk_rbtree_reorder (tree, new_order, len);
+  /* see gtk_tree_view_build_tree() */
+  _gtk_rbtree_first (tree);
 
   _gtk_tree_view_accessible_reorder (tree_view);
 
@@ -9288,28 +10308,140 @@ gtk_tree_view_get_arrow_xrange (GtkTreeView *tree_view,
     *x2 = *x1;
 }
 
+/* Called when a row that was part of a span gets a node of its own,
+ * see gtk_tree_view_build_tree(). Rows are only reffed then.
+ */
+static void
+gtk_tree_view_materialize_row (GtkRBTree *tree,
+                               GtkRBNode *node,
+                               gpointer   data)
+{
+  GtkTreeView *tree_view = data;
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  path = _gtk_tree_path_new_from_rbtree (tree, node);
+
+  /* In row-deleted the model is already a row ahead of us */
+  if (tree_view->priv->deleted_path)
+    {
+      GtkTreePath *deleted = tree_view->priv->deleted_path;
+      gint *indices = gtk_tree_path_get_indices (path);
+      gint *deleted_indices = gtk_tree_path_get_indices (deleted);
+      gint depth = gtk_tree_path_get_depth (deleted);
+      gint i;
+
+      if (gtk_tree_path_compare (path, deleted) == 0 ||
+          gtk_tree_path_is_ancestor (deleted, path))
+        {
+          gtk_tree_path_free (path);
+          return;
+        }
+
+      if (gtk_tree_path_get_depth (path) >= depth)
+        {
+          for (i = 0; i < depth - 1; i++)
+            if (indices[i] != deleted_indices[i])
+              break;
+
+          if (i == depth - 1 && indices[i] > deleted_indices[i])
+            indices[i]--;
+        }
+    }
+
+  if (gtk_tree_model_get_iter (tree_view->priv->model, &iter, path))
+    {
+      gtk_tree_model_ref_node (tree_view->priv->model, &iter);
+
+      if (!tree_view->priv->is_list &&
+          gtk_tree_model_iter_has_child (tree_view->priv->model, &iter))
+        GTK_RBNODE_SET_FLAG (node, GTK_RBNODE_IS_PARENT);
+    }
+
+  /* spans may carry a guess, see do_validate_rows() */
+  if (tree_view->priv->fixed_height <= 0 &&
+      !GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_INVALID))
+    {
+      _gtk_rbtree_node_mark_invalid (tree, node);
+      install_presize_handler (tree_view);
+    }
+
+  gtk_tree_path_free (path);
+}
+
+static GtkRBTree *
+gtk_tree_view_new_rbtree (GtkTreeView *tree_view)
+{
+  GtkRBTree *tree;
+
+  tree = _gtk_rbtree_new ();
+  _gtk_rbtree_set_materialize_func (tree, gtk_tree_view_materialize_row, tree_view);
+
+  return tree;
+}
+
 static void
 gtk_tree_view_build_tree (GtkTreeView *tree_view,
 			  GtkRBTree   *tree,
+			  GtkTreeIter *parent,
 			  GtkTreeIter *iter,
 			  gint         depth,
 			  gboolean     recurse)
 {
   GtkRBNode *temp = NULL;
+  GtkRBNode *next;
   GtkTreePath *path = NULL;
+  gint height;
+  gboolean valid;
+
+  if (tree_view->priv->fixed_height > 0)
+    {
+      height = tree_view->priv->fixed_height;
+      valid = TRUE;
+    }
+  else
+    {
+      /* Rows get validated later, until then a guess keeps the
+       * scrollbar from jumping around */
+      height = MAX (tree_view->priv->estimated_row_height, 0);
+      valid = FALSE;
+    }
+
+  if (!recurse)
+    {
+      /* One span stands in for all rows, which get nodes of their own
+       * and are reffed only once something looks at them, in
+       * gtk_tree_view_materialize_row(). That keeps attaching a huge
+       * model cheap. The first row always has a node, so filter and
+       * sort models keep the level around. */
+      _gtk_rbtree_insert_span_after (tree, NULL,
+                                     gtk_tree_model_iter_n_children (tree_view->priv->model, parent),
+                                     height,
+                                     valid);
+      _gtk_rbtree_first (tree);
+      return;
+    }
+
+  /* Creating all nodes at once is a lot faster than inserting them
+   * one by one, which matters for huge models */
+  next = _gtk_rbtree_fill (tree,
+                           gtk_tree_model_iter_n_children (tree_view->priv->model, parent),
+                           height,
+                           valid);
 
   do
     {
       gtk_tree_model_ref_node (tree_view->priv->model, iter);
-      temp = _gtk_rbtree_insert_after (tree, temp, 0, FALSE);
 
-      if (tree_view->priv->fixed_height > 0)
+      if (next != NULL)
         {
-          if (GTK_RBNODE_FLAG_SET (temp, GTK_RBNODE_INVALID))
-	    {
-              _gtk_rbtree_node_set_height (tree, temp, tree_view->priv->fixed_height);
-	      _gtk_rbtree_node_mark_valid (tree, temp);
-	    }
+          temp = next;
+          next = _gtk_rbtree_next (tree, temp);
+        }
+      else
+        {
+          /* the model has more rows than it told us */
+          temp = _gtk_rbtree_insert_after (tree, temp, height, valid);
         }
 
       if (tree_view->priv->is_list)
@@ -9336,7 +10468,7 @@ gtk_tree_view_build_tree (GtkTreeView *tree_view,
 	          temp->children = _gtk_rbtree_new ();
 	          temp->children->parent_tree = tree;
 	          temp->children->parent_node = temp;
-	          gtk_tree_view_build_tree (tree_view, temp->children, &child, depth + 1, recurse);
+	          gtk_tree_view_build_tree (tree_view, temp->children, iter, &child, depth + 1, recurse);
 		}
 	    }
 	}
@@ -9349,6 +10481,13 @@ gtk_tree_view_build_tree (GtkTreeView *tree_view,
     }
   while (gtk_tree_model_iter_next (tree_view->priv->model, iter));
 
+  /* or fewer */
+  if (next != NULL)
+    {
+      while ((next = _gtk_rbtree_next (tree, temp)) != NULL)
+        _gtk_rbtree_remove_node (tree, next);
+    }
+
   if (path)
     gtk_tree_path_free (path);
 }
@@ -9467,8 +10606,9 @@ _gtk_tree_path_new_from_rbtree (GtkRBTree   *tree,
     {
       while (!_gtk_rbtree_is_nil (tmp_node))
 	{
+	  /* the rows of tmp_node and its left branch, tmp_node may be a span */
 	  if (tmp_node->right == last)
-	    count += 1 + tmp_node->left->count;
+	    count += tmp_node->count - tmp_node->right->count;
 	  last = tmp_node;
 	  tmp_node = tmp_node->parent;
 	}
@@ -9486,13 +10626,15 @@ _gtk_tree_path_new_from_rbtree (GtkRBTree   *tree,
 
 /* Returns TRUE if we ran out of tree before finding the path.  If the path is
  * invalid (ie. points to a node that's not in the tree), *tree and *node are
- * both set to NULL.
+ * both set to NULL.  Unless @materialize is set, *node may be the span
+ * the row is part of.
  */
-gboolean
-_gtk_tree_view_find_node (GtkTreeView  *tree_view,
-			  GtkTreePath  *path,
-			  GtkRBTree   **tree,
-			  GtkRBNode   **node)
+static gboolean
+gtk_tree_view_real_find_node (GtkTreeView  *tree_view,
+			      GtkTreePath  *path,
+			      gboolean      materialize,
+			      GtkRBTree   **tree,
+			      GtkRBNode   **node)
 {
   GtkRBNode *tmpnode = NULL;
   GtkRBTree *tmptree = tree_view->priv->tree;
@@ -9507,7 +10649,10 @@ _gtk_tree_view_find_node (GtkTreeView  *tree_view,
     return FALSE;
   do
     {
-      tmpnode = _gtk_rbtree_find_count (tmptree, indices[i] + 1);
+      if (materialize)
+        tmpnode = _gtk_rbtree_find_count (tmptree, indices[i] + 1);
+      else
+        tmpnode = _gtk_rbtree_peek_count (tmptree, indices[i] + 1);
       ++i;
       if (tmpnode == NULL)
 	{
@@ -9530,6 +10675,15 @@ _gtk_tree_view_find_node (GtkTreeView  *tree_view,
   while (1);
 }
 
+gboolean
+_gtk_tree_view_find_node (GtkTreeView  *tree_view,
+			  GtkTreePath  *path,
+			  GtkRBTree   **tree,
+			  GtkRBNode   **node)
+{
+  return gtk_tree_view_real_find_node (tree_view, path, TRUE, tree, node);
+}
+
 static gboolean
 gtk_tree_view_is_expander_column (GtkTreeView       *tree_view,
 				  GtkTreeViewColumn *column)
@@ -9607,10 +10761,28 @@ gtk_tree_view_unref_tree_helper (GtkTreeModel *model,
 				 GtkRBTree    *tree,
 				 GtkRBNode    *node)
 {
+  GtkTreeIter parent;
+  gboolean has_parent;
+  gint index = 0;
   gint retval = FALSE;
-  do
+
+  has_parent = gtk_tree_model_iter_parent (model, &parent, iter);
+
+  while (node != NULL)
     {
-      g_return_val_if_fail (node != NULL, FALSE);
+      if (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SELECTED))
+	retval = TRUE;
+
+      /* the rows of spans were never reffed */
+      if (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
+        {
+          index += GTK_RBNODE_GET_ROWS (node);
+          node = _gtk_rbtree_peek_next (tree, node);
+          if (node != NULL &&
+              !gtk_tree_model_iter_nth_child (model, iter, has_parent ? &parent : NULL, index))
+            break;
+          continue;
+        }
 
       if (node->children)
 	{
@@ -9619,7 +10791,7 @@ gtk_tree_view_unref_tree_helper (GtkTreeModel *model,
 	  GtkRBNode *new_node;
 
 	  new_tree = node->children;
-          new_node = _gtk_rbtree_first (new_tree);
+          new_node = _gtk_rbtree_peek_first (new_tree);
 
 	  if (!gtk_tree_model_iter_children (model, &child, iter))
 	    return FALSE;
@@ -9627,12 +10799,12 @@ gtk_tree_view_unref_tree_helper (GtkTreeModel *model,
 	  retval = gtk_tree_view_unref_tree_helper (model, &child, new_tree, new_node) | retval;
 	}
 
-      if (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SELECTED))
-	retval = TRUE;
       gtk_tree_model_unref_node (model, iter);
-      node = _gtk_rbtree_next (tree, node);
+      index++;
+      node = _gtk_rbtree_peek_next (tree, node);
+      if (node != NULL && !gtk_tree_model_iter_next (model, iter))
+        break;
     }
-  while (gtk_tree_model_iter_next (model, iter));
 
   return retval;
 }
@@ -9649,7 +10821,7 @@ gtk_tree_view_unref_and_check_selection_tree (GtkTreeView *tree_view,
   if (!tree)
     return FALSE;
 
-  node = _gtk_rbtree_first (tree);
+  node = _gtk_rbtree_peek_first (tree);
 
   g_return_val_if_fail (node != NULL, FALSE);
   path = _gtk_tree_path_new_from_rbtree (tree, node);
@@ -10605,6 +11777,9 @@ gtk_tree_view_move_cursor_start_end (GtkTreeView *tree_view,
 	{
 	  while (cursor_node && !_gtk_rbtree_is_nil (cursor_node->right))
 	    cursor_node = cursor_node->right;
+	  /* the last row of a span gets a node of its own */
+	  if (GTK_RBNODE_FLAG_SET (cursor_node, GTK_RBNODE_IS_SPAN))
+	    cursor_node = _gtk_rbtree_find_count (cursor_tree, cursor_tree->root->count);
 	  if (cursor_node->children == NULL)
 	    break;
 
@@ -11209,6 +12384,9 @@ gtk_tree_view_set_model (GtkTreeView  *tree_view,
   if (model == tree_view->priv->model)
     return;
 
+  discard_validate_batch (tree_view);
+  gtk_tree_view_clear_row_cache (tree_view);
+
   if (tree_view->priv->scroll_to_path)
     {
       gtk_tree_row_reference_free (tree_view->priv->scroll_to_path);
@@ -11240,6 +12418,9 @@ gtk_tree_view_set_model (GtkTreeView  *tree_view,
       g_signal_handlers_disconnect_by_func (tree_view->priv->model,
 					    gtk_tree_view_rows_reordered,
 					    tree_view);
+      _gtk_tree_model_remove_rows_inserted_hook (tree_view->priv->model,
+                                                 gtk_tree_view_rows_inserted,
+                                                 tree_view);
 
       for (; tmplist; tmplist = tmplist->next)
 	_gtk_tree_view_column_unset_model (tmplist->data,
@@ -11264,6 +12445,7 @@ gtk_tree_view_set_model (GtkTreeView  *tree_view,
       tree_view->priv->search_column = -1;
       tree_view->priv->fixed_height_check = 0;
       tree_view->priv->fixed_height = -1;
+      tree_view->priv->estimated_row_height = -1;
       tree_view->priv->dy = tree_view->priv->top_row_dy = 0;
       tree_view->priv->last_button_x = -1;
       tree_view->priv->last_button_y = -1;
@@ -11313,6 +12495,9 @@ gtk_tree_view_set_model (GtkTreeView  *tree_view,
 			"rows-reordered",
 			G_CALLBACK (gtk_tree_view_rows_reordered),
 			tree_view);
+      _gtk_tree_model_add_rows_inserted_hook (tree_view->priv->model,
+                                              gtk_tree_view_rows_inserted,
+                                              tree_view);
 
       flags = gtk_tree_model_get_flags (tree_view->priv->model);
       if ((flags & GTK_TREE_MODEL_LIST_ONLY) == GTK_TREE_MODEL_LIST_ONLY)
@@ -11323,8 +12508,8 @@ gtk_tree_view_set_model (GtkTreeView  *tree_view,
       path = gtk_tree_path_new_first ();
       if (gtk_tree_model_get_iter (tree_view->priv->model, &iter, path))
 	{
-	  tree_view->priv->tree = _gtk_rbtree_new ();
-	  gtk_tree_view_build_tree (tree_view, tree_view->priv->tree, &iter, 1, FALSE);
+	  tree_view->priv->tree = gtk_tree_view_new_rbtree (tree_view);
+	  gtk_tree_view_build_tree (tree_view, tree_view->priv->tree, NULL, &iter, 1, FALSE);
           _gtk_tree_view_accessible_add (tree_view, tree_view->priv->tree, NULL);
 	}
       gtk_tree_path_free (path);
@@ -11769,6 +12954,112 @@ gtk_tree_view_get_activate_on_single_click (GtkTreeView *tree_view)
   return tree_view->priv->activate_on_single_click;
 }
 
+/**
+ * gtk_tree_view_set_threaded_validation:
+ * @tree_view: a #GtkTreeView
+ * @threaded: %TRUE to measure rows in a thread
+ *
+ * Makes @tree_view measure the heights of rows outside of the visible
+ * area in a thread instead of in idle handlers. This makes the
+ * scrollbar settle much faster for big models with text of varying
+ * height.
+ *
+ * Only rows whose visible columns all show a single
+ * #GtkCellRendererText that does not wrap its text are measured in the
+ * thread, all other rows are measured as usual. Cell data functions are
+ * still called in the main thread.
+ *
+ * Since: 3.12
+ **/
+void
+gtk_tree_view_set_threaded_validation (GtkTreeView *tree_view,
+                                       gboolean     threaded)
+{
+  g_return_if_fail (GTK_IS_TREE_VIEW (tree_view));
+
+  threaded = threaded != FALSE;
+
+  if (tree_view->priv->threaded_validation == threaded)
+    return;
+
+  tree_view->priv->threaded_validation = threaded;
+  g_object_notify (G_OBJECT (tree_view), "threaded-validation");
+}
+
+/**
+ * gtk_tree_view_get_threaded_validation:
+ * @tree_view: a #GtkTreeView
+ *
+ * Gets the setting set by gtk_tree_view_set_threaded_validation().
+ *
+ * Return value: %TRUE if rows are measured in a thread
+ *
+ * Since: 3.12
+ **/
+gboolean
+gtk_tree_view_get_threaded_validation (GtkTreeView *tree_view)
+{
+  g_return_val_if_fail (GTK_IS_TREE_VIEW (tree_view), FALSE);
+
+  return tree_view->priv->threaded_validation;
+}
+
+/**
+ * gtk_tree_view_set_cache_rows:
+ * @tree_view: a #GtkTreeView
+ * @cache_rows: %TRUE to reuse rendered rows
+ *
+ * Makes @tree_view keep rendered rows around and copy them to the
+ * screen when they are drawn again, for example when the pointer moves
+ * over the view or when it is scrolled. Rows are rendered anew when
+ * the model emits #GtkTreeModel::row-changed for them, when they are
+ * selected or unselected and when the style or the column widths
+ * change.
+ *
+ * Only use this if the contents of the cells depend on nothing but the
+ * model, as changes to cell data functions or cell renderers are not
+ * noticed. Rows are always drawn as usual when horizontal grid lines
+ * are shown.
+ *
+ * Since: 3.12
+ **/
+void
+gtk_tree_view_set_cache_rows (GtkTreeView *tree_view,
+                              gboolean     cache_rows)
+{
+  g_return_if_fail (GTK_IS_TREE_VIEW (tree_view));
+
+  cache_rows = cache_rows != FALSE;
+
+  if (tree_view->priv->cache_rows == cache_rows)
+    return;
+
+  tree_view->priv->cache_rows = cache_rows;
+
+  if (!cache_rows)
+    gtk_tree_view_free_row_cache (tree_view);
+
+  g_object_notify (G_OBJECT (tree_view), "cache-rows");
+}
+
+/**
+ * gtk_tree_view_get_cache_rows:
+ * @tree_view: a #GtkTreeView
+ *
+ * Gets the setting set by gtk_tree_view_set_cache_rows().
+ *
+ * Return value: %TRUE if rendered rows are reused
+ *
+ * Since: 3.12
+ **/
+gboolean
+gtk_tree_view_get_cache_rows (GtkTreeView *tree_view)
+{
+  g_return_val_if_fail (GTK_IS_TREE_VIEW (tree_view), FALSE);
+
+  return tree_view->priv->cache_rows;
+}
+
 /* Public Column functions
  */
 
@@ -12521,14 +13812,15 @@ gtk_tree_view_collapse_all (GtkTreeView *tree_view)
   indices = gtk_tree_path_get_indices (path);
 
   tree = tree_view->priv->tree;
-  node = _gtk_rbtree_first (tree);
+  node = _gtk_rbtree_peek_first (tree);
 
+  /* spans are skipped, they are never expanded */
   while (node)
     {
       if (node->children)
 	gtk_tree_view_real_collapse_row (tree_view, path, tree, node, FALSE);
-      indices[0]++;
-      node = _gtk_rbtree_next (tree, node);
+      indices[0] += GTK_RBNODE_GET_ROWS (node);
+      node = _gtk_rbtree_peek_next (tree, node);
     }
 
   gtk_tree_path_free (path);
@@ -12641,6 +13933,8 @@ gtk_tree_view_real_expand_row (GtkTreeView *tree_view,
   if (expand)
     return FALSE;
 
+  gtk_tree_view_clear_row_cache (tree_view);
+
   node->children = _gtk_rbtree_new ();
   node->children->parent_tree = tree;
   node->children->parent_node = node;
@@ -12649,6 +13943,7 @@ gtk_tree_view_real_expand_row (GtkTreeView *tree_view,
 
   gtk_tree_view_build_tree (tree_view,
 			    node->children,
+			    &iter,
 			    &temp,
 			    gtk_tree_path_get_depth (path) + 1,
 			    open_all);
@@ -12738,6 +14033,9 @@ gtk_tree_view_real_collapse_row (GtkTreeView *tree_view,
   if (collapse)
     return FALSE;
 
+  discard_validate_batch (tree_view);
+  gtk_tree_view_clear_row_cache (tree_view);
+
   /* if the prelighted node is a child of us, we want to unprelight it.  We have
    * a chance to prelight the correct node below */
 
@@ -12899,11 +14197,13 @@ gtk_tree_view_map_expanded_rows_helper (GtkTreeView            *tree_view,
 					gpointer                user_data)
 {
   GtkRBNode *node;
+  gint *indices;
+  gint depth;
 
   if (tree == NULL || tree->root == NULL)
     return;
 
-  node = _gtk_rbtree_first (tree);
+  node = _gtk_rbtree_peek_first (tree);
 
   while (node)
     {
@@ -12914,8 +14214,12 @@ gtk_tree_view_map_expanded_rows_helper (GtkTreeView            *tree_view,
 	  gtk_tree_view_map_expanded_rows_helper (tree_view, node->children, path, func, user_data);
 	  gtk_tree_path_up (path);
 	}
-      gtk_tree_path_next (path);
-      node = _gtk_rbtree_next (tree, node);
+
+      /* skip all rows of spans at once */
+      indices = gtk_tree_path_get_indices (path);
+      depth = gtk_tree_path_get_depth (path);
+      indices[depth - 1] += GTK_RBNODE_GET_ROWS (node);
+      node = _gtk_rbtree_peek_next (tree, node);
     }
 }
 
@@ -15750,6 +17054,8 @@ gtk_tree_view_set_row_separator_func (GtkTreeView                 *tree_view,
 
   /* Have the tree recalculate heights */
   _gtk_rbtree_mark_invalid (tree_view->priv->tree);
+  discard_validate_batch (tree_view);
+  gtk_tree_view_clear_row_cache (tree_view);
   gtk_widget_queue_resize (GTK_WIDGET (tree_view));
 }
 
@@ -15778,6 +17084,7 @@ gtk_tree_view_state_flags_changed (GtkWidget     *widget,
   if (gtk_widget_get_realized (widget))
     gtk_tree_view_ensure_background (GTK_TREE_VIEW (widget));
 
+  gtk_tree_view_clear_row_cache (GTK_TREE_VIEW (widget));
   gtk_widget_queue_draw (widget);
 }
 
@@ -239,6 +239,16 @@ gboolean               gtk_tree_view_get_activate_on_single_click  (GtkTreeView
 GDK_AVAILABLE_IN_3_8
 void                   gtk_tree_view_set_activate_on_single_click  (GtkTreeView               *tree_view,
 								    gboolean                   single);
+GDK_AVAILABLE_IN_3_12
+gboolean               gtk_tree_view_get_threaded_validation       (GtkTreeView               *tree_view);
+GDK_AVAILABLE_IN_3_12
+void                   gtk_tree_view_set_threaded_validation       (GtkTreeView               *tree_view,
+								    gboolean                   threaded);
+GDK_AVAILABLE_IN_3_12
+gboolean               gtk_tree_view_get_cache_rows                (GtkTreeView               *tree_view);
+GDK_AVAILABLE_IN_3_12
+void                   gtk_tree_view_set_cache_rows                (GtkTreeView               *tree_view,
+								    gboolean                   cache_rows);
 
 /* Column funtions */
 gint                   gtk_tree_view_append_column                 (GtkTreeView               *tree_view,
@@ -32,6 +32,7 @@
 #include "gtkarrow.h"
 #include "gtkcellareacontext.h"
 #include "gtkcellareabox.h"
+#include "gtkcellareaboxcontextprivate.h"
 #include "gtkprivate.h"
 #include "gtkintl.h"
 #include "gtktypebuiltins.h"
@@ -3214,3 +3215,42 @@ _gtk_tree_view_column_get_context (GtkTreeViewColumn  *column)
 {
   return column->priv->cell_area_context;
 }
+
+/* Returns the renderer if it is the only one in a #GtkCellAreaBox, so
+ * the column's size is the size of that renderer */
+GtkCellRenderer *
+_gtk_tree_view_column_get_sole_cell (GtkTreeViewColumn  *column)
+{
+  GtkTreeViewColumnPrivate *priv = column->priv;
+  GtkCellRenderer *cell = NULL;
+  GList *cells;
+
+  if (!GTK_IS_CELL_AREA_BOX (priv->cell_area))
+    return NULL;
+
+  cells = gtk_cell_layout_get_cells (GTK_CELL_LAYOUT (priv->cell_area));
+  if (cells && cells->next == NULL)
+    cell = cells->data;
+  g_list_free (cells);
+
+  return cell;
+}
+
+/* Does to the column's context what measuring the sole cell for a row
+ * with gtk_tree_view_column_cell_get_size() would do */
+void
+_gtk_tree_view_column_push_cell_width (GtkTreeViewColumn  *column,
+                                       gint                minimum_width,
+                                       gint                natural_width)
+{
+  GtkTreeViewColumnPrivate *priv = column->priv;
+
+  g_signal_handler_block (priv->cell_area_context, 
+			  priv->context_changed_signal);
+
+  _gtk_cell_area_box_context_push_group_width (GTK_CELL_AREA_BOX_CONTEXT (priv->cell_area_context),
+                                               0, minimum_width, natural_width);
+
+  g_signal_handler_unblock (priv->cell_area_context, 
+			    priv->context_changed_signal);
+}
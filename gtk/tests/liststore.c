@@ -80,6 +80,8 @@ list_store_setup (ListStore     *fixture,
   int i;
 
   fixture->store = gtk_list_store_new (1, G_TYPE_INT);
+  /* test_data is TRUE for the columnar variants */
+  gtk_list_store_set_columnar_storage (fixture->store, GPOINTER_TO_INT (test_data));
 
   for (i = 0; i < 5; i++)
     {
@@ -457,6 +459,244 @@ list_store_test_insert_before_NULL (void)
   g_object_unref (store);
 }
 
+/* bulk insertion */
+static GValue *
+int_values_new (const gint *ints,
+                gint        n_ints)
+{
+  GValue *values;
+  gint i;
+
+  values = g_new0 (GValue, n_ints);
+  for (i = 0; i < n_ints; i++)
+    {
+      g_value_init (&values[i], G_TYPE_INT);
+      g_value_set_int (&values[i], ints[i]);
+    }
+
+  return values;
+}
+
+static void
+check_int_column (GtkListStore *store,
+                  const gint   *ints,
+                  gint          n_ints)
+{
+  GtkTreeIter iter;
+  gint i, value;
+
+  g_assert_cmpint (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (store), NULL), ==, n_ints);
+
+  gtk_tree_model_get_iter_first (GTK_TREE_MODEL (store), &iter);
+  for (i = 0; i < n_ints; i++)
+    {
+      g_assert (iter_position (store, &iter, i));
+      gtk_tree_model_get (GTK_TREE_MODEL (store), &iter, 0, &value, -1);
+      g_assert_cmpint (value, ==, ints[i]);
+      gtk_tree_model_iter_next (GTK_TREE_MODEL (store), &iter);
+    }
+}
+
+static void
+list_store_test_insert_rows (ListStore     *fixture,
+                             gconstpointer  user_data)
+{
+  const gint middle[] = { 10, 11, 12 };
+  const gint end[] = { 20, 21 };
+  const gint result[] = { 0, 1, 10, 11, 12, 2, 3, 4, 20, 21 };
+  SignalMonitor *monitor;
+  GValue *values;
+  gint column = 0;
+
+  monitor = signal_monitor_new (GTK_TREE_MODEL (fixture->store));
+
+  /* one row-inserted per row, in order */
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "2");
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "3");
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "4");
+
+  values = int_values_new (middle, G_N_ELEMENTS (middle));
+  gtk_list_store_insert_rows (fixture->store, 2, G_N_ELEMENTS (middle),
+                              &column, values, 1);
+  g_free (values);
+  signal_monitor_assert_is_empty (monitor);
+
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "8");
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "9");
+
+  values = int_values_new (end, G_N_ELEMENTS (end));
+  gtk_list_store_insert_rows (fixture->store, -1, G_N_ELEMENTS (end),
+                              &column, values, 1);
+  g_free (values);
+  signal_monitor_assert_is_empty (monitor);
+
+  check_int_column (fixture->store, result, G_N_ELEMENTS (result));
+
+  /* the old iters are still good */
+  g_assert (iter_position (fixture->store, &fixture->iter[2], 5));
+  g_assert (iter_position (fixture->store, &fixture->iter[4], 7));
+
+  signal_monitor_free (monitor);
+}
+
+static void
+list_store_test_insert_rows_sorted (ListStore     *fixture,
+                                    gconstpointer  user_data)
+{
+  const gint rows[] = { 7, -1, 5 };
+  const gint result[] = { -1, 0, 1, 2, 3, 4, 5, 7 };
+  SignalMonitor *monitor;
+  GValue *values;
+  gint column = 0;
+
+  gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (fixture->store),
+                                        0, GTK_SORT_ASCENDING);
+
+  monitor = signal_monitor_new (GTK_TREE_MODEL (fixture->store));
+
+  /* sorted stores put every row where it belongs right away */
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "5");
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "0");
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "6");
+
+  values = int_values_new (rows, G_N_ELEMENTS (rows));
+  gtk_list_store_insert_rows (fixture->store, 0, G_N_ELEMENTS (rows),
+                              &column, values, 1);
+  g_free (values);
+  signal_monitor_assert_is_empty (monitor);
+
+  check_int_column (fixture->store, result, G_N_ELEMENTS (result));
+
+  signal_monitor_free (monitor);
+}
+
+static void
+check_view_rows (GtkTreeView *view,
+                 gint         n_rows)
+{
+  GtkTreePath *path, *cursor;
+
+  /* the view only has a cursor on rows it knows about */
+  path = gtk_tree_path_new_from_indices (n_rows - 1, -1);
+  gtk_tree_view_set_cursor (view, path, NULL, FALSE);
+  gtk_tree_view_get_cursor (view, &cursor, NULL);
+  g_assert (cursor != NULL);
+  g_assert_cmpint (gtk_tree_path_compare (cursor, path), ==, 0);
+  gtk_tree_path_free (cursor);
+  gtk_tree_path_free (path);
+
+  path = gtk_tree_path_new_from_indices (n_rows, -1);
+  gtk_tree_view_set_cursor (view, path, NULL, FALSE);
+  gtk_tree_view_get_cursor (view, &cursor, NULL);
+  g_assert (cursor == NULL);
+  gtk_tree_path_free (path);
+}
+
+static void
+list_store_test_insert_rows_view (void)
+{
+  GtkListStore *store;
+  GtkWidget *view;
+  GValue *values;
+  gint *ints;
+  gint column = 0;
+  gint i;
+
+  ints = g_new (gint, 1000);
+  for (i = 0; i < 1000; i++)
+    ints[i] = i;
+  values = int_values_new (ints, 1000);
+
+  store = gtk_list_store_new (1, G_TYPE_INT);
+  view = gtk_tree_view_new_with_model (GTK_TREE_MODEL (store));
+  g_object_ref_sink (view);
+
+  /* into an empty view, and into one that has rows already */
+  gtk_list_store_insert_rows (store, 0, 1000, &column, values, 1);
+  check_view_rows (GTK_TREE_VIEW (view), 1000);
+  gtk_list_store_insert_rows (store, 500, 10, &column, values, 1);
+  check_view_rows (GTK_TREE_VIEW (view), 1010);
+  gtk_list_store_insert_rows (store, 0, 10, &column, values, 1);
+  check_view_rows (GTK_TREE_VIEW (view), 1020);
+
+  /* single rows still work after a range */
+  gtk_list_store_append (store, NULL);
+  check_view_rows (GTK_TREE_VIEW (view), 1021);
+
+  /* and so does sorting the new rows */
+  gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (store),
+                                        0, GTK_SORT_DESCENDING);
+  gtk_list_store_insert_rows (store, 0, 100, &column, values, 1);
+  check_view_rows (GTK_TREE_VIEW (view), 1121);
+
+  g_object_unref (view);
+  g_object_unref (store);
+  g_free (values);
+  g_free (ints);
+}
+
+static gboolean
+int_is_even (GtkTreeModel *model,
+             GtkTreeIter  *iter,
+             gpointer      data)
+{
+  gint value;
+
+  gtk_tree_model_get (model, iter, 0, &value, -1);
+
+  return value % 2 == 0;
+}
+
+static void
+list_store_test_insert_rows_filter_view (void)
+{
+  GtkListStore *store;
+  GtkTreeModel *filter, *sort;
+  GtkWidget *view, *sort_view;
+  GValue *values;
+  gint *ints;
+  gint column = 0;
+  gint i;
+
+  ints = g_new (gint, 1000);
+  for (i = 0; i < 1000; i++)
+    ints[i] = i;
+  values = int_values_new (ints, 1000);
+
+  store = gtk_list_store_new (1, G_TYPE_INT);
+  filter = gtk_tree_model_filter_new (GTK_TREE_MODEL (store), NULL);
+  gtk_tree_model_filter_set_visible_func (GTK_TREE_MODEL_FILTER (filter),
+                                          int_is_even, NULL, NULL);
+  sort = gtk_tree_model_sort_new_with_model (filter);
+  gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (sort),
+                                        0, GTK_SORT_ASCENDING);
+
+  view = gtk_tree_view_new_with_model (filter);
+  g_object_ref_sink (view);
+  sort_view = gtk_tree_view_new_with_model (sort);
+  g_object_ref_sink (sort_view);
+
+  /* the ranges are passed on through the filter and the sort model */
+  gtk_list_store_insert_rows (store, 0, 1000, &column, values, 1);
+  check_view_rows (GTK_TREE_VIEW (view), 500);
+  check_view_rows (GTK_TREE_VIEW (sort_view), 500);
+  gtk_list_store_insert_rows (store, 500, 10, &column, values, 1);
+  check_view_rows (GTK_TREE_VIEW (view), 505);
+  check_view_rows (GTK_TREE_VIEW (sort_view), 505);
+
+  gtk_list_store_append (store, NULL);
+  check_view_rows (GTK_TREE_VIEW (view), 506);
+  check_view_rows (GTK_TREE_VIEW (sort_view), 506);
+
+  g_object_unref (sort_view);
+  g_object_unref (view);
+  g_object_unref (sort);
+  g_object_unref (filter);
+  g_object_unref (store);
+  g_free (values);
+  g_free (ints);
+}
+
 /* removal */
 static void
 list_store_test_remove_begin (ListStore     *fixture,
@@ -998,6 +1238,414 @@ list_store_test_iter_parent_invalid (ListStore     *fixture,
 }
 
 
+/* columnar storage */
+
+enum {
+  COLUMN_BOOLEAN,
+  COLUMN_CHAR,
+  COLUMN_UCHAR,
+  COLUMN_INT,
+  COLUMN_UINT,
+  COLUMN_LONG,
+  COLUMN_ULONG,
+  COLUMN_INT64,
+  COLUMN_UINT64,
+  COLUMN_ENUM,
+  COLUMN_FLAGS,
+  COLUMN_FLOAT,
+  COLUMN_DOUBLE,
+  COLUMN_STRING,
+  COLUMN_POINTER,
+  COLUMN_BOXED,
+  COLUMN_OBJECT,
+  COLUMN_VARIANT,
+  N_COLUMNS
+};
+
+static GtkListStore *
+columnar_store_new (void)
+{
+  GtkListStore *store;
+
+  store = gtk_list_store_new (N_COLUMNS,
+                              G_TYPE_BOOLEAN,
+                              G_TYPE_CHAR,
+                              G_TYPE_UCHAR,
+                              G_TYPE_INT,
+                              G_TYPE_UINT,
+                              G_TYPE_LONG,
+                              G_TYPE_ULONG,
+                              G_TYPE_INT64,
+                              G_TYPE_UINT64,
+                              GTK_TYPE_SORT_TYPE,
+                              GTK_TYPE_STATE_FLAGS,
+                              G_TYPE_FLOAT,
+                              G_TYPE_DOUBLE,
+                              G_TYPE_STRING,
+                              G_TYPE_POINTER,
+                              GDK_TYPE_RGBA,
+                              G_TYPE_OBJECT,
+                              G_TYPE_VARIANT);
+  gtk_list_store_set_columnar_storage (store, TRUE);
+  g_assert (gtk_list_store_get_columnar_storage (store));
+
+  return store;
+}
+
+static void
+columnar_store_set_row (GtkListStore *store,
+                        GtkTreeIter  *iter,
+                        gint          n,
+                        GObject      *object)
+{
+  GdkRGBA rgba = { n / 10.0, 0.5, 0.25, 1.0 };
+  char *string;
+
+  string = g_strdup_printf ("row %d", n);
+  gtk_list_store_set (store, iter,
+                      COLUMN_BOOLEAN, n % 2,
+                      COLUMN_CHAR, (gchar) -n,
+                      COLUMN_UCHAR, (guchar) (200 + n),
+                      COLUMN_INT, -1000 * n,
+                      COLUMN_UINT, (guint) (G_MAXUINT - n),
+                      COLUMN_LONG, (glong) (-100000 * n),
+                      COLUMN_ULONG, (gulong) (100000 * n),
+                      COLUMN_INT64, (gint64) (G_MININT64 + n),
+                      COLUMN_UINT64, (guint64) (G_MAXUINT64 - n),
+                      COLUMN_ENUM, n % 2 ? GTK_SORT_DESCENDING : GTK_SORT_ASCENDING,
+                      COLUMN_FLAGS, GTK_STATE_FLAG_ACTIVE | (n % 2 ? GTK_STATE_FLAG_PRELIGHT : 0),
+                      COLUMN_FLOAT, n + 0.5f,
+                      COLUMN_DOUBLE, n / 3.0,
+                      COLUMN_STRING, string,
+                      COLUMN_POINTER, GINT_TO_POINTER (n + 1),
+                      COLUMN_BOXED, &rgba,
+                      COLUMN_OBJECT, object,
+                      COLUMN_VARIANT, g_variant_new_int32 (n),
+                      -1);
+  g_free (string);
+}
+
+static void
+columnar_store_check_row (GtkListStore *store,
+                          GtkTreeIter  *iter,
+                          gint          n,
+                          GObject      *object)
+{
+  GdkRGBA expected_rgba = { n / 10.0, 0.5, 0.25, 1.0 };
+  gboolean v_boolean;
+  gchar v_char;
+  guchar v_uchar;
+  gint v_int;
+  guint v_uint;
+  glong v_long;
+  gulong v_ulong;
+  gint64 v_int64;
+  guint64 v_uint64;
+  GtkSortType v_enum;
+  GtkStateFlags v_flags;
+  gfloat v_float;
+  gdouble v_double;
+  gchar *v_string, *expected_string;
+  gpointer v_pointer;
+  GdkRGBA *v_boxed;
+  GObject *v_object;
+  GVariant *v_variant;
+
+  gtk_tree_model_get (GTK_TREE_MODEL (store), iter,
+                      COLUMN_BOOLEAN, &v_boolean,
+                      COLUMN_CHAR, &v_char,
+                      COLUMN_UCHAR, &v_uchar,
+                      COLUMN_INT, &v_int,
+                      COLUMN_UINT, &v_uint,
+                      COLUMN_LONG, &v_long,
+                      COLUMN_ULONG, &v_ulong,
+                      COLUMN_INT64, &v_int64,
+                      COLUMN_UINT64, &v_uint64,
+                      COLUMN_ENUM, &v_enum,
+                      COLUMN_FLAGS, &v_flags,
+                      COLUMN_FLOAT, &v_float,
+                      COLUMN_DOUBLE, &v_double,
+                      COLUMN_STRING, &v_string,
+                      COLUMN_POINTER, &v_pointer,
+                      COLUMN_BOXED, &v_boxed,
+                      COLUMN_OBJECT, &v_object,
+                      COLUMN_VARIANT, &v_variant,
+                      -1);
+
+  g_assert_cmpint (v_boolean, ==, n % 2);
+  g_assert_cmpint (v_char, ==, (gchar) -n);
+  g_assert_cmpint (v_uchar, ==, (guchar) (200 + n));
+  g_assert_cmpint (v_int, ==, -1000 * n);
+  g_assert_cmpuint (v_uint, ==, (guint) (G_MAXUINT - n));
+  g_assert_cmpint (v_long, ==, (glong) (-100000 * n));
+  g_assert_cmpuint (v_ulong, ==, (gulong) (100000 * n));
+  g_assert_cmpint (v_int64, ==, (gint64) (G_MININT64 + n));
+  g_assert_cmpuint (v_uint64, ==, (guint64) (G_MAXUINT64 - n));
+  g_assert_cmpint (v_enum, ==, n % 2 ? GTK_SORT_DESCENDING : GTK_SORT_ASCENDING);
+  g_assert_cmpint (v_flags, ==, GTK_STATE_FLAG_ACTIVE | (n % 2 ? GTK_STATE_FLAG_PRELIGHT : 0));
+  g_assert_cmpfloat (v_float, ==, n + 0.5f);
+  g_assert_cmpfloat (v_double, ==, n / 3.0);
+  expected_string = g_strdup_printf ("row %d", n);
+  g_assert_cmpstr (v_string, ==, expected_string);
+  g_free (expected_string);
+  g_assert (v_pointer == GINT_TO_POINTER (n + 1));
+  g_assert (gdk_rgba_equal (v_boxed, &expected_rgba));
+  g_assert (v_object == object);
+  g_assert_cmpint (g_variant_get_int32 (v_variant), ==, n);
+
+  g_free (v_string);
+  gdk_rgba_free (v_boxed);
+  if (v_object)
+    g_object_unref (v_object);
+  g_variant_unref (v_variant);
+}
+
+static void
+columnar_store_check_empty_row (GtkListStore *store,
+                                GtkTreeIter  *iter)
+{
+  gint v_int;
+  gchar *v_string;
+  GdkRGBA *v_boxed;
+  GObject *v_object;
+  GVariant *v_variant;
+
+  gtk_tree_model_get (GTK_TREE_MODEL (store), iter,
+                      COLUMN_INT, &v_int,
+                      COLUMN_STRING, &v_string,
+                      COLUMN_BOXED, &v_boxed,
+                      COLUMN_OBJECT, &v_object,
+                      COLUMN_VARIANT, &v_variant,
+                      -1);
+
+  g_assert_cmpint (v_int, ==, 0);
+  g_assert (v_string == NULL);
+  g_assert (v_boxed == NULL);
+  g_assert (v_object == NULL);
+  g_assert (v_variant == NULL);
+}
+
+static void
+list_store_test_columnar_set_get (void)
+{
+  GtkListStore *store;
+  GtkTreeIter iter;
+  GObject *object;
+  gint i;
+
+  store = columnar_store_new ();
+  object = g_object_new (G_TYPE_OBJECT, NULL);
+  g_object_add_weak_pointer (object, (gpointer *) &object);
+
+  for (i = 0; i < 10; i++)
+    {
+      gtk_list_store_append (store, &iter);
+      columnar_store_check_empty_row (store, &iter);
+      columnar_store_set_row (store, &iter, i, i % 3 ? object : NULL);
+    }
+
+  /* overwriting a cell replaces the old value */
+  gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (store), &iter, NULL, 4);
+  columnar_store_set_row (store, &iter, 40, object);
+
+  for (i = 0; i < 10; i++)
+    {
+      g_assert (gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (store), &iter, NULL, i));
+      if (i == 4)
+        columnar_store_check_row (store, &iter, 40, object);
+      else
+        columnar_store_check_row (store, &iter, i, i % 3 ? object : NULL);
+    }
+
+  /* the store holds the only references left */
+  g_object_unref (object);
+  g_assert (object != NULL);
+  g_object_unref (store);
+  g_assert (object == NULL);
+}
+
+static void
+list_store_test_columnar_reuse (void)
+{
+  GtkListStore *store;
+  GtkTreeIter iter, iters[6];
+  GObject *object;
+  gint i;
+
+  store = columnar_store_new ();
+  object = g_object_new (G_TYPE_OBJECT, NULL);
+  g_object_add_weak_pointer (object, (gpointer *) &object);
+
+  for (i = 0; i < 6; i++)
+    {
+      gtk_list_store_append (store, &iters[i]);
+      columnar_store_set_row (store, &iters[i], i, i == 2 ? object : NULL);
+    }
+  g_object_unref (object);
+
+  /* rows 0 and 3 share their string with the row that stays */
+  gtk_list_store_set (store, &iters[3], COLUMN_STRING, "row 5", -1);
+  gtk_list_store_set (store, &iters[0], COLUMN_STRING, "row 5", -1);
+
+  /* removing a row releases what it held */
+  gtk_list_store_remove (store, &iters[0]);
+  gtk_list_store_remove (store, &iters[2]);
+  gtk_list_store_remove (store, &iters[3]);
+  g_assert (object == NULL);
+  g_assert_cmpint (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (store), NULL), ==, 3);
+
+  /* the rows that were freed are used again, without the old values */
+  for (i = 0; i < 4; i++)
+    {
+      gtk_list_store_insert (store, &iter, 1);
+      columnar_store_check_empty_row (store, &iter);
+      columnar_store_set_row (store, &iter, 10 + i, NULL);
+    }
+
+  /* rows: 1, 13, 12, 11, 10, 4, 5 */
+  g_assert_cmpint (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (store), NULL), ==, 7);
+  gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (store), &iter, NULL, 0);
+  g_assert (iters_equal (&iter, &iters[1]));
+  columnar_store_check_row (store, &iter, 1, NULL);
+  for (i = 0; i < 4; i++)
+    {
+      gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (store), &iter, NULL, 1 + i);
+      columnar_store_check_row (store, &iter, 13 - i, NULL);
+    }
+  g_assert (iter_position (store, &iters[4], 5));
+  columnar_store_check_row (store, &iters[4], 4, NULL);
+  g_assert (iter_position (store, &iters[5], 6));
+  columnar_store_check_row (store, &iters[5], 5, NULL);
+
+  g_object_unref (store);
+}
+
+static void
+list_store_test_columnar_sort (void)
+{
+  const gint rows[] = { 3, 0, 4, 1, 2 };
+  GtkListStore *store;
+  GtkTreeIter iter, iters[5];
+  gint i;
+
+  store = columnar_store_new ();
+  for (i = 0; i < 5; i++)
+    {
+      gtk_list_store_append (store, &iters[i]);
+      columnar_store_set_row (store, &iters[i], rows[i], NULL);
+    }
+
+  gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (store),
+                                        COLUMN_STRING, GTK_SORT_ASCENDING);
+  for (i = 0; i < 5; i++)
+    {
+      gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (store), &iter, NULL, i);
+      columnar_store_check_row (store, &iter, i, NULL);
+    }
+
+  /* the iters stay valid and follow their rows */
+  for (i = 0; i < 5; i++)
+    g_assert (iter_position (store, &iters[i], rows[i]));
+
+  gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (store),
+                                        COLUMN_INT, GTK_SORT_ASCENDING);
+  for (i = 0; i < 5; i++)
+    g_assert (iter_position (store, &iters[i], 4 - rows[i]));
+
+  /* new rows go to their place */
+  gtk_list_store_insert_with_values (store, &iter, -1,
+                                     COLUMN_INT, -2500,
+                                     COLUMN_STRING, "row 2.5",
+                                     -1);
+  g_assert (iter_position (store, &iter, 2));
+
+  g_object_unref (store);
+}
+
+static void
+list_store_test_columnar_reorder (void)
+{
+  gint new_order[5] = { 4, 1, 0, 2, 3 };
+  GtkListStore *store;
+  GtkTreeIter iter, iters[5];
+  gint i;
+
+  store = columnar_store_new ();
+  for (i = 0; i < 5; i++)
+    {
+      gtk_list_store_append (store, &iters[i]);
+      columnar_store_set_row (store, &iters[i], i, NULL);
+    }
+
+  gtk_list_store_reorder (store, new_order);
+  for (i = 0; i < 5; i++)
+    {
+      gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (store), &iter, NULL, i);
+      g_assert (iters_equal (&iter, &iters[new_order[i]]));
+      columnar_store_check_row (store, &iter, new_order[i], NULL);
+    }
+
+  gtk_list_store_swap (store, &iters[4], &iters[3]);
+  gtk_list_store_move_before (store, &iters[1], NULL);
+  /* rows: 3, 0, 2, 4, 1 */
+  columnar_store_check_row (store, &iters[3], 3, NULL);
+  g_assert (iter_position (store, &iters[3], 0));
+  g_assert (iter_position (store, &iters[4], 3));
+  g_assert (iter_position (store, &iters[1], 4));
+  columnar_store_check_row (store, &iters[1], 1, NULL);
+
+  g_object_unref (store);
+}
+
+static void
+list_store_test_columnar_clear (void)
+{
+  GtkListStore *store;
+  GtkTreeIter iter;
+  GObject *object;
+  gint i;
+
+  store = columnar_store_new ();
+  object = g_object_new (G_TYPE_OBJECT, NULL);
+  g_object_add_weak_pointer (object, (gpointer *) &object);
+
+  for (i = 0; i < 20; i++)
+    {
+      gtk_list_store_append (store, &iter);
+      columnar_store_set_row (store, &iter, i, object);
+    }
+  g_object_unref (object);
+
+  gtk_list_store_clear (store);
+  g_assert (object == NULL);
+  g_assert_cmpint (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (store), NULL), ==, 0);
+  g_assert (gtk_list_store_get_columnar_storage (store));
+
+  /* the store is as good as new afterwards */
+  for (i = 0; i < 3; i++)
+    {
+      gtk_list_store_append (store, &iter);
+      columnar_store_check_empty_row (store, &iter);
+      columnar_store_set_row (store, &iter, i, NULL);
+    }
+  for (i = 0; i < 3; i++)
+    {
+      g_assert (gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (store), &iter, NULL, i));
+      columnar_store_check_row (store, &iter, i, NULL);
+    }
+
+  /* and it can be switched back once it's empty */
+  gtk_list_store_clear (store);
+  gtk_list_store_set_columnar_storage (store, FALSE);
+  g_assert (!gtk_list_store_get_columnar_storage (store));
+  gtk_list_store_append (store, &iter);
+  columnar_store_set_row (store, &iter, 7, NULL);
+  columnar_store_check_row (store, &iter, 7, NULL);
+
+  g_object_unref (store);
+}
+
+
 /* main */
 
 void
@@ -1019,6 +1667,18 @@ register_list_store_tests (void)
   g_test_add_func ("/ListStore/insert-before-NULL",
 		   list_store_test_insert_before_NULL);
 
+  /* bulk insertion */
+  g_test_add ("/ListStore/insert-rows", ListStore, NULL,
+              list_store_setup, list_store_test_insert_rows,
+              list_store_teardown);
+  g_test_add ("/ListStore/insert-rows-sorted", ListStore, NULL,
+              list_store_setup, list_store_test_insert_rows_sorted,
+              list_store_teardown);
+  g_test_add_func ("/ListStore/insert-rows-view",
+                   list_store_test_insert_rows_view);
+  g_test_add_func ("/ListStore/insert-rows-filter-view",
+                   list_store_test_insert_rows_filter_view);
+
   /* setting values (FIXME) */
 
   /* removal */
@@ -1119,4 +1779,46 @@ register_list_store_tests (void)
   g_test_add ("/ListStore/iter-parent-invalid", ListStore, NULL,
               list_store_setup, list_store_test_iter_parent_invalid,
               list_store_teardown);
+
+  /* columnar storage */
+  g_test_add_func ("/ListStore/columnar/set-get",
+                   list_store_test_columnar_set_get);
+  g_test_add_func ("/ListStore/columnar/reuse",
+                   list_store_test_columnar_reuse);
+  g_test_add_func ("/ListStore/columnar/sort",
+                   list_store_test_columnar_sort);
+  g_test_add_func ("/ListStore/columnar/reorder",
+                   list_store_test_columnar_reorder);
+  g_test_add_func ("/ListStore/columnar/clear",
+                   list_store_test_columnar_clear);
+  g_test_add ("/ListStore/columnar/insert-rows", ListStore, GINT_TO_POINTER (TRUE),
+              list_store_setup, list_store_test_insert_rows,
+              list_store_teardown);
+  g_test_add ("/ListStore/columnar/insert-rows-sorted", ListStore, GINT_TO_POINTER (TRUE),
+              list_store_setup, list_store_test_insert_rows_sorted,
+              list_store_teardown);
+  g_test_add ("/ListStore/columnar/remove-begin", ListStore, GINT_TO_POINTER (TRUE),
+              list_store_setup, list_store_test_remove_begin,
+              list_store_teardown);
+  g_test_add ("/ListStore/columnar/remove-middle", ListStore, GINT_TO_POINTER (TRUE),
+              list_store_setup, list_store_test_remove_middle,
+              list_store_teardown);
+  g_test_add ("/ListStore/columnar/remove-end", ListStore, GINT_TO_POINTER (TRUE),
+              list_store_setup, list_store_test_remove_end,
+              list_store_teardown);
+  g_test_add ("/ListStore/columnar/clear-fixture", ListStore, GINT_TO_POINTER (TRUE),
+              list_store_setup, list_store_test_clear,
+              list_store_teardown);
+  g_test_add ("/ListStore/columnar/reorder-fixture", ListStore, GINT_TO_POINTER (TRUE),
+              list_store_setup, list_store_test_reorder,
+              list_store_teardown);
+  g_test_add ("/ListStore/columnar/swap-middle-apart", ListStore, GINT_TO_POINTER (TRUE),
+              list_store_setup, list_store_test_swap_middle_apart,
+              list_store_teardown);
+  g_test_add ("/ListStore/columnar/move-after-apart", ListStore, GINT_TO_POINTER (TRUE),
+              list_store_setup, list_store_test_move_after_apart,
+              list_store_teardown);
+  g_test_add ("/ListStore/columnar/move-before-apart", ListStore, GINT_TO_POINTER (TRUE),
+              list_store_setup, list_store_test_move_before_apart,
+              list_store_teardown);
 }
@@ -0,0 +1,604 @@
+/* GtkRBTree tests.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <locale.h>
+
+#include "../gtkrbtree.h"
+
+/* gtk_rbtree_check */
+
+static gint
+get_rows (GtkRBNode *node)
+{
+  if (!GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN))
+    return 1;
+
+  /* all rows of a span have the same height */
+  g_assert (node->children == NULL);
+  g_assert_cmpint (GTK_RBNODE_GET_ROWS (node), >, 0);
+  g_assert_cmpint (GTK_RBNODE_GET_HEIGHT (node) % GTK_RBNODE_GET_ROWS (node), ==, 0);
+
+  return GTK_RBNODE_GET_ROWS (node);
+}
+
+static guint
+count_total (GtkRBTree *tree,
+             GtkRBNode *node)
+{
+  guint res;
+
+  if (_gtk_rbtree_is_nil (node))
+    return 0;
+
+  res = count_total (tree, node->left) +
+        count_total (tree, node->right) +
+        get_rows (node) +
+        (node->children ? count_total (node->children, node->children->root) : 0);
+
+  g_assert_cmpint (res, ==, node->total_count);
+
+  return res;
+}
+
+static gint
+_count_nodes (GtkRBTree *tree,
+              GtkRBNode *node)
+{
+  gint res;
+
+  if (_gtk_rbtree_is_nil (node))
+    return 0;
+
+  res = (_count_nodes (tree, node->left) +
+         _count_nodes (tree, node->right) + get_rows (node));
+
+  g_assert_cmpint (res, ==, node->count);
+
+  return res;
+}
+
+static void
+gtk_rbtree_check_dirty (GtkRBTree *tree,
+                        GtkRBNode *node)
+{
+  gboolean dirty;
+
+  if (_gtk_rbtree_is_nil (node))
+    return;
+
+  dirty = GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_INVALID) ||
+          GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_COLUMN_INVALID) ||
+          GTK_RBNODE_FLAG_SET (node->left, GTK_RBNODE_DESCENDANTS_INVALID) ||
+          GTK_RBNODE_FLAG_SET (node->right, GTK_RBNODE_DESCENDANTS_INVALID) ||
+          (node->children &&
+           GTK_RBNODE_FLAG_SET (node->children->root, GTK_RBNODE_DESCENDANTS_INVALID));
+
+  g_assert (dirty == GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_DESCENDANTS_INVALID));
+
+  gtk_rbtree_check_dirty (tree, node->left);
+  gtk_rbtree_check_dirty (tree, node->right);
+  if (node->children)
+    gtk_rbtree_check_dirty (node->children, node->children->root);
+}
+
+static guint
+gtk_rbtree_check_node (GtkRBTree *tree,
+                       GtkRBNode *node)
+{
+  guint left_blacks, right_blacks;
+  gint offset;
+
+  if (_gtk_rbtree_is_nil (node))
+    return 1;
+
+  if (!_gtk_rbtree_is_nil (node->left))
+    g_assert (node->left->parent == node);
+  if (!_gtk_rbtree_is_nil (node->right))
+    g_assert (node->right->parent == node);
+
+  /* a red node never has a red child */
+  if (GTK_RBNODE_GET_COLOR (node) == GTK_RBNODE_RED)
+    {
+      g_assert (GTK_RBNODE_GET_COLOR (node->left) == GTK_RBNODE_BLACK);
+      g_assert (GTK_RBNODE_GET_COLOR (node->right) == GTK_RBNODE_BLACK);
+    }
+
+  offset = node->left->offset + node->right->offset + GTK_RBNODE_GET_HEIGHT (node);
+  if (node->children)
+    {
+      g_assert (node->children->parent_tree == tree);
+      g_assert (node->children->parent_node == node);
+      offset += node->children->root->offset;
+      gtk_rbtree_check_node (node->children, node->children->root);
+    }
+  g_assert_cmpint (offset, ==, node->offset);
+
+  left_blacks = gtk_rbtree_check_node (tree, node->left);
+  right_blacks = gtk_rbtree_check_node (tree, node->right);
+  g_assert_cmpint (left_blacks, ==, right_blacks);
+
+  return left_blacks + (GTK_RBNODE_GET_COLOR (node) == GTK_RBNODE_BLACK ? 1 : 0);
+}
+
+static void
+gtk_rbtree_check (GtkRBTree *tree)
+{
+  while (tree->parent_tree)
+    tree = tree->parent_tree;
+
+  if (_gtk_rbtree_is_nil (tree->root))
+    return;
+
+  g_assert (GTK_RBNODE_GET_COLOR (tree->root) == GTK_RBNODE_BLACK);
+  g_assert (_gtk_rbtree_is_nil (tree->root->parent));
+
+  gtk_rbtree_check_node (tree, tree->root);
+  _count_nodes (tree, tree->root);
+  count_total (tree, tree->root);
+  gtk_rbtree_check_dirty (tree, tree->root);
+}
+
+/* tests */
+
+static const guint fill_sizes[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 31, 32, 33, 100, 1000 };
+
+static void
+check_filled (GtkRBTree *tree,
+              guint      n_nodes,
+              gint       height,
+              gboolean   valid)
+{
+  GtkRBNode *node;
+  guint i;
+
+  gtk_rbtree_check (tree);
+
+  g_assert_cmpint (tree->root->count, ==, n_nodes);
+  g_assert_cmpint (tree->root->total_count, ==, n_nodes);
+  g_assert_cmpint (tree->root->offset, ==, n_nodes * height);
+
+  for (i = 0, node = _gtk_rbtree_first (tree);
+       node != NULL;
+       i++, node = _gtk_rbtree_next (tree, node))
+    {
+      g_assert_cmpint (GTK_RBNODE_GET_HEIGHT (node), ==, height);
+      g_assert (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_INVALID) == !valid);
+      g_assert (_gtk_rbtree_find_count (tree, i + 1) == node);
+      g_assert_cmpint (_gtk_rbtree_node_find_offset (tree, node), ==, i * height);
+    }
+  g_assert_cmpint (i, ==, n_nodes);
+}
+
+static void
+test_fill (gconstpointer data)
+{
+  gboolean valid = GPOINTER_TO_INT (data);
+  GtkRBTree *tree;
+  GtkRBNode *first;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (fill_sizes); i++)
+    {
+      tree = _gtk_rbtree_new ();
+
+      first = _gtk_rbtree_fill (tree, fill_sizes[i], 10, valid);
+      if (fill_sizes[i] == 0)
+        g_assert (first == NULL);
+      else
+        g_assert (first == _gtk_rbtree_first (tree));
+
+      check_filled (tree, fill_sizes[i], 10, valid);
+      if (fill_sizes[i] > 0)
+        g_assert (GTK_RBNODE_FLAG_SET (tree->root, GTK_RBNODE_DESCENDANTS_INVALID) == !valid);
+
+      _gtk_rbtree_free (tree);
+    }
+}
+
+static void
+test_fill_then_modify (void)
+{
+  GtkRBTree *tree;
+  GtkRBNode *node;
+  guint i;
+
+  tree = _gtk_rbtree_new ();
+  _gtk_rbtree_fill (tree, 100, 10, TRUE);
+
+  /* the tree has to stay a valid red-black tree afterwards */
+  node = _gtk_rbtree_find_count (tree, 50);
+  for (i = 0; i < 20; i++)
+    node = _gtk_rbtree_insert_after (tree, node, 5, TRUE);
+  gtk_rbtree_check (tree);
+  g_assert_cmpint (tree->root->count, ==, 120);
+  g_assert_cmpint (tree->root->offset, ==, 100 * 10 + 20 * 5);
+
+  for (i = 0; i < 60; i++)
+    _gtk_rbtree_remove_node (tree, _gtk_rbtree_first (tree));
+  gtk_rbtree_check (tree);
+  g_assert_cmpint (tree->root->count, ==, 60);
+
+  _gtk_rbtree_free (tree);
+}
+
+static GtkRBTree *
+create_children (GtkRBTree *tree,
+                 GtkRBNode *node)
+{
+  GtkRBTree *children;
+
+  children = _gtk_rbtree_new ();
+  children->parent_tree = tree;
+  children->parent_node = node;
+  node->children = children;
+
+  return children;
+}
+
+static void
+mark_all_valid (GtkRBTree *tree)
+{
+  GtkRBNode *node;
+
+  for (node = _gtk_rbtree_first (tree);
+       node != NULL;
+       node = _gtk_rbtree_next (tree, node))
+    {
+      if (node->children)
+        mark_all_valid (node->children);
+      _gtk_rbtree_node_mark_valid (tree, node);
+    }
+}
+
+static void
+test_fill_expand (void)
+{
+  GtkRBTree *tree, *children, *grandchildren;
+  GtkRBNode *node, *child;
+
+  /* This is what GtkTreeView does when expanding a row: hang an
+   * empty tree off the node and fill it with unmeasured rows.
+   */
+  tree = _gtk_rbtree_new ();
+  _gtk_rbtree_fill (tree, 20, 10, TRUE);
+  g_assert (!GTK_RBNODE_FLAG_SET (tree->root, GTK_RBNODE_DESCENDANTS_INVALID));
+
+  node = _gtk_rbtree_find_count (tree, 8);
+  children = create_children (tree, node);
+  _gtk_rbtree_fill (children, 50, 5, FALSE);
+
+  gtk_rbtree_check (tree);
+  g_assert (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_DESCENDANTS_INVALID));
+  g_assert (GTK_RBNODE_FLAG_SET (tree->root, GTK_RBNODE_DESCENDANTS_INVALID));
+  g_assert_cmpint (tree->root->count, ==, 20);
+  g_assert_cmpint (tree->root->total_count, ==, 70);
+  g_assert_cmpint (tree->root->offset, ==, 20 * 10 + 50 * 5);
+  g_assert_cmpint (node->offset - node->left->offset - node->right->offset, ==, 10 + 50 * 5);
+
+  /* and one more level down */
+  child = _gtk_rbtree_find_count (children, 33);
+  grandchildren = create_children (children, child);
+  _gtk_rbtree_fill (grandchildren, 7, 3, FALSE);
+
+  gtk_rbtree_check (tree);
+  g_assert_cmpint (tree->root->total_count, ==, 77);
+  g_assert_cmpint (tree->root->offset, ==, 20 * 10 + 50 * 5 + 7 * 3);
+  g_assert_cmpint (_gtk_rbtree_node_find_offset (children, child), ==, 8 * 10 + 32 * 5);
+
+  /* validating everything clears the flags all the way up */
+  mark_all_valid (tree);
+  gtk_rbtree_check (tree);
+  g_assert (!GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_DESCENDANTS_INVALID));
+  g_assert (!GTK_RBNODE_FLAG_SET (tree->root, GTK_RBNODE_DESCENDANTS_INVALID));
+
+  /* expanding with valid rows leaves the parents alone */
+  node = _gtk_rbtree_find_count (tree, 15);
+  children = create_children (tree, node);
+  _gtk_rbtree_fill (children, 10, 5, TRUE);
+  gtk_rbtree_check (tree);
+  g_assert (!GTK_RBNODE_FLAG_SET (tree->root, GTK_RBNODE_DESCENDANTS_INVALID));
+  g_assert_cmpint (tree->root->total_count, ==, 87);
+
+  _gtk_rbtree_free (tree);
+}
+
+static void
+test_insert_many (void)
+{
+  static const guint counts[] = { 0, 1, 2, 3, 10, 100 };
+  GtkRBTree *tree, *children;
+  GtkRBNode *node, *after, *first;
+  guint i, j, k, n_nodes;
+  gint position;
+
+  for (i = 0; i < 10; i++)
+    for (j = 0; j < G_N_ELEMENTS (counts); j++)
+      for (position = 0; position <= (gint) fill_sizes[i]; position++)
+        {
+          n_nodes = fill_sizes[i];
+          tree = _gtk_rbtree_new ();
+          _gtk_rbtree_fill (tree, n_nodes, 10, TRUE);
+
+          /* an expanded row makes the old nodes differ from the new ones */
+          if (n_nodes > 0)
+            {
+              children = create_children (tree, _gtk_rbtree_find_count (tree, (n_nodes + 1) / 2));
+              _gtk_rbtree_fill (children, 4, 7, TRUE);
+            }
+
+          after = position > 0 ? _gtk_rbtree_find_count (tree, position) : NULL;
+          first = _gtk_rbtree_insert_many_after (tree, after, counts[j], 3, FALSE);
+
+          gtk_rbtree_check (tree);
+          if (counts[j] == 0)
+            {
+              g_assert (first == NULL);
+              if (n_nodes > 0)
+                g_assert (!GTK_RBNODE_FLAG_SET (tree->root, GTK_RBNODE_DESCENDANTS_INVALID));
+              _gtk_rbtree_free (tree);
+              continue;
+            }
+
+          g_assert_cmpint (tree->root->count, ==, n_nodes + counts[j]);
+          g_assert_cmpint (tree->root->total_count, ==, n_nodes + counts[j] + (n_nodes > 0 ? 4 : 0));
+          g_assert_cmpint (tree->root->offset, ==, n_nodes * 10 + counts[j] * 3 + (n_nodes > 0 ? 4 * 7 : 0));
+          g_assert (GTK_RBNODE_FLAG_SET (tree->root, GTK_RBNODE_DESCENDANTS_INVALID));
+          g_assert (first == _gtk_rbtree_find_count (tree, position + 1));
+          if (after)
+            g_assert (_gtk_rbtree_next (tree, after) == first);
+
+          for (k = 0, node = first; k < counts[j]; k++, node = _gtk_rbtree_next (tree, node))
+            {
+              g_assert_cmpint (GTK_RBNODE_GET_HEIGHT (node), ==, 3);
+              g_assert (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_INVALID));
+            }
+          for (; node != NULL; node = _gtk_rbtree_next (tree, node))
+            g_assert (!GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_INVALID));
+
+          _gtk_rbtree_free (tree);
+        }
+}
+
+static void
+count_materialized (GtkRBTree *tree,
+                    GtkRBNode *node,
+                    gpointer   data)
+{
+  guint *materialized = data;
+
+  g_assert (!GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN));
+  g_assert_cmpint (GTK_RBNODE_GET_ROWS (node), ==, 1);
+
+  (*materialized)++;
+}
+
+static guint
+count_nodes (GtkRBTree *tree)
+{
+  GtkRBNode *node;
+  guint n_nodes = 0;
+
+  for (node = _gtk_rbtree_peek_first (tree);
+       node != NULL;
+       node = _gtk_rbtree_peek_next (tree, node))
+    n_nodes++;
+
+  return n_nodes;
+}
+
+static void
+test_span (void)
+{
+  GtkRBTree *tree, *children;
+  GtkRBNode *node, *span, *tmp_node;
+  GtkRBTree *tmp_tree;
+  guint materialized = 0;
+  gint i;
+
+  tree = _gtk_rbtree_new ();
+  _gtk_rbtree_set_materialize_func (tree, count_materialized, &materialized);
+
+  span = _gtk_rbtree_insert_span_after (tree, NULL, 1000, 10, FALSE);
+  gtk_rbtree_check (tree);
+  g_assert (span == tree->root);
+  g_assert (GTK_RBNODE_FLAG_SET (span, GTK_RBNODE_IS_SPAN));
+  g_assert (GTK_RBNODE_FLAG_SET (span, GTK_RBNODE_INVALID));
+  g_assert_cmpint (tree->root->count, ==, 1000);
+  g_assert_cmpint (tree->root->total_count, ==, 1000);
+  g_assert_cmpint (tree->root->offset, ==, 1000 * 10);
+  g_assert (_gtk_rbtree_peek_count (tree, 500) == span);
+  g_assert_cmpuint (materialized, ==, 0);
+
+  /* a lookup gives the row a node of its own */
+  node = _gtk_rbtree_find_count (tree, 500);
+  gtk_rbtree_check (tree);
+  g_assert_cmpuint (materialized, ==, 1);
+  g_assert_cmpuint (count_nodes (tree), ==, 3);
+  g_assert (!GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN));
+  g_assert (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_INVALID));
+  g_assert_cmpint (GTK_RBNODE_GET_HEIGHT (node), ==, 10);
+  g_assert_cmpint (_gtk_rbtree_node_find_offset (tree, node), ==, 499 * 10);
+  g_assert_cmpuint (_gtk_rbtree_node_get_index (tree, node), ==, 499);
+  g_assert (_gtk_rbtree_peek_count (tree, 500) == node);
+  g_assert (GTK_RBNODE_FLAG_SET (_gtk_rbtree_peek_count (tree, 499), GTK_RBNODE_IS_SPAN));
+  g_assert (GTK_RBNODE_FLAG_SET (_gtk_rbtree_peek_count (tree, 501), GTK_RBNODE_IS_SPAN));
+  g_assert (_gtk_rbtree_find_count (tree, 500) == node);
+  g_assert_cmpuint (materialized, ==, 1);
+
+  /* as does walking to it */
+  tmp_node = _gtk_rbtree_prev (tree, node);
+  g_assert_cmpuint (_gtk_rbtree_node_get_index (tree, tmp_node), ==, 498);
+  tmp_node = _gtk_rbtree_next (tree, node);
+  g_assert_cmpuint (_gtk_rbtree_node_get_index (tree, tmp_node), ==, 500);
+  tmp_node = _gtk_rbtree_first (tree);
+  g_assert_cmpuint (_gtk_rbtree_node_get_index (tree, tmp_node), ==, 0);
+  g_assert (_gtk_rbtree_peek_first (tree) == tmp_node);
+  g_assert_cmpuint (materialized, ==, 4);
+  gtk_rbtree_check (tree);
+
+  g_assert_cmpint (_gtk_rbtree_find_offset (tree, 700 * 10 + 3, &tmp_tree, &tmp_node), ==, 3);
+  g_assert (tmp_tree == tree);
+  g_assert_cmpuint (_gtk_rbtree_node_get_index (tree, tmp_node), ==, 700);
+  g_assert (_gtk_rbtree_find_index (tree, 900, &tmp_tree, &tmp_node));
+  g_assert_cmpuint (_gtk_rbtree_node_get_index (tree, tmp_node), ==, 900);
+  g_assert_cmpuint (materialized, ==, 6);
+  gtk_rbtree_check (tree);
+
+  /* spans don't get in the way of expanding or inserting */
+  children = create_children (tree, node);
+  _gtk_rbtree_insert_span_after (children, NULL, 20, 5, TRUE);
+  _gtk_rbtree_insert_many_after (tree, node, 10, 7, TRUE);
+  gtk_rbtree_check (tree);
+  g_assert_cmpint (tree->root->count, ==, 1010);
+  g_assert_cmpint (tree->root->total_count, ==, 1030);
+  g_assert_cmpint (tree->root->offset, ==, 1000 * 10 + 20 * 5 + 10 * 7);
+  g_assert (_gtk_rbtree_find_count (tree, 501) == _gtk_rbtree_next (tree, node));
+  g_assert_cmpint (GTK_RBNODE_GET_HEIGHT (_gtk_rbtree_find_count (tree, 501)), ==, 7);
+  g_assert (_gtk_rbtree_find_index (tree, 500, &tmp_tree, &tmp_node));
+  g_assert (tmp_tree == children);
+  g_assert (tmp_node == _gtk_rbtree_first (children));
+
+  /* setting the height of a span sets that of all of its rows */
+  span = _gtk_rbtree_peek_count (tree, 800);
+  g_assert (GTK_RBNODE_FLAG_SET (span, GTK_RBNODE_IS_SPAN));
+  i = GTK_RBNODE_GET_ROWS (span);
+  _gtk_rbtree_node_set_height (tree, span, 4);
+  _gtk_rbtree_node_mark_valid (tree, span);
+  gtk_rbtree_check (tree);
+  g_assert_cmpint (GTK_RBNODE_GET_HEIGHT (span), ==, i * 4);
+  g_assert_cmpint (tree->root->offset, ==, (1000 - i) * 10 + i * 4 + 20 * 5 + 10 * 7);
+
+  /* materializing everything leaves no spans behind */
+  materialized = 0;
+  for (i = 0, node = _gtk_rbtree_first (tree);
+       node != NULL;
+       i++, node = _gtk_rbtree_next (tree, node))
+    g_assert_cmpint (_gtk_rbtree_node_find_offset (tree, node), ==,
+                     _gtk_rbtree_node_find_offset (tree, _gtk_rbtree_find_count (tree, i + 1)));
+  gtk_rbtree_check (tree);
+  g_assert_cmpint (i, ==, 1010);
+  g_assert_cmpuint (count_nodes (tree), ==, 1010);
+  g_assert_cmpuint (materialized, ==, 1000 - 6);
+
+  _gtk_rbtree_free (tree);
+}
+
+static void
+test_span_remove (void)
+{
+  GtkRBTree *tree;
+  GtkRBNode *node;
+  guint materialized = 0;
+
+  tree = _gtk_rbtree_new ();
+  _gtk_rbtree_set_materialize_func (tree, count_materialized, &materialized);
+  _gtk_rbtree_insert_span_after (tree, NULL, 100, 10, TRUE);
+
+  node = _gtk_rbtree_find_count (tree, 30);
+  _gtk_rbtree_remove_node (tree, node);
+  gtk_rbtree_check (tree);
+  g_assert_cmpint (tree->root->count, ==, 99);
+  g_assert_cmpint (tree->root->offset, ==, 99 * 10);
+
+  /* removing a span removes all of its rows */
+  _gtk_rbtree_remove_node (tree, _gtk_rbtree_peek_count (tree, 50));
+  gtk_rbtree_check (tree);
+  g_assert_cmpint (tree->root->count, ==, 29);
+  g_assert_cmpint (tree->root->offset, ==, 29 * 10);
+
+  while (tree->root->count > 1)
+    {
+      _gtk_rbtree_remove_node (tree, _gtk_rbtree_first (tree));
+      gtk_rbtree_check (tree);
+    }
+  g_assert_cmpuint (materialized, ==, 29);
+
+  _gtk_rbtree_free (tree);
+}
+
+static void
+test_span_reorder (void)
+{
+  GtkRBTree *tree, *children;
+  GtkRBNode *node, *first, *middle;
+  gint new_order[100];
+  guint materialized = 0;
+  gint i;
+
+  tree = _gtk_rbtree_new ();
+  _gtk_rbtree_set_materialize_func (tree, count_materialized, &materialized);
+  _gtk_rbtree_insert_span_after (tree, NULL, 100, 5, FALSE);
+
+  first = _gtk_rbtree_find_count (tree, 11);
+  middle = _gtk_rbtree_find_count (tree, 51);
+  children = create_children (tree, middle);
+  _gtk_rbtree_fill (children, 3, 7, TRUE);
+  GTK_RBNODE_SET_FLAG (_gtk_rbtree_peek_count (tree, 80), GTK_RBNODE_IS_SELECTED);
+  gtk_rbtree_check (tree);
+  g_assert_cmpuint (count_nodes (tree), ==, 5);
+
+  for (i = 0; i < 100; i++)
+    new_order[i] = 99 - i;
+  _gtk_rbtree_reorder (tree, new_order, 100);
+  gtk_rbtree_check (tree);
+
+  g_assert_cmpuint (materialized, ==, 2);
+  g_assert_cmpint (tree->root->count, ==, 100);
+  g_assert_cmpint (tree->root->total_count, ==, 103);
+  g_assert_cmpint (tree->root->offset, ==, 100 * 5 + 3 * 7);
+  g_assert (_gtk_rbtree_peek_count (tree, 90) == first);
+  g_assert (_gtk_rbtree_peek_count (tree, 50) == middle);
+  g_assert (middle->children == children);
+  g_assert_cmpint (_gtk_rbtree_node_find_offset (tree, first), ==, 89 * 5 + 3 * 7);
+
+  /* rows of the same span end up next to each other again */
+  g_assert_cmpuint (count_nodes (tree), ==, 5);
+  node = _gtk_rbtree_peek_count (tree, 20);
+  g_assert (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SPAN));
+  g_assert (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_IS_SELECTED));
+  g_assert (GTK_RBNODE_FLAG_SET (node, GTK_RBNODE_INVALID));
+  g_assert_cmpint (GTK_RBNODE_GET_ROWS (node), ==, 49);
+
+  /* but not if they are selected differently */
+  for (i = 0; i < 100; i++)
+    new_order[i] = i % 2 ? i / 2 : 99 - i / 2;
+  _gtk_rbtree_reorder (tree, new_order, 100);
+  gtk_rbtree_check (tree);
+  g_assert_cmpuint (count_nodes (tree), ==, 100);
+  g_assert_cmpint (tree->root->count, ==, 100);
+  g_assert_cmpint (tree->root->offset, ==, 100 * 5 + 3 * 7);
+  g_assert_cmpuint (materialized, ==, 2);
+
+  _gtk_rbtree_free (tree);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  setlocale (LC_ALL, "C");
+
+  g_test_add_data_func ("/rbtree/fill/valid", GINT_TO_POINTER (TRUE), test_fill);
+  g_test_add_data_func ("/rbtree/fill/invalid", GINT_TO_POINTER (FALSE), test_fill);
+  g_test_add_func ("/rbtree/fill/modify", test_fill_then_modify);
+  g_test_add_func ("/rbtree/fill/expand", test_fill_expand);
+  g_test_add_func ("/rbtree/insert-many", test_insert_many);
+  g_test_add_func ("/rbtree/span", test_span);
+  g_test_add_func ("/rbtree/span/remove", test_span_remove);
+  g_test_add_func ("/rbtree/span/reorder", test_span_reorder);
+
+  return g_test_run ();
+}
@@ -30,6 +30,8 @@
 
 #include <gtk/gtk.h>
 
+#include "treemodel.h"
+
 static inline gboolean
 iters_equal (GtkTreeIter *a,
 	     GtkTreeIter *b)
@@ -458,6 +460,193 @@ tree_store_test_insert_before_NULL (void)
   g_object_unref (store);
 }
 
+/* bulk insertion */
+static GValue *
+int_values_new (const gint *ints,
+                gint        n_ints)
+{
+  GValue *values;
+  gint i;
+
+  values = g_new0 (GValue, n_ints);
+  for (i = 0; i < n_ints; i++)
+    {
+      g_value_init (&values[i], G_TYPE_INT);
+      g_value_set_int (&values[i], ints[i]);
+    }
+
+  return values;
+}
+
+static void
+check_int_children (GtkTreeStore *store,
+                    GtkTreeIter  *parent,
+                    const gint   *ints,
+                    gint          n_ints)
+{
+  GtkTreeIter iter;
+  gint i, value;
+
+  g_assert_cmpint (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (store), parent), ==, n_ints);
+
+  gtk_tree_model_iter_children (GTK_TREE_MODEL (store), &iter, parent);
+  for (i = 0; i < n_ints; i++)
+    {
+      gtk_tree_model_get (GTK_TREE_MODEL (store), &iter, 0, &value, -1);
+      g_assert_cmpint (value, ==, ints[i]);
+      gtk_tree_model_iter_next (GTK_TREE_MODEL (store), &iter);
+    }
+}
+
+static void
+tree_store_test_insert_rows (TreeStore     *fixture,
+                             gconstpointer  user_data)
+{
+  const gint first[] = { 10, 11, 12 };
+  const gint second[] = { 20, 21 };
+  const gint result[] = { 10, 20, 21, 11, 12 };
+  SignalMonitor *monitor;
+  GValue *values;
+  gint column = 0;
+
+  monitor = signal_monitor_new (GTK_TREE_MODEL (fixture->store));
+
+  /* one row-inserted per row, in order */
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "1:0");
+  signal_monitor_append_signal (monitor, ROW_HAS_CHILD_TOGGLED, "1");
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "1:1");
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "1:2");
+
+  values = int_values_new (first, G_N_ELEMENTS (first));
+  gtk_tree_store_insert_rows (fixture->store, &fixture->iter[1], -1,
+                              G_N_ELEMENTS (first), &column, values, 1);
+  g_free (values);
+  signal_monitor_assert_is_empty (monitor);
+
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "1:1");
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "1:2");
+
+  values = int_values_new (second, G_N_ELEMENTS (second));
+  gtk_tree_store_insert_rows (fixture->store, &fixture->iter[1], 1,
+                              G_N_ELEMENTS (second), &column, values, 1);
+  g_free (values);
+  signal_monitor_assert_is_empty (monitor);
+
+  check_int_children (fixture->store, &fixture->iter[1], result, G_N_ELEMENTS (result));
+  g_assert_cmpint (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (fixture->store), NULL), ==, 5);
+
+  signal_monitor_free (monitor);
+}
+
+static void
+tree_store_test_insert_rows_sorted (TreeStore     *fixture,
+                                    gconstpointer  user_data)
+{
+  const gint rows[] = { 3, 1, 2 };
+  const gint result[] = { 1, 2, 3 };
+  SignalMonitor *monitor;
+  GValue *values;
+  gint column = 0;
+
+  gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (fixture->store),
+                                        0, GTK_SORT_ASCENDING);
+
+  monitor = signal_monitor_new (GTK_TREE_MODEL (fixture->store));
+
+  /* sorted stores put every row where it belongs right away */
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "2:0");
+  signal_monitor_append_signal (monitor, ROW_HAS_CHILD_TOGGLED, "2");
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "2:0");
+  signal_monitor_append_signal (monitor, ROW_INSERTED, "2:1");
+
+  values = int_values_new (rows, G_N_ELEMENTS (rows));
+  gtk_tree_store_insert_rows (fixture->store, &fixture->iter[2], 0,
+                              G_N_ELEMENTS (rows), &column, values, 1);
+  g_free (values);
+  signal_monitor_assert_is_empty (monitor);
+
+  check_int_children (fixture->store, &fixture->iter[2], result, G_N_ELEMENTS (result));
+
+  signal_monitor_free (monitor);
+}
+
+static void
+check_view_children (GtkTreeView *view,
+                     gint         parent,
+                     gint         n_rows)
+{
+  GtkTreePath *path, *cursor;
+
+  /* the view only has a cursor on rows it knows about */
+  path = gtk_tree_path_new_from_indices (parent, n_rows - 1, -1);
+  gtk_tree_view_set_cursor (view, path, NULL, FALSE);
+  gtk_tree_view_get_cursor (view, &cursor, NULL);
+  g_assert (cursor != NULL);
+  g_assert_cmpint (gtk_tree_path_compare (cursor, path), ==, 0);
+  gtk_tree_path_free (cursor);
+  gtk_tree_path_free (path);
+
+  path = gtk_tree_path_new_from_indices (parent, n_rows, -1);
+  gtk_tree_view_set_cursor (view, path, NULL, FALSE);
+  gtk_tree_view_get_cursor (view, &cursor, NULL);
+  g_assert (cursor == NULL);
+  gtk_tree_path_free (path);
+}
+
+static void
+expand_toggled_row (GtkTreeModel *model,
+                    GtkTreePath  *path,
+                    GtkTreeIter  *iter,
+                    GtkTreeView  *view)
+{
+  gtk_tree_view_expand_row (view, path, FALSE);
+}
+
+static void
+tree_store_test_insert_rows_view (TreeStore     *fixture,
+                                  gconstpointer  user_data)
+{
+  GtkTreePath *path;
+  GtkWidget *view;
+  GValue *values;
+  gint *ints;
+  gint column = 0;
+  gint i;
+
+  ints = g_new (gint, 500);
+  for (i = 0; i < 500; i++)
+    ints[i] = i;
+  values = int_values_new (ints, 500);
+
+  view = gtk_tree_view_new_with_model (GTK_TREE_MODEL (fixture->store));
+  g_object_ref_sink (view);
+
+  /* below a collapsed row, then expand it */
+  gtk_tree_store_insert_rows (fixture->store, &fixture->iter[1], 0,
+                              500, &column, values, 1);
+  path = gtk_tree_path_new_from_indices (1, -1);
+  g_assert (gtk_tree_view_expand_row (GTK_TREE_VIEW (view), path, FALSE));
+  gtk_tree_path_free (path);
+  check_view_children (GTK_TREE_VIEW (view), 1, 500);
+
+  /* below an expanded row */
+  gtk_tree_store_insert_rows (fixture->store, &fixture->iter[1], 100,
+                              20, &column, values, 1);
+  check_view_children (GTK_TREE_VIEW (view), 1, 520);
+
+  /* the row gets expanded while its children are added */
+  g_signal_connect_after (fixture->store, "row-has-child-toggled",
+                          G_CALLBACK (expand_toggled_row), view);
+  gtk_tree_store_insert_rows (fixture->store, &fixture->iter[3], 0,
+                              50, &column, values, 1);
+  check_view_children (GTK_TREE_VIEW (view), 3, 50);
+  g_signal_handlers_disconnect_by_func (fixture->store, expand_toggled_row, view);
+
+  g_object_unref (view);
+  g_free (values);
+  g_free (ints);
+}
+
 /* removal */
 static void
 tree_store_test_remove_begin (TreeStore     *fixture,
@@ -1053,6 +1242,17 @@ register_tree_store_tests (void)
   g_test_add_func ("/TreeStore/insert-before-NULL",
 		   tree_store_test_insert_before_NULL);
 
+  /* bulk insertion */
+  g_test_add ("/TreeStore/insert-rows", TreeStore, NULL,
+              tree_store_setup, tree_store_test_insert_rows,
+              tree_store_teardown);
+  g_test_add ("/TreeStore/insert-rows-sorted", TreeStore, NULL,
+              tree_store_setup, tree_store_test_insert_rows_sorted,
+              tree_store_teardown);
+  g_test_add ("/TreeStore/insert-rows-view", TreeStore, NULL,
+              tree_store_setup, tree_store_test_insert_rows_view,
+              tree_store_teardown);
+
   /* setting values (FIXME) */
 
   /* removal */
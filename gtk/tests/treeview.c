@@ -228,6 +228,118 @@ test_row_separator_height (void)
   gtk_widget_destroy (tree_view);
 }
 
+static void
+draw_window (GtkWidget *window)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+
+  while (gtk_events_pending ())
+    gtk_main_iteration ();
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                        gtk_widget_get_allocated_width (window),
+                                        gtk_widget_get_allocated_height (window));
+  cr = cairo_create (surface);
+  gtk_widget_draw (window, cr);
+  cairo_destroy (cr);
+  cairo_surface_destroy (surface);
+}
+
+static void
+test_cache_rows (void)
+{
+  GtkTreeIter iter;
+  GtkTreePath *path;
+  GtkListStore *store;
+  GtkWidget *window;
+  GtkWidget *scrolled_window;
+  GtkWidget *tree_view;
+  GtkTreeSelection *selection;
+  GtkAdjustment *vadjustment;
+  gboolean cache_rows;
+  char *text;
+  int i;
+
+  store = gtk_list_store_new (1, G_TYPE_STRING);
+  for (i = 0; i < 200; i++)
+    {
+      text = g_strdup_printf ("Row %d", i);
+      gtk_list_store_insert_with_values (store, NULL, i, 0, text, -1);
+      g_free (text);
+    }
+
+  window = gtk_offscreen_window_new ();
+  gtk_window_set_default_size (GTK_WINDOW (window), 200, 300);
+
+  scrolled_window = gtk_scrolled_window_new (NULL, NULL);
+  tree_view = gtk_tree_view_new_with_model (GTK_TREE_MODEL (store));
+  gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (tree_view),
+                                               0,
+                                               "Test",
+                                               gtk_cell_renderer_text_new (),
+                                               "text", 0,
+                                               NULL);
+
+  gtk_container_add (GTK_CONTAINER (scrolled_window), tree_view);
+  gtk_container_add (GTK_CONTAINER (window), scrolled_window);
+  gtk_widget_show_all (window);
+
+  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (tree_view));
+  gtk_tree_selection_set_mode (selection, GTK_SELECTION_MULTIPLE);
+  vadjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (tree_view));
+
+  /* turn the cache on and off while rows change under it */
+  for (i = 0; i < 60; i++)
+    {
+      if (i % 10 == 0)
+        {
+          cache_rows = i % 20 == 0;
+          gtk_tree_view_set_cache_rows (GTK_TREE_VIEW (tree_view), cache_rows);
+          g_assert (gtk_tree_view_get_cache_rows (GTK_TREE_VIEW (tree_view)) == cache_rows);
+        }
+
+      if (i % 3 == 0)
+        gtk_tree_selection_unselect_all (selection);
+      path = gtk_tree_path_new_from_indices (i * 7 % 40, -1);
+      gtk_tree_selection_select_path (selection, path);
+      gtk_tree_path_free (path);
+
+      g_assert (gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (store), &iter, NULL, i * 3 % 30));
+      text = g_strdup_printf ("Changed %d", i);
+      gtk_list_store_set (store, &iter, 0, text, -1);
+      g_free (text);
+
+      if (i % 4 == 1)
+        {
+          gtk_list_store_insert_with_values (store, NULL, i % 20, 0, "Inserted", -1);
+        }
+      else if (i % 4 == 3)
+        {
+          g_assert (gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (store), &iter, NULL, i % 20));
+          gtk_list_store_remove (store, &iter);
+        }
+
+      gtk_adjustment_set_value (vadjustment,
+                                (i % 5) * gtk_adjustment_get_page_size (vadjustment) / 3);
+
+      draw_window (window);
+    }
+
+  /* and while the model goes away and comes back */
+  gtk_tree_view_set_cache_rows (GTK_TREE_VIEW (tree_view), TRUE);
+  draw_window (window);
+  gtk_tree_view_set_model (GTK_TREE_VIEW (tree_view), NULL);
+  draw_window (window);
+  gtk_tree_view_set_model (GTK_TREE_VIEW (tree_view), GTK_TREE_MODEL (store));
+  gtk_list_store_clear (store);
+  draw_window (window);
+  g_assert (gtk_tree_view_get_cache_rows (GTK_TREE_VIEW (tree_view)));
+
+  gtk_widget_destroy (window);
+  g_object_unref (store);
+}
+
 int
 main (int    argc,
       char **argv)
@@ -240,6 +352,7 @@ main (int    argc,
                    test_select_collapsed_row);
   g_test_add_func ("/TreeView/sizing/row-separator-height",
                    test_row_separator_height);
+  g_test_add_func ("/TreeView/drawing/cache-rows", test_cache_rows);
 
   return g_test_run ();
 }
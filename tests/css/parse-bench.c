@@ -0,0 +1,115 @@
+/* Measures how fast CSS can be parsed
+ *
+ * Loads the given files (or GTK's own default theme) into a
+ * GtkCssProvider over and over and reports the throughput. Use
+ * resource:// URIs to parse from resources like GTK does for its
+ * built-in themes.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtk/gtk.h>
+
+static void
+count_error (GtkCssProvider *provider,
+             GtkCssSection  *section,
+             const GError   *error,
+             guint          *n_errors)
+{
+  (*n_errors)++;
+}
+
+static void
+bench_file (GFile *file,
+            int    runs)
+{
+  GtkCssProvider *provider;
+  GError *error = NULL;
+  char *contents, *name;
+  gsize length;
+  guint n_errors = 0;
+  gint64 start, time;
+  int i;
+
+  name = g_file_get_parse_name (file);
+
+  if (!g_file_load_contents (file, NULL, &contents, &length, NULL, &error))
+    {
+      g_printerr ("%s: %s\n", name, error->message);
+      g_error_free (error);
+      g_free (name);
+      return;
+    }
+  g_free (contents);
+
+  provider = gtk_css_provider_new ();
+  g_signal_connect (provider, "parsing-error", G_CALLBACK (count_error), &n_errors);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < runs; i++)
+    gtk_css_provider_load_from_file (provider, file, NULL);
+  time = MAX (g_get_monotonic_time () - start, 1);
+
+  g_print ("file: %s\n", name);
+  g_print ("size: %" G_GSIZE_FORMAT " bytes\n", length);
+  g_print ("errors: %u\n", n_errors / MAX (runs, 1));
+  g_print ("loads/sec: %.1f\n", runs * (double) G_USEC_PER_SEC / time);
+  g_print ("MB/sec: %.2f\n", runs * (double) length / time);
+
+  g_object_unref (provider);
+  g_free (name);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int runs = 200;
+  int i;
+  GOptionContext *context;
+  GError *error = NULL;
+  const GOptionEntry entries[] = {
+    { "runs", 'r', 0, G_OPTION_ARG_INT, &runs, "How often to load every file", "N" },
+    { NULL }
+  };
+
+  context = g_option_context_new ("[FILE...] - measure CSS parsing");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gtk_get_option_group (TRUE));
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("option parsing failed: %s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (argc > 1)
+    {
+      for (i = 1; i < argc; i++)
+        {
+          GFile *file = g_file_new_for_commandline_arg (argv[i]);
+
+          bench_file (file, runs);
+          g_object_unref (file);
+        }
+    }
+  else
+    {
+      GFile *file = g_file_new_for_uri ("resource:///org/gtk/libgtk/Raleigh.css");
+
+      bench_file (file, runs);
+      g_object_unref (file);
+    }
+
+  return 0;
+}
@@ -0,0 +1,206 @@
+/* Measures how fast a theme's selectors can be matched
+ *
+ * Matches a set of widget paths like the ones a big window has against
+ * all rules of a theme, by looking up a style property that no theme
+ * sets. That way the provider has to match and walk all rules every
+ * time and nothing else gets in the way.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtk/gtk.h>
+
+typedef GtkWidget BenchWidget;
+typedef GtkWidgetClass BenchWidgetClass;
+
+static GType bench_widget_get_type (void);
+G_DEFINE_TYPE (BenchWidget, bench_widget, GTK_TYPE_WIDGET)
+
+static void
+bench_widget_class_init (BenchWidgetClass *klass)
+{
+  gtk_widget_class_install_style_property (klass,
+                                           g_param_spec_int ("unused", NULL, NULL,
+                                                             0, G_MAXINT, 0,
+                                                             G_PARAM_READABLE));
+}
+
+static void
+bench_widget_init (BenchWidget *widget)
+{
+}
+
+static GtkWidgetPath *
+append_path (GtkWidgetPath *path,
+             GType          type,
+             const char    *style_class)
+{
+  gint pos;
+
+  path = gtk_widget_path_copy (path);
+  pos = gtk_widget_path_append_type (path, type);
+  if (style_class)
+    gtk_widget_path_iter_add_class (path, pos, style_class);
+
+  return path;
+}
+
+static GPtrArray *
+create_paths (void)
+{
+  GtkWidgetPath *root, *window, *box, *toolbar, *view, *notebook;
+  GtkWidgetPath *path;
+  GPtrArray *paths;
+  guint i;
+
+  paths = g_ptr_array_new_with_free_func ((GDestroyNotify) gtk_widget_path_unref);
+
+  root = gtk_widget_path_new ();
+  window = append_path (root, GTK_TYPE_WINDOW, GTK_STYLE_CLASS_BACKGROUND);
+  box = append_path (window, GTK_TYPE_BOX, NULL);
+  g_ptr_array_add (paths, window);
+  g_ptr_array_add (paths, box);
+
+  toolbar = append_path (box, GTK_TYPE_TOOLBAR, GTK_STYLE_CLASS_PRIMARY_TOOLBAR);
+  g_ptr_array_add (paths, toolbar);
+  path = append_path (toolbar, GTK_TYPE_TOOL_BUTTON, NULL);
+  g_ptr_array_add (paths, append_path (path, GTK_TYPE_BUTTON, GTK_STYLE_CLASS_BUTTON));
+  g_ptr_array_add (paths, path);
+
+  notebook = append_path (box, GTK_TYPE_NOTEBOOK, GTK_STYLE_CLASS_NOTEBOOK);
+  g_ptr_array_add (paths, notebook);
+  for (i = 0; i < 4; i++)
+    {
+      path = gtk_widget_path_copy (notebook);
+      gtk_widget_path_iter_add_region (path, -1, GTK_STYLE_REGION_TAB,
+                                       i == 0 ? GTK_REGION_FIRST : i == 3 ? GTK_REGION_LAST
+                                       : i % 2 ? GTK_REGION_EVEN : GTK_REGION_ODD);
+      g_ptr_array_add (paths, append_path (path, GTK_TYPE_LABEL, NULL));
+      gtk_widget_path_unref (path);
+    }
+
+  path = append_path (notebook, GTK_TYPE_SCROLLED_WINDOW, GTK_STYLE_CLASS_FRAME);
+  view = append_path (path, GTK_TYPE_TREE_VIEW, GTK_STYLE_CLASS_VIEW);
+  g_ptr_array_add (paths, path);
+  g_ptr_array_add (paths, append_path (path, GTK_TYPE_SCROLLBAR, GTK_STYLE_CLASS_SCROLLBAR));
+  g_ptr_array_add (paths, view);
+  for (i = 0; i < 4; i++)
+    {
+      path = gtk_widget_path_copy (view);
+      gtk_widget_path_iter_add_class (path, -1, GTK_STYLE_CLASS_CELL);
+      gtk_widget_path_iter_add_region (path, -1, GTK_STYLE_REGION_ROW,
+                                       i % 2 ? GTK_REGION_EVEN : GTK_REGION_ODD);
+      gtk_widget_path_iter_add_region (path, -1, GTK_STYLE_REGION_COLUMN,
+                                       i == 0 ? GTK_REGION_FIRST : i == 3 ? GTK_REGION_LAST : 0);
+      g_ptr_array_add (paths, path);
+    }
+
+  path = append_path (box, GTK_TYPE_ENTRY, GTK_STYLE_CLASS_ENTRY);
+  g_ptr_array_add (paths, path);
+  path = append_path (box, GTK_TYPE_STATUSBAR, NULL);
+  g_ptr_array_add (paths, append_path (path, GTK_TYPE_LABEL, NULL));
+  g_ptr_array_add (paths, path);
+
+  /* And the widget that we look up the style property for */
+  for (i = 0; i < paths->len; i++)
+    {
+      GtkWidgetPath *parent = g_ptr_array_index (paths, i);
+
+      path = append_path (parent, bench_widget_get_type (), NULL);
+      gtk_widget_path_unref (parent);
+      g_ptr_array_index (paths, i) = path;
+    }
+
+  gtk_widget_path_unref (root);
+
+  return paths;
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const GtkStateFlags states[] = {
+    GTK_STATE_FLAG_NORMAL,
+    GTK_STATE_FLAG_PRELIGHT,
+    GTK_STATE_FLAG_ACTIVE | GTK_STATE_FLAG_PRELIGHT,
+    GTK_STATE_FLAG_SELECTED | GTK_STATE_FLAG_FOCUSED,
+    GTK_STATE_FLAG_INSENSITIVE
+  };
+  GtkStyleProvider *provider;
+  GParamSpec *pspec;
+  GPtrArray *paths;
+  GValue value = G_VALUE_INIT;
+  char *theme_name = NULL;
+  guint64 n_matches;
+  gint64 start, time;
+  int runs = 20000;
+  guint i, j, k;
+  GOptionContext *context;
+  GError *error = NULL;
+  const GOptionEntry entries[] = {
+    { "runs", 'r', 0, G_OPTION_ARG_INT, &runs, "How often to match every path", "N" },
+    { NULL }
+  };
+
+  context = g_option_context_new ("[THEME] - measure CSS selector matching");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gtk_get_option_group (TRUE));
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("option parsing failed: %s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (argc > 1)
+    theme_name = g_strdup (argv[1]);
+  else
+    g_object_get (gtk_settings_get_default (), "gtk-theme-name", &theme_name, NULL);
+
+  provider = GTK_STYLE_PROVIDER (gtk_css_provider_get_named (theme_name, NULL));
+  pspec = gtk_widget_class_find_style_property (g_type_class_ref (bench_widget_get_type ()), "unused");
+  paths = create_paths ();
+  g_value_init (&value, G_TYPE_INT);
+
+  n_matches = 0;
+  start = g_get_monotonic_time ();
+  for (i = 0; i < (guint) runs; i++)
+    {
+      for (j = 0; j < paths->len; j++)
+        {
+          for (k = 0; k < G_N_ELEMENTS (states); k++)
+            {
+              if (gtk_style_provider_get_style_property (provider,
+                                                         g_ptr_array_index (paths, j),
+                                                         states[k],
+                                                         pspec,
+                                                         &value))
+                g_error ("Theme %s sets %s", theme_name, pspec->name);
+              n_matches++;
+            }
+        }
+    }
+  time = MAX (g_get_monotonic_time () - start, 1);
+
+  g_print ("theme: %s\n", theme_name);
+  g_print ("paths: %u\n", paths->len);
+  g_print ("matches: %" G_GUINT64_FORMAT "\n", n_matches);
+  g_print ("matches/sec: %.0f\n", n_matches * (double) G_USEC_PER_SEC / time);
+
+  g_value_unset (&value);
+  g_ptr_array_unref (paths);
+  g_free (theme_name);
+
+  return 0;
+}